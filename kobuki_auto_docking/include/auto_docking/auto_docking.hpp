@@ -1,11 +1,35 @@
-/**
- * @file /auto_docking/include/auto_docking/auto_docking.hpp
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
  *
- * @brief File comment
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
  *
- * File comment
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_auto_docking/include/auto_docking/auto_docking.hpp
  *
- * @date Nov 30, 2012
+ * @brief Docking state machine driven by the dock's infrared beams.
  **/
 /*****************************************************************************
 ** Ifdefs
@@ -18,35 +42,127 @@
 ** Includes
 *****************************************************************************/
 
+#include <string>
+#include <stdint.h>
+#include <kobuki_driver/packets/dock_ir.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
 
-class AutoDocking
-{
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Finds the docking station and drives onto it.
+ *
+ * The dock emits three beams, left, centre and right as seen from the dock,
+ * each at a near and a far power. Each of the robot's three receivers
+ * (right, central, left) reports the beams it picks up, so the robot knows
+ * both which side of the dock's centre line it is on and roughly where the
+ * dock lies relative to itself.
+ *
+ * The engine runs on every frame:
+ *
+ * - Scanning : rotate on the spot until the central receiver sees the dock.
+ * - Finding : off the centre line, turn square to it and drive across
+ *   until the centre beam shows up.
+ * - Aligning : rotate to face the dock again.
+ * - Approaching : follow the centre beam in, steering back onto it when a
+ *   side beam appears and towards the dock when it leaves the central
+ *   receiver's view.
+ * - Contact : the bumper touched, wait briefly for the charging contacts.
+ * - BackingOff : no charge, reverse and try again.
+ *
+ * Docked and Failed are final. Odometry (heading and distance travelled)
+ * measures turns and back offs.
+ **/
+class AutoDocking {
 public:
-  AutoDocking(){};
-  ~AutoDocking(){};
-
-  void auto_dock()
-  {
-    int i = 0;
-    if (ir_left)
-    {
-      turn_left = true;
-      i = -1;
-    }
-    else if (ir_right)
-    {
-      turn_right = true;
-      i = 1;
-    }
-
-    target_direction_ = i;
+  enum State {
+    Idle,
+    Scanning,
+    Finding,
+    Aligning,
+    Approaching,
+    Contact,
+    BackingOff,
+    Docked,
+    Failed
+  };
+
+  /**
+   * @brief Bits of each receiver's DockIR byte (DockIR::Flags), and their combinations.
+   */
+  struct Beams : public DockIR::Flags {
+    static const uint8_t Left   = NearLeft | FarLeft;
+    static const uint8_t Center = NearCenter | FarCenter;
+    static const uint8_t Right  = NearRight | FarRight;
+    static const uint8_t Near   = NearLeft | NearCenter | NearRight;
   };
 
+  /**
+   * @brief Receiver order in DockIR::Data::docking.
+   */
+  enum Receiver {
+    RightReceiver = 0,
+    CentralReceiver = 1,
+    LeftReceiver = 2
+  };
+
+  struct Settings {
+    Settings() :
+      approach_speed(0.1), near_speed(0.05), search_speed(0.15), turn_speed(0.6), steering(0.3),
+      angle_tolerance(0.02), backoff_distance(0.15), contact_time(0.5), find_distance(3.0), retries(3),
+      timeout(120.0) {}
+    double approach_speed;   /**< [m/s] along the centre beam **/
+    double near_speed;       /**< [m/s] once in the near beams **/
+    double search_speed;     /**< [m/s] crossing towards the centre beam **/
+    double turn_speed;       /**< [rad/s] on the spot **/
+    double steering;         /**< [rad/s] corrections while approaching **/
+    double angle_tolerance;  /**< [rad] for lining up on the dock **/
+    double backoff_distance; /**< [m] to reverse after a failed contact **/
+    double contact_time;     /**< [s] to wait for the charging contacts after a bump **/
+    double find_distance;    /**< [m] to drive looking for the centre beam before rescanning **/
+    int retries;             /**< failed contacts or lost beams before giving up **/
+    double timeout;          /**< [s] for the whole attempt **/
+  };
+
+  AutoDocking();
+  void init(const Settings &settings) { this->settings = settings; }
+  void start(const double &time);
+  void cancel();
+  bool update(const double &time, const uint8_t dock_ir[3], const bool &bumper, const bool &docked,
+              const double &heading, const double &distance,
+              double &linear_velocity, double &angular_velocity);
+
+  State state() const { return current; }
+  bool isActive() const { return ( current != Idle ) && ( current != Docked ) && ( current != Failed ); }
+  int attempts() const { return retries_used; } /**< Retries used so far. **/
+  double elapsed() const { return last_time - start_time; } /**< [s] since the start. **/
+
+  static std::string toString(const State &state);
+
 private:
-  double magic_;
-  int target_direction_;
-  bool ir_left_, ir_right_;
-  double target_direction;
+  void enter(const State &state);
+  void retry();
+
+  Settings settings;
+  State current;
+  double start_time, last_time, state_time; // [s]
+  double heading, last_heading, turned;     // [rad], turned is unwrapped since entering the state
+  double distance, state_distance;          // [m] travelled, at entering the state
+  double seen_time;                         // [s] the receiver of interest last saw the dock
+  double sight_start, sight_end;            // [rad] turned at first and last sight while aligning
+  int turn_direction;                       // +1 anti-clockwise
+  int retries_used;
+  bool heading_known;
+  bool sighted, swept;                      // aligning has seen the dock, and swept past it
 };
 
+} // namespace kobuki
+
 #endif /* AUTO_DOCKING_HPP_ */
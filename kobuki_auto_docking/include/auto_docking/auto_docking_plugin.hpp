@@ -27,24 +27,24 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 /**
- * @file /kobuki_driver/include/kobuki_driver/modules/gate_keeper.hpp
- *
- * @brief Simple module for the diff drive odometry.
+ * @file /kobuki_auto_docking/include/auto_docking/auto_docking_plugin.hpp
  *
+ * @brief Runs the docking state machine inside the driver.
  **/
 /*****************************************************************************
 ** Ifdefs
 *****************************************************************************/
 
-#ifndef KOBUKI_GATE_KEEPER_HPP_
-#define KOBUKI_GATE_KEEPER_HPP_
+#ifndef AUTO_DOCKING_PLUGIN_HPP_
+#define AUTO_DOCKING_PLUGIN_HPP_
 
 /*****************************************************************************
 ** Includes
 *****************************************************************************/
 
-#include <stdint.h>
-#include <ecl/time.hpp>
+#include <ecl/threads/mutex.hpp>
+#include <kobuki_driver/modules/plugin_host.hpp>
+#include "auto_docking.hpp"
 
 /*****************************************************************************
 ** Namespaces
@@ -56,63 +56,43 @@ namespace kobuki {
 ** Interfaces
 *****************************************************************************/
 
-class GateKeeper {
+/**
+ * @brief Hosts AutoDocking on the driver's frame thread.
+ *
+ * Add it with Kobuki::addPlugin; it then sees every frame and, while
+ * docking, claims the velocity for it. Odometry comes from the frame
+ * itself (the driver's heading and the encoders at its calibrated
+ * resolution) and the dock connection from the frame's power events and
+ * charger flags, so nothing beyond the driver is needed. The safety reflex
+ * still stops the base on cliffs and wheel drops; while docking the bumper
+ * is claimed for the engine, the dock is meant to be bumped into.
+ *
+ * Start and cancel may be called from any thread, they take effect on the
+ * next frame.
+ **/
+class AutoDockingPlugin : public PluginHost::Plugin {
 public:
-  GateKeeper() :
-    is_enabled(true),
-    last_speed(0), 
-    last_timestamp(ecl::TimeStamp())
-  {}
-  void init(bool enable_gate_keeper){ is_enabled = enable_gate_keeper; }
-  void confirm(short &speed, short &radius) // or smoother, limiter, etc
-  {
-    if( is_enabled )
-    {
-      //get current time
-      ecl::TimeStamp curr_timestamp;
-      //get time difference
-      ecl::TimeStamp duration = curr_timestamp - last_timestamp;
-      //calculate acceleration
-      double acceleration = ((double)(speed - last_speed)) / duration; // in mm/s^2
-
-      //if criterion meet some condition, limit input velocity in certain step
-//      std::ostringstream oss;
-//      oss << "[" << duration << "]";
-//      oss << "[" << last_speed << "]";
-//      oss << "[" << speed << ", " << radius << "]";
-//      oss << "[" << acceleration << "]";
+  AutoDockingPlugin(const AutoDocking::Settings &settings = AutoDocking::Settings());
 
-      if( std::abs(acceleration) > 20.0 ) // 20mm/s^2 ?
-      { 
-        if( std::abs(speed - last_speed) > 8 ) 
-        {
-          speed = last_speed + 8 * (short)(acceleration / std::abs(acceleration));
-        }
-      }
-      if( radius == 0 && std::abs(speed) > 0 ) {
-        radius = last_radius;
-      } else { 
-        last_radius = radius;
-      }
- //     oss << "[" << speed << ", " << radius << "]";
- //     std::cout << oss.str() << std::endl;
-
-      //update last_speed
-      last_speed = speed;
-      //update last_timestamp
-      last_timestamp = curr_timestamp;
-      
-    }
-  }
+  void start();
+  void cancel();
+  AutoDocking::State state() const;
+  int attempts() const;
+  void update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands);
 
 private:
-  bool is_enabled;
-  short last_speed;
-  short last_radius;
-//  unsigned short last_timestamp;
-  ecl::TimeStamp last_timestamp;
+  enum Request { NoRequest, StartRequest, CancelRequest };
+
+  AutoDocking docking;
+  bool has_encoders;
+  uint16_t last_left, last_right;
+  double distance; // [m] path length
+  Request request;
+  AutoDocking::State current;
+  int retries; // used by the current or last attempt
+  mutable ecl::Mutex mutex;
 };
 
 } // namespace kobuki
 
-#endif /* KOBUKI_GATE_KEEPER_HPP_ */
+#endif /* AUTO_DOCKING_PLUGIN_HPP_ */
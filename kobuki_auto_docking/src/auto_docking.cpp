@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_auto_docking/src/auto_docking.cpp
+ *
+ * @brief Implementation of the docking state machine.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <ecl/geometry/angle.hpp>
+#include <ecl/math.hpp>
+#include "../include/auto_docking/auto_docking.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+/**
+ * Receivers miss the odd frame, the dock only counts as out of view after
+ * this long [s] without a reading.
+ */
+static const double lost_time = 0.1;
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+AutoDocking::AutoDocking() :
+  current(Idle),
+  start_time(0.0),
+  last_time(0.0),
+  state_time(0.0),
+  heading(0.0),
+  last_heading(0.0),
+  turned(0.0),
+  distance(0.0),
+  state_distance(0.0),
+  seen_time(0.0),
+  sight_start(0.0),
+  sight_end(0.0),
+  turn_direction(1),
+  retries_used(0),
+  heading_known(false),
+  sighted(false),
+  swept(false)
+{}
+
+void AutoDocking::start(const double &time) {
+  start_time = time;
+  last_time = time;
+  retries_used = 0;
+  turn_direction = 1;
+  heading_known = false;
+  enter(Scanning);
+}
+
+void AutoDocking::cancel() {
+  if ( isActive() ) {
+    current = Idle;
+  }
+}
+
+/**
+ * @brief Run one frame of the state machine.
+ *
+ * @param time : [s] host time of the frame.
+ * @param dock_ir : raw bytes of the right, central and left receivers.
+ * @param bumper : any bumper pressed.
+ * @param docked : the charging contacts are live.
+ * @param heading : [rad] odometry heading.
+ * @param distance : [m] odometry path length, never decreasing.
+ * @param linear_velocity : [m/s] command for this frame.
+ * @param angular_velocity : [rad/s] command for this frame.
+ * @return bool : true while the engine wants the base, i.e. the commands are valid.
+ **/
+bool AutoDocking::update(const double &time, const uint8_t dock_ir[3], const bool &bumper, const bool &docked,
+                         const double &heading, const double &distance,
+                         double &linear_velocity, double &angular_velocity) {
+  linear_velocity = 0.0;
+  angular_velocity = 0.0;
+  if ( !isActive() ) {
+    return false;
+  }
+  last_time = time;
+  if ( heading_known ) {
+    turned += ecl::wrap_angle(heading - last_heading);
+  }
+  last_heading = heading;
+  heading_known = true;
+  this->heading = heading;
+  this->distance = distance;
+
+  if ( docked ) {
+    enter(Docked);
+    return false;
+  }
+  if ( time - start_time > settings.timeout ) {
+    enter(Failed);
+    return false;
+  }
+  if ( bumper && ( current != Contact ) && ( current != BackingOff ) ) {
+    enter(Contact);
+  }
+
+  const uint8_t &right = dock_ir[RightReceiver];
+  const uint8_t &central = dock_ir[CentralReceiver];
+  const uint8_t &left = dock_ir[LeftReceiver];
+  const uint8_t any = right | central | left;
+
+  switch ( current ) {
+    case Scanning: {
+      if ( central ) {
+        // the dock is ahead: in the centre beam line up on it, otherwise cross over to it
+        if ( central & Beams::Center ) {
+          enter(Aligning);
+        } else {
+          // the dock's left beam means the centre line lies to the robot's left
+          turn_direction = ( central & Beams::Left ) ? 1 : -1;
+          enter(Finding);
+        }
+        break;
+      }
+      if ( left && !right ) {
+        turn_direction = 1;
+      } else if ( right && !left ) {
+        turn_direction = -1;
+      }
+      if ( std::fabs(turned) > 2.0 * ecl::pi ) {
+        enter(Failed);
+        return false;
+      }
+      angular_velocity = turn_direction * settings.turn_speed;
+      break;
+    }
+    case Finding: {
+      // the side receiver that should keep the dock while crossing over
+      const uint8_t &side = ( turn_direction > 0 ) ? right : left;
+      if ( any & Beams::Center ) {
+        turn_direction = -turn_direction;
+        enter(Aligning);
+        break;
+      }
+      if ( distance - state_distance > settings.find_distance ) {
+        retry();
+        break;
+      }
+      if ( side ) {
+        seen_time = time;
+      }
+      if ( central ) {
+        angular_velocity = turn_direction * settings.turn_speed; // still facing it, keep turning square
+      } else if ( time - seen_time < lost_time ) {
+        // circle the dock towards its centre line, letting it drift to the back of the receiver
+        linear_velocity = settings.search_speed;
+      } else {
+        angular_velocity = -turn_direction * settings.turn_speed; // drifted out of view, bring it back
+      }
+      break;
+    }
+    case Aligning: {
+      // sweep the central receiver across the dock and settle half way
+      if ( central && !swept ) {
+        if ( !sighted ) {
+          sighted = true;
+          sight_start = turned;
+        }
+        sight_end = turned;
+        seen_time = time;
+      }
+      if ( sighted && ( time - seen_time > lost_time ) ) {
+        swept = true;
+        double error = 0.5 * ( sight_start + sight_end ) - turned;
+        if ( std::fabs(error) < settings.angle_tolerance ) {
+          enter(Approaching);
+          break;
+        }
+        angular_velocity = ( error > 0.0 ? 1.0 : -1.0 ) * std::min(settings.turn_speed, 2.0 * std::fabs(error) + 0.1);
+        break;
+      }
+      if ( std::fabs(turned) > 2.0 * ecl::pi ) {
+        retry();
+        break;
+      }
+      angular_velocity = turn_direction * settings.turn_speed;
+      break;
+    }
+    case Approaching: {
+      if ( central ) {
+        seen_time = time;
+      }
+      if ( time - seen_time > lost_time ) {
+        // lost it, the side receivers tell which way to look
+        if ( left && !right ) {
+          turn_direction = 1;
+        } else if ( right && !left ) {
+          turn_direction = -1;
+        }
+        enter(Aligning);
+        break;
+      }
+      linear_velocity = ( central & Beams::Near ) ? settings.near_speed : settings.approach_speed;
+      // off the centre line, steer back to it: the dock's left beam means the line lies to the robot's left
+      if ( ( central & Beams::Left ) && !( central & Beams::Center ) ) {
+        angular_velocity = settings.steering;
+      } else if ( ( central & Beams::Right ) && !( central & Beams::Center ) ) {
+        angular_velocity = -settings.steering;
+      }
+      break;
+    }
+    case Contact: {
+      if ( time - state_time > settings.contact_time ) {
+        enter(BackingOff);
+      }
+      break;
+    }
+    case BackingOff: {
+      if ( distance - state_distance < settings.backoff_distance ) {
+        linear_velocity = -settings.approach_speed;
+      } else {
+        retry();
+      }
+      break;
+    }
+    default: {
+      return false;
+    }
+  }
+  return isActive();
+}
+
+void AutoDocking::enter(const State &state) {
+  current = state;
+  state_time = last_time;
+  state_distance = distance;
+  seen_time = last_time;
+  turned = 0.0;
+  sighted = false;
+  swept = false;
+  sight_start = 0.0;
+  sight_end = 0.0;
+}
+
+void AutoDocking::retry() {
+  if ( ++retries_used > settings.retries ) {
+    enter(Failed);
+  } else {
+    enter(Scanning);
+  }
+}
+
+std::string AutoDocking::toString(const State &state) {
+  switch ( state ) {
+    case Idle: { return "idle"; }
+    case Scanning: { return "scanning"; }
+    case Finding: { return "finding"; }
+    case Aligning: { return "aligning"; }
+    case Approaching: { return "approaching"; }
+    case Contact: { return "contact"; }
+    case BackingOff: { return "backing off"; }
+    case Docked: { return "docked"; }
+    case Failed: { return "failed"; }
+    default: { return "unknown"; }
+  }
+}
+
+} // namespace kobuki
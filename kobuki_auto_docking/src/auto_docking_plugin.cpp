@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_auto_docking/src/auto_docking_plugin.cpp
+ *
+ * @brief Implementation of the driver hosted docking plugin.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include "../include/auto_docking/auto_docking_plugin.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+AutoDockingPlugin::AutoDockingPlugin(const AutoDocking::Settings &settings) :
+  has_encoders(false),
+  last_left(0),
+  last_right(0),
+  distance(0.0),
+  request(NoRequest),
+  current(AutoDocking::Idle),
+  retries(0)
+{
+  docking.init(settings);
+}
+
+void AutoDockingPlugin::start() {
+  mutex.lock();
+  request = StartRequest;
+  mutex.unlock();
+}
+
+void AutoDockingPlugin::cancel() {
+  mutex.lock();
+  request = CancelRequest;
+  mutex.unlock();
+}
+
+AutoDocking::State AutoDockingPlugin::state() const {
+  mutex.lock();
+  AutoDocking::State state = current;
+  mutex.unlock();
+  return state;
+}
+
+/**
+ * @brief Retries used by the current or last docking attempt.
+ */
+int AutoDockingPlugin::attempts() const {
+  mutex.lock();
+  int used = retries;
+  mutex.unlock();
+  return used;
+}
+
+void AutoDockingPlugin::update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands) {
+  // odometry, path length only: back offs are measured in distance travelled
+  const CoreSensors::Data &core = feedback.core_sensors;
+  if ( has_encoders ) {
+    int left = static_cast<int16_t>(static_cast<uint16_t>(core.left_encoder - last_left));
+    int right = static_cast<int16_t>(static_cast<uint16_t>(core.right_encoder - last_right));
+    distance += std::fabs(0.5 * (left + right) * feedback.travel_resolution);
+  }
+  has_encoders = true;
+  last_left = core.left_encoder;
+  last_right = core.right_encoder;
+
+  bool docked = false;
+  for ( unsigned int i = 0; i < feedback.events.power_events.size(); ++i ) {
+    if ( feedback.events.power_events[i].event == PowerEvent::PluggedToDockbase ) {
+      docked = true;
+    }
+  }
+  // also catch a robot that was on the dock already
+  if ( ( ( core.charger & CoreSensors::Flags::BatteryStateMask ) != CoreSensors::Flags::Discharging ) &&
+       !( core.charger & CoreSensors::Flags::AdapterType ) ) {
+    docked = true;
+  }
+
+  mutex.lock();
+  Request pending = request;
+  request = NoRequest;
+  mutex.unlock();
+  if ( pending == StartRequest ) {
+    docking.start(feedback.time);
+  } else if ( pending == CancelRequest ) {
+    docking.cancel();
+  }
+
+  bool was_active = docking.isActive() || ( pending == CancelRequest );
+  double linear_velocity, angular_velocity;
+  bool active = docking.update(feedback.time, &feedback.dock_ir.docking[0], core.bumper != 0, docked,
+                               feedback.heading, distance, linear_velocity, angular_velocity);
+  if ( active || was_active ) {
+    commands.setVelocity(linear_velocity, angular_velocity); // zero on the frame it finishes
+    commands.claimBumper();
+  }
+
+  mutex.lock();
+  current = docking.state();
+  retries = docking.attempts();
+  mutex.unlock();
+}
+
+} // namespace kobuki
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+/**
+ * @file /kobuki_auto_docking/src/test/docking.cpp
+ *
+ * @brief Docks through the driver and its safety reflex, against the emulator.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include "docking_robot.hpp"
+
+using kobuki::AutoDocking;
+using kobuki::SafetyReflex;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * A robot with the safety reflex stopping on bumps, cliffs and wheel drops.
+ */
+class GuardedRobot : public DockingRobot {
+public:
+  GuardedRobot() {
+    parameters.safety_reflex.enable = true;
+    parameters.safety_reflex.bumper = SafetyReflex::Stop;
+    parameters.safety_reflex.cliff = SafetyReflex::Stop;
+    parameters.safety_reflex.wheel_drop = SafetyReflex::Stop;
+  }
+
+  /**
+   * Step until docking finishes, or the given time [s] runs out.
+   */
+  AutoDocking::State dock(const double &time) {
+    AutoDocking::State state = docking->state();
+    for ( unsigned int i = 0; ( i < time / 0.02 ) && ( state != AutoDocking::Docked ) &&
+                              ( state != AutoDocking::Failed ); ++i ) {
+      step();
+      state = docking->state();
+    }
+    return state;
+  }
+};
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(AutoDockingPlugin, docksWithTheReflexOn) {
+  std::srand(7);
+  GuardedRobot robot;
+  ASSERT_TRUE(robot.start());
+  robot.place(1.0, 0.1, 0.75 * ecl::pi);
+  robot.docking->start();
+  EXPECT_EQ(AutoDocking::Docked, robot.dock(60.0));
+  EXPECT_TRUE(robot.isDocked());
+  EXPECT_EQ(0u, robot.kobuki.getSafetyReflexReaction().triggers) << "the dock is bumped into on purpose";
+
+  // no longer docking, bumps are the reflex' again
+  robot.emulator.sensors.bumper = kobuki::CoreSensors::Flags::CenterBumper;
+  robot.emulator.stream(2);
+  EXPECT_EQ(1u, robot.kobuki.getSafetyReflexReaction().triggers);
+}
+
+TEST(AutoDockingPlugin, cancelReleasesTheBase) {
+  std::srand(7);
+  GuardedRobot robot;
+  ASSERT_TRUE(robot.start());
+  robot.place(1.5, -0.5, 0.0);
+  robot.docking->start();
+  for ( unsigned int i = 0; i < 25; ++i ) {
+    robot.step();
+  }
+  EXPECT_NE(0, robot.emulator.commandSpeed()) << "scanning";
+  robot.docking->cancel();
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    robot.step();
+  }
+  EXPECT_EQ(AutoDocking::Idle, robot.docking->state());
+  EXPECT_EQ(0, robot.emulator.commandSpeed());
+  EXPECT_EQ(-1, robot.kobuki.getSelectedVelocityInput());
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+/**
+ * @file /kobuki_auto_docking/src/test/docking_benchmark.cpp
+ *
+ * @brief Benchmarks docking time and success rate against a simulated dock.
+ *
+ * The docking plugin runs in the driver, over pty:// to the emulator, with
+ * the safety reflex on, so the benchmark covers the whole path the robot
+ * takes: frames, plugin host, velocity multiplexer and base control. The
+ * emulator streams in real time, so several robots dock side by side.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "docking_robot.hpp"
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  unsigned int runs = ( argc > 1 ) ? std::atoi(argv[1]) : 40;
+  const unsigned int parallel = 10;
+  std::srand(42);
+
+  kobuki::AutoDocking::Settings settings;
+  std::vector<double> times;
+  std::vector<unsigned int> outcomes(kobuki::AutoDocking::Failed + 1, 0);
+  unsigned int retries = 0, reflexes = 0;
+
+  for ( unsigned int first = 0; first < runs; first += parallel ) {
+    unsigned int count = std::min(parallel, runs - first);
+    std::vector<boost::shared_ptr<DockingRobot> > robots;
+    std::vector<double> starts;
+    for ( unsigned int i = 0; i < count; ++i ) {
+      boost::shared_ptr<DockingRobot> robot(new DockingRobot(settings));
+      robot->parameters.safety_reflex.enable = true;
+      robot->parameters.safety_reflex.bumper = kobuki::SafetyReflex::Stop;
+      robot->parameters.safety_reflex.cliff = kobuki::SafetyReflex::Stop;
+      robot->parameters.safety_reflex.wheel_drop = kobuki::SafetyReflex::Stop;
+      if ( !robot->start() ) {
+        std::printf("Could not bring up the driver over pty://\n");
+        return 1;
+      }
+      double range = 0.6 + 1.6 * DockingRobot::uniform();
+      double phi = ( DockingRobot::uniform() - 0.5 ) * 140.0 * ecl::pi / 180.0;
+      robot->place(range * std::cos(phi), range * std::sin(phi), ( DockingRobot::uniform() - 0.5 ) * 2.0 * ecl::pi);
+      robot->docking->start();
+      robots.push_back(robot);
+      starts.push_back(range);
+      starts.push_back(phi);
+    }
+    // until every robot has docked or given up, with a little grace beyond the timeout
+    std::vector<unsigned int> frames(count, 0);
+    unsigned int running = count;
+    const unsigned int limit = static_cast<unsigned int>(( settings.timeout + 5.0 ) / 0.02);
+    while ( running > 0 ) {
+      running = 0;
+      for ( unsigned int i = 0; i < count; ++i ) {
+        kobuki::AutoDocking::State state = robots[i]->docking->state();
+        bool finished = ( state == kobuki::AutoDocking::Docked ) || ( state == kobuki::AutoDocking::Failed ) ||
+                        ( frames[i] >= limit );
+        if ( finished ) {
+          continue;
+        }
+        robots[i]->step();
+        ++frames[i];
+        ++running;
+      }
+    }
+    for ( unsigned int i = 0; i < count; ++i ) {
+      kobuki::AutoDocking::State state = robots[i]->docking->state();
+      outcomes[state] += 1;
+      retries += robots[i]->docking->attempts();
+      reflexes += robots[i]->kobuki.getSafetyReflexReaction().triggers;
+      if ( state == kobuki::AutoDocking::Docked ) {
+        times.push_back(frames[i] * 0.02);
+      } else if ( argc > 2 ) {
+        double range = starts[2 * i], phi = starts[2 * i + 1];
+        std::printf("  start [%.2f, %.2f, %.2f]: %s after %.1fs\n", range * std::cos(phi), range * std::sin(phi),
+                    phi, kobuki::AutoDocking::toString(state).c_str(), frames[i] * 0.02);
+      }
+    }
+  }
+
+  std::printf("Docking benchmark, %u runs from 0.6-2.2m, +-70 degrees, any heading\n", runs);
+  std::printf("  docked      : %u (%.1f%%)\n", outcomes[kobuki::AutoDocking::Docked],
+              100.0 * outcomes[kobuki::AutoDocking::Docked] / runs);
+  std::printf("  failed      : %u\n", outcomes[kobuki::AutoDocking::Failed]);
+  std::printf("  retries     : %.2f per run\n", static_cast<double>(retries) / runs);
+  std::printf("  reflexes    : %u\n", reflexes);
+  if ( !times.empty() ) {
+    std::sort(times.begin(), times.end());
+    double total = 0.0;
+    for ( unsigned int i = 0; i < times.size(); ++i ) {
+      total += times[i];
+    }
+    std::printf("  time [s]    : mean %.1f median %.1f 90%% %.1f max %.1f\n", total / times.size(),
+                times[times.size() / 2], times[( times.size() * 9 ) / 10], times.back());
+  }
+  return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+/**
+ * @file /kobuki_auto_docking/src/test/docking_robot.hpp
+ *
+ * @brief The driver and docking plugin against an emulated robot in front of a dock.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef AUTO_DOCKING_TEST_DOCKING_ROBOT_HPP_
+#define AUTO_DOCKING_TEST_DOCKING_ROBOT_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <ecl/geometry/angle.hpp>
+#include <ecl/math.hpp>
+#include <ecl/sigslots.hpp>
+#include <ecl/threads/mutex.hpp>
+#include <ecl/time/sleep.hpp>
+#include <kobuki_driver/kobuki.hpp>
+#include <kobuki_driver/emulator.hpp>
+#include "../../include/auto_docking/auto_docking_plugin.hpp"
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * The driver, hosting the docking plugin, over a pty:// transport to an
+ * emulated robot in front of a dock at the origin, facing +x.
+ *
+ * The dock's centre beam covers +-8 degrees either side of the x axis, its
+ * left (+y) and right beams the rest out to +-80 degrees, overlapping the
+ * centre beam by a couple of degrees. Beams read near under 0.8m and are
+ * lost beyond 2.5m. The robot's right, central and left receivers look at
+ * -1, 0 and +1 rad with fields of view of +-0.7, +-0.35 and +-0.7 rad, and
+ * drop 5% of their readings. Motion slips by a few percent, which the gyro
+ * sees and the encoders do not. The robot charges when its centre reaches
+ * the contacts within 4cm of the centre line and 15 degrees of square;
+ * anything pushing into the dock presses the bumper.
+ */
+class DockingRobot {
+public:
+  DockingRobot(const kobuki::AutoDocking::Settings &settings = kobuki::AutoDocking::Settings()) :
+    docking(new kobuki::AutoDockingPlugin(settings)),
+    slot_info(&DockingRobot::info, *this),
+    docked(false)
+  {
+    static unsigned int count = 0;
+    std::ostringstream ns;
+    ns << "/docking_robot_" << count++;
+    parameters.device_port = "pty://";
+    parameters.sigslots_namespace = ns.str();
+    parameters.enable_gyro_bias_estimation = false;
+    slot_info.connect(ns.str() + "/ros_info");
+  }
+
+  /**
+   * Start the driver, connect the emulator and host the docking plugin.
+   */
+  bool start() {
+    kobuki.init(parameters);
+    ecl::MilliSleep sleep;
+    for ( unsigned int i = 0; ( i < 200 ) && slave().empty(); ++i ) {
+      sleep(10);
+    }
+    if ( slave().empty() || !emulator.open(slave()) ) {
+      return false;
+    }
+    bool handshake = false;
+    for ( unsigned int i = 0; !handshake && ( i < 250 ); ++i ) {
+      emulator.stream(1);
+      handshake = kobuki.waitForHandshake(0.0);
+    }
+    if ( !handshake || !kobuki.addPlugin(docking, "auto_docking", 100) ) {
+      return false;
+    }
+    kobuki.enable();
+    return true;
+  }
+
+  /**
+   * Put the robot down, at rest, off the dock.
+   */
+  void place(const double &x, const double &y, const double &heading) {
+    emulator.setPose(x, y, heading);
+    emulator.sensors.charger = kobuki::CoreSensors::Flags::Discharging;
+    emulator.sensors.bumper = 0;
+    docked = false;
+    sense();
+  }
+
+  /**
+   * One 50Hz frame of the world around the robot.
+   */
+  void step() {
+    double x = emulator.x(), y = emulator.y(), heading = emulator.heading();
+    emulator.stream(1);
+    double slip = 1.0 + 0.04 * ( uniform() - 0.5 );
+    double nx = x + slip * ( emulator.x() - x );
+    double ny = y + slip * ( emulator.y() - y );
+    heading += slip * ( emulator.heading() - heading );
+    emulator.sensors.bumper = 0;
+    if ( ( nx < 0.2 ) && ( std::fabs(ny) < 0.3 ) ) {
+      nx = 0.2;
+      emulator.sensors.bumper = kobuki::CoreSensors::Flags::CenterBumper;
+      docked = docked || ( ( std::fabs(ny) < 0.04 ) &&
+                           ( std::fabs(ecl::wrap_angle(heading - ecl::pi)) < 15.0 * ecl::pi / 180.0 ) );
+    }
+    emulator.setPose(nx, ny, heading);
+    emulator.sensors.charger = docked ? kobuki::CoreSensors::Flags::Charging : kobuki::CoreSensors::Flags::Discharging;
+    sense();
+  }
+
+  bool isDocked() const { return docked; }
+
+  static double uniform() { return static_cast<double>(std::rand()) / RAND_MAX; }
+
+  kobuki::Parameters parameters;
+  kobuki::Kobuki kobuki;
+  kobuki::Emulator emulator;
+  boost::shared_ptr<kobuki::AutoDockingPlugin> docking;
+
+private:
+  /**
+   * Dock beams as the receivers see them from where the robot is now.
+   */
+  void sense() {
+    typedef kobuki::AutoDocking::Beams Beams;
+    const double axis[3] = { -1.0, 0.0, 1.0 };
+    const double field[3] = { 0.7, 0.35, 0.7 };
+    const double degree = ecl::pi / 180.0;
+    double x = emulator.x(), y = emulator.y();
+    double range = std::sqrt(x * x + y * y);
+    double phi = std::atan2(y, x); // bearing of the robot, seen from the dock
+    uint8_t beams = 0;
+    if ( ( x > 0.0 ) && ( range < 2.5 ) && ( std::fabs(phi) < 80.0 * degree ) ) {
+      bool near = range < 0.8;
+      if ( std::fabs(phi) < 8.0 * degree ) {
+        beams |= near ? Beams::NearCenter : Beams::FarCenter;
+      }
+      if ( phi > 6.0 * degree ) {
+        beams |= near ? Beams::NearLeft : Beams::FarLeft;
+      }
+      if ( phi < -6.0 * degree ) {
+        beams |= near ? Beams::NearRight : Beams::FarRight;
+      }
+    }
+    double alpha = ecl::wrap_angle(std::atan2(-y, -x) - emulator.heading()); // bearing of the dock, seen from the robot
+    for ( unsigned int i = 0; i < 3; ++i ) {
+      bool visible = std::fabs(alpha - axis[i]) < field[i];
+      emulator.sensors.dock_ir[i] = ( visible && ( uniform() > 0.05 ) ) ? beams : 0;
+    }
+  }
+
+  std::string slave() {
+    mutex.lock();
+    std::string name = slave_name;
+    mutex.unlock();
+    return name;
+  }
+
+  void info(const std::string &message) {
+    const std::string prefix("pseudo terminal for the emulator is ");
+    if ( message.compare(0, prefix.size(), prefix) == 0 ) {
+      mutex.lock();
+      slave_name = message.substr(prefix.size());
+      mutex.unlock();
+    }
+  }
+
+  ecl::Slot<const std::string&> slot_info;
+  ecl::Mutex mutex;
+  std::string slave_name;
+  bool docked;
+};
+
+#endif /* AUTO_DOCKING_TEST_DOCKING_ROBOT_HPP_ */
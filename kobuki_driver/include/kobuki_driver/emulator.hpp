@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/emulator.hpp
+ *
+ * @brief A kinematic stand in for the robot, on the far end of a transport.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_EMULATOR_HPP_
+#define KOBUKI_EMULATOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interface [Emulator]
+*****************************************************************************/
+
+/**
+ * @brief Speaks the robot's side of the serial protocol, for tests and benchmarks.
+ *
+ * Opens a device, typically the slave end of a driver's pty:// transport,
+ * and every step():
+ *
+ * - reads the commands the driver sent since the last step, keeping the
+ *   latest base control and answering version info requests,
+ * - drives a differential drive model one 20ms firmware cycle with that
+ *   base control, as the firmware interprets speed and radius,
+ * - streams a frame with the core sensors (encoders from the model), the
+ *   dock infrared, the inertia (gyro heading from the model), the cliff
+ *   and current packets.
+ *
+ * Bumpers, cliffs, dock beams... are whatever the caller sets in sensors
+ * between steps, so a test scripts the world around the robot while the
+ * driver runs unmodified against it.
+ **/
+class Emulator {
+public:
+  /**
+   * @brief What the next frames report besides the model's encoders and gyro.
+   */
+  struct Sensors {
+    Sensors() : bumper(0), wheel_drop(0), cliff(0), buttons(0), charger(0), battery(160) {
+      dock_ir[0] = dock_ir[1] = dock_ir[2] = 0;
+      cliff_bottom[0] = cliff_bottom[1] = cliff_bottom[2] = 1000;
+    }
+    uint8_t bumper, wheel_drop, cliff, buttons, charger;
+    uint8_t battery;          /**< [0.1V] **/
+    uint8_t dock_ir[3];       /**< Right, centre and left receivers' beam flags (see DockIR::Flags). **/
+    uint16_t cliff_bottom[3]; /**< Analog cliff readings [adc counts]. **/
+  };
+
+  /**
+   * @brief The physical robot, which need not match the driver's calibration.
+   */
+  struct Model {
+    Model() : wheel_bias(0.23), wheel_radius(0.035), tick_to_rad(0.002436916871363930187454) {}
+    double wheel_bias;   /**< [m] **/
+    double wheel_radius; /**< [m] **/
+    double tick_to_rad;  /**< [rad/tick] **/
+  };
+
+  Emulator();
+  ~Emulator();
+
+  bool open(const std::string &device);
+  void close();
+  bool isOpen() const { return descriptor != -1; }
+
+  void step();
+  void stream(const unsigned int &frames);
+  void setPose(const double &x, const double &y, const double &heading);
+
+  double x() const { return pose_x; }             /**< [m] **/
+  double y() const { return pose_y; }             /**< [m] **/
+  double heading() const { return pose_heading; } /**< [rad], unwrapped **/
+  double linearVelocity() const { return linear; }   /**< [m/s] from the latest base control. **/
+  double angularVelocity() const { return angular; } /**< [rad/s] from the latest base control. **/
+  int16_t commandSpeed() const { return speed; }   /**< [mm/s] latest base control. **/
+  int16_t commandRadius() const { return radius; } /**< [mm] latest base control. **/
+  unsigned long baseControls() const { return base_controls; } /**< Base control commands received so far. **/
+  unsigned long frames() const { return frame_count; } /**< Frames streamed so far. **/
+
+  Sensors sensors;
+  Model model;
+  uint32_t hardware, firmware;    /**< Versions answered to version info requests. **/
+  uint32_t udid0, udid1, udid2;   /**< Unique device id answered to version info requests. **/
+
+private:
+  void receive();
+  void command(const unsigned char *payload, const unsigned int &size);
+  void integrate(const double &dt);
+  void send();
+
+  int descriptor;
+  std::vector<unsigned char> incoming;
+  uint16_t requests; // version info flags asked for and not yet answered
+  int16_t speed, radius;
+  double linear, angular;
+  double pose_x, pose_y, pose_heading;
+  double left_ticks, right_ticks;
+  uint16_t time_stamp;
+  unsigned long base_controls, frame_count;
+  double next_frame; // [s] monotonic, for stream()
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_EMULATOR_HPP_ */
@@ -72,6 +72,7 @@ struct ButtonEvent {
     Button1,
     Button2
   } button;
+  double time; /**< Host time [s] the firmware stamped the frame that raised it. **/
 };
 
 struct BumperEvent {
@@ -84,6 +85,7 @@ struct BumperEvent {
     Center,
     Right
   } bumper;
+  double time; /**< Host time [s] the firmware stamped the frame that raised it. **/
 };
 
 struct CliffEvent {
@@ -97,6 +99,7 @@ struct CliffEvent {
     Right
   } sensor;
   uint16_t bottom;
+  double time; /**< Host time [s] the firmware stamped the frame that raised it. **/
 };
 
 struct WheelEvent {
@@ -108,6 +111,7 @@ struct WheelEvent {
     Left,
     Right
   } wheel;
+  double time; /**< Host time [s] the firmware stamped the frame that raised it. **/
 };
 
 struct PowerEvent {
@@ -119,10 +123,12 @@ struct PowerEvent {
     BatteryLow        = 4,
     BatteryCritical   = 5
   } event;
+  double time; /**< Host time [s] the firmware stamped the frame that raised it. **/
 };
 
 struct InputEvent {
   bool values[4]; /**< Digital on or off for pins 0-3 respectively. **/
+  double time; /**< Host time [s] the firmware stamped the frame that raised it. **/
 };
 
 struct RobotEvent {
@@ -131,35 +137,126 @@ struct RobotEvent {
     Online,
     Unknown  // at startup
   } state;
+  double time; /**< Host time [s] the robot went online/offline. **/
+};
+
+/**
+ * @brief Every sensor event raised by a single frame, delivered in one go.
+ */
+struct EventBatch {
+  std::vector<ButtonEvent> button_events;
+  std::vector<BumperEvent> bumper_events;
+  std::vector<CliffEvent>  cliff_events;
+  std::vector<WheelEvent>  wheel_events;
+  std::vector<PowerEvent>  power_events;
+
+  bool empty() const {
+    return button_events.empty() && bumper_events.empty() && cliff_events.empty() &&
+           wheel_events.empty() && power_events.empty();
+  }
+  void clear() {
+    button_events.clear();
+    bumper_events.clear();
+    cliff_events.clear();
+    wheel_events.clear();
+    power_events.clear();
+  }
 };
 
 /*****************************************************************************
 ** Interfaces
 *****************************************************************************/
 
+/**
+ * @brief Turns changes in the streamed sensor state into events.
+ *
+ * The bitmask fields of the core sensors (buttons, bumper, cliff, wheel
+ * drop) are described by an event table: one line per flag, naming its
+ * field, its mask and the factory building its event. Each frame takes
+ * one xor per field, and only the changed bits are visited. A change may be
+ * debounced, i.e. only reported once it has held for a number of frames
+ * and/or a minimum (firmware) time, so chattering sensors on rough floors
+ * collapse to the transitions that matter. Cliff events may also be taken
+ * from the analog cliff readings through a hysteresis band instead of the
+ * firmware's single threshold.
+ * All events from a frame go out together as an EventBatch on
+ * "/event_batch", as well as one by one on their own signals. Every event
+ * carries the host time of the frame that raised it, from the firmware's
+ * own time stamp (see FirmwareClock), so reaction latencies can be
+ * measured end to end and events lined up with odometry.
+ **/
 class EventManager {
 public:
-  EventManager() {
-    last_state.buttons    = 0;
-    last_state.bumper     = 0;
-    last_state.cliff      = 0;
-    last_state.wheel_drop = 0;
-    last_state.charger    = 0;
-    last_state.battery    = 0;
-    last_digital_input    = 0;
-    last_robot_state      = RobotEvent::Unknown;
-  }
+  enum Field {
+    Buttons,
+    Bumper,
+    Cliff,
+    WheelDrop,
+    NumberOfFields
+  };
+
+  /**
+   * @brief How long a change must hold before it is reported.
+   */
+  struct Debounce {
+    Debounce(const int &frames = 0, const double &time = 0.0) : frames(frames), time(time) {}
+    int frames;  /**< Consecutive frames, 0 or 1 reports on the first. **/
+    double time; /**< Minimum duration [s], by the firmware clock. **/
+  };
+
+  /**
+   * @brief Thresholds on the analog cliff readings [adc counts].
+   */
+  struct Hysteresis {
+    Hysteresis(const bool &enable = false, const int &cliff_below = 0, const int &floor_above = 0) :
+      enable(enable), cliff_below(cliff_below), floor_above(floor_above) {}
+    bool enable;
+    int cliff_below; /**< A reading under this is a cliff. **/
+    int floor_above; /**< A reading over this is floor again. **/
+  };
+
+  EventManager();
 
   void init(const std::string &sigslots_namespace);
-  void update(const CoreSensors::Data &new_state, const std::vector<uint16_t> &cliff_data);
-  void update(const uint16_t &digital_input);
+  void setDebounce(const Field &field, const Debounce &debounce, uint8_t mask = 0xff);
+  void setCliffHysteresis(const Hysteresis &hysteresis) { cliff_hysteresis = hysteresis; }
+  void update(const CoreSensors::Data &new_state, const std::vector<uint16_t> &cliff_data, const double &time);
+  void update(const uint16_t &digital_input, const double &time);
   void update(bool is_plugged, bool is_alive);
+  const EventBatch& events() const { return batch; } /**< Events raised by the latest core sensors update. **/
 
 private:
+  typedef void (*Factory)(const int &id, const bool &is_set, const std::vector<uint16_t> &cliff_data,
+                          const double &time, EventBatch &batch);
+
+  struct Entry {
+    Field field;
+    uint8_t mask;
+    int id;          // which button, bumper, sensor or wheel
+    Factory factory;
+  };
+  static const Entry table[];
+  static const unsigned int table_size;
+
+  void updatePower(const CoreSensors::Data &new_state, const double &time);
+  void emit();
+
   CoreSensors::Data last_state;
   uint16_t          last_digital_input;
   RobotEvent::State last_robot_state;
 
+  uint8_t reported[NumberOfFields];            // state as last reported by events
+  uint8_t pending[NumberOfFields];             // bits differing from the reported state
+  uint8_t known[NumberOfFields];               // bits with an entry in the table
+  int lookup[NumberOfFields][8];               // table entry for each bit
+  unsigned int debounce_frames[NumberOfFields][8]; // frames a change must hold before it is reported
+  uint16_t debounce_time[NumberOfFields][8];       // [ms] and how long
+  unsigned int held[NumberOfFields][8];            // frames a pending change has held so far
+  uint16_t held_since[NumberOfFields][8];          // [ms] firmware time it changed
+  Hysteresis cliff_hysteresis;
+  uint8_t cliff_state;                             // cliff flags from the analog readings
+  EventBatch batch;
+
   ecl::Signal<const ButtonEvent&> sig_button_event;
   ecl::Signal<const BumperEvent&> sig_bumper_event;
   ecl::Signal<const CliffEvent&>  sig_cliff_event;
@@ -167,6 +264,7 @@ private:
   ecl::Signal<const PowerEvent&>  sig_power_event;
   ecl::Signal<const InputEvent&>  sig_input_event;
   ecl::Signal<const RobotEvent&>  sig_robot_event;
+  ecl::Signal<const EventBatch&>  sig_event_batch;
 };
 
 
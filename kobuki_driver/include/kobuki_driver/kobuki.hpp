@@ -45,7 +45,7 @@
 #include <string>
 #include <iomanip>
 #include <ecl/threads.hpp>
-#include <ecl/devices.hpp>
+#include <boost/shared_ptr.hpp>
 #include <ecl/threads/mutex.hpp>
 #include <ecl/exceptions/standard_exception.hpp>
 #include "version_info.hpp"
@@ -55,6 +55,8 @@
 #include "modules.hpp"
 #include "packets.hpp"
 #include "packet_handler/packet_finder.hpp"
+#include "transport.hpp"
+#include "reactor.hpp"
 
 /*****************************************************************************
  ** Namespaces
@@ -90,9 +92,11 @@ public:
 /**
  * @brief  The core kobuki driver class.
  *
- * This connects to the outside world via sigslots and get accessors.
+ * This connects to the outside world via sigslots and get accessors. It runs
+ * in its own worker thread, or is served by a Reactor if the parameters
+ * give it one.
  **/
-class Kobuki
+class Kobuki : private Reactor::Client
 {
 public:
   Kobuki();
@@ -104,7 +108,11 @@ public:
   void init(Parameters &parameters) throw (ecl::StandardException);
   bool isAlive() const { return is_alive; } /**< Whether the connection to the robot is alive and currently streaming. **/
   bool isShutdown() const { return shutdown_requested; } /**< Whether the worker thread is alive or not. **/
-  bool isEnabled() const { return is_enabled; } /**< Whether the motor power is enabled or disabled. **/
+  ConnectionState::State connectionState() const { return connection.state(); } /**< Where the link is in its connection life cycle. **/
+  ConnectionState::Metrics handshakeMetrics() const { return connection.metrics(); } /**< Version handshake counters and timing. **/
+  bool waitUntilStreaming(const double &timeout) const { return connection.waitUntilStreaming(timeout); } /**< Block until the first frame, false on timeout [s]. **/
+  bool waitForHandshake(const double &timeout) const { return connection.waitUntilReady(timeout); } /**< Block until streaming with version info, false on timeout [s]. **/
+  bool isEnabled() const { return __atomic_load_n(&is_enabled, __ATOMIC_ACQUIRE); } /**< Whether the motor power is enabled or disabled. **/
   bool enable(); /**< Enable power to the motors. **/
   bool disable(); /**< Disable power to the motors. **/
   void shutdown() { shutdown_requested = true; } /**< Gently terminate the worker thread. **/
@@ -115,6 +123,8 @@ public:
   *******************************************/
   ecl::Angle<double> getHeading() const;
   double getAngularVelocity() const;
+  double getGyroBias() const { return gyro_bias.bias(); } /**< Estimated gyro rate bias [rad/s]. **/
+  bool isStationary() const { return gyro_bias.isStationary(); } /**< Whether the robot has been still long enough to trust the gyro at rest. **/
   VersionInfo versionInfo() const { return VersionInfo(firmware.data.version, hardware.data.version, unique_device_id.data.udid0, unique_device_id.data.udid1, unique_device_id.data.udid2); }
   Battery batteryStatus() const { return Battery(core_sensors.data.battery, core_sensors.data.charger); }
 
@@ -134,7 +144,27 @@ public:
   void getWheelJointStates(double &wheel_left_angle, double &wheel_left_angle_rate,
                             double &wheel_right_angle, double &wheel_right_angle_rate);
   void updateOdometry(ecl::Pose2D<double> &pose_update,
-                      ecl::linear_algebra::Vector3d &pose_update_rates);
+                      ecl::linear_algebra::Vector3d &pose_update_rates) const;
+  double getStreamTime() const { return firmware_clock.hostTime(); } /**< Host time [s] the latest frame was stamped at by the firmware. **/
+  const ecl::linear_algebra::Matrix3d& getPoseCovariance() const { return odometry_covariance.poseCovariance(); } /**< x, y, heading **/
+  const ecl::linear_algebra::Vector3d& getTwistVariance() const { return odometry_covariance.twistVariance(); } /**< vx, vy, wz **/
+  double getWheelSlip() const { return odometry_covariance.slip(); } /**< Disagreement between encoders, gyro and motor effort. **/
+  const LinkStatistics& getLinkStatistics() const { return link_statistics; } /**< Serial traffic totals. **/
+  bool isPipelined() const { return frame_queue.isEnabled(); } /**< Whether frames are processed on a separate thread. **/
+  FrameQueue::Statistics getPipelineStatistics() const { return frame_queue.statistics(); } /**< Frame queue depth, overruns and stage latencies. **/
+  const CommandScheduler::Latency& getCommandLatency() const { return command_scheduler.latency(); } /**< Command to encoder response latency. **/
+  bool isSafetyReflexEnabled() const { return safety_reflex.isEnabled(); }
+  SafetyReflex::State getSafetyReflexState() const { return safety_reflex.state(); } /**< Whether the reflex is overriding base control. **/
+  const SafetyReflex::Reaction& getSafetyReflexReaction() const { return safety_reflex.reaction(); } /**< Hazard frame to override command latency. **/
+  std::vector<VelocityMux::Input> getVelocityInputs() const { return velocity_mux.status(); } /**< Multiplexed inputs and their last active times. **/
+  int getSelectedVelocityInput() const { return velocity_mux.selected(); } /**< Input the multiplexer last picked, -1 for none. **/
+  bool isTrajectoryRunning() const { return trajectory_buffer.isRunning(); }
+  bool isMotionRunning() const { return motion_primitive.isRunning(); }
+  MotionPrimitive::Result getMotionResult() const { return motion_primitive.result(); } /**< Progress of the running, or outcome of the last, motion primitive. **/
+  TrajectoryBuffer::Statistics getTrajectoryStatistics() const { return trajectory_buffer.statistics(); } /**< Trajectories received, preempted, completed... **/
+  DockIRFilter::Estimate getDockEstimate() const { return dock_ir_filter.estimate(); } /**< Filtered dock bearing, range and region, see DockIRFilter. **/
+  bool getPoseAt(const double &time, ecl::Pose2D<double> &pose, ecl::linear_algebra::Vector3d &twist) const
+    { return pose_history.lookup(time, pose, twist); } /**< Odometry pose/twist at a host time [s] in the recent past. **/
 
   /*********************
   ** Soft Commands
@@ -145,16 +175,34 @@ public:
   ** Hard Commands
   **********************/
   void setBaseControl(const double &linear_velocity, const double &angular_velocity);
+  void setBaseControl(const unsigned int &input, const double &linear_velocity, const double &angular_velocity);
+  int addVelocityInput(const std::string &name, const int &priority, const double &timeout)
+    { return velocity_mux.add(name, priority, timeout); } /**< Register a multiplexed velocity input, see VelocityMux. **/
+  bool setTrajectory(const double &start, const std::vector<TrajectoryBuffer::Sample> &samples)
+    { return trajectory_buffer.set(start, samples); } /**< Execute (t, v, w) samples from a host time [s], see TrajectoryBuffer. **/
+  void cancelTrajectory() { trajectory_buffer.cancel(); }
+  bool startMotion(const double &distance, const double &angle);
+  void cancelMotion();
+  void emergencyStop();
   void setLed(const enum LedNumber &number, const enum LedColour &colour);
   void setDigitalOutput(const DigitalOutput &digital_output);
   void setExternalPower(const DigitalOutput &digital_output);
   void playSoundSequence(const enum SoundSequences &number);
 
+  /*********************
+  ** Plugins
+  **********************/
+  bool addPlugin(const boost::shared_ptr<PluginHost::Plugin> &plugin, const std::string &name,
+                 const int &priority = 0, const double &budget = 0.001);
+  bool removePlugin(const std::string &name) { return plugin_host.remove(name); }
+  std::vector<PluginHost::Statistics> getPluginStatistics() const { return plugin_host.statistics(); } /**< Run times and overruns. **/
+
 private:
   /*********************
   ** Thread
   **********************/
   ecl::Thread thread;
+  ecl::Thread processing_thread; // decodes frames when the pipeline is enabled
   bool shutdown_requested; // helper to shutdown the worker thread.
 
   /*********************
@@ -163,6 +211,26 @@ private:
   DiffDrive diff_drive;
   bool is_enabled;
 
+  /*********************
+  ** Gyro Bias
+  **********************/
+  GyroBias gyro_bias;
+
+  /*********************
+  ** Time & Pose History
+  **********************/
+  FirmwareClock firmware_clock;
+  ecl::Pose2D<double> pose;
+  ecl::Pose2D<double> frame_pose_update; // odometry step of the latest frame
+  ecl::linear_algebra::Vector3d frame_pose_update_rates;
+  PoseHistory pose_history;
+  OdometryCovariance odometry_covariance;
+
+  /*********************
+  ** Dock IR
+  **********************/
+  DockIRFilter dock_ir_filter;
+
   /*********************
   ** Driver Paramters
   **********************/
@@ -170,9 +238,15 @@ private:
   bool is_connected;
 
   /*********************
-  ** Gate Keeper / High Acceleration Smoother / Limiter
+  ** Velocity Mux, Trajectories, Motions, Smoother, Reflex & Scheduling
   **********************/
-  GateKeeper gate_keeper;
+  VelocitySmoother velocity_smoother;
+  VelocityMux velocity_mux;
+  TrajectoryBuffer trajectory_buffer;
+  MotionPrimitive motion_primitive;
+  CommandScheduler command_scheduler;
+  SafetyReflex safety_reflex;
+  LinkStatistics link_statistics;
 
   /*********************
   ** Packet Handling
@@ -187,18 +261,64 @@ private:
   Firmware firmware; // requestable
   UniqueDeviceID unique_device_id;
 
-  ecl::Serial serial;
+  boost::shared_ptr<Transport> transport;
   PacketFinder packet_finder;
   PacketFinder::BufferType data_buffer;
+  PacketFinder::BufferType frame_buffer; // the worker thread's copy of a packet on its way to the frame queue
   bool is_alive; // used as a flag set by the data stream watchdog
+  ecl::Duration stream_timeout; // silence before the stream is considered stalled
+  ecl::TimeStamp last_signal_time; // arrival of the last frame
+  ecl::TimeStamp last_notice; // last report of a failure to (re)connect
 
-  int version_info_reminder;
+  ConnectionState connection;
+
+  /*********************
+  ** Runtime
+  **********************/
+  void received(const unsigned char *buf, const int &n);
+  void watchdog();
+  void checkStream();
+  void processFrame(const ecl::TimeStamp &arrival_time);
+  void integrateOdometry();
+
+  /*********************
+  ** Pipeline
+  **********************/
+  void queueFrame(const ecl::TimeStamp &arrival_time);
+  void process();
+  FrameQueue frame_queue;
+  ecl::Mutex state_mutex; // the processing thread's state, against (re)connection on the worker thread
+  int descriptor() const; // Reactor::Client
+  void readable();        // Reactor::Client
+  long service();         // Reactor::Client
+  long reconnect();       // Reactor::Client
+
+  /*********************
+  ** Device Cache
+  **********************/
+  bool connect();
+  bool openDevice();
+  void dropConnection();
+  bool warmStart();
+  void verifyCachedDevice();
+  void applyCalibration(const DeviceCache::Entry &entry);
+  void saveCachedDevice();
+  DeviceCache device_cache;
+  DeviceCacheWriter cache_writer;
+  DeviceCache::Entry cached_device;       // robot the current calibration belongs to
+  DeviceCache::Entry default_calibration; // for robots not in the cache
+  bool battery_capacity_configured;
 
   /*********************
   ** Commands
   **********************/
+  void checkFirmwareVersion();
+  long serviceCommands();
+  void transmitBaseControl();
+  unsigned int pluginCommands(const PluginHost::Commands &commands, Command *packet);
   void sendBaseControlCommand();
   void sendCommand(Command command);
+  void sendCommands(Command *commands, const unsigned int &count);
   ecl::Mutex command_mutex; // protection against the user calling the command functions from multiple threads
   Command kobuki_command; // used to maintain some state about the command history
   Command::Buffer command_buffer;
@@ -208,11 +328,19 @@ private:
   **********************/
   EventManager event_manager;
 
+  /*********************
+  ** Plugins
+  **********************/
+  PluginHost plugin_host;
+  int plugin_input; // the plugins' velocity input to the multiplexer, -1 until the first plugin
+
   /*********************
   ** Signals
   **********************/
   ecl::Signal<> sig_stream_data;
+  ecl::Signal<> sig_ready; // first frame after (re)connecting
   ecl::Signal<const VersionInfo&> sig_version_info;
+  ecl::Signal<const MotionPrimitive::Result&> sig_motion_result;
   ecl::Signal<const std::string&> sig_debug, sig_info, sig_warn, sig_error;
   ecl::Signal<Command::Buffer&> sig_raw_data_command; // should be const, but pushnpop is not fully realised yet for const args in the formatters.
   ecl::Signal<PacketFinder::BufferType&> sig_raw_data_stream; // should be const, but pushnpop is not fully realised yet for const args in the formatters.
@@ -47,6 +47,21 @@
 #include "modules/led_array.hpp"
 #include "modules/diff_drive.hpp"
 #include "modules/sound.hpp"
-#include "modules/gate_keeper.hpp"
+#include "modules/velocity_smoother.hpp"
+#include "modules/velocity_mux.hpp"
+#include "modules/trajectory_buffer.hpp"
+#include "modules/motion_primitive.hpp"
+#include "modules/command_scheduler.hpp"
+#include "modules/safety_reflex.hpp"
+#include "modules/link_statistics.hpp"
+#include "modules/frame_queue.hpp"
+#include "modules/connection_state.hpp"
+#include "modules/device_cache.hpp"
+#include "modules/gyro_bias.hpp"
+#include "modules/firmware_clock.hpp"
+#include "modules/pose_history.hpp"
+#include "modules/odometry_covariance.hpp"
+#include "modules/dock_ir_filter.hpp"
+#include "modules/plugin_host.hpp"
 
 #endif /* KOBUKI_MODULES_HPP_ */
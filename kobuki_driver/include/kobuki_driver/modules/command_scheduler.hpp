@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/command_scheduler.hpp
+ *
+ * @brief Aligns base control commands with the firmware control cycle.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_COMMAND_SCHEDULER_HPP_
+#define KOBUKI_COMMAND_SCHEDULER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Schedules base control commands against the firmware cycle.
+ *
+ * The firmware samples its sensors, runs its control tick and streams a
+ * frame every ~20ms. The frame's host time (from the FirmwareClock) fixes
+ * the phase of that cycle; the period is learnt from the firmware time
+ * stamps. Instead of sending straight after a frame arrives, the driver
+ * sends at the latest moment that still makes the next tick, i.e. the
+ * predicted next frame time less a configurable lead covering transmission
+ * and firmware parsing. Commands set in between then go out on the very
+ * next tick.
+ *
+ * Optionally, unchanged commands are suppressed: a base control command is
+ * then only sent when its speed or radius changes, or when the keepalive
+ * interval expires so the firmware keeps seeing a live command stream.
+ *
+ * It also measures the command-to-effect latency: when a command asks a
+ * wheel to change rate by a noticeable amount, the time until the encoders
+ * first show that wheel responding is recorded.
+ **/
+class CommandScheduler {
+public:
+  /**
+   * @brief Command-to-effect latency statistics [s].
+   */
+  struct Latency {
+    Latency() : count(0), last(0.0), mean(0.0), minimum(0.0), maximum(0.0) {}
+    unsigned int count;
+    double last, mean, minimum, maximum;
+  };
+
+  CommandScheduler();
+  void init(const bool &enable, const double &lead, const double &encoder_resolution);
+  void initChangeDriven(const bool &enable, const double &keepalive);
+  void reset();
+
+  /*********************
+  ** Scheduling
+  **********************/
+  void frameArrived(const double &frame_time, const double &frame_interval);
+  bool isEnabled() const { return is_enabled; }
+  bool isPending() const { return pending; } /**< A transmission is scheduled for this cycle. **/
+  double transmitTime() const { return transmit_time; } /**< Host time [s] of the scheduled transmission. **/
+  void transmitted() { pending = false; }
+  double period() const { return cycle_period; } /**< Learnt firmware cycle period [s]. **/
+
+  /*********************
+  ** Change Driven
+  **********************/
+  bool isRedundant(const int16_t &speed, const int16_t &radius, const double &time) const;
+  void baseControlSent(const int16_t &speed, const int16_t &radius, const double &time);
+  void forceNext() { has_sent = false; } /**< Make sure the next command goes out, e.g. after losing the link. **/
+
+  /*********************
+  ** Latency
+  **********************/
+  void commandSent(const double &time, const double &left_rate, const double &right_rate);
+  void feedback(const double &frame_time, const double &dt,
+                const uint16_t &left_encoder, const uint16_t &right_encoder);
+  const Latency& latency() const { return latency_statistics; }
+
+private:
+  bool is_enabled;
+  double lead;
+  double encoder_resolution; // [rad/tick]
+
+  double cycle_period;  // [s]
+  bool pending;
+  double transmit_time; // host [s]
+
+  // change driven transmission
+  bool change_driven;
+  double keepalive; // [s]
+  bool has_sent;
+  int16_t last_speed, last_radius;
+  double last_sent_time; // host [s]
+
+  // encoder feedback
+  bool has_feedback;
+  uint16_t last_left_encoder, last_right_encoder;
+  double wheel_rates[2]; // [rad/s] over the last frame
+
+  // latency probe
+  bool probing;
+  unsigned int probe_wheel;
+  double probe_time, probe_start_rate, probe_direction;
+  Latency latency_statistics;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_COMMAND_SCHEDULER_HPP_ */
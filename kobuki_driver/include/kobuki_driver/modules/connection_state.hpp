@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/connection_state.hpp
+ *
+ * @brief Connection and version handshake state machine.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_CONNECTION_STATE_HPP_
+#define KOBUKI_CONNECTION_STATE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Tracks the link to the robot through its connection life cycle.
+ *
+ * - Disconnected : no device at the port.
+ * - Opening : the device is present and being opened.
+ * - Handshaking : frames may be flowing, the version info (hardware,
+ *   firmware, unique device id) is being requested.
+ * - Streaming : the handshake completed and frames are flowing.
+ * - Degraded : the port is open, but either the stream stalled or the
+ *   handshake ran out of attempts/time without an answer.
+ *
+ * Version info requests are spaced by a retry interval and bounded both in
+ * number and by an overall handshake timeout. A handshake that fails is
+ * tried again while frames keep arriving, after a backoff that doubles with
+ * every failure (1s up to a minute). When a stalled stream resumes the
+ * handshake starts over, since the robot may have been power cycled.
+ *
+ * On a warm start, i.e. the robot on this port is already known from the
+ * device cache, the driver runs on the cached calibration from the first
+ * frame, but the link only reports Streaming once the handshake has
+ * confirmed the robot's identity.
+ *
+ * Events come from the driver's threads, the accessors may be called from
+ * any thread.
+ **/
+class ConnectionState {
+public:
+  enum State {
+    Disconnected,
+    Opening,
+    Handshaking,
+    Streaming,
+    Degraded
+  };
+
+  enum Action {
+    None,
+    RequestVersionInfo,
+    HandshakeFailed
+  };
+
+  /**
+   * @brief Handshake counters and timing.
+   */
+  struct Metrics {
+    Metrics() : handshakes(0), failures(0), attempts(0), total_attempts(0), stalls(0), warm_starts(0), last_duration(0.0) {}
+    unsigned int handshakes;     /**< Handshakes completed. **/
+    unsigned int failures;       /**< Handshakes abandoned (attempts exhausted or timed out). **/
+    unsigned int attempts;       /**< Version info requests in the current/last handshake. **/
+    unsigned int total_attempts; /**< Version info requests overall. **/
+    unsigned int stalls;         /**< Times the stream stalled after it was established. **/
+    unsigned int warm_starts;    /**< Times streaming began before the handshake, from the device cache. **/
+    double last_duration;        /**< Time [s] the last completed handshake took. **/
+  };
+
+  ConnectionState();
+  void init(const unsigned int &max_attempts, const double &retry_interval, const double &handshake_timeout);
+
+  /*********************
+  ** Events
+  **********************/
+  void disconnected();
+  void opening();
+  void opened(const double &time, const bool &warm_start = false);
+  void frameReceived(const double &time);
+  void streamLost();
+  void handshakeComplete(const double &time);
+  Action update(const double &time);
+
+  /*********************
+  ** Accessors
+  **********************/
+  State state() const;
+  bool isStreaming() const; /**< Frames are arriving, handshake or not. **/
+  bool isReady() const;
+  bool isVerified() const; /**< The robot has answered the handshake since the port was opened. **/
+  bool waitUntilStreaming(const double &timeout) const;
+  bool waitUntilReady(const double &timeout) const;
+  Metrics metrics() const;
+  static std::string toString(const State &state);
+
+private:
+  void startHandshake(const double &time);
+  bool waitUntil(bool (ConnectionState::*condition)() const, const double &timeout) const;
+
+  State current_state;
+  bool handshake_done;     // a handshake completed since the port was opened
+  bool warm_start;         // stream before the handshake completes
+  bool has_stream;         // a frame arrived since the port was opened or the stream stalled
+  unsigned int max_attempts;
+  double retry_interval;    // [s]
+  double handshake_timeout; // [s]
+  double handshake_start;   // host [s]
+  double last_request;      // host [s]
+  double backoff;           // [s] before retrying after the next failure
+  double next_handshake;    // host [s] to retry a failed handshake
+  Metrics handshake_metrics;
+  mutable ecl::Mutex mutex;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_CONNECTION_STATE_HPP_ */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/device_cache.hpp
+ *
+ * @brief On-disk cache of device identity and calibration, keyed by UDID.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_DEVICE_CACHE_HPP_
+#define KOBUKI_DEVICE_CACHE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <stdint.h>
+#include <semaphore.h>
+#include <ecl/threads/mutex.hpp>
+#include <ecl/threads/thread.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Remembers robots between runs.
+ *
+ * Each robot gets a small text file named after its unique device id,
+ * holding its version info and calibration. An index maps each device port
+ * to the robot last seen on it, so a restart can pick up the identity and
+ * calibration before the robot has answered a single version request.
+ *
+ * The cache is disabled if no directory is given.
+ **/
+class DeviceCache {
+public:
+  /**
+   * @brief What is remembered about a single robot.
+   */
+  struct Entry {
+    Entry() :
+      firmware(0), hardware(0), udid0(0), udid1(0), udid2(0),
+      wheel_bias(0.0), tick_to_rad(0.0), gyro_bias(0.0), gyro_bias_valid(false), battery_capacity(0.0),
+      wheel_radius_left(0.0), wheel_radius_right(0.0), gyro_scale(0.0) {}
+    bool isValid() const { return ( wheel_bias > 0.0 ) && ( tick_to_rad > 0.0 ) && ( battery_capacity > 0.0 ); }
+    bool sameDevice(const uint32_t &id0, const uint32_t &id1, const uint32_t &id2) const {
+      return ( udid0 == id0 ) && ( udid1 == id1 ) && ( udid2 == id2 );
+    }
+
+    uint32_t firmware, hardware;
+    uint32_t udid0, udid1, udid2;
+    double wheel_bias;       /**< [m] **/
+    double tick_to_rad;      /**< [rad/tick] **/
+    double gyro_bias;        /**< [rad/s] **/
+    bool gyro_bias_valid;    /**< The gyro bias was measured, rather than never estimated. **/
+    double battery_capacity; /**< [V] **/
+    double wheel_radius_left;  /**< [m], zero for the nominal radius **/
+    double wheel_radius_right; /**< [m], zero for the nominal radius **/
+    double gyro_scale;         /**< true per measured rotation, zero for uncalibrated **/
+  };
+
+  void init(const std::string &directory);
+  bool isEnabled() const { return !directory.empty(); }
+  bool lookup(const std::string &device_port, Entry &entry) const;
+  bool load(const uint32_t &udid0, const uint32_t &udid1, const uint32_t &udid2, Entry &entry) const;
+  bool save(const std::string &device_port, const Entry &entry) const;
+  bool store(const Entry &entry) const;
+
+  static std::string key(const uint32_t &udid0, const uint32_t &udid1, const uint32_t &udid2);
+
+private:
+  bool loadFile(const std::string &name, Entry &entry) const;
+  bool makeDirectory() const;
+  bool writeAtomically(const std::string &name, const std::string &contents) const;
+
+  std::string directory;
+};
+
+/**
+ * @brief Writes a robot's entry to the device cache on its own thread.
+ *
+ * Keeps the disk (and its fsync) off the driver's frame thread. Only the
+ * latest entry posted is written; one still pending when another arrives is
+ * superseded. stop() writes whatever is pending before joining.
+ **/
+class DeviceCacheWriter {
+public:
+  DeviceCacheWriter();
+  ~DeviceCacheWriter();
+  void start(const DeviceCache &cache, const std::string &device_port);
+  void post(const DeviceCache::Entry &entry);
+  void stop();
+  unsigned long failures(); /**< Writes that failed since the last call. **/
+
+private:
+  void run();
+
+  DeviceCache cache;
+  std::string device_port;
+  bool is_running;
+  bool pending, stopping;
+  DeviceCache::Entry entry;
+  unsigned long failed;
+  ecl::Mutex mutex;
+  sem_t wake;
+  ecl::Thread thread;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_DEVICE_CACHE_HPP_ */
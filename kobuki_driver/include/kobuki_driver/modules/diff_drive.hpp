@@ -46,6 +46,7 @@
 #include <stdint.h>
 #include <boost/shared_ptr.hpp>
 #include <ecl/mobile_robot.hpp>
+#include "velocity_estimator.hpp"
 
 /*****************************************************************************
 ** Namespaces
@@ -60,7 +61,9 @@ namespace kobuki {
 class DiffDrive {
 public:
   DiffDrive();
-  void init();
+  void init(const unsigned int &velocity_window = 5);
+  void calibrate(const double &wheel_bias, const double &tick_to_rad,
+                 const double &wheel_radius_left = 0.0, const double &wheel_radius_right = 0.0);
   boost::shared_ptr<ecl::DifferentialDrive::Kinematics> kinematics() { return diff_drive_kinematics; }
   void update(const uint16_t &time_stamp,
               const uint16_t &left_encoder,
@@ -84,11 +87,17 @@ public:
   ** Property Accessors
   **********************/
   double wheel_bias() const { return bias; }
+  double encoder_resolution() const { return tick_to_rad; } // [rad/tick]
+  double travel_resolution() const { return tick_to_rad * wheel_radius; } // [m/tick]
+  void wheel_radii(double &left, double &right) const { left = left_radius; right = right_radius; } // [m]
+  void wheelVelocities(const double &vx, const double &wz, double &left_rate, double &right_rate) const;
 
 private:
+  bool is_initialised;
   unsigned short last_timestamp;
+  double elapsed_time; // unwrapped firmware time [s]
   double last_velocity_left, last_velocity_right;
-  double last_diff_time;
+  VelocityEstimator velocity_left, velocity_right;
 
   unsigned short last_tick_left, last_tick_right;
   double last_rad_left, last_rad_right;
@@ -97,9 +106,10 @@ private:
   int16_t radius;
   short speed;
   double bias; //wheelbase, wheel_to_wheel, in [m]
-  double wheel_radius;
+  double wheel_radius; // mean of the two below, used by the kinematics
+  double left_radius, right_radius;
   int imu_heading_offset;
-  const double tick_to_rad;
+  double tick_to_rad;
 
   boost::shared_ptr<ecl::DifferentialDrive::Kinematics> diff_drive_kinematics;
 
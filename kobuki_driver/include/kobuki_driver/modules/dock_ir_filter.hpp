@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/dock_ir_filter.hpp
+ *
+ * @brief Sliding window filter turning the dock infrared bytes into a bearing.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_DOCK_IR_FILTER_HPP_
+#define KOBUKI_DOCK_IR_FILTER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Dock bearing, range and region from the last few frames of dock ir.
+ *
+ * Each of the three receivers (right, central, left) reports the dock's
+ * beams it picks up, one byte per frame, and drops the odd frame. A
+ * receiver that sees the dock puts it somewhere along its axis, so each
+ * reading is turned into a bearing in the gyro's frame (heading plus the
+ * receiver's axis) and averaged over the window as a unit vector. While
+ * the robot turns, the readings of neighbouring receivers overlap and the
+ * mean falls between their axes, finer than their spacing, though it lags
+ * by up to half the window's turn. The window is kept as running sums, so
+ * an update costs the same however long it is.
+ *
+ * Translation is ignored: over a window of a second or less the robot
+ * moves little compared with its distance to the dock.
+ *
+ * - bearing : of the dock from the robot's current heading.
+ * - range : near or far beams, by majority over the window. A tie goes to
+ *   near: the robot is on the boundary, better to slow down early.
+ * - region : which of the dock's beams the robot is in, left, center or
+ *   right as seen from the dock (the names follow DockIR::Flags), by
+ *   majority over the window. A tie with the center beam goes to center,
+ *   the beams overlap there; a tie between left and right to right.
+ * - confidence : fraction of frames with a reading times the agreement
+ *   of their bearings (the mean vector's length), in [0, 1].
+ **/
+class DockIRFilter {
+public:
+  enum Range {
+    OutOfRange,
+    Far,
+    Near
+  };
+  enum Region {
+    NoRegion,
+    LeftRegion,
+    CenterRegion,
+    RightRegion
+  };
+
+  struct Estimate {
+    Estimate() : bearing(0.0), range(OutOfRange), region(NoRegion), confidence(0.0) {}
+    double bearing;    /**< [rad] of the dock, anticlockwise from the robot's heading **/
+    Range range;
+    Region region;
+    double confidence; /**< [0, 1], zero when the dock is out of sight **/
+  };
+
+  DockIRFilter(const unsigned int &window = 25);
+  void init(const unsigned int &window);
+  void reset();
+  void update(const double &heading, const std::vector<uint8_t> &docking);
+  Estimate estimate() const;
+  unsigned int window() const { return capacity; }
+
+  static std::string toString(const Range &range);
+  static std::string toString(const Region &region);
+
+private:
+  struct Observation {
+    Observation() : x(0.0), y(0.0), weight(0.0), near(0), far(0), left(0), center(0), right(0) {}
+    double x, y, weight; // weighted unit bearings of the receivers that saw the dock
+    int near, far, left, center, right;
+  };
+
+  void add(const Observation &observation, const int &sign);
+
+  std::vector<Observation> observations; // ring buffer
+  unsigned int capacity, newest, count;
+  Observation sum;
+  int frames_seen;
+  double heading;
+  Estimate latest;
+  mutable ecl::Mutex mutex;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_DOCK_IR_FILTER_HPP_ */
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/firmware_clock.hpp
+ *
+ * @brief Maps the 16 bit firmware time stamps onto the host clock.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FIRMWARE_CLOCK_HPP_
+#define KOBUKI_FIRMWARE_CLOCK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Unwraps firmware time stamps and synchronises them with the host.
+ *
+ * The firmware stamps every frame with a millisecond counter that wraps
+ * every 65.536 seconds. This unwraps it into continuous seconds and tracks
+ * the offset to the host clock. Frames can only arrive later than they were
+ * stamped, so the offset is the minimum of (arrival - stamp) seen so far,
+ * slowly relaxed upwards to follow drift between the two oscillators.
+ *
+ * A stream gap longer than the wrap, or a robot reboot, leaves the unwrapped
+ * time meaningless. The driver resets the clock when it loses the stream,
+ * and the clock re-seeds itself whenever (arrival - stamp) jumps by more
+ * than the resync threshold, rather than creeping back at the drift rate.
+ **/
+class FirmwareClock {
+public:
+  FirmwareClock(const double &max_drift = 1e-4, const double &resync_threshold = 0.1);
+  void reset();
+  void update(const uint16_t &time_stamp, const double &arrival);
+
+  bool isSynchronised() const { return initialised; }
+  double firmwareTime() const { return firmware_time; } /**< Unwrapped time [s] of the latest frame. **/
+  double frameInterval() const { return frame_interval; } /**< Firmware time [s] between the last two frames (0 until two have arrived). **/
+  double unwrap(const uint16_t &time_stamp) const;
+  double toHostTime(const double &firmware_time) const { return firmware_time + offset; }
+  double hostTime() const { return toHostTime(firmware_time); } /**< Host time [s] the latest frame was stamped at. **/
+  double hostTime(const uint16_t &time_stamp) const { return toHostTime(unwrap(time_stamp)); }
+
+private:
+  bool initialised;
+  uint16_t last_time_stamp;
+  double firmware_time; // unwrapped [s]
+  double frame_interval; // [s]
+  double offset;        // host - firmware [s]
+  double max_drift;     // [s/s] upwards relaxation of the offset
+  double resync_threshold; // [s] jump in the offset that re-seeds the clock
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FIRMWARE_CLOCK_HPP_ */
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/frame_queue.hpp
+ *
+ * @brief Single producer, single consumer queue of framed packets.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FRAME_QUEUE_HPP_
+#define KOBUKI_FRAME_QUEUE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Hands framed packets from the I/O thread to the processing thread.
+ *
+ * A ring of fixed size slots. The I/O thread claim()s a slot, copies a
+ * packet in and publish()es it; it never waits, so a slow consumer cannot
+ * hold up reading the FTDI fifo. If the ring is full, the packet is
+ * dropped and counted as an overrun instead. The processing thread waits in
+ * front() for the oldest packet and release()s it once processed.
+ *
+ * It also times the two stages: queueing (framed to dequeued) and
+ * processing (dequeued to released). The producer's counters are atomic and
+ * the consumer's under a lock, so statistics() may be called from any thread.
+ **/
+class FrameQueue {
+public:
+  static const unsigned int max_frame_size = 264; /**< Largest payload plus stx, length and checksum. **/
+
+  struct Frame {
+    Frame() : size(0), arrival(0.0) {}
+    unsigned int size;
+    double arrival; /**< Host time [s] the I/O thread completed the frame. **/
+    unsigned char bytes[max_frame_size];
+  };
+
+  /**
+   * @brief Time [s] spent in a stage.
+   */
+  struct Stage {
+    Stage() : count(0), last(0.0), mean(0.0), minimum(0.0), maximum(0.0) {}
+    void add(const double &value);
+    unsigned int count;
+    double last, mean, minimum, maximum;
+  };
+
+  struct Statistics {
+    Statistics() : frames(0), overruns(0), depth(0), max_depth(0) {}
+    unsigned long frames;   /**< Frames published. **/
+    unsigned long overruns; /**< Frames dropped because the queue was full. **/
+    unsigned int depth, max_depth;
+    Stage queueing, processing;
+  };
+
+  FrameQueue();
+  ~FrameQueue();
+  void init(const bool &enable, const unsigned int &capacity);
+  bool isEnabled() const { return is_enabled; }
+
+  /*********************
+  ** Producer
+  **********************/
+  Frame* claim();
+  void publish();
+
+  /*********************
+  ** Consumer
+  **********************/
+  Frame* front(const long &timeout_ms);
+  void release();
+
+  Statistics statistics() const;
+
+private:
+  bool is_enabled;
+  std::vector<Frame> slots;
+  unsigned long head; // next slot to consume, written by the consumer only
+  unsigned long tail; // next slot to fill, written by the producer only
+  double dequeue_time;
+  int available; // eventfd semaphore counting published frames
+  unsigned long frames, overruns; // producer's, atomic
+  Statistics stats; // consumer's, under the mutex
+  mutable ecl::Mutex stats_mutex;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FRAME_QUEUE_HPP_ */
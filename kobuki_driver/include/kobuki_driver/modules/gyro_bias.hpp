@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/gyro_bias.hpp
+ *
+ * @brief Online gyro bias estimation while the robot is standing still.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_GYRO_BIAS_HPP_
+#define KOBUKI_GYRO_BIAS_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include <ecl/geometry/angle.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Estimates the gyro rate bias during stationary periods.
+ *
+ * The robot is considered stationary when the encoders have not moved, no
+ * velocity is being commanded and no bumper is pressed. Once it has been
+ * stationary for longer than the settle time, every change in the raw gyro
+ * heading is treated as drift: it is removed from the corrected heading and
+ * folded into a time weighted estimate of the rate bias. While moving, the
+ * corrected heading subtracts the integrated bias estimate instead.
+ *
+ * A calibrated scale factor on the gyro is applied to the bias corrected
+ * rotation while moving, and to the corrected rate.
+ **/
+class GyroBias {
+public:
+  GyroBias();
+  void init(const double &settle_time, const double &memory);
+  void update(const uint16_t &time_stamp,
+              const uint16_t &left_encoder,
+              const uint16_t &right_encoder,
+              const uint8_t &bumper,
+              const bool &commanding_motion,
+              const int16_t &angle,
+              const int16_t &angle_rate);
+  void reset();
+  void seed(const double &bias, const double &weight);
+  void setScale(const double &scale);
+
+  bool isStationary() const { return stationary_time >= settle_time; } /**< Stationary for longer than the settle time. **/
+  double bias() const { return rate_bias; } /**< Estimated rate bias [rad/s]. **/
+  bool isEstimated() const { return bias_weight > 0.0; } /**< The bias has been measured or seeded. **/
+  double scale() const { return rate_scale; } /**< True rotation per unit of (bias corrected) gyro rotation. **/
+  double heading() const; /**< Bias corrected heading [rad]. **/
+  double angularVelocity() const { return rate_scale * ( last_rate - rate_bias ); } /**< Bias corrected rate [rad/s]. **/
+
+private:
+  bool initialised;
+  uint16_t last_time_stamp;
+  uint16_t last_left_encoder, last_right_encoder;
+  double last_angle, last_rate; // raw gyro, [rad], [rad/s]
+
+  double settle_time; // [s] stationary time required before trusting the gyro to be at rest
+  double memory;      // [s] maximum amount of evidence retained in the bias estimate
+  double stationary_time;
+  double rate_bias, bias_weight;
+  double rate_scale;
+  double heading_correction; // accumulated drift removed from the raw heading [rad]
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_GYRO_BIAS_HPP_ */
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/link_statistics.hpp
+ *
+ * @brief Byte and packet accounting for the serial link.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_LINK_STATISTICS_HPP_
+#define KOBUKI_LINK_STATISTICS_HPP_
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Running totals of the traffic over the serial link.
+ *
+ * Base control commands are also counted separately, along with those that
+ * were suppressed because they only repeated the previous command, so the
+ * bandwidth saved by change driven transmission can be read off directly.
+ **/
+class LinkStatistics {
+public:
+  LinkStatistics() { reset(); }
+  void reset() {
+    bytes_received = bytes_sent = packets_sent = 0;
+    base_control_sent = base_control_skipped = base_control_bytes_saved = 0;
+    base_control_size = 0;
+  }
+  void received(const unsigned int &bytes) { bytes_received += bytes; }
+  void sent(const unsigned int &bytes, const bool &base_control) {
+    bytes_sent += bytes;
+    packets_sent += 1;
+    if ( base_control ) {
+      base_control_sent += 1;
+      base_control_size = bytes;
+    }
+  }
+  void skipped() {
+    base_control_skipped += 1;
+    base_control_bytes_saved += base_control_size;
+  }
+
+  unsigned long bytes_received;
+  unsigned long bytes_sent;
+  unsigned long packets_sent;
+  unsigned long base_control_sent;
+  unsigned long base_control_skipped;
+  unsigned long base_control_bytes_saved;
+
+private:
+  unsigned int base_control_size; // bytes in the last base control packet
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_LINK_STATISTICS_HPP_ */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/motion_primitive.hpp
+ *
+ * @brief Closed loop rotations, translations and arcs.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_MOTION_PRIMITIVE_HPP_
+#define KOBUKI_MOTION_PRIMITIVE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <stdint.h>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Drives a distance and/or turns an angle, closed on the sensors.
+ *
+ * Every primitive is a (distance, angle) pair: a rotation has no distance,
+ * a translation no angle and an arc both, with the heading following the
+ * distance travelled. The dominant axis (distance when there is one) runs
+ * a trapezoidal profile on the remaining error, measured from the encoders
+ * or the gyro every frame, so the motion lands on target instead of
+ * relying on timing. On an arc the other axis follows the curvature, with
+ * a proportional correction of the heading error. Arcs and translations
+ * only succeed once the heading is within tolerance too; any heading
+ * still missing when the distance is covered is turned on the spot.
+ *
+ * A primitive that has not finished within twice its planned duration,
+ * plus a second, times out.
+ **/
+class MotionPrimitive {
+public:
+  struct Limits {
+    Limits(const double &linear_velocity = 0.2, const double &angular_velocity = 1.0,
+           const double &linear_acceleration = 0.5, const double &angular_acceleration = 2.0,
+           const double &distance_tolerance = 0.005, const double &angle_tolerance = 0.01,
+           const double &heading_gain = 2.0) :
+      linear_velocity(linear_velocity), angular_velocity(angular_velocity),
+      linear_acceleration(linear_acceleration), angular_acceleration(angular_acceleration),
+      distance_tolerance(distance_tolerance), angle_tolerance(angle_tolerance),
+      heading_gain(heading_gain) {}
+    double linear_velocity;      /**< [m/s] cruising speed **/
+    double angular_velocity;     /**< [rad/s] cruising rate **/
+    double linear_acceleration;  /**< [m/s^2] used both speeding up and slowing down **/
+    double angular_acceleration; /**< [rad/s^2] used both speeding up and slowing down **/
+    double distance_tolerance;   /**< [m] close enough to the target distance **/
+    double angle_tolerance;      /**< [rad] close enough to the target angle **/
+    double heading_gain;         /**< [1/s] heading error correction on arcs and translations **/
+  };
+
+  enum Status {
+    Idle,       /**< nothing to execute **/
+    Running,    /**< under way **/
+    Succeeded,  /**< target reached within tolerance **/
+    Aborted,    /**< cancelled before reaching the target **/
+    TimedOut    /**< target not reached in time **/
+  };
+
+  /**
+   * @brief How a primitive ended.
+   */
+  struct Result {
+    Result() : status(Idle), distance(0.0), angle(0.0), duration(0.0) {}
+    Status status;
+    double distance; /**< [m] travelled **/
+    double angle;    /**< [rad] turned **/
+    double duration; /**< [s] from start to the end **/
+  };
+
+  MotionPrimitive();
+  void init(const Limits &limits);
+  bool start(const double &distance, const double &angle, const double &resolution, const double &time);
+  void feedback(const double &heading, const uint16_t &left_encoder, const uint16_t &right_encoder);
+  Status command(const double &time, const double &period, double &linear_velocity, double &angular_velocity);
+  void cancel();
+
+  bool isRunning() const { return status == Running; }
+  Result result() const;
+
+  static std::string toString(const Status &status);
+
+private:
+  static double profile(const double &remaining, const double &last_command, const double &period,
+                        const double &speed, const double &acceleration);
+  double travelled() const;
+  void finish(const Status &final_status);
+
+  Limits limits;
+  Status status;
+  bool report; // the current status has not been returned by command() yet
+  bool rotation; // the angle, not the distance, is the dominant axis
+  double target_distance, target_angle;
+  double tick_to_metre;
+  double start_time, deadline, last_time;
+  double linear_command, angular_command; // last commanded [m/s, rad/s]
+
+  bool has_baseline;
+  uint16_t last_left, last_right;
+  double last_heading;
+  long ticks_left, ticks_right; // accumulated since the start
+  double turned; // [rad] accumulated since the start
+
+  Result last_result;
+  mutable ecl::Mutex mutex; // primitives arrive on user threads, feedback and commands come from the driver thread
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_MOTION_PRIMITIVE_HPP_ */
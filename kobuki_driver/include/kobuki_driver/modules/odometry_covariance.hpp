@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/odometry_covariance.hpp
+ *
+ * @brief Online odometry covariance propagation with slip detection.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_ODOMETRY_COVARIANCE_HPP_
+#define KOBUKI_ODOMETRY_COVARIANCE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <ecl/geometry/pose2d.hpp>
+#include <ecl/linear_algebra.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Propagates the (x, y, heading) covariance of the dead reckoned pose.
+ *
+ * Each frame adds noise proportional to the distance and rotation travelled,
+ * pushed through the motion model jacobians. That noise is inflated by a
+ * slip score built from sensors that should agree with the encoders:
+ *
+ * - the gyro rate against the yaw rate measured by the wheels,
+ * - each wheel's pwm and motor current against the effort it normally
+ *   takes to turn it at that speed (learned online while the gyro agrees).
+ *
+ * The propagation starts from small non-zero variances, and the published
+ * covariance has floors on its diagonal so it stays positive definite while
+ * standing still. The heading floor defaults to a very large value, as the
+ * gyro (imu) is the better heading source for filters like robot_pose_ekf.
+ **/
+class OdometryCovariance {
+public:
+  OdometryCovariance();
+  void init(const double &distance_noise, const double &rotation_noise, const double &drift_noise,
+            const double &slip_gain, const double &heading_variance);
+  void reset();
+  void update(const double &heading,
+              const ecl::Pose2D<double> &pose_update,
+              const ecl::linear_algebra::Vector3d &twist,
+              const double &gyro_rate,
+              const double &wheel_rate_left, const double &wheel_rate_right,
+              const double &pwm_left, const double &pwm_right,
+              const double &current_left, const double &current_right);
+
+  const ecl::linear_algebra::Matrix3d& poseCovariance() const { return published_covariance; } /**< x, y, heading, with floors on the diagonal **/
+  const ecl::linear_algebra::Vector3d& twistVariance() const { return twist_variance; } /**< vx, vy, wz **/
+  double slip() const { return slip_score; } /**< 0 when all sensors agree, grows with disagreement. **/
+
+private:
+  /**
+   * @brief Learned ratio between a motor's effort (pwm or current) and its wheel speed.
+   */
+  class EffortModel {
+  public:
+    EffortModel(const double &tolerance) : ratio(0.0), learned(false), tolerance(tolerance) {}
+    void learn(const double &effort, const double &rate);
+    double mismatch(const double &effort, const double &rate) const;
+  private:
+    double ratio;
+    bool learned;
+    double tolerance; // effort difference not considered suspicious
+  };
+
+  void publish();
+
+  double distance_noise; // [m^2/m] translational variance per metre travelled
+  double rotation_noise; // [rad^2/rad] heading variance per radian turned
+  double drift_noise;    // [rad^2/m] heading variance per metre travelled
+  double heading_variance; // [rad^2] floor on the published heading variance
+  double slip_gain;      // noise multiplier per unit of slip score
+  double slip_score;
+  EffortModel pwm_left_model, pwm_right_model, current_left_model, current_right_model;
+  ecl::linear_algebra::Matrix3d pose_covariance;
+  ecl::linear_algebra::Matrix3d published_covariance;
+  ecl::linear_algebra::Vector3d twist_variance;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_ODOMETRY_COVARIANCE_HPP_ */
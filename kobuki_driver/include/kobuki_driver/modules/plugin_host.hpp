@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/plugin_host.hpp
+ *
+ * @brief Runs small controllers inside the driver, once per frame.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_PLUGIN_HOST_HPP_
+#define KOBUKI_PLUGIN_HOST_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <ecl/threads/mutex.hpp>
+#include "../event_manager.hpp"
+#include "../packets/core_sensors.hpp"
+#include "../packets/cliff.hpp"
+#include "../packets/dock_ir.hpp"
+#include "../packets/inertia.hpp"
+#include "../packets/gp_input.hpp"
+#include "led_array.hpp"
+#include "sound.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interface [PluginHost]
+*****************************************************************************/
+
+/**
+ * @brief Hosts controllers that run in the driver at the stream rate.
+ *
+ * Reactive behaviours (bump and blink, safety stops, ...) normally sit in
+ * separate nodes, one or two ros hops from the driver. Registered here
+ * instead, a plugin sees every decoded frame and its events on the thread
+ * that processes frames, and answers with commands that go out with the
+ * frame's own base control packet: a 50Hz closed loop without any ipc.
+ *
+ * Plugins run in order of descending priority, all of them every frame.
+ * Each command channel (velocity, each led, sound) goes to the first
+ * plugin to claim it in a frame, so higher priorities win. The velocity
+ * enters the driver's velocity multiplexer as the "plugins" input, at
+ * Parameters::plugin_priority: multiplexed inputs ranked above it (e.g. a
+ * safety controller) beat the plugins, those below are beaten. It is ramped
+ * by the velocity smoother like any other target and dropped as soon as no
+ * plugin sets one. Motion primitives, trajectories and the driver's safety
+ * reflex still override it, though a plugin that means to bump into things
+ * (e.g. a dock) can claim the bumper to keep the reflex off it for a frame.
+ * Leds only go out when the plugins ask for a colour other than the one
+ * they last asked for.
+ *
+ * Plugins are not preempted. Each has a time budget, and runs that exceed
+ * it are counted as overruns in the statistics.
+ **/
+class PluginHost {
+public:
+  /**
+   * @brief The frame a plugin runs on. Valid only for the duration of the call.
+   */
+  struct Feedback {
+    Feedback(const double &time, const double &heading, const double &travel_resolution,
+             const CoreSensors::Data &core_sensors, const Cliff::Data &cliff,
+             const DockIR::Data &dock_ir, const Inertia::Data &inertia, const GpInput::Data &gp_input,
+             const EventBatch &events) :
+      time(time), heading(heading), travel_resolution(travel_resolution), core_sensors(core_sensors),
+      cliff(cliff), dock_ir(dock_ir), inertia(inertia), gp_input(gp_input), events(events) {}
+    const double time; /**< Host time [s] the firmware stamped the frame. **/
+    const double heading; /**< [rad] the driver's heading, gyro bias corrected when estimated (see Kobuki::getHeading). **/
+    const double travel_resolution; /**< [m/tick] calibrated wheel travel per encoder tick. **/
+    const CoreSensors::Data &core_sensors;
+    const Cliff::Data &cliff;
+    const DockIR::Data &dock_ir;
+    const Inertia::Data &inertia;
+    const GpInput::Data &gp_input;
+    const EventBatch &events; /**< Events raised by this frame. **/
+  };
+
+  /**
+   * @brief Commands merged from the plugins, first claim wins.
+   *
+   * Once collected, has_led marks only the leds the plugins asked to
+   * change, so each can go out as is.
+   */
+  class Commands {
+  public:
+    Commands() { clear(); }
+    bool setVelocity(const double &linear, const double &angular);
+    bool setLed(const LedNumber &number, const LedColour &colour);
+    bool playSoundSequence(const SoundSequences &sequence);
+    void claimBumper() { claims_bumper = true; } /**< This frame's bumps are the plugin's business, not the safety reflex'. **/
+    void clear();
+    bool empty() const { return !has_velocity && !has_led[Led1] && !has_led[Led2] && !has_sound; }
+
+    bool has_velocity;
+    double linear_velocity;  /**< [m/s] **/
+    double angular_velocity; /**< [rad/s] **/
+    bool has_led[2];
+    LedColour led_colours[2];
+    bool has_sound;
+    SoundSequences sound;
+    bool claims_bumper;
+  };
+
+  class Plugin {
+  public:
+    virtual ~Plugin() {}
+    /**
+     * @brief Called on every frame, with the commands claimed so far.
+     *
+     * Must not add or remove plugins.
+     */
+    virtual void update(const Feedback &feedback, Commands &commands) = 0;
+    /**
+     * @brief Called when the driver is disabled, to drop whatever is in progress.
+     *
+     * Must not add or remove plugins.
+     */
+    virtual void cancel() {}
+  };
+
+  /**
+   * @brief Per plugin run times [s] against the budget.
+   */
+  struct Statistics {
+    Statistics() : priority(0), budget(0.0), runs(0), overruns(0), last(0.0), mean(0.0), maximum(0.0) {}
+    std::string name;
+    int priority;
+    double budget;
+    unsigned long runs, overruns;
+    double last, mean, maximum;
+  };
+
+  PluginHost();
+
+  bool add(const boost::shared_ptr<Plugin> &plugin, const std::string &name,
+           const int &priority = 0, const double &budget = 0.001);
+  bool remove(const std::string &name);
+  bool empty() const;
+
+  void run(const Feedback &feedback);
+  bool bumperClaimed() const;
+  void cancel();
+  bool collect(Commands &commands);
+  std::vector<Statistics> statistics() const;
+
+private:
+  struct Entry {
+    boost::shared_ptr<Plugin> plugin;
+    Statistics statistics;
+  };
+
+  std::vector<Entry> plugins; // by descending priority
+  Commands commands;          // merged by the latest run, until collected
+  bool bumper_claimed;        // by a plugin in the latest run
+  bool has_led_request[2];    // whether the plugins ever asked for a colour...
+  LedColour led_requests[2];  // ...and the one they last asked for
+  mutable ecl::Mutex mutex;   // plugins are added from user threads, commands collected from the worker thread
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_PLUGIN_HOST_HPP_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/pose_history.hpp
+ *
+ * @brief Time indexed ring of odometry poses with interpolated lookups.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_POSE_HISTORY_HPP_
+#define KOBUKI_POSE_HISTORY_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <ecl/geometry/pose2d.hpp>
+#include <ecl/linear_algebra.hpp>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Fixed capacity history of timestamped poses and twists.
+ *
+ * Stamps are expected to increase monotonically (they come from the
+ * synchronised firmware clock), which lets lookups binary search the ring.
+ * Poses between two entries are interpolated along the SE(2) geodesic
+ * (constant twist), twists linearly.
+ *
+ * Safe to query from other threads while the driver thread is adding to it.
+ **/
+class PoseHistory {
+public:
+  PoseHistory(const unsigned int &capacity = 500);
+  void init(const unsigned int &capacity);
+  void clear();
+  void add(const double &time, const ecl::Pose2D<double> &pose, const ecl::linear_algebra::Vector3d &twist);
+  bool lookup(const double &time, ecl::Pose2D<double> &pose, ecl::linear_algebra::Vector3d &twist) const;
+  bool timeRange(double &oldest, double &newest) const;
+  unsigned int size() const { return count; }
+
+private:
+  struct Entry {
+    double time;
+    double x, y, heading;
+    double vx, vy, wz;
+  };
+  const Entry& at(const unsigned int &index) const { return ring[(first + index) % ring.size()]; } // oldest first
+  static void interpolate(const Entry &a, const Entry &b, const double &alpha, Entry &result);
+
+  std::vector<Entry> ring;
+  unsigned int first, count;
+  mutable ecl::Mutex mutex;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_POSE_HISTORY_HPP_ */
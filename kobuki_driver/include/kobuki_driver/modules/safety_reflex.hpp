@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/safety_reflex.hpp
+ *
+ * @brief Stops or backs off the base on the frame reporting a hazard.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SAFETY_REFLEX_HPP_
+#define KOBUKI_SAFETY_REFLEX_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <stdint.h>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Overrides base control when a bumper, cliff or wheel drop sensor fires.
+ *
+ * Runs on every frame, on the raw core sensor flags, so the override goes
+ * out with the frame that reported the hazard rather than after a round
+ * trip through the event signals and a ros controller. Each sensor can be
+ * ignored, stop the base or back it off:
+ *
+ * - stop holds zero velocity until the sensor clears,
+ * - back off reverses at a fixed speed for a fixed time, then holds zero
+ *   velocity until the sensor clears.
+ *
+ * A stop from any sensor wins over a back off. Once released, the base
+ * stays still until the user commands it again.
+ *
+ * The reaction time, from the firmware's stamp on the triggering frame to
+ * the overriding command leaving the host, is recorded.
+ **/
+class SafetyReflex {
+public:
+  enum Action {
+    Ignore,
+    BackOff,
+    Stop // strongest last
+  };
+
+  enum State {
+    Idle,
+    Stopped,
+    BackingOff
+  };
+
+  /**
+   * @brief Per sensor reactions and the back off profile.
+   */
+  struct Settings {
+    Settings() : enable(false), bumper(BackOff), cliff(BackOff), wheel_drop(Stop),
+                 backoff_speed(0.1), backoff_time(0.5) {}
+    bool enable;
+    Action bumper, cliff, wheel_drop;
+    double backoff_speed; /**< [m/s] reversing speed, positive **/
+    double backoff_time;  /**< [s] how long to reverse for **/
+  };
+
+  /**
+   * @brief Trigger to override latency statistics [s].
+   */
+  struct Reaction {
+    Reaction() : triggers(0), count(0), last(0.0), mean(0.0), maximum(0.0) {}
+    unsigned int triggers; /**< times the reflex fired **/
+    unsigned int count;    /**< reactions measured **/
+    double last, mean, maximum;
+  };
+
+  SafetyReflex();
+  void init(const Settings &settings);
+  void reset();
+
+  bool update(const uint8_t &bumper, const uint8_t &cliff, const uint8_t &wheel_drop, const double &frame_time);
+  bool override(double &linear_velocity, double &angular_velocity);
+  void commandSent(const double &time);
+
+  bool isEnabled() const { return settings.enable; }
+  State state() const { return current_state; }
+  const std::string& cause() const { return trigger; } /**< Sensor behind the latest trigger. **/
+  const Reaction& reaction() const { return reaction_statistics; }
+
+  static bool fromString(const std::string &name, Action &action);
+  static std::string toString(const Action &action);
+
+private:
+  Settings settings;
+  State current_state;
+  double backoff_end;   // host [s]
+  bool reacting;        // waiting for the override to be sent
+  double trigger_time;  // host [s] of the triggering frame
+  std::string trigger;
+  Reaction reaction_statistics;
+  ecl::Mutex mutex; // updated on the processing thread, sent from the worker thread when scheduled
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_SAFETY_REFLEX_HPP_ */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/trajectory_buffer.hpp
+ *
+ * @brief Buffers short velocity trajectories and samples them each cycle.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_TRAJECTORY_BUFFER_HPP_
+#define KOBUKI_TRAJECTORY_BUFFER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Executes time parameterised velocity trajectories.
+ *
+ * A planner streaming (v, w) in real time passes its publishing jitter on
+ * to the motion. Instead it can hand over a second or two of (t, v, w)
+ * samples at once; the driver then interpolates them exactly at each
+ * firmware cycle.
+ *
+ * A trajectory runs from its start time plus its first sample's time to
+ * its start time plus its last sample's time. A newer trajectory preempts
+ * the running one as soon as its own first sample is due, so planners can
+ * send overlapping horizons and have them spliced seamlessly. When the
+ * last trajectory runs out, sample() reports it once as finished.
+ *
+ * Samples must be finite and, between consecutive samples, stay within the
+ * accelerations given to init(); the sampled velocities are still only
+ * targets for the velocity smoother.
+ **/
+class TrajectoryBuffer {
+public:
+  struct Sample {
+    Sample(const double &time = 0.0, const double &linear_velocity = 0.0, const double &angular_velocity = 0.0) :
+      time(time), linear_velocity(linear_velocity), angular_velocity(angular_velocity) {}
+    double time;             /**< [s] since the trajectory's start **/
+    double linear_velocity;  /**< [m/s] **/
+    double angular_velocity; /**< [rad/s] **/
+  };
+
+  enum Result {
+    Idle,     /**< no trajectory is due **/
+    Running,  /**< velocities sampled from a trajectory **/
+    Finished  /**< the last trajectory just ran out **/
+  };
+
+  /**
+   * @brief Trajectory counts, for introspection.
+   */
+  struct Statistics {
+    Statistics() : received(0), rejected(0), preempted(0), completed(0), cancelled(0) {}
+    unsigned long received, rejected, preempted, completed, cancelled;
+  };
+
+  TrajectoryBuffer();
+  void init(const double &linear_acceleration, const double &angular_acceleration);
+  bool set(const double &start, const std::vector<Sample> &samples);
+  Result sample(const double &time, double &linear_velocity, double &angular_velocity);
+  void cancel();
+
+  bool isRunning() const { return running; }
+  Statistics statistics() const;
+
+private:
+  double linear_acceleration, angular_acceleration; // [m/s^2, rad/s^2] zero for unlimited
+  std::vector<Sample> current, pending; // absolute host times [s]
+  bool running, has_pending;
+  unsigned int cursor; // segment of current being sampled
+  Statistics counts;
+  mutable ecl::Mutex mutex; // trajectories arrive on user threads, sampling happens on the driver thread
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_TRAJECTORY_BUFFER_HPP_ */
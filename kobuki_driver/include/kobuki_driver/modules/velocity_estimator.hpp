@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/velocity_estimator.hpp
+ *
+ * @brief Sliding window velocity estimator for the wheel encoders.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_VELOCITY_ESTIMATOR_HPP_
+#define KOBUKI_VELOCITY_ESTIMATOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Least squares slope over the last few (time, position) samples.
+ *
+ * Differencing a single encoder tick delta over a single firmware time stamp
+ * delta is badly quantised. Fitting a line through a window of samples
+ * trades a little latency (roughly half the window) for a lot less noise.
+ * A window of two samples reproduces plain differencing.
+ *
+ * Samples sharing the newest time stamp replace it rather than being
+ * appended, so repeated stamps never produce a zero time base.
+ **/
+class VelocityEstimator {
+public:
+  VelocityEstimator(const unsigned int &window = 5);
+  void init(const unsigned int &window);
+  void reset();
+  void update(const double &time, const double &position);
+  double velocity() const { return rate; } /**< Latest estimate [position units/s]. **/
+  unsigned int window() const { return capacity; }
+
+private:
+  std::vector<double> times, positions; // ring buffers
+  unsigned int capacity, newest, count;
+  double rate;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_VELOCITY_ESTIMATOR_HPP_ */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/velocity_mux.hpp
+ *
+ * @brief Selects one of several prioritised velocity command inputs.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_VELOCITY_MUX_HPP_
+#define KOBUKI_VELOCITY_MUX_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <vector>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Velocity command multiplexer.
+ *
+ * Replaces an external cmd_vel mux in front of the driver. Each named input
+ * has a priority and a timeout; once per feedback cycle the most recent
+ * command of the highest priority input that is still active is selected.
+ * An input is active from its first command until it has been silent for
+ * longer than its timeout (a timeout of zero or less never expires).
+ * Priorities should be unique; ties go to the input registered first.
+ **/
+class VelocityMux {
+public:
+  /**
+   * @brief An input's configuration and its latest command.
+   */
+  struct Input {
+    Input(const std::string &name = "", const int &priority = 0, const double &timeout = 0.0) :
+      name(name), priority(priority), timeout(timeout),
+      commands(0), released(false), linear_velocity(0.0), angular_velocity(0.0), last_active(0.0) {}
+    bool isActive(const double &now) const {
+      return ( commands > 0 ) && !released && ( ( timeout <= 0.0 ) || ( now - last_active <= timeout ) );
+    }
+    std::string name;
+    int priority;
+    double timeout;          /**< [s] silence before the input is dropped **/
+    unsigned long commands;  /**< commands received **/
+    bool released;           /**< dropped by release() until its next command **/
+    double linear_velocity;  /**< [m/s] latest command **/
+    double angular_velocity; /**< [rad/s] latest command **/
+    double last_active;      /**< host time [s] of the latest command **/
+  };
+
+  VelocityMux();
+  int add(const std::string &name, const int &priority, const double &timeout);
+  bool set(const unsigned int &input, const double &linear_velocity, const double &angular_velocity,
+           const double &time);
+  bool release(const unsigned int &input);
+  void clear();
+  bool select(const double &now, double &linear_velocity, double &angular_velocity);
+
+  bool empty() const;
+  int selected() const;
+  std::vector<Input> status() const;
+
+private:
+  std::vector<Input> inputs;
+  int selected_input;
+  unsigned long selected_commands; // commands the selected input had at the last selection
+  mutable ecl::Mutex mutex; // commands arrive on user threads, selection happens on the driver thread
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_VELOCITY_MUX_HPP_ */
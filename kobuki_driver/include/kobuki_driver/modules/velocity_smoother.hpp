@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/velocity_smoother.hpp
+ *
+ * @brief Acceleration and jerk limited velocity smoother.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_VELOCITY_SMOOTHER_HPP_
+#define KOBUKI_VELOCITY_SMOOTHER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Limits the rate of change of the commanded (v, w).
+ *
+ * Runs once per feedback cycle on the linear and angular velocities before
+ * they are converted to the firmware's speed/radius command. Each axis is
+ * limited independently:
+ *
+ * - acceleration while speeding up, deceleration while slowing down
+ *   (including the slowing down half of a direction reversal),
+ * - jerk, i.e. how quickly the acceleration itself may change; the
+ *   acceleration is ramped down in time to land on the target smoothly,
+ * - an emergency deceleration, without jerk limiting, for emergencyStop().
+ *
+ * A limit that is zero or negative is treated as unlimited.
+ **/
+class VelocitySmoother {
+public:
+  struct Limits {
+    Limits(const double &acceleration = 0.0, const double &deceleration = 0.0,
+           const double &emergency_deceleration = 0.0, const double &jerk = 0.0) :
+      acceleration(acceleration), deceleration(deceleration),
+      emergency_deceleration(emergency_deceleration), jerk(jerk) {}
+    double acceleration;           /**< [units/s^2] while speeding up **/
+    double deceleration;           /**< [units/s^2] while slowing down **/
+    double emergency_deceleration; /**< [units/s^2] while executing an emergency stop **/
+    double jerk;                   /**< [units/s^3] rate of change of the acceleration **/
+  };
+
+  VelocitySmoother();
+  void init(const bool &enable, const Limits &linear_limits, const Limits &angular_limits);
+  void setTarget(const double &linear_velocity, const double &angular_velocity);
+  void emergencyStop();
+  void track(const double &linear_velocity, const double &angular_velocity);
+  void reset();
+  void update(const double &dt);
+
+  bool isEnabled() const { return is_enabled; }
+  double linearVelocity() const;
+  double angularVelocity() const;
+
+private:
+  /**
+   * @brief Smoothing state for a single velocity axis.
+   */
+  struct Axis {
+    Axis() : target(0.0), value(0.0), acceleration(0.0) {}
+    void step(const double &dt, const Limits &limits, const bool &emergency);
+    double target, value, acceleration;
+  };
+
+  bool is_enabled;
+  bool emergency;
+  Limits linear_limits, angular_limits;
+  Axis linear, angular;
+  mutable ecl::Mutex mutex; // targets are set from user threads, updated on the driver thread
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_VELOCITY_SMOOTHER_HPP_ */
@@ -61,9 +61,19 @@ class DockIR : public packet_handler::payloadBase
 public:
   struct Data {
     Data() : docking(3) {}
-    std::vector<uint8_t> docking;
+    std::vector<uint8_t> docking; /**< right, central and left receivers **/
   } data;
 
+  // beams of the dock each receiver picks up, left and right as seen from the dock
+  struct Flags {
+    static const uint8_t NearLeft   = 0x01;
+    static const uint8_t NearCenter = 0x02;
+    static const uint8_t NearRight  = 0x04;
+    static const uint8_t FarCenter  = 0x08;
+    static const uint8_t FarLeft    = 0x10;
+    static const uint8_t FarRight   = 0x20;
+  };
+
   bool serialise(ecl::PushAndPop<unsigned char> & byteStream)
   {
     if (!(byteStream.size() > 0))
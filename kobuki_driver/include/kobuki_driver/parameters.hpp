@@ -43,7 +43,13 @@
  *****************************************************************************/
 
 #include <string>
+#include <boost/shared_ptr.hpp>
 #include "modules/battery.hpp"
+#include "modules/velocity_smoother.hpp"
+#include "modules/safety_reflex.hpp"
+#include "modules/motion_primitive.hpp"
+#include "reactor.hpp"
+#include "event_manager.hpp"
 
 /*****************************************************************************
  ** Namespaces
@@ -63,20 +69,77 @@ class Parameters
 public:
   Parameters() :
     simulation(false),
-    enable_gate_keeper(true),
+    enable_processing_thread(false),
+    frame_queue_size(16),
+    enable_velocity_smoother(false),
+    linear_limits(0.5, 0.8, 2.0, 5.0),
+    angular_limits(3.0, 4.0, 10.0, 30.0),
+    enable_command_scheduling(false),
+    command_lead(0.005),
+    enable_change_driven_commands(false),
+    command_keepalive(0.1),
+    plugin_priority(0),
+    handshake_attempts(10),
+    handshake_retry_interval(0.2),
+    handshake_timeout(5.0),
+    enable_gyro_bias_estimation(true),
+    gyro_bias_settle_time(0.5),
+    gyro_bias_memory(60.0),
+    gyro_bias_cached_weight(5.0),
+    velocity_window(5),
+    dock_ir_window(25),
+    pose_history_size(500),
+    odometry_distance_noise(0.01),
+    odometry_rotation_noise(0.05),
+    odometry_drift_noise(0.01),
+    odometry_slip_gain(20.0),
+    odometry_heading_variance(1e6),
     battery_capacity(Battery::capacity),
     battery_low(Battery::low),
     battery_dangerous(Battery::dangerous)
   {
   }
 
-  std::string device_port;         /**< For the serial device, a port (e.g. "/dev/ttyUSB0") **/
+  std::string device_port;         /**< A serial port (e.g. "/dev/ttyUSB0") or transport uri (e.g. "tcp://host:port", see Transport) **/
+  std::string record_file;         /**< Record incoming bytes here for later replay, empty to disable. **/
+  boost::shared_ptr<Reactor> reactor; /**< Serve the driver from this (shared) reactor rather than its own thread, null for a thread. **/
   std::string sigslots_namespace;  /**< this should match the kobuki-node namespace **/
+  std::string cache_directory;     /**< Where to remember robots' identity and calibration between runs, empty to disable. **/
   bool simulation;                 /**< whether to put the motors in loopback mode or not **/
-  bool enable_gate_keeper;
+  bool enable_processing_thread;   /**< Decode and signal on a second thread, leaving the worker thread to read and frame. **/
+  int frame_queue_size;            /**< Frames buffered between the worker and processing threads. **/
+  bool enable_velocity_smoother;   /**< Acceleration and jerk limit the commanded velocities. **/
+  VelocitySmoother::Limits linear_limits;  /**< Smoother limits on the linear velocity [m/s^2, m/s^3]. **/
+  VelocitySmoother::Limits angular_limits; /**< Smoother limits on the angular velocity [rad/s^2, rad/s^3]. **/
+  bool enable_command_scheduling;  /**< Send base control just before the firmware's control tick rather than on frame arrival. **/
+  double command_lead;             /**< Time [s] ahead of the firmware's control tick to send base control. **/
+  bool enable_change_driven_commands; /**< Only send base control when it changes or the keepalive expires. **/
+  double command_keepalive;        /**< Longest interval [s] between base control commands in change driven mode. **/
+  int plugin_priority;             /**< Rank of plugin velocities among the multiplexed velocity inputs, see PluginHost. **/
+  int handshake_attempts;          /**< Version info requests made before giving up on the handshake. **/
+  double handshake_retry_interval; /**< Time [s] between version info requests. **/
+  double handshake_timeout;        /**< Time [s] before giving up on the handshake, however many attempts remain. **/
+  bool enable_gyro_bias_estimation; /**< Estimate the gyro bias while stationary and correct the heading. **/
+  double gyro_bias_settle_time;    /**< Time [s] the robot must be still before measuring gyro drift. **/
+  double gyro_bias_memory;         /**< Maximum evidence [s] retained by the gyro bias estimate. **/
+  double gyro_bias_cached_weight;  /**< Evidence [s] a gyro bias from the device cache starts with. **/
+  int velocity_window;             /**< Frames the wheel velocity estimate is fitted over (2 = plain differencing). **/
+  int dock_ir_window;              /**< Frames of dock infrared readings the dock bearing is filtered over. **/
+  int pose_history_size;           /**< Frames of odometry kept for time indexed pose lookups. **/
+  double odometry_distance_noise;  /**< Odometry variance added per metre travelled [m^2/m]. **/
+  double odometry_rotation_noise;  /**< Odometry heading variance added per radian turned [rad^2/rad]. **/
+  double odometry_drift_noise;     /**< Odometry heading variance added per metre travelled [rad^2/m]. **/
+  double odometry_slip_gain;       /**< Noise multiplier per unit of detected wheel slip. **/
+  double odometry_heading_variance; /**< Floor on the published odometry heading variance [rad^2], large to defer to the gyro. **/
   double battery_capacity;         /**< Capacity voltage of the battery **/
   double battery_low;              /**< Low level warning for battery level. **/
   double battery_dangerous;        /**< Battery in imminent danger of running out. **/
+  EventManager::Debounce bumper_debounce;     /**< Frames/time a bumper change must hold before its event. **/
+  EventManager::Debounce cliff_debounce;      /**< Frames/time a cliff change must hold before its event. **/
+  EventManager::Debounce wheel_drop_debounce; /**< Frames/time a wheel drop change must hold before its event. **/
+  EventManager::Hysteresis cliff_hysteresis;  /**< Cliff events from the analog readings with a hysteresis band, rather than the firmware flags. **/
+  SafetyReflex::Settings safety_reflex;       /**< Stop or back off in the driver on the frame a bumper, cliff or wheel drop fires. **/
+  MotionPrimitive::Limits motion_limits;      /**< Speeds, accelerations and tolerances of rotations, translations and arcs. **/
 
 
   /**
@@ -87,7 +150,94 @@ public:
    */
   bool validate()
   {
-    // not doing anything right now -  delete it, if we can find a use case ...
+    if ( ( gyro_bias_settle_time < 0.0 ) || ( gyro_bias_memory <= 0.0 ) || ( gyro_bias_cached_weight < 0.0 ) ) {
+      error_msg = "gyro bias settle time and cached weight cannot be negative and its memory must be greater than zero.";
+      return false;
+    }
+    if ( pose_history_size < 2 ) {
+      error_msg = "pose history must hold at least two frames.";
+      return false;
+    }
+    if ( ( odometry_distance_noise < 0.0 ) || ( odometry_rotation_noise < 0.0 ) || ( odometry_drift_noise < 0.0 ) ||
+         ( odometry_slip_gain < 0.0 ) || ( odometry_heading_variance < 0.0 ) ) {
+      error_msg = "odometry noise parameters cannot be negative.";
+      return false;
+    }
+    if ( enable_velocity_smoother &&
+         ( ( linear_limits.acceleration <= 0.0 ) || ( linear_limits.deceleration <= 0.0 ) ||
+           ( angular_limits.acceleration <= 0.0 ) || ( angular_limits.deceleration <= 0.0 ) ) ) {
+      error_msg = "velocity smoother accelerations and decelerations must be greater than zero.";
+      return false;
+    }
+    if ( enable_velocity_smoother &&
+         ( ( linear_limits.emergency_deceleration < linear_limits.deceleration ) ||
+           ( angular_limits.emergency_deceleration < angular_limits.deceleration ) ) ) {
+      error_msg = "velocity smoother emergency deceleration must be at least the normal deceleration.";
+      return false;
+    }
+    if ( ( command_lead < 0.0 ) || ( command_lead >= 0.02 ) ) {
+      error_msg = "command lead must lie within a single 20ms feedback cycle.";
+      return false;
+    }
+    // the firmware treats a silent link as lost, keep well inside that
+    if ( ( command_keepalive < 0.02 ) || ( command_keepalive > 0.5 ) ) {
+      error_msg = "command keepalive must lie between one feedback cycle (0.02s) and 0.5s.";
+      return false;
+    }
+    if ( ( handshake_attempts < 1 ) || ( handshake_retry_interval < 0.0 ) || ( handshake_timeout <= 0.0 ) ) {
+      error_msg = "handshake needs at least one attempt, a non-negative retry interval and a positive timeout.";
+      return false;
+    }
+    if ( enable_processing_thread && ( frame_queue_size < 2 ) ) {
+      error_msg = "frame queue must hold at least two frames.";
+      return false;
+    }
+    if ( enable_processing_thread && reactor ) {
+      error_msg = "a separate processing thread is not available to drivers served by a reactor.";
+      return false;
+    }
+    if ( ( bumper_debounce.frames < 0 ) || ( bumper_debounce.time < 0.0 ) ||
+         ( cliff_debounce.frames < 0 ) || ( cliff_debounce.time < 0.0 ) ||
+         ( wheel_drop_debounce.frames < 0 ) || ( wheel_drop_debounce.time < 0.0 ) ) {
+      error_msg = "event debounce frames and times cannot be negative.";
+      return false;
+    }
+    // a 16 bit firmware clock measures the time held
+    if ( ( bumper_debounce.time > 60.0 ) || ( cliff_debounce.time > 60.0 ) || ( wheel_drop_debounce.time > 60.0 ) ) {
+      error_msg = "event debounce times must be under a minute.";
+      return false;
+    }
+    if ( cliff_hysteresis.enable && ( cliff_hysteresis.cliff_below >= cliff_hysteresis.floor_above ) ) {
+      error_msg = "cliff hysteresis needs its cliff threshold below its floor threshold.";
+      return false;
+    }
+    if ( safety_reflex.enable &&
+         ( ( safety_reflex.backoff_speed <= 0.0 ) || ( safety_reflex.backoff_speed > 0.3 ) ) ) {
+      error_msg = "safety reflex back off speed must lie between 0 and 0.3m/s.";
+      return false;
+    }
+    if ( safety_reflex.enable && ( ( safety_reflex.backoff_time < 0.0 ) || ( safety_reflex.backoff_time > 5.0 ) ) ) {
+      error_msg = "safety reflex back off time must lie between 0 and 5s.";
+      return false;
+    }
+    if ( ( motion_limits.linear_velocity <= 0.0 ) || ( motion_limits.angular_velocity <= 0.0 ) ||
+         ( motion_limits.linear_acceleration <= 0.0 ) || ( motion_limits.angular_acceleration <= 0.0 ) ) {
+      error_msg = "motion primitive speeds and accelerations must be greater than zero.";
+      return false;
+    }
+    if ( ( motion_limits.distance_tolerance <= 0.0 ) || ( motion_limits.angle_tolerance <= 0.0 ) ||
+         ( motion_limits.heading_gain < 0.0 ) ) {
+      error_msg = "motion primitive tolerances must be greater than zero and its heading gain non-negative.";
+      return false;
+    }
+    if ( velocity_window < 2 ) {
+      error_msg = "velocity window must span at least two frames.";
+      return false;
+    }
+    if ( dock_ir_window < 1 ) {
+      error_msg = "dock ir window must span at least one frame.";
+      return false;
+    }
     return true;
   }
 
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/reactor.hpp
+ *
+ * @brief Event loop serving many drivers from a few threads.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_REACTOR_HPP_
+#define KOBUKI_REACTOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <stdint.h>
+#include <semaphore.h>
+#include <boost/shared_ptr.hpp>
+#include <ecl/threads.hpp>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interface [Reactor]
+*****************************************************************************/
+
+/**
+ * @brief An epoll loop (or a small pool of them) multiplexing driver instances.
+ *
+ * Instead of each Kobuki blocking in its own worker thread, every client
+ * registers its descriptor and a timerfd with one epoll set. A pool of
+ * threads waits on that set; readable() is called when bytes arrive and
+ * service() when the client's timer expires. service() returns how long
+ * until it next wants to be called (command deadlines, watchdog, reconnection
+ * attempts), and the reactor re-arms the client's timer accordingly.
+ *
+ * Both registrations are one shot and callbacks for a client are
+ * serialised, so a client never sees two of its callbacks at once even with
+ * several threads in the pool. After every callback the reactor re-reads
+ * descriptor(), so clients may close and reopen their device freely.
+ *
+ * Opening a device may block (name lookups, connecting to a remote bridge),
+ * so the pool never does it. A client that needs to (re)connect returns
+ * reconnect_now from service(); its reconnect() then runs on the reactor's
+ * connection thread while its timer and descriptor stay disarmed.
+ **/
+class Reactor {
+public:
+  class Client {
+  public:
+    virtual ~Client() {}
+    virtual int descriptor() const = 0; /**< Descriptor to watch for incoming bytes, -1 for none. **/
+    virtual void readable() = 0;        /**< Bytes are waiting on descriptor(). **/
+    virtual long service() = 0;         /**< Timer expired, returns milliseconds until it should next expire, or reconnect_now. **/
+    virtual long reconnect() { return 0; } /**< Blocking attempt at opening the device, returns milliseconds until service() is due. **/
+  };
+
+  static const long reconnect_now = -1; /**< From service(): call reconnect() on the connection thread. **/
+
+  Reactor(const unsigned int &threads = 1);
+  ~Reactor();
+
+  void add(Client *client);
+  void remove(Client *client);
+  unsigned int size() const { return clients.size(); } /**< Number of clients being served. **/
+  unsigned int threads() const { return pool.size(); } /**< Number of threads in the pool. **/
+
+private:
+  struct Entry {
+    Entry(Client *client, const uint64_t &id) : client(client), id(id), timer(-1), watched(-1), removed(false) {}
+    Client *client;
+    uint64_t id;
+    int timer;   // timerfd for service()
+    int watched; // descriptor currently registered for readable()
+    bool removed;
+    ecl::Mutex mutex; // serialises the client's callbacks
+  };
+  typedef boost::shared_ptr<Entry> EntryPtr;
+
+  void spin();
+  void connect();
+  void dispatch(const uint64_t &key);
+  void rearm(Entry &entry, const long &wait);
+  bool isShuttingDown();
+
+  int epoll;
+  int wakeup; // eventfd that releases the pool on shutdown
+  bool shutdown_requested; // under clients_mutex, the pool reads it
+  std::deque<EntryPtr> reconnecting; // under clients_mutex, for the connection thread
+  sem_t reconnect_requests;
+  ecl::Thread connection_thread;
+  uint64_t next_id;
+  std::map<uint64_t, EntryPtr> clients; // by id, epoll events carry the id (x2, +1 for the timer)
+  ecl::Mutex clients_mutex;
+  std::vector<boost::shared_ptr<ecl::Thread> > pool;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_REACTOR_HPP_ */
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/include/kobuki_driver/transport.hpp
+ *
+ * @brief Byte transports the driver can talk to the robot over.
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_TRANSPORT_HPP_
+#define KOBUKI_TRANSPORT_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interface [Transport]
+*****************************************************************************/
+
+/**
+ * @brief A bidirectional byte stream to the robot (or something pretending to be).
+ *
+ * Created from a uri by create():
+ *
+ * - /dev/ttyUSB0 or tty:///dev/ttyUSB0 : a serial device, 115200 8N1.
+ * - pty:// : a new pseudo terminal, for an emulator to open the slave end of.
+ * - tcp://host:port : e.g. a remote serial bridge.
+ * - unix:///path/to/socket : a local emulator.
+ * - replay:///path/to/log[?rate=1.0] : bytes recorded with a RecordingTransport,
+ *   replayed with their original timing (scaled by rate, 0 as fast as possible).
+ *
+ * A read that fails for good (device unplugged, peer hung up, end of the
+ * log) closes the transport; the driver then waits for exists() and opens
+ * it again.
+ **/
+class Transport {
+public:
+  Transport(const std::string &uri) : transport_uri(uri) {}
+  virtual ~Transport() {}
+
+  virtual bool open() = 0;
+  virtual void close() = 0;
+  virtual bool isOpen() const = 0;
+  virtual bool exists() const { return true; } /**< Whether it is worth trying to open. **/
+  virtual int read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms) = 0;
+  virtual int write(const unsigned char *buffer, const unsigned int &size) = 0;
+  virtual int fd() const { return -1; } /**< Descriptor to poll for incoming data, -1 if none. **/
+  virtual long idleTime() const { return 0; } /**< Milliseconds until a read is worth trying, 0 if now. **/
+
+  const std::string& uri() const { return transport_uri; }
+  virtual const std::string& errorMessage() const { return error_message; } /**< Why the last open/read/write failed. **/
+
+  static boost::shared_ptr<Transport> create(const std::string &uri);
+
+protected:
+  std::string transport_uri;
+  std::string error_message;
+};
+
+/*****************************************************************************
+** Interface [Implementations]
+*****************************************************************************/
+
+/**
+ * @brief Common ground for transports backed by a file descriptor.
+ */
+class FdTransport : public Transport {
+public:
+  FdTransport(const std::string &uri) : Transport(uri), descriptor(-1) {}
+  virtual ~FdTransport() { close(); }
+
+  void close();
+  bool isOpen() const { return descriptor != -1; }
+  int read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms);
+  int write(const unsigned char *buffer, const unsigned int &size);
+  int fd() const { return descriptor; }
+
+protected:
+  virtual int hangup(const long &timeout_ms);
+  bool fail(const std::string &what);
+
+  int descriptor;
+};
+
+/**
+ * @brief A serial device, configured raw at 115200 8N1.
+ */
+class TtyTransport : public FdTransport {
+public:
+  TtyTransport(const std::string &uri, const std::string &device) : FdTransport(uri), device(device) {}
+  bool open();
+  bool exists() const;
+
+private:
+  std::string device;
+};
+
+/**
+ * @brief The master end of a fresh pseudo terminal.
+ *
+ * The slave's name is only known once opened; an emulator opens it and
+ * behaves like the robot. Until it does, the master reports a hangup on
+ * every poll, so it is put aside (fd() is -1, reads return 0 straight away)
+ * and only checked again every retry_period.
+ */
+class PtyTransport : public FdTransport {
+public:
+  PtyTransport(const std::string &uri) : FdTransport(uri), hung_up(false), retry_time(0.0) {}
+  bool open();
+  int read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms);
+  int fd() const { return hung_up ? -1 : descriptor; }
+  long idleTime() const;
+  const std::string& slaveName() const { return slave_name; }
+
+protected:
+  int hangup(const long &timeout_ms);
+
+private:
+  static const double retry_period; // [s]
+
+  std::string slave_name;
+  bool hung_up;
+  double retry_time; // [s] monotonic time of the next check for an emulator
+};
+
+/**
+ * @brief A stream socket, either TCP (host, port) or UNIX (path).
+ */
+class SocketTransport : public FdTransport {
+public:
+  SocketTransport(const std::string &uri, const std::string &host, const std::string &port) :
+    FdTransport(uri), host(host), port(port) {}
+  SocketTransport(const std::string &uri, const std::string &path) : FdTransport(uri), path(path) {}
+  bool open();
+  bool exists() const;
+
+private:
+  bool nonBlocking();
+
+  std::string host, port, path;
+};
+
+/**
+ * @brief Plays back incoming bytes recorded by a RecordingTransport.
+ *
+ * The log is a sequence of chunks: double host time [s], uint32 length,
+ * then the bytes. Writes are accepted and discarded.
+ *
+ * It never sleeps; a chunk that is not due yet reads as nothing and
+ * idleTime() says when it will be, for the caller to wait on.
+ */
+class ReplayTransport : public Transport {
+public:
+  ReplayTransport(const std::string &uri, const std::string &path, const double &rate) :
+    Transport(uri), path(path), rate(rate), file(NULL), finished(false), start_log(0.0), start_host(0.0) {}
+  ~ReplayTransport() { close(); }
+
+  bool open();
+  void close();
+  bool isOpen() const { return file != NULL; }
+  bool exists() const;
+  int read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms);
+  int write(const unsigned char *buffer, const unsigned int &size) { return size; }
+  long idleTime() const;
+
+private:
+  bool nextChunk();
+
+  std::string path;
+  double rate;
+  std::FILE *file;
+  bool finished;
+  double start_log, start_host; // [s]
+  double chunk_time;            // [s] log time of the pending chunk
+  std::deque<unsigned char> pending;
+};
+
+/**
+ * @brief Records everything read from another transport into a replay log.
+ *
+ * The log is started afresh by the first open() and kept across
+ * reconnections, so one log always holds a single run with one time base.
+ */
+class RecordingTransport : public Transport {
+public:
+  RecordingTransport(const boost::shared_ptr<Transport> &transport, const std::string &log);
+  ~RecordingTransport();
+
+  bool open();
+  void close() { transport->close(); }
+  bool isOpen() const { return transport->isOpen(); }
+  bool exists() const { return transport->exists(); }
+  int read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms);
+  int write(const unsigned char *buffer, const unsigned int &size) { return transport->write(buffer, size); }
+  int fd() const { return transport->fd(); }
+  long idleTime() const { return transport->idleTime(); }
+  const std::string& errorMessage() const { return error_message.empty() ? transport->errorMessage() : error_message; }
+
+private:
+  boost::shared_ptr<Transport> transport;
+  std::string log;
+  std::FILE *file;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_TRANSPORT_HPP_ */
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/command_scheduler.cpp
+ *
+ * @brief Implementation of the cycle aligned command scheduler.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+#include "../../include/kobuki_driver/modules/command_scheduler.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const double nominal_period = 0.02;    // [s] 50Hz feedback
+const double period_gain = 0.05;       // filter gain on the period estimate
+const double response_threshold = 0.3; // [rad/s] ~2.5 encoder ticks per frame
+const double probe_timeout = 0.5;      // [s] give up on a wheel that never responds (e.g. blocked)
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+CommandScheduler::CommandScheduler() :
+  is_enabled(false),
+  lead(0.005),
+  encoder_resolution(0.0),
+  cycle_period(nominal_period),
+  pending(false),
+  transmit_time(0.0),
+  change_driven(false),
+  keepalive(0.1),
+  has_sent(false),
+  last_speed(0),
+  last_radius(0),
+  last_sent_time(0.0),
+  has_feedback(false),
+  last_left_encoder(0),
+  last_right_encoder(0),
+  probing(false),
+  probe_wheel(0),
+  probe_time(0.0),
+  probe_start_rate(0.0),
+  probe_direction(0.0)
+{
+  wheel_rates[0] = wheel_rates[1] = 0.0;
+}
+
+/**
+ * @param enable : if false, the driver transmits straight after each frame.
+ * @param lead : how long [s] before the firmware's control tick to transmit.
+ * @param encoder_resolution : [rad/tick]
+ */
+void CommandScheduler::init(const bool &enable, const double &lead, const double &encoder_resolution) {
+  is_enabled = enable;
+  this->lead = lead;
+  this->encoder_resolution = encoder_resolution;
+  reset();
+}
+
+/**
+ * @param enable : only send base control when it changes or the keepalive expires.
+ * @param keepalive : longest interval [s] between base control commands.
+ */
+void CommandScheduler::initChangeDriven(const bool &enable, const double &keepalive) {
+  change_driven = enable;
+  this->keepalive = keepalive;
+  has_sent = false;
+}
+
+void CommandScheduler::reset() {
+  cycle_period = nominal_period;
+  pending = false;
+  has_sent = false;
+  has_feedback = false;
+  probing = false;
+  wheel_rates[0] = wheel_rates[1] = 0.0;
+  latency_statistics = Latency();
+}
+
+/**
+ * @brief Schedule the next transmission off a newly arrived frame.
+ *
+ * @param frame_time : host time [s] the frame was stamped by the firmware
+ * @param frame_interval : firmware time [s] since the previous frame
+ */
+void CommandScheduler::frameArrived(const double &frame_time, const double &frame_interval) {
+  // ignore dropped frames and restarts, they are not a change of period
+  if ( ( frame_interval > 0.5 * cycle_period ) && ( frame_interval < 1.5 * cycle_period ) ) {
+    cycle_period += period_gain * (frame_interval - cycle_period);
+  }
+  transmit_time = frame_time + cycle_period - lead;
+  pending = true;
+}
+
+/**
+ * @brief Whether a base control command would only repeat the last one.
+ *
+ * Always false unless change driven transmission is enabled.
+ *
+ * @param speed : [mm/s]
+ * @param radius : [mm]
+ * @param time : host time [s]
+ */
+bool CommandScheduler::isRedundant(const int16_t &speed, const int16_t &radius, const double &time) const {
+  if ( !change_driven || !has_sent ) {
+    return false;
+  }
+  return ( speed == last_speed ) && ( radius == last_radius ) && ( time - last_sent_time < keepalive );
+}
+
+/**
+ * @param speed : [mm/s]
+ * @param radius : [mm]
+ * @param time : host time [s] of the transmission
+ */
+void CommandScheduler::baseControlSent(const int16_t &speed, const int16_t &radius, const double &time) {
+  has_sent = true;
+  last_speed = speed;
+  last_radius = radius;
+  last_sent_time = time;
+}
+
+/**
+ * @brief Register a command on its way to the firmware.
+ *
+ * Starts a latency probe if a wheel is asked to change rate noticeably
+ * and no probe is already running.
+ *
+ * @param time : host time [s] of the transmission
+ * @param left_rate : commanded left wheel rate [rad/s]
+ * @param right_rate : commanded right wheel rate [rad/s]
+ */
+void CommandScheduler::commandSent(const double &time, const double &left_rate, const double &right_rate) {
+  if ( probing || !has_feedback ) {
+    return;
+  }
+  double changes[2] = { left_rate - wheel_rates[0], right_rate - wheel_rates[1] };
+  unsigned int wheel = ( std::fabs(changes[0]) >= std::fabs(changes[1]) ) ? 0 : 1;
+  if ( std::fabs(changes[wheel]) < 2.0 * response_threshold ) {
+    return;
+  }
+  probing = true;
+  probe_wheel = wheel;
+  probe_time = time;
+  probe_start_rate = wheel_rates[wheel];
+  probe_direction = ( changes[wheel] > 0.0 ) ? 1.0 : -1.0;
+}
+
+/**
+ * @brief Update the wheel rates from a frame's encoders and close any probe.
+ *
+ * @param frame_time : host time [s] the frame was stamped by the firmware
+ * @param dt : firmware time [s] since the previous frame
+ * @param left_encoder : [ticks]
+ * @param right_encoder : [ticks]
+ */
+void CommandScheduler::feedback(const double &frame_time, const double &dt,
+                                const uint16_t &left_encoder, const uint16_t &right_encoder) {
+  if ( has_feedback && ( dt > 0.0 ) ) {
+    wheel_rates[0] = encoder_resolution * static_cast<int16_t>(left_encoder - last_left_encoder) / dt;
+    wheel_rates[1] = encoder_resolution * static_cast<int16_t>(right_encoder - last_right_encoder) / dt;
+  }
+  last_left_encoder = left_encoder;
+  last_right_encoder = right_encoder;
+  has_feedback = true;
+
+  if ( !probing || ( frame_time < probe_time ) ) {
+    return;
+  }
+  if ( probe_direction * (wheel_rates[probe_wheel] - probe_start_rate) >= response_threshold ) {
+    double latency = frame_time - probe_time;
+    Latency &stats = latency_statistics;
+    stats.last = latency;
+    stats.minimum = ( stats.count == 0 ) ? latency : std::min(stats.minimum, latency);
+    stats.maximum = ( stats.count == 0 ) ? latency : std::max(stats.maximum, latency);
+    stats.count += 1;
+    stats.mean += (latency - stats.mean) / stats.count;
+    probing = false;
+  } else if ( frame_time - probe_time > probe_timeout ) {
+    probing = false;
+  }
+}
+
+} // namespace kobuki
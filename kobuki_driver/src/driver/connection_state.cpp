@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/connection_state.cpp
+ *
+ * @brief Implementation of the connection state machine.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <ecl/time/sleep.hpp>
+#include <ecl/time/timestamp.hpp>
+#include "../../include/kobuki_driver/modules/connection_state.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+
+const double min_backoff = 1.0;  // [s] before retrying a failed handshake
+const double max_backoff = 60.0; // [s]
+
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+ConnectionState::ConnectionState() :
+  current_state(Disconnected),
+  handshake_done(false),
+  warm_start(false),
+  has_stream(false),
+  max_attempts(10),
+  retry_interval(0.2),
+  handshake_timeout(5.0),
+  handshake_start(0.0),
+  last_request(0.0),
+  backoff(min_backoff),
+  next_handshake(0.0)
+{}
+
+/**
+ * @param max_attempts : version info requests per handshake.
+ * @param retry_interval : time [s] between version info requests.
+ * @param handshake_timeout : time [s] to give up on a handshake, however many attempts are left.
+ */
+void ConnectionState::init(const unsigned int &max_attempts, const double &retry_interval,
+                           const double &handshake_timeout) {
+  mutex.lock();
+  this->max_attempts = max_attempts;
+  this->retry_interval = retry_interval;
+  this->handshake_timeout = handshake_timeout;
+  current_state = Disconnected;
+  handshake_done = false;
+  has_stream = false;
+  backoff = min_backoff;
+  handshake_metrics = Metrics();
+  mutex.unlock();
+}
+
+void ConnectionState::disconnected() {
+  mutex.lock();
+  current_state = Disconnected;
+  handshake_done = false;
+  has_stream = false;
+  mutex.unlock();
+}
+
+void ConnectionState::opening() {
+  mutex.lock();
+  current_state = Opening;
+  mutex.unlock();
+}
+
+/**
+ * @brief The port is open, start the handshake.
+ *
+ * @param time : host time [s]
+ * @param warm_start : the robot is known already, its cached calibration is in use.
+ */
+void ConnectionState::opened(const double &time, const bool &warm_start) {
+  mutex.lock();
+  handshake_done = false;
+  has_stream = false;
+  backoff = min_backoff;
+  this->warm_start = warm_start;
+  if ( warm_start ) {
+    handshake_metrics.warm_starts += 1;
+  }
+  startHandshake(time);
+  mutex.unlock();
+}
+
+/**
+ * @brief A complete frame arrived; resumes a stalled stream.
+ *
+ * @param time : host time [s]
+ */
+void ConnectionState::frameReceived(const double &time) {
+  mutex.lock();
+  has_stream = true;
+  if ( ( current_state == Degraded ) && handshake_done ) {
+    // stalled earlier, the robot may have been power cycled meanwhile
+    handshake_done = false;
+    backoff = min_backoff;
+    startHandshake(time);
+  }
+  mutex.unlock();
+}
+
+/**
+ * @brief The watchdog saw no frames for too long.
+ */
+void ConnectionState::streamLost() {
+  mutex.lock();
+  has_stream = false;
+  if ( current_state == Streaming ) {
+    handshake_metrics.stalls += 1;
+    current_state = Degraded;
+  }
+  mutex.unlock();
+}
+
+/**
+ * @brief The robot answered with its unique device id, the last part of the version info.
+ *
+ * @param time : host time [s]
+ */
+void ConnectionState::handshakeComplete(const double &time) {
+  mutex.lock();
+  if ( !handshake_done ) {
+    handshake_metrics.handshakes += 1;
+    handshake_metrics.last_duration = time - handshake_start;
+  }
+  handshake_done = true;
+  backoff = min_backoff;
+  current_state = Streaming;
+  mutex.unlock();
+}
+
+/**
+ * @brief Drive the handshake, call once per received frame.
+ *
+ * @param time : host time [s]
+ * @return Action : whether to request the version info now, or to report
+ *                  that the handshake has been given up on.
+ */
+ConnectionState::Action ConnectionState::update(const double &time) {
+  mutex.lock();
+  Action action = None;
+  if ( ( current_state == Degraded ) && has_stream && !handshake_done && ( time >= next_handshake ) ) {
+    startHandshake(time); // the last one failed, but the robot is talking
+  }
+  if ( current_state == Handshaking ) {
+    bool exhausted = ( handshake_metrics.attempts >= max_attempts ) && ( time - last_request >= retry_interval );
+    if ( exhausted || ( time - handshake_start > handshake_timeout ) ) {
+      handshake_metrics.failures += 1;
+      current_state = Degraded;
+      next_handshake = time + backoff;
+      backoff = std::min(2.0 * backoff, max_backoff);
+      action = HandshakeFailed;
+    } else if ( ( handshake_metrics.attempts < max_attempts ) &&
+                ( ( handshake_metrics.attempts == 0 ) || ( time - last_request >= retry_interval ) ) ) {
+      handshake_metrics.attempts += 1;
+      handshake_metrics.total_attempts += 1;
+      last_request = time;
+      action = RequestVersionInfo;
+    }
+  }
+  mutex.unlock();
+  return action;
+}
+
+ConnectionState::State ConnectionState::state() const {
+  mutex.lock();
+  State state = current_state;
+  mutex.unlock();
+  return state;
+}
+
+bool ConnectionState::isStreaming() const {
+  mutex.lock();
+  bool streaming = has_stream;
+  mutex.unlock();
+  return streaming;
+}
+
+bool ConnectionState::isReady() const {
+  return state() == Streaming;
+}
+
+bool ConnectionState::isVerified() const {
+  mutex.lock();
+  bool verified = handshake_done;
+  mutex.unlock();
+  return verified;
+}
+
+ConnectionState::Metrics ConnectionState::metrics() const {
+  mutex.lock();
+  Metrics metrics = handshake_metrics;
+  mutex.unlock();
+  return metrics;
+}
+
+/**
+ * @brief Block until the first frame arrives.
+ *
+ * @param timeout : [s]
+ * @return bool : true if streaming, false if it timed out.
+ */
+bool ConnectionState::waitUntilStreaming(const double &timeout) const {
+  return waitUntil(&ConnectionState::isStreaming, timeout);
+}
+
+/**
+ * @brief Block until the handshake completes and frames are streaming.
+ *
+ * @param timeout : [s]
+ * @return bool : true if ready, false if it timed out.
+ */
+bool ConnectionState::waitUntilReady(const double &timeout) const {
+  return waitUntil(&ConnectionState::isReady, timeout);
+}
+
+bool ConnectionState::waitUntil(bool (ConnectionState::*condition)() const, const double &timeout) const {
+  ecl::MilliSleep sleep;
+  ecl::TimeStamp start;
+  while ( !(this->*condition)() ) {
+    if ( ecl::TimeStamp() - start > ecl::Duration(timeout) ) {
+      return false;
+    }
+    sleep(10);
+  }
+  return true;
+}
+
+std::string ConnectionState::toString(const State &state) {
+  switch ( state ) {
+    case Disconnected : return "Disconnected";
+    case Opening : return "Opening";
+    case Handshaking : return "Handshaking";
+    case Streaming : return "Streaming";
+    case Degraded : return "Degraded";
+    default : return "Unknown";
+  }
+}
+
+void ConnectionState::startHandshake(const double &time) {
+  current_state = Handshaking;
+  handshake_start = time;
+  last_request = time;
+  handshake_metrics.attempts = 0;
+}
+
+} // namespace kobuki
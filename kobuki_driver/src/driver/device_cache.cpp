@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/device_cache.cpp
+ *
+ * @brief Implementation of the device identity and calibration cache.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+#include "../../include/kobuki_driver/modules/device_cache.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const char *port_index = "ports";
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+/**
+ * @param directory : where to keep the cache files, empty to disable.
+ */
+void DeviceCache::init(const std::string &directory) {
+  this->directory = directory;
+  while ( ( this->directory.size() > 1 ) && ( this->directory[this->directory.size() - 1] == '/' ) ) {
+    this->directory.erase(this->directory.size() - 1);
+  }
+}
+
+std::string DeviceCache::key(const uint32_t &udid0, const uint32_t &udid1, const uint32_t &udid2) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%08x-%08x-%08x", udid0, udid1, udid2);
+  return std::string(buffer);
+}
+
+/**
+ * @brief Find the robot last seen on a device port.
+ *
+ * @param device_port : e.g. /dev/kobuki
+ * @param entry : filled in if found
+ * @return bool : true if a valid entry was found.
+ */
+bool DeviceCache::lookup(const std::string &device_port, Entry &entry) const {
+  if ( !isEnabled() ) {
+    return false;
+  }
+  std::ifstream index((directory + "/" + port_index).c_str());
+  std::string port, name;
+  while ( index >> port >> name ) {
+    if ( port == device_port ) {
+      return loadFile(name, entry);
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Load the entry for a specific robot.
+ *
+ * @return bool : true if a valid entry was found.
+ */
+bool DeviceCache::load(const uint32_t &udid0, const uint32_t &udid1, const uint32_t &udid2, Entry &entry) const {
+  if ( !isEnabled() ) {
+    return false;
+  }
+  return loadFile(key(udid0, udid1, udid2), entry);
+}
+
+/**
+ * @brief Store a robot's entry and remember it as the last seen on the port.
+ *
+ * Files are replaced atomically, so a crash never leaves a half written entry.
+ *
+ * @return bool : false if the cache is disabled or could not be written.
+ */
+bool DeviceCache::save(const std::string &device_port, const Entry &entry) const {
+  if ( !store(entry) ) {
+    return false;
+  }
+  std::string name = key(entry.udid0, entry.udid1, entry.udid2);
+
+  // rewrite the port index with this port pointing at this robot
+  std::ostringstream ports;
+  std::ifstream index((directory + "/" + port_index).c_str());
+  std::string port, other;
+  while ( index >> port >> other ) {
+    if ( port != device_port ) {
+      ports << port << " " << other << "\n";
+    }
+  }
+  ports << device_port << " " << name << "\n";
+  return writeAtomically(port_index, ports.str());
+}
+
+/**
+ * @brief Store a robot's entry without touching the port index, e.g. from a calibration tool.
+ *
+ * @return bool : false if the cache is disabled or could not be written.
+ */
+bool DeviceCache::store(const Entry &entry) const {
+  if ( !isEnabled() || !makeDirectory() ) {
+    return false;
+  }
+  std::string name = key(entry.udid0, entry.udid1, entry.udid2);
+  std::ostringstream contents;
+  contents.precision(17);
+  contents << "firmware " << entry.firmware << "\n";
+  contents << "hardware " << entry.hardware << "\n";
+  contents << "udid0 " << entry.udid0 << "\n";
+  contents << "udid1 " << entry.udid1 << "\n";
+  contents << "udid2 " << entry.udid2 << "\n";
+  contents << "wheel_bias " << entry.wheel_bias << "\n";
+  contents << "tick_to_rad " << entry.tick_to_rad << "\n";
+  contents << "gyro_bias " << entry.gyro_bias << "\n";
+  contents << "gyro_bias_valid " << entry.gyro_bias_valid << "\n";
+  contents << "battery_capacity " << entry.battery_capacity << "\n";
+  contents << "wheel_radius_left " << entry.wheel_radius_left << "\n";
+  contents << "wheel_radius_right " << entry.wheel_radius_right << "\n";
+  contents << "gyro_scale " << entry.gyro_scale << "\n";
+  return writeAtomically(name, contents.str());
+}
+
+bool DeviceCache::loadFile(const std::string &name, Entry &entry) const {
+  std::ifstream file((directory + "/" + name).c_str());
+  if ( !file ) {
+    return false;
+  }
+  Entry loaded;
+  std::string field;
+  while ( file >> field ) {
+    if      ( field == "firmware" )         { file >> loaded.firmware; }
+    else if ( field == "hardware" )         { file >> loaded.hardware; }
+    else if ( field == "udid0" )            { file >> loaded.udid0; }
+    else if ( field == "udid1" )            { file >> loaded.udid1; }
+    else if ( field == "udid2" )            { file >> loaded.udid2; }
+    else if ( field == "wheel_bias" )       { file >> loaded.wheel_bias; }
+    else if ( field == "tick_to_rad" )      { file >> loaded.tick_to_rad; }
+    else if ( field == "gyro_bias" )        { file >> loaded.gyro_bias; }
+    else if ( field == "gyro_bias_valid" )  { file >> loaded.gyro_bias_valid; } // absent from older files: not valid
+    else if ( field == "battery_capacity" ) { file >> loaded.battery_capacity; }
+    else if ( field == "wheel_radius_left" )  { file >> loaded.wheel_radius_left; }
+    else if ( field == "wheel_radius_right" ) { file >> loaded.wheel_radius_right; }
+    else if ( field == "gyro_scale" )       { file >> loaded.gyro_scale; }
+    else { std::getline(file, field); } // unknown, e.g. written by a newer driver
+    if ( file.fail() ) {
+      return false;
+    }
+  }
+  if ( !loaded.isValid() || ( key(loaded.udid0, loaded.udid1, loaded.udid2) != name ) ) {
+    return false;
+  }
+  entry = loaded;
+  return true;
+}
+
+bool DeviceCache::makeDirectory() const {
+  for ( std::string::size_type i = 1; i <= directory.size(); ++i ) {
+    if ( ( i == directory.size() ) || ( directory[i] == '/' ) ) {
+      if ( ( mkdir(directory.substr(0, i).c_str(), 0755) != 0 ) && ( errno != EEXIST ) ) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Writes to a uniquely named temporary file, flushes it to the disk and
+ * renames it over the original, so neither a crash nor another driver
+ * sharing the cache directory can leave a half written file behind.
+ */
+bool DeviceCache::writeAtomically(const std::string &name, const std::string &contents) const {
+  std::string path = directory + "/" + name;
+  std::vector<char> temporary(path.begin(), path.end());
+  const char suffix[] = ".XXXXXX";
+  temporary.insert(temporary.end(), suffix, suffix + sizeof(suffix)); // including the terminator
+  int file = mkstemp(&temporary[0]);
+  if ( file < 0 ) {
+    return false;
+  }
+  bool ok = ( fchmod(file, 0644) == 0 );
+  for ( std::string::size_type written = 0; ok && ( written < contents.size() ); ) {
+    ssize_t result = ::write(file, contents.data() + written, contents.size() - written);
+    if ( result < 0 ) {
+      ok = ( errno == EINTR );
+    } else {
+      written += static_cast<std::string::size_type>(result);
+    }
+  }
+  ok = ok && ( fsync(file) == 0 );
+  ok = ( close(file) == 0 ) && ok;
+  ok = ok && ( std::rename(&temporary[0], path.c_str()) == 0 );
+  if ( !ok ) {
+    unlink(&temporary[0]);
+    return false;
+  }
+  int parent = open(directory.c_str(), O_RDONLY);
+  if ( parent >= 0 ) {
+    fsync(parent); // the rename itself
+    close(parent);
+  }
+  return true;
+}
+
+/*****************************************************************************
+** Implementation [DeviceCacheWriter]
+*****************************************************************************/
+
+DeviceCacheWriter::DeviceCacheWriter() :
+  is_running(false),
+  pending(false),
+  stopping(false),
+  failed(0)
+{
+  sem_init(&wake, 0, 0);
+}
+
+DeviceCacheWriter::~DeviceCacheWriter() {
+  stop();
+  sem_destroy(&wake);
+}
+
+/**
+ * @param cache : where to write, a copy is kept.
+ * @param device_port : the port the entries are saved against.
+ */
+void DeviceCacheWriter::start(const DeviceCache &cache, const std::string &device_port) {
+  stop();
+  this->cache = cache;
+  this->device_port = device_port;
+  stopping = false;
+  is_running = true;
+  thread.start(&DeviceCacheWriter::run, *this);
+}
+
+/**
+ * @brief Queue an entry for writing, returns straight away.
+ */
+void DeviceCacheWriter::post(const DeviceCache::Entry &entry) {
+  if ( !is_running ) {
+    return;
+  }
+  mutex.lock();
+  this->entry = entry;
+  pending = true;
+  mutex.unlock();
+  sem_post(&wake);
+}
+
+/**
+ * @brief Write the pending entry, if any, and join the thread.
+ */
+void DeviceCacheWriter::stop() {
+  if ( !is_running ) {
+    return;
+  }
+  mutex.lock();
+  stopping = true;
+  mutex.unlock();
+  sem_post(&wake);
+  thread.join();
+  is_running = false;
+}
+
+unsigned long DeviceCacheWriter::failures() {
+  mutex.lock();
+  unsigned long count = failed;
+  failed = 0;
+  mutex.unlock();
+  return count;
+}
+
+void DeviceCacheWriter::run() {
+  for (;;) {
+    while ( ( sem_wait(&wake) != 0 ) && ( errno == EINTR ) ) {}
+    mutex.lock();
+    bool write = pending;
+    bool done = stopping;
+    DeviceCache::Entry latest = entry;
+    pending = false;
+    mutex.unlock();
+    if ( write && !cache.save(device_port, latest) ) {
+      mutex.lock();
+      failed += 1;
+      mutex.unlock();
+    }
+    if ( done ) {
+      return;
+    }
+  }
+}
+
+} // namespace kobuki
@@ -43,10 +43,21 @@
 
 namespace kobuki {
 
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const double nominal_wheel_radius = 0.035; // [m]
+}
+
 /*****************************************************************************
 ** Implementation
 *****************************************************************************/
 DiffDrive::DiffDrive() :
+  is_initialised(false),
+  last_timestamp(0),
+  elapsed_time(0.0),
   last_velocity_left(0.0),
   last_velocity_right(0.0),
   last_tick_left(0),
@@ -56,75 +67,98 @@ DiffDrive::DiffDrive() :
   v(0), w(0),
   radius(0), speed(0),
   bias(0.23), //wheelbase, wheel_to_wheel, in [m]
-  wheel_radius(0.035),
+  wheel_radius(nominal_wheel_radius),
+  left_radius(nominal_wheel_radius),
+  right_radius(nominal_wheel_radius),
   imu_heading_offset(0),
   tick_to_rad( 0.002436916871363930187454f)
 {}
 
-void DiffDrive::init() {
+/**
+ * @param velocity_window : number of frames the wheel velocity estimators fit over.
+ */
+void DiffDrive::init(const unsigned int &velocity_window) {
+  diff_drive_kinematics.reset(new ecl::DifferentialDrive::Kinematics(bias, wheel_radius));
+  velocity_left.init(velocity_window);
+  velocity_right.init(velocity_window);
+}
+
+/**
+ * @brief Apply a per-robot calibration.
+ *
+ * Unequal wheels are handled by scaling each wheel's rotation onto a
+ * wheel of the mean radius before it reaches the kinematics.
+ *
+ * @param wheel_bias : distance between the wheels [m]
+ * @param tick_to_rad : encoder resolution [rad/tick]
+ * @param wheel_radius_left : [m], zero or less for the nominal radius
+ * @param wheel_radius_right : [m], zero or less for the nominal radius
+ */
+void DiffDrive::calibrate(const double &wheel_bias, const double &tick_to_rad,
+                          const double &wheel_radius_left, const double &wheel_radius_right) {
+  bias = wheel_bias;
+  this->tick_to_rad = tick_to_rad;
+  left_radius = ( wheel_radius_left > 0.0 ) ? wheel_radius_left : nominal_wheel_radius;
+  right_radius = ( wheel_radius_right > 0.0 ) ? wheel_radius_right : nominal_wheel_radius;
+  wheel_radius = ( left_radius + right_radius ) / 2.0;
   diff_drive_kinematics.reset(new ecl::DifferentialDrive::Kinematics(bias, wheel_radius));
 }
 
 /**
  * @brief Updates the odometry from firmware stamps and encoders.
  *
- * Really horrible - could do with an overhaul.
+ * Wheel rates come from a least squares fit over the last few frames
+ * rather than a single tick delta, and the body twist is derived from them.
  *
  * @param time_stamp
  * @param left_encoder
  * @param right_encoder
  * @param pose_update
- * @param pose_update_rates
+ * @param pose_update_rates : body frame twist (vx, vy, wz)
  */
 void DiffDrive::update(const uint16_t &time_stamp,
             const uint16_t &left_encoder,
             const uint16_t &right_encoder,
             ecl::Pose2D<double> &pose_update,
             ecl::linear_algebra::Vector3d &pose_update_rates) {
-  static bool init_l = false;
-  static bool init_r = false;
-  double left_diff_ticks = 0.0f;
-  double right_diff_ticks = 0.0f;
-  unsigned short curr_tick_left = 0;
-  unsigned short curr_tick_right = 0;
-  unsigned short curr_timestamp = 0;
-  curr_timestamp = time_stamp;
-  curr_tick_left = left_encoder;
-  if (!init_l)
+  if (!is_initialised)
   {
-    last_tick_left = curr_tick_left;
-    init_l = true;
+    last_tick_left = left_encoder;
+    last_tick_right = right_encoder;
+    last_timestamp = time_stamp;
+    is_initialised = true;
   }
-  left_diff_ticks = (double)(short)((curr_tick_left - last_tick_left) & 0xffff);
-  last_tick_left = curr_tick_left;
+  double left_diff_ticks = (double)(short)((left_encoder - last_tick_left) & 0xffff);
+  last_tick_left = left_encoder;
   last_rad_left += tick_to_rad * left_diff_ticks;
 
-  curr_tick_right = right_encoder;
-  if (!init_r)
-  {
-    last_tick_right = curr_tick_right;
-    init_r = true;
-  }
-  right_diff_ticks = (double)(short)((curr_tick_right - last_tick_right) & 0xffff);
-  last_tick_right = curr_tick_right;
+  double right_diff_ticks = (double)(short)((right_encoder - last_tick_right) & 0xffff);
+  last_tick_right = right_encoder;
   last_rad_right += tick_to_rad * right_diff_ticks;
 
-  // TODO this line and the last statements are really ugly; refactor, put in another place
-  pose_update = diff_drive_kinematics->forward(tick_to_rad * left_diff_ticks, tick_to_rad * right_diff_ticks);
-
-  if (curr_timestamp != last_timestamp)
-  {
-    last_diff_time = ((double)(short)((curr_timestamp - last_timestamp) & 0xffff)) / 1000.0f;
-    last_timestamp = curr_timestamp;
-    last_velocity_left = (tick_to_rad * left_diff_ticks) / last_diff_time;
-    last_velocity_right = (tick_to_rad * right_diff_ticks) / last_diff_time;
-  } else {
-    // we need to set the last_velocity_xxx to zero?
+  pose_update = diff_drive_kinematics->forward(tick_to_rad * left_diff_ticks * left_radius / wheel_radius,
+                                               tick_to_rad * right_diff_ticks * right_radius / wheel_radius);
+
+  // firmware stamps are 16 bit milliseconds, unwrap them. A frame is 20ms, so a
+  // step of more than half the range is a stamp going backwards (a reordered
+  // frame or a firmware reset), not a 65s gap: hold the time and restart the fit.
+  unsigned short step = static_cast<unsigned short>(time_stamp - last_timestamp);
+  if ( step > 0x7fff ) {
+    step = 0;
+    velocity_left.reset();
+    velocity_right.reset();
   }
+  elapsed_time += static_cast<double>(step) / 1000.0;
+  last_timestamp = time_stamp;
 
-  pose_update_rates << pose_update.x()/last_diff_time,
-                       pose_update.y()/last_diff_time,
-                       pose_update.heading()/last_diff_time;
+  velocity_left.update(elapsed_time, last_rad_left);
+  velocity_right.update(elapsed_time, last_rad_right);
+  last_velocity_left = velocity_left.velocity();
+  last_velocity_right = velocity_right.velocity();
+
+  pose_update_rates << (left_radius * last_velocity_left + right_radius * last_velocity_right) / 2.0,
+                       0.0,
+                       (right_radius * last_velocity_right - left_radius * last_velocity_left) / bias;
 }
 
 void DiffDrive::reset(const double& current_heading) {
@@ -132,6 +166,8 @@ void DiffDrive::reset(const double& current_heading) {
   last_rad_right = 0.0;
   last_velocity_left = 0.0;
   last_velocity_right = 0.0;
+  velocity_left.reset();
+  velocity_right.reset();
   imu_heading_offset = current_heading;
 }
 
@@ -168,6 +204,19 @@ void DiffDrive::velocityCommands(const short &cmd_speed, const short &cmd_radius
   radius = cmd_radius; //in mm/s
 }
 
+/**
+ * @brief Wheel rates that realise a body velocity.
+ *
+ * @param vx : linear velocity [m/s]
+ * @param wz : angular velocity [rad/s]
+ * @param left_rate : left wheel rate [rad/s]
+ * @param right_rate : right wheel rate [rad/s]
+ */
+void DiffDrive::wheelVelocities(const double &vx, const double &wz, double &left_rate, double &right_rate) const {
+  left_rate = (vx - bias * wz / 2.0) / left_radius;
+  right_rate = (vx + bias * wz / 2.0) / right_radius;
+}
+
 std::vector<short> DiffDrive::velocityCommands() const {
   std::vector<short> cmd(2);
   cmd[0] = speed;
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/dock_ir_filter.cpp
+ *
+ * @brief Implementation of the dock infrared filter.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_driver/modules/dock_ir_filter.hpp"
+#include "../../include/kobuki_driver/packets/dock_ir.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+/**
+ * Receiver axes [rad] from the robot's heading, right, central, left, and
+ * the weight of their readings. The central receiver sees a narrower arc,
+ * so it says more about where the dock is.
+ */
+static const double receiver_axes[3] = { -1.0, 0.0, 1.0 };
+static const double receiver_weights[3] = { 1.0, 2.0, 1.0 };
+
+static const uint8_t near_beams = DockIR::Flags::NearLeft | DockIR::Flags::NearCenter | DockIR::Flags::NearRight;
+static const uint8_t far_beams = DockIR::Flags::FarLeft | DockIR::Flags::FarCenter | DockIR::Flags::FarRight;
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+DockIRFilter::DockIRFilter(const unsigned int &window) :
+  capacity(0), newest(0), count(0), frames_seen(0), heading(0.0)
+{
+  init(window);
+}
+
+/**
+ * @param window : number of frames to filter over, at least one.
+ */
+void DockIRFilter::init(const unsigned int &window) {
+  mutex.lock();
+  capacity = ( window < 1 ) ? 1 : window;
+  observations.resize(capacity);
+  mutex.unlock();
+  reset();
+}
+
+void DockIRFilter::reset() {
+  mutex.lock();
+  newest = 0;
+  count = 0;
+  sum = Observation();
+  frames_seen = 0;
+  latest = Estimate();
+  mutex.unlock();
+}
+
+/**
+ * @brief Add a frame's readings and refresh the estimate.
+ *
+ * @param heading : [rad] gyro heading of the frame.
+ * @param docking : right, central and left receiver bytes (DockIR::Data).
+ */
+void DockIRFilter::update(const double &heading, const std::vector<uint8_t> &docking) {
+  Observation observation;
+  for ( unsigned int i = 0; ( i < 3 ) && ( i < docking.size() ); ++i ) {
+    const uint8_t &beams = docking[i];
+    if ( !beams ) {
+      continue;
+    }
+    observation.x += receiver_weights[i] * std::cos(heading + receiver_axes[i]);
+    observation.y += receiver_weights[i] * std::sin(heading + receiver_axes[i]);
+    observation.weight += receiver_weights[i];
+    if ( beams & near_beams ) { ++observation.near; }
+    if ( beams & far_beams ) { ++observation.far; }
+    if ( beams & ( DockIR::Flags::NearLeft | DockIR::Flags::FarLeft ) ) { ++observation.left; }
+    if ( beams & ( DockIR::Flags::NearCenter | DockIR::Flags::FarCenter ) ) { ++observation.center; }
+    if ( beams & ( DockIR::Flags::NearRight | DockIR::Flags::FarRight ) ) { ++observation.right; }
+  }
+
+  mutex.lock();
+  this->heading = heading;
+  if ( count == capacity ) {
+    newest = ( newest + 1 ) % capacity;
+    add(observations[newest], -1); // evict the oldest, it sits where the newest goes
+  } else {
+    newest = ( count == 0 ) ? 0 : newest + 1;
+    ++count;
+  }
+  observations[newest] = observation;
+  add(observation, 1);
+  if ( newest == capacity - 1 ) {
+    // once per lap, resum to shed rounding in the running sums
+    sum.x = sum.y = sum.weight = 0.0;
+    for ( unsigned int i = 0; i < count; ++i ) {
+      sum.x += observations[i].x;
+      sum.y += observations[i].y;
+      sum.weight += observations[i].weight;
+    }
+  }
+
+  latest = Estimate();
+  if ( ( frames_seen > 0 ) && ( sum.weight > 0.0 ) ) {
+    double length = std::sqrt(sum.x * sum.x + sum.y * sum.y);
+    latest.bearing = ecl::wrap_angle(std::atan2(sum.y, sum.x) - heading);
+    latest.range = ( sum.near >= sum.far ) ? Near : Far; // ties near, see the class documentation
+    if ( ( sum.center >= sum.left ) && ( sum.center >= sum.right ) ) {
+      latest.region = CenterRegion;
+    } else {
+      latest.region = ( sum.left > sum.right ) ? LeftRegion : RightRegion;
+    }
+    latest.confidence = ( length / sum.weight ) * static_cast<double>(frames_seen) / capacity;
+  }
+  mutex.unlock();
+}
+
+DockIRFilter::Estimate DockIRFilter::estimate() const {
+  mutex.lock();
+  Estimate estimate = latest;
+  mutex.unlock();
+  return estimate;
+}
+
+void DockIRFilter::add(const Observation &observation, const int &sign) {
+  sum.x += sign * observation.x;
+  sum.y += sign * observation.y;
+  sum.weight += sign * observation.weight;
+  sum.near += sign * observation.near;
+  sum.far += sign * observation.far;
+  sum.left += sign * observation.left;
+  sum.center += sign * observation.center;
+  sum.right += sign * observation.right;
+  if ( observation.weight > 0.0 ) {
+    frames_seen += sign;
+  }
+}
+
+std::string DockIRFilter::toString(const Range &range) {
+  switch ( range ) {
+    case Far: { return "far"; }
+    case Near: { return "near"; }
+    default: { return "out of range"; }
+  }
+}
+
+std::string DockIRFilter::toString(const Region &region) {
+  switch ( region ) {
+    case LeftRegion: { return "left"; }
+    case CenterRegion: { return "center"; }
+    case RightRegion: { return "right"; }
+    default: { return "none"; }
+  }
+}
+
+} // namespace kobuki
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/emulator.cpp
+ *
+ * @brief Implementation of the robot emulator.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cerrno>
+#include <cmath>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "../../include/kobuki_driver/emulator.hpp"
+#include "../../include/kobuki_driver/command.hpp"
+#include "../../include/kobuki_driver/packet_handler/payload_headers.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+namespace {
+
+const double frame_period = 0.02; // [s] the firmware's cycle
+const double pi = 3.14159265358979323846;
+
+double now() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void put8(std::vector<unsigned char> &bytes, const unsigned int &value) {
+  bytes.push_back(static_cast<unsigned char>(value & 0xff));
+}
+
+void put16(std::vector<unsigned char> &bytes, const unsigned int &value) {
+  put8(bytes, value);
+  put8(bytes, value >> 8);
+}
+
+void put32(std::vector<unsigned char> &bytes, const uint32_t &value) {
+  put16(bytes, value & 0xffff);
+  put16(bytes, value >> 16);
+}
+
+} // anonymous namespace
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+Emulator::Emulator() :
+  hardware(0x00010000),
+  firmware(0x00010100),
+  udid0(0x0011),
+  udid1(0x2233),
+  udid2(0x4455),
+  descriptor(-1),
+  requests(0),
+  speed(0),
+  radius(0),
+  linear(0.0),
+  angular(0.0),
+  pose_x(0.0),
+  pose_y(0.0),
+  pose_heading(0.0),
+  left_ticks(0.0),
+  right_ticks(0.0),
+  time_stamp(0),
+  base_controls(0),
+  frame_count(0),
+  next_frame(0.0)
+{}
+
+Emulator::~Emulator() {
+  close();
+}
+
+/**
+ * @param device : e.g. the slave end of the driver's pseudo terminal.
+ * @return bool : false if it could not be opened.
+ */
+bool Emulator::open(const std::string &device) {
+  close();
+  descriptor = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if ( descriptor == -1 ) {
+    return false;
+  }
+  termios options;
+  if ( tcgetattr(descriptor, &options) == 0 ) {
+    cfmakeraw(&options);
+    tcsetattr(descriptor, TCSANOW, &options);
+  }
+  incoming.clear();
+  next_frame = 0.0;
+  return true;
+}
+
+void Emulator::close() {
+  if ( descriptor != -1 ) {
+    ::close(descriptor);
+    descriptor = -1;
+  }
+}
+
+/**
+ * @brief Place the robot, e.g. at the start of a run.
+ */
+void Emulator::setPose(const double &x, const double &y, const double &heading) {
+  pose_x = x;
+  pose_y = y;
+  pose_heading = heading;
+}
+
+/**
+ * @brief One firmware cycle: take the commands in, move, stream a frame.
+ */
+void Emulator::step() {
+  receive();
+  integrate(frame_period);
+  send();
+}
+
+/**
+ * @brief Step at the firmware's 50Hz in real time, for a number of frames.
+ */
+void Emulator::stream(const unsigned int &frames) {
+  for ( unsigned int i = 0; i < frames; ++i ) {
+    double wait = next_frame - now();
+    if ( wait > 0.0 ) {
+      timespec duration;
+      duration.tv_sec = static_cast<time_t>(wait);
+      duration.tv_nsec = static_cast<long>(( wait - duration.tv_sec ) * 1e9);
+      nanosleep(&duration, NULL);
+    } else if ( wait < -frame_period ) {
+      next_frame = now(); // fell behind, do not try to catch up in a burst
+    }
+    next_frame += frame_period;
+    step();
+  }
+}
+
+/**
+ * @brief Read whatever the driver sent and act on every complete packet.
+ */
+void Emulator::receive() {
+  unsigned char buffer[256];
+  ssize_t n;
+  while ( ( descriptor != -1 ) && ( ( n = ::read(descriptor, buffer, sizeof(buffer)) ) > 0 ) ) {
+    incoming.insert(incoming.end(), buffer, buffer + n);
+  }
+  // stx0 stx1 length payload checksum, the checksum covering the length and payload
+  std::vector<unsigned char>::size_type start = 0;
+  while ( incoming.size() - start >= 4 ) {
+    if ( ( incoming[start] != 0xaa ) || ( incoming[start + 1] != 0x55 ) ) {
+      ++start;
+      continue;
+    }
+    unsigned int length = incoming[start + 2];
+    if ( incoming.size() - start < length + 4 ) {
+      break;
+    }
+    unsigned char checksum = 0;
+    for ( unsigned int i = 2; i < length + 3; ++i ) {
+      checksum ^= incoming[start + i];
+    }
+    if ( checksum == incoming[start + length + 3] ) {
+      command(&incoming[start + 3], length);
+      start += length + 4;
+    } else {
+      ++start; // not a packet after all, resynchronise
+    }
+  }
+  incoming.erase(incoming.begin(), incoming.begin() + start);
+}
+
+/**
+ * @brief Act on the sub-payloads of a command packet.
+ */
+void Emulator::command(const unsigned char *payload, const unsigned int &size) {
+  unsigned int i = 0;
+  while ( i + 2 <= size ) {
+    unsigned char id = payload[i];
+    unsigned int length = payload[i + 1];
+    const unsigned char *data = payload + i + 2;
+    if ( i + 2 + length > size ) {
+      return;
+    }
+    if ( ( id == Command::BaseControl ) && ( length == 4 ) ) {
+      speed = static_cast<int16_t>(data[0] | ( data[1] << 8 ));
+      radius = static_cast<int16_t>(data[2] | ( data[3] << 8 ));
+      base_controls += 1;
+    } else if ( ( id == Command::RequestExtra ) && ( length == 2 ) ) {
+      requests |= static_cast<uint16_t>(data[0] | ( data[1] << 8 ));
+    }
+    i += 2 + length;
+  }
+}
+
+/**
+ * @brief Move the model with the latest base control.
+ *
+ * Speed is the outer wheel's [mm/s] and radius the turning radius [mm],
+ * zero for straight and +-1 for turning on the spot, which is what the
+ * firmware makes of them.
+ */
+void Emulator::integrate(const double &dt) {
+  double half_bias = model.wheel_bias / 2.0;
+  double outer = speed / 1000.0;
+  if ( radius == 0 ) {
+    linear = outer;
+    angular = 0.0;
+  } else if ( ( radius == 1 ) || ( radius == -1 ) ) {
+    linear = 0.0;
+    angular = radius * outer / half_bias;
+  } else {
+    double r = radius / 1000.0;
+    linear = outer * std::fabs(r) / ( std::fabs(r) + half_bias );
+    angular = linear / r;
+  }
+  double metres_per_tick = model.wheel_radius * model.tick_to_rad;
+  left_ticks += ( linear - half_bias * angular ) * dt / metres_per_tick;
+  right_ticks += ( linear + half_bias * angular ) * dt / metres_per_tick;
+  double middle = pose_heading + angular * dt / 2.0;
+  pose_x += linear * dt * std::cos(middle);
+  pose_y += linear * dt * std::sin(middle);
+  pose_heading += angular * dt;
+}
+
+/**
+ * @brief Stream a frame, with any version info asked for.
+ */
+void Emulator::send() {
+  time_stamp += static_cast<uint16_t>(frame_period * 1000.0);
+  std::vector<unsigned char> payload;
+
+  put8(payload, Header::CoreSensors);
+  put8(payload, 15);
+  put16(payload, time_stamp);
+  put8(payload, sensors.bumper);
+  put8(payload, sensors.wheel_drop);
+  put8(payload, sensors.cliff);
+  put16(payload, static_cast<unsigned int>(static_cast<long>(std::floor(left_ticks))) & 0xffff);
+  put16(payload, static_cast<unsigned int>(static_cast<long>(std::floor(right_ticks))) & 0xffff);
+  put8(payload, 0); // pwm
+  put8(payload, 0);
+  put8(payload, sensors.buttons);
+  put8(payload, sensors.charger);
+  put8(payload, sensors.battery);
+  put8(payload, 0); // over current
+
+  put8(payload, Header::DockInfraRed);
+  put8(payload, 3);
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    put8(payload, sensors.dock_ir[i]);
+  }
+
+  // hundredths of a degree, the angle wrapping at +-180
+  double degrees = std::fmod(pose_heading * 180.0 / pi, 360.0);
+  if ( degrees > 180.0 ) {
+    degrees -= 360.0;
+  } else if ( degrees <= -180.0 ) {
+    degrees += 360.0;
+  }
+  put8(payload, Header::Inertia);
+  put8(payload, 7);
+  put16(payload, static_cast<unsigned int>(static_cast<int>(std::floor(degrees * 100.0 + 0.5))) & 0xffff);
+  put16(payload, static_cast<unsigned int>(static_cast<int>(std::floor(angular * 18000.0 / pi + 0.5))) & 0xffff);
+  put8(payload, 0);
+  put8(payload, 0);
+  put8(payload, 0);
+
+  put8(payload, Header::Cliff);
+  put8(payload, 6);
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    put16(payload, sensors.cliff_bottom[i]);
+  }
+
+  put8(payload, Header::Current);
+  put8(payload, 2);
+  put8(payload, 0);
+  put8(payload, 0);
+
+  if ( requests & Command::HardwareVersion ) {
+    put8(payload, Header::Hardware);
+    put8(payload, 4);
+    put32(payload, hardware);
+  }
+  if ( requests & Command::FirmwareVersion ) {
+    put8(payload, Header::Firmware);
+    put8(payload, 4);
+    put32(payload, firmware);
+  }
+  if ( requests & Command::UniqueDeviceID ) {
+    put8(payload, Header::UniqueDeviceID);
+    put8(payload, 12);
+    put32(payload, udid0);
+    put32(payload, udid1);
+    put32(payload, udid2);
+  }
+  requests = 0;
+
+  std::vector<unsigned char> packet;
+  put8(packet, 0xaa);
+  put8(packet, 0x55);
+  put8(packet, payload.size());
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  unsigned char checksum = 0;
+  for ( unsigned int i = 2; i < packet.size(); ++i ) {
+    checksum ^= packet[i];
+  }
+  put8(packet, checksum);
+  if ( ( descriptor != -1 ) && ( ::write(descriptor, &packet[0], packet.size()) < 0 ) ) {} // nobody reading (yet)
+  frame_count += 1;
+}
+
+} // namespace kobuki
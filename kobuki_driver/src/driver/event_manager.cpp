@@ -38,6 +38,7 @@
 ** Includes
 *****************************************************************************/
 
+#include <ecl/time/timestamp.hpp>
 #include "../../include/kobuki_driver/event_manager.hpp"
 #include "../../include/kobuki_driver/modules/battery.hpp"
 #include "../../include/kobuki_driver/packets/core_sensors.hpp"
@@ -48,10 +49,108 @@
 
 namespace kobuki {
 
+/*****************************************************************************
+** Event Factories
+*****************************************************************************/
+
+namespace {
+
+void buttonEvent(const int &id, const bool &is_set, const std::vector<uint16_t> &cliff_data,
+                 const double &time, EventBatch &batch) {
+  ButtonEvent event;
+  event.time = time;
+  event.button = static_cast<ButtonEvent::Button>(id);
+  event.state = is_set ? ButtonEvent::Pressed : ButtonEvent::Released;
+  batch.button_events.push_back(event);
+}
+
+void bumperEvent(const int &id, const bool &is_set, const std::vector<uint16_t> &cliff_data,
+                 const double &time, EventBatch &batch) {
+  BumperEvent event;
+  event.time = time;
+  event.bumper = static_cast<BumperEvent::Bumper>(id);
+  event.state = is_set ? BumperEvent::Pressed : BumperEvent::Released;
+  batch.bumper_events.push_back(event);
+}
+
+// cliff data readings are included as extra information on cliff events
+void cliffEvent(const int &id, const bool &is_set, const std::vector<uint16_t> &cliff_data,
+                 const double &time, EventBatch &batch) {
+  CliffEvent event;
+  event.time = time;
+  event.sensor = static_cast<CliffEvent::Sensor>(id);
+  event.state = is_set ? CliffEvent::Cliff : CliffEvent::Floor;
+  event.bottom = ( static_cast<unsigned int>(id) < cliff_data.size() ) ? cliff_data[id] : 0;
+  batch.cliff_events.push_back(event);
+}
+
+void wheelEvent(const int &id, const bool &is_set, const std::vector<uint16_t> &cliff_data,
+                 const double &time, EventBatch &batch) {
+  WheelEvent event;
+  event.time = time;
+  event.wheel = static_cast<WheelEvent::Wheel>(id);
+  event.state = is_set ? WheelEvent::Dropped : WheelEvent::Raised;
+  batch.wheel_events.push_back(event);
+}
+
+} // anonymous namespace
+
+/*****************************************************************************
+** Event Table
+*****************************************************************************/
+
+// Note that the touch pad means at most one button can be pressed at a time,
+// though nothing here depends on it.
+const EventManager::Entry EventManager::table[] = {
+  // field                   mask                              id                    factory
+  { EventManager::Buttons,   CoreSensors::Flags::Button0,      ButtonEvent::Button0, &buttonEvent },
+  { EventManager::Buttons,   CoreSensors::Flags::Button1,      ButtonEvent::Button1, &buttonEvent },
+  { EventManager::Buttons,   CoreSensors::Flags::Button2,      ButtonEvent::Button2, &buttonEvent },
+  { EventManager::Bumper,    CoreSensors::Flags::LeftBumper,   BumperEvent::Left,    &bumperEvent },
+  { EventManager::Bumper,    CoreSensors::Flags::CenterBumper, BumperEvent::Center,  &bumperEvent },
+  { EventManager::Bumper,    CoreSensors::Flags::RightBumper,  BumperEvent::Right,   &bumperEvent },
+  { EventManager::Cliff,     CoreSensors::Flags::LeftCliff,    CliffEvent::Left,     &cliffEvent },
+  { EventManager::Cliff,     CoreSensors::Flags::CenterCliff,  CliffEvent::Center,   &cliffEvent },
+  { EventManager::Cliff,     CoreSensors::Flags::RightCliff,   CliffEvent::Right,    &cliffEvent },
+  { EventManager::WheelDrop, CoreSensors::Flags::LeftWheel,    WheelEvent::Left,     &wheelEvent },
+  { EventManager::WheelDrop, CoreSensors::Flags::RightWheel,   WheelEvent::Right,    &wheelEvent },
+};
+
+const unsigned int EventManager::table_size = sizeof(EventManager::table) / sizeof(EventManager::Entry);
+
 /*****************************************************************************
 ** Implementation
 *****************************************************************************/
 
+EventManager::EventManager() {
+  last_state.buttons    = 0;
+  last_state.bumper     = 0;
+  last_state.cliff      = 0;
+  last_state.wheel_drop = 0;
+  last_state.charger    = 0;
+  last_state.battery    = 0;
+  last_digital_input    = 0;
+  last_robot_state      = RobotEvent::Unknown;
+
+  cliff_state = 0;
+  for (unsigned int field = 0; field < NumberOfFields; ++field) {
+    reported[field] = 0;
+    pending[field] = 0;
+    known[field] = 0;
+    for (unsigned int bit = 0; bit < 8; ++bit) {
+      lookup[field][bit] = -1;
+      debounce_frames[field][bit] = 1;
+      debounce_time[field][bit] = 0;
+      held[field][bit] = 0;
+      held_since[field][bit] = 0;
+    }
+  }
+  for (unsigned int i = 0; i < table_size; ++i) {
+    known[table[i].field] |= table[i].mask;
+    lookup[table[i].field][__builtin_ctz(table[i].mask)] = i;
+  }
+}
+
 void EventManager::init ( const std::string &sigslots_namespace ) {
   sig_button_event.connect(sigslots_namespace + std::string("/button_event"));
   sig_bumper_event.connect(sigslots_namespace + std::string("/bumper_event"));
@@ -60,174 +159,89 @@ void EventManager::init ( const std::string &sigslots_namespace ) {
   sig_power_event.connect(sigslots_namespace  + std::string("/power_event"));
   sig_input_event.connect(sigslots_namespace  + std::string("/input_event"));
   sig_robot_event.connect(sigslots_namespace  + std::string("/robot_event"));
+  sig_event_batch.connect(sigslots_namespace  + std::string("/event_batch"));
+}
+
+/**
+ * Only report changes of these flags once they have held for a number of
+ * frames and a minimum time (both, if both are given).
+ * @param field    Core sensors field the flags belong to
+ * @param debounce Frames and time a change must hold
+ * @param mask     Flags to debounce (e.g. CoreSensors::Flags::LeftBumper), all by default
+ */
+void EventManager::setDebounce(const Field &field, const Debounce &debounce, uint8_t mask) {
+  for (unsigned int bit = 0; bit < 8; ++bit) {
+    if (mask & (1 << bit)) {
+      debounce_frames[field][bit] = ( debounce.frames > 1 ) ? debounce.frames : 1; // the changing frame is the first
+      debounce_time[field][bit] = static_cast<uint16_t>(debounce.time * 1000.0 + 0.5);
+    }
+  }
 }
 
 /**
  * Update with incoming data and emit events if necessary.
  * @param new_state  Updated core sensors state
  * @param cliff_data Cliff sensors readings (we include them as an extra information on cliff events)
+ * @param time       Host time [s] the frame was stamped by the firmware
  */
-void EventManager::update(const CoreSensors::Data &new_state, const std::vector<uint16_t> &cliff_data) {
-  if (last_state.buttons != new_state.buttons)
-  {
-    // ------------
-    // Button Event
-    // ------------
-
-    // Note that the touch pad means at most one button can be pressed
-    // at a time.
-    ButtonEvent event;
-
-    // Check changes in each button state's; even if this block of code
-    // supports it, two buttons cannot be pressed simultaneously
-    if ((new_state.buttons ^ last_state.buttons) & CoreSensors::Flags::Button0) {
-      event.button = ButtonEvent::Button0;
-      if (new_state.buttons & CoreSensors::Flags::Button0) {
-        event.state = ButtonEvent::Pressed;
-      } else {
-        event.state = ButtonEvent::Released;
+void EventManager::update(const CoreSensors::Data &new_state, const std::vector<uint16_t> &cliff_data,
+                          const double &time) {
+  batch.clear();
+  if (cliff_hysteresis.enable && (cliff_data.size() >= 3)) {
+    const uint8_t masks[3] = { CoreSensors::Flags::LeftCliff, CoreSensors::Flags::CenterCliff, CoreSensors::Flags::RightCliff };
+    for (unsigned int i = 0; i < 3; ++i) {
+      if (cliff_data[i] < cliff_hysteresis.cliff_below) {
+        cliff_state |= masks[i];
+      } else if (cliff_data[i] > cliff_hysteresis.floor_above) {
+        cliff_state &= ~masks[i];
       }
-      sig_button_event.emit(event);
-    }
-
-    if ((new_state.buttons ^ last_state.buttons) & CoreSensors::Flags::Button1) {
-      event.button = ButtonEvent::Button1;
-      if (new_state.buttons & CoreSensors::Flags::Button1) {
-        event.state = ButtonEvent::Pressed;
-      } else {
-        event.state = ButtonEvent::Released;
-      }
-      sig_button_event.emit(event);
-    }
-
-    if ((new_state.buttons ^ last_state.buttons) & CoreSensors::Flags::Button2) {
-      event.button = ButtonEvent::Button2;
-      if (new_state.buttons & CoreSensors::Flags::Button2) {
-        event.state = ButtonEvent::Pressed;
-      } else {
-        event.state = ButtonEvent::Released;
-      }
-      sig_button_event.emit(event);
     }
+  } else {
+    cliff_state = new_state.cliff;
   }
+  const uint8_t values[NumberOfFields] = { new_state.buttons, new_state.bumper, cliff_state, new_state.wheel_drop };
 
-  // ------------
-  // Bumper Event
-  // ------------
-
-  if (last_state.bumper != new_state.bumper)
-  {
-    BumperEvent event;
-
-    // Check changes in each bumper state's and raise an event if so
-    if ((new_state.bumper ^ last_state.bumper) & CoreSensors::Flags::LeftBumper) {
-      event.bumper = BumperEvent::Left;
-      if (new_state.bumper & CoreSensors::Flags::LeftBumper) {
-        event.state = BumperEvent::Pressed;
-      } else {
-        event.state = BumperEvent::Released;
-      }
-      sig_bumper_event.emit(event);
+  for (unsigned int field = 0; field < NumberOfFields; ++field) {
+    uint8_t changed = ( values[field] ^ reported[field] ) & known[field];
+    if (!changed && !pending[field]) {
+      continue;
     }
-
-    if ((new_state.bumper ^ last_state.bumper) & CoreSensors::Flags::CenterBumper) {
-      event.bumper = BumperEvent::Center;
-      if (new_state.bumper & CoreSensors::Flags::CenterBumper) {
-        event.state = BumperEvent::Pressed;
-      } else {
-        event.state = BumperEvent::Released;
-      }
-      sig_bumper_event.emit(event);
+    // changes that reverted before they were reported start over
+    for (uint8_t bits = pending[field] & ~changed; bits; bits &= bits - 1) {
+      held[field][__builtin_ctz(bits)] = 0;
     }
-
-    if ((new_state.bumper ^ last_state.bumper) & CoreSensors::Flags::RightBumper) {
-      event.bumper = BumperEvent::Right;
-      if (new_state.bumper & CoreSensors::Flags::RightBumper) {
-        event.state = BumperEvent::Pressed;
-      } else {
-        event.state = BumperEvent::Released;
+    pending[field] = changed;
+    for (uint8_t bits = changed; bits; bits &= bits - 1) {
+      unsigned int bit = __builtin_ctz(bits);
+      if (held[field][bit]++ == 0) {
+        held_since[field][bit] = new_state.time_stamp;
       }
-      sig_bumper_event.emit(event);
-    }
-  }
-
-  // ------------
-  // Cliff Event
-  // ------------
-
-  if (last_state.cliff != new_state.cliff)
-  {
-    CliffEvent event;
-
-    // Check changes in each cliff sensor state's and raise an event if so
-    if ((new_state.cliff ^ last_state.cliff) & CoreSensors::Flags::LeftCliff) {
-      event.sensor = CliffEvent::Left;
-      if (new_state.cliff & CoreSensors::Flags::LeftCliff) {
-        event.state = CliffEvent::Cliff;
-      } else {
-        event.state = CliffEvent::Floor;
+      // firmware time wraps every 65.536s, the unsigned difference does not care
+      uint16_t held_time = new_state.time_stamp - held_since[field][bit];
+      if ((held[field][bit] < debounce_frames[field][bit]) || (held_time < debounce_time[field][bit])) {
+        continue;
       }
-      event.bottom = cliff_data[event.sensor];
-      sig_cliff_event.emit(event);
-    }
-
-    if ((new_state.cliff ^ last_state.cliff) & CoreSensors::Flags::CenterCliff) {
-      event.sensor = CliffEvent::Center;
-      if (new_state.cliff & CoreSensors::Flags::CenterCliff) {
-        event.state = CliffEvent::Cliff;
-      } else {
-        event.state = CliffEvent::Floor;
-      }
-      event.bottom = cliff_data[event.sensor];
-      sig_cliff_event.emit(event);
-    }
-
-    if ((new_state.cliff ^ last_state.cliff) & CoreSensors::Flags::RightCliff) {
-      event.sensor = CliffEvent::Right;
-      if (new_state.cliff & CoreSensors::Flags::RightCliff) {
-        event.state = CliffEvent::Cliff;
-      } else {
-        event.state = CliffEvent::Floor;
-      }
-      event.bottom = cliff_data[event.sensor];
-      sig_cliff_event.emit(event);
+      uint8_t mask = 1 << bit;
+      held[field][bit] = 0;
+      reported[field] ^= mask;
+      pending[field] &= ~mask;
+      const Entry &entry = table[lookup[field][bit]];
+      entry.factory(entry.id, values[field] & mask, cliff_data, time, batch);
     }
   }
-
-  // ------------
-  // Wheel Drop Event
-  // ------------
-
-  if (last_state.wheel_drop != new_state.wheel_drop)
-  {
-    WheelEvent event;
-
-    // Check changes in each wheel_drop sensor state's and raise an event if so
-    if ((new_state.wheel_drop ^ last_state.wheel_drop) & CoreSensors::Flags::LeftWheel) {
-      event.wheel = WheelEvent::Left;
-      if (new_state.wheel_drop & CoreSensors::Flags::LeftWheel) {
-        event.state = WheelEvent::Dropped;
-      } else {
-        event.state = WheelEvent::Raised;
-      }
-      sig_wheel_event.emit(event);
-    }
-
-    if ((new_state.wheel_drop ^ last_state.wheel_drop) & CoreSensors::Flags::RightWheel) {
-      event.wheel = WheelEvent::Right;
-      if (new_state.wheel_drop & CoreSensors::Flags::RightWheel) {
-        event.state = WheelEvent::Dropped;
-      } else {
-        event.state = WheelEvent::Raised;
-      }
-      sig_wheel_event.emit(event);
-    }
+  updatePower(new_state, time);
+  last_state = new_state;
+  if (!batch.empty()) {
+    emit();
   }
+}
 
-  // ------------
-  // Power System Event
-  // ------------
-
+/**
+ * Charging state and battery level changes; these are not simple flags.
+ * @param new_state  Updated core sensors state
+ * @param time       Host time [s] the frame was stamped by the firmware
+ */
+void EventManager::updatePower(const CoreSensors::Data &new_state, const double &time) {
   if (last_state.charger != new_state.charger)
   {
     Battery battery_new(new_state.battery, new_state.charger);
@@ -236,6 +250,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
     if (battery_last.charging_state != battery_new.charging_state)
     {
       PowerEvent event;
+      event.time = time;
       switch (battery_new.charging_state)
       {
         case Battery::Discharging:
@@ -251,7 +266,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
             event.event = PowerEvent::PluggedToDockbase;
           break;
       }
-      sig_power_event.emit(event);
+      batch.power_events.push_back(event);
     }
   }
 
@@ -263,6 +278,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
     if (battery_last.level() != battery_new.level())
     {
       PowerEvent event;
+      event.time = time;
       switch (battery_new.level())
       {
         case Battery::Low:
@@ -274,22 +290,44 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
         default:
           break;
       }
-      sig_power_event.emit(event);
+      batch.power_events.push_back(event);
     }
   }
+}
 
-  last_state = new_state;
+/**
+ * Deliver the frame's events, the whole batch first, then one by one.
+ */
+void EventManager::emit() {
+  sig_event_batch.emit(batch);
+  for (unsigned int i = 0; i < batch.button_events.size(); ++i) {
+    sig_button_event.emit(batch.button_events[i]);
+  }
+  for (unsigned int i = 0; i < batch.bumper_events.size(); ++i) {
+    sig_bumper_event.emit(batch.bumper_events[i]);
+  }
+  for (unsigned int i = 0; i < batch.cliff_events.size(); ++i) {
+    sig_cliff_event.emit(batch.cliff_events[i]);
+  }
+  for (unsigned int i = 0; i < batch.wheel_events.size(); ++i) {
+    sig_wheel_event.emit(batch.wheel_events[i]);
+  }
+  for (unsigned int i = 0; i < batch.power_events.size(); ++i) {
+    sig_power_event.emit(batch.power_events[i]);
+  }
 }
 
 /**
  * Emit events if something changed in the digital input port.
  * @param new_digital_input New values on digital input port.
+ * @param time Host time [s] the frame was stamped by the firmware.
  */
-void EventManager::update(const uint16_t &new_digital_input)
+void EventManager::update(const uint16_t &new_digital_input, const double &time)
 {
   if (last_digital_input != new_digital_input)
   {
     InputEvent event;
+    event.time = time;
 
     event.values[0] = new_digital_input&0x0001;
     event.values[1] = new_digital_input&0x0002;
@@ -315,6 +353,7 @@ void EventManager::update(bool is_plugged, bool is_alive)
   {
     RobotEvent event;
     event.state = robot_state;
+    event.time = ecl::TimeStamp();
 
     sig_robot_event.emit(event);
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/firmware_clock.cpp
+ *
+ * @brief Implementation of the firmware to host clock synchronisation.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include "../../include/kobuki_driver/modules/firmware_clock.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+/**
+ * @param max_drift : relative drift [s/s] between the firmware and host clocks to follow.
+ * @param resync_threshold : jump [s] in (arrival - stamp) treated as a discontinuity, a few frames.
+ */
+FirmwareClock::FirmwareClock(const double &max_drift, const double &resync_threshold) :
+  initialised(false),
+  last_time_stamp(0),
+  firmware_time(0.0),
+  frame_interval(0.0),
+  offset(0.0),
+  max_drift(max_drift),
+  resync_threshold(resync_threshold)
+{}
+
+void FirmwareClock::reset() {
+  initialised = false;
+  firmware_time = 0.0;
+  frame_interval = 0.0;
+  offset = 0.0;
+}
+
+/**
+ * @brief Register a new frame.
+ *
+ * @param time_stamp : firmware time stamp [ms]
+ * @param arrival : host time [s] at which the frame was received
+ */
+void FirmwareClock::update(const uint16_t &time_stamp, const double &arrival) {
+  if ( initialised ) {
+    // a reboot or a gap of more than a wrap breaks the unwrapping, start over
+    double dt = static_cast<double>(static_cast<uint16_t>(time_stamp - last_time_stamp)) / 1000.0;
+    if ( std::fabs(arrival - ( firmware_time + dt ) - offset) > resync_threshold ) {
+      initialised = false;
+    }
+  }
+  if ( !initialised ) {
+    last_time_stamp = time_stamp;
+    firmware_time = 0.0;
+    frame_interval = 0.0;
+    offset = arrival;
+    initialised = true;
+    return;
+  }
+  double dt = static_cast<double>(static_cast<uint16_t>(time_stamp - last_time_stamp)) / 1000.0;
+  last_time_stamp = time_stamp;
+  firmware_time += dt;
+  frame_interval = dt;
+
+  double observed = arrival - firmware_time;
+  if ( observed < offset ) {
+    offset = observed; // less transport delay than ever seen before
+  } else {
+    offset += std::min(observed - offset, max_drift * dt);
+  }
+}
+
+/**
+ * @brief Unwrap a firmware stamp close to (within ~32s of) the latest frame.
+ *
+ * @param time_stamp : firmware time stamp [ms]
+ * @return double : unwrapped firmware time [s]
+ */
+double FirmwareClock::unwrap(const uint16_t &time_stamp) const {
+  int16_t diff = static_cast<int16_t>(static_cast<uint16_t>(time_stamp - last_time_stamp));
+  return firmware_time + static_cast<double>(diff) / 1000.0;
+}
+
+} // namespace kobuki
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/frame_queue.cpp
+ *
+ * @brief Implementation of the frame queue.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <ecl/time/timestamp.hpp>
+#include "../../include/kobuki_driver/modules/frame_queue.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+namespace {
+
+double now() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+} // anonymous namespace
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+const unsigned int FrameQueue::max_frame_size;
+
+void FrameQueue::Stage::add(const double &value) {
+  last = value;
+  minimum = ( count == 0 ) ? value : std::min(minimum, value);
+  maximum = ( count == 0 ) ? value : std::max(maximum, value);
+  count += 1;
+  mean += (value - mean) / count;
+}
+
+FrameQueue::FrameQueue() :
+  is_enabled(false),
+  head(0),
+  tail(0),
+  dequeue_time(0.0),
+  frames(0),
+  overruns(0)
+{
+  available = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+FrameQueue::~FrameQueue() {
+  if ( available != -1 ) {
+    close(available);
+  }
+}
+
+/**
+ * @brief Size the ring; call before either thread uses it.
+ *
+ * @param enable : whether the driver runs a separate processing thread.
+ * @param capacity : number of frame slots (at 50Hz, 16 slots is 320ms of slack).
+ */
+void FrameQueue::init(const bool &enable, const unsigned int &capacity) {
+  is_enabled = enable;
+  slots.assign(enable ? std::max(capacity, 2u) : 0, Frame());
+  head = tail = 0;
+  uint64_t count;
+  while ( read(available, &count, sizeof(count)) == sizeof(count) ) {}
+  frames = overruns = 0;
+  stats_mutex.lock();
+  stats = Statistics();
+  stats_mutex.unlock();
+}
+
+/**
+ * @brief Slot for the producer to fill, or null (an overrun) if the ring is full.
+ */
+FrameQueue::Frame* FrameQueue::claim() {
+  unsigned long consumed = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  if ( tail - consumed >= slots.size() ) {
+    __atomic_fetch_add(&overruns, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  return &slots[tail % slots.size()];
+}
+
+/**
+ * @brief Hand the claimed slot over to the consumer.
+ */
+void FrameQueue::publish() {
+  __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&frames, 1, __ATOMIC_RELAXED);
+  uint64_t one = 1;
+  if ( write(available, &one, sizeof(one)) != sizeof(one) ) {}
+}
+
+/**
+ * @brief Wait for the oldest frame.
+ *
+ * The wait is relative on the monotonic clock, so the wall clock being
+ * stepped (e.g. by ntp) neither cuts it short nor stretches it.
+ *
+ * @param timeout_ms : how long to wait for one.
+ * @return Frame* : the frame, valid until release(), or null on timeout.
+ */
+FrameQueue::Frame* FrameQueue::front(const long &timeout_ms) {
+  double deadline = now() + std::max(timeout_ms, 0L) / 1000.0;
+  uint64_t count;
+  while ( read(available, &count, sizeof(count)) != sizeof(count) ) {
+    long remaining = static_cast<long>((deadline - now()) * 1000.0 + 0.999);
+    if ( remaining <= 0 ) {
+      return NULL;
+    }
+    pollfd request;
+    request.fd = available;
+    request.events = POLLIN;
+    request.revents = 0;
+    if ( ( poll(&request, 1, static_cast<int>(remaining)) < 0 ) && ( errno != EINTR ) ) {
+      return NULL;
+    }
+  }
+  unsigned long published = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  Frame *frame = &slots[head % slots.size()];
+  dequeue_time = static_cast<double>(ecl::TimeStamp());
+  stats_mutex.lock();
+  stats.depth = published - head;
+  stats.max_depth = std::max(stats.max_depth, stats.depth);
+  stats.queueing.add(dequeue_time - frame->arrival);
+  stats_mutex.unlock();
+  return frame;
+}
+
+/**
+ * @brief Done with the frame from front(), give its slot back to the producer.
+ */
+void FrameQueue::release() {
+  double processing = static_cast<double>(ecl::TimeStamp()) - dequeue_time;
+  stats_mutex.lock();
+  stats.processing.add(processing);
+  stats_mutex.unlock();
+  __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+}
+
+FrameQueue::Statistics FrameQueue::statistics() const {
+  stats_mutex.lock();
+  Statistics copy = stats;
+  stats_mutex.unlock();
+  copy.frames = __atomic_load_n(&frames, __ATOMIC_RELAXED);
+  copy.overruns = __atomic_load_n(&overruns, __ATOMIC_RELAXED);
+  return copy;
+}
+
+} // namespace kobuki
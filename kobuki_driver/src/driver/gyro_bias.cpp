@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/gyro_bias.cpp
+ *
+ * @brief Implementation of the stationary gyro bias estimator.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <ecl/math.hpp>
+#include "../../include/kobuki_driver/modules/gyro_bias.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+GyroBias::GyroBias() :
+  initialised(false),
+  last_time_stamp(0),
+  last_left_encoder(0),
+  last_right_encoder(0),
+  last_angle(0.0),
+  last_rate(0.0),
+  settle_time(0.5),
+  memory(60.0),
+  stationary_time(0.0),
+  rate_bias(0.0),
+  bias_weight(0.0),
+  rate_scale(1.0),
+  heading_correction(0.0)
+{}
+
+/**
+ * @param settle_time : time [s] the robot must be still before drift is measured.
+ * @param memory : maximum evidence [s] kept in the bias estimate, so it can follow temperature changes.
+ */
+void GyroBias::init(const double &settle_time, const double &memory) {
+  this->settle_time = settle_time;
+  this->memory = memory;
+  reset();
+}
+
+/**
+ * @brief Forget the bias estimate and the accumulated heading correction.
+ */
+void GyroBias::reset() {
+  initialised = false;
+  stationary_time = 0.0;
+  rate_bias = 0.0;
+  bias_weight = 0.0;
+  heading_correction = 0.0;
+}
+
+/**
+ * @brief Start from a previously estimated bias, e.g. cached from the last run.
+ *
+ * @param bias : rate bias [rad/s]
+ * @param weight : evidence [s] to credit it with; small, so fresh measurements soon take over.
+ */
+void GyroBias::seed(const double &bias, const double &weight) {
+  rate_bias = bias;
+  bias_weight = std::min(weight, memory);
+}
+
+/**
+ * @brief Correct the gyro's scale, e.g. from an offline calibration.
+ *
+ * @param scale : true rotation per unit of gyro rotation, zero or less for none.
+ */
+void GyroBias::setScale(const double &scale) {
+  rate_scale = ( scale > 0.0 ) ? scale : 1.0;
+}
+
+/**
+ * @brief Feed a new frame of core sensor and inertia data.
+ *
+ * @param time_stamp : firmware time stamp [ms]
+ * @param left_encoder : left encoder ticks
+ * @param right_encoder : right encoder ticks
+ * @param bumper : bumper flags
+ * @param commanding_motion : whether a non-zero velocity is currently commanded
+ * @param angle : raw gyro heading [hundredths of a degree]
+ * @param angle_rate : raw gyro rate [hundredths of a degree per second]
+ */
+void GyroBias::update(const uint16_t &time_stamp,
+                      const uint16_t &left_encoder,
+                      const uint16_t &right_encoder,
+                      const uint8_t &bumper,
+                      const bool &commanding_motion,
+                      const int16_t &angle,
+                      const int16_t &angle_rate) {
+  // raw data angles are in hundredths of a degree, convert to radians.
+  double new_angle = (static_cast<double>(angle) / 100.0) * ecl::pi / 180.0;
+  double new_rate = (static_cast<double>(angle_rate) / 100.0) * ecl::pi / 180.0;
+
+  if ( !initialised ) {
+    last_time_stamp = time_stamp;
+    last_left_encoder = left_encoder;
+    last_right_encoder = right_encoder;
+    last_angle = new_angle;
+    last_rate = new_rate;
+    initialised = true;
+    return;
+  }
+
+  double dt = static_cast<double>(static_cast<uint16_t>(time_stamp - last_time_stamp)) / 1000.0;
+  double angle_diff = ecl::wrap_angle(new_angle - last_angle);
+  bool still = ( left_encoder == last_left_encoder ) && ( right_encoder == last_right_encoder )
+               && ( bumper == 0 ) && !commanding_motion;
+
+  if ( still ) {
+    stationary_time += dt;
+  } else {
+    stationary_time = 0.0;
+  }
+
+  if ( isStationary() && ( dt > 0.0 ) ) {
+    // everything the gyro reports now is drift
+    heading_correction += angle_diff;
+    rate_bias = ( rate_bias * bias_weight + angle_diff ) / ( bias_weight + dt );
+    bias_weight = std::min(bias_weight + dt, memory);
+  } else {
+    // what the heading should have turned by is the scaled, bias free rotation
+    heading_correction += angle_diff - rate_scale * ( angle_diff - rate_bias * dt );
+  }
+  ecl::wrap_angle(heading_correction); // in place
+
+  last_time_stamp = time_stamp;
+  last_left_encoder = left_encoder;
+  last_right_encoder = right_encoder;
+  last_angle = new_angle;
+  last_rate = new_rate;
+}
+
+double GyroBias::heading() const {
+  return ecl::wrap_angle(last_angle - heading_correction);
+}
+
+} // namespace kobuki
@@ -36,6 +36,7 @@
  ** Includes
  *****************************************************************************/
 
+#include <algorithm>
 #include <stdexcept>
 #include <ecl/math.hpp>
 #include <ecl/geometry/angle.hpp>
@@ -75,7 +76,7 @@ bool PacketFinder::checkSum()
 
 Kobuki::Kobuki() :
     shutdown_requested(false), is_enabled(false), is_connected(false), is_alive(false)
-    , version_info_reminder(0)
+    , stream_timeout(0.1), last_notice(0.0), battery_capacity_configured(false), plugin_input(-1)
 {
 }
 
@@ -86,10 +87,32 @@ Kobuki::~Kobuki()
 {
   disable();
   shutdown_requested = true; // thread's spin() will catch this and terminate
-  thread.join();
+  if ( parameters.reactor ) {
+    parameters.reactor->remove(this);
+  } else {
+    thread.join();
+    if ( frame_queue.isEnabled() ) {
+      processing_thread.join();
+    }
+  }
+  if ( connection.isVerified() ) {
+    saveCachedDevice(); // keep the latest gyro bias for next time
+  }
+  cache_writer.stop(); // finishes writing it
   sig_debug.emit("Device: kobuki driver terminated.");
 }
 
+/**
+ * @brief Configure the driver and start the worker thread.
+ *
+ * Returns straight away; the worker thread (or the reactor in the
+ * parameters) waits for the device, opens it
+ * and signals "/ready" on the first frame. Use waitUntilStreaming() or
+ * waitForHandshake() to block until then.
+ *
+ * @param parameters : driver configuration.
+ * @exception StandardException : if the parameters do not validate.
+ */
 void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
 {
 
@@ -100,6 +123,10 @@ void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
   this->parameters = parameters;
   std::string sigslots_namespace = parameters.sigslots_namespace;
   event_manager.init(sigslots_namespace);
+  event_manager.setDebounce(EventManager::Bumper, parameters.bumper_debounce);
+  event_manager.setDebounce(EventManager::Cliff, parameters.cliff_debounce);
+  event_manager.setDebounce(EventManager::WheelDrop, parameters.wheel_drop_debounce);
+  event_manager.setCliffHysteresis(parameters.cliff_hysteresis);
 
   // connect signals
   sig_version_info.connect(sigslots_namespace + std::string("/version_info"));
@@ -112,47 +139,171 @@ void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
   sig_info.connect(sigslots_namespace + std::string("/ros_info"));
   sig_warn.connect(sigslots_namespace + std::string("/ros_warn"));
   sig_error.connect(sigslots_namespace + std::string("/ros_error"));
+  sig_ready.connect(sigslots_namespace + std::string("/ready"));
+  sig_motion_result.connect(sigslots_namespace + std::string("/motion_result"));
 
-  //checking device
-  if (access(parameters.device_port.c_str(), F_OK) == -1)
-  {
-    ecl::Sleep waiting(5); //for 5sec.
-    event_manager.update(is_connected, is_alive);
-    while (access(parameters.device_port.c_str(), F_OK) == -1)
-    {
-      sig_info.emit("Device does not exist. Waiting...");
-      waiting();
-    }
+  transport = Transport::create(parameters.device_port);
+  if ( !transport ) {
+    throw ecl::StandardException(LOC, ecl::ConfigurationError, "Kobuki's device port is not a device or a uri it understands.");
+  }
+  if ( !parameters.record_file.empty() ) {
+    transport.reset(new RecordingTransport(transport, parameters.record_file));
   }
 
-  serial.open(parameters.device_port, ecl::BaudRate_115200, ecl::DataBits_8, ecl::StopBits_1, ecl::NoParity);
-
-  is_connected = true;
-  is_alive = true;
-
-  serial.block(4000); // blocks by default, but just to be clear!
-  serial.clear();
+  connection.init(parameters.handshake_attempts, parameters.handshake_retry_interval, parameters.handshake_timeout);
   ecl::PushAndPop<unsigned char> stx(2, 0);
   ecl::PushAndPop<unsigned char> etx(1);
   stx.push_back(0xaa);
   stx.push_back(0x55);
   packet_finder.configure(sigslots_namespace, stx, etx, 1, 256, 1, true);
 
-  diff_drive.init();
-  gate_keeper.init(parameters.enable_gate_keeper);
+  diff_drive.init(parameters.velocity_window);
+  velocity_smoother.init(parameters.enable_velocity_smoother, parameters.linear_limits, parameters.angular_limits);
+  if ( parameters.enable_velocity_smoother ) {
+    trajectory_buffer.init(std::max(parameters.linear_limits.acceleration, parameters.linear_limits.deceleration),
+                           std::max(parameters.angular_limits.acceleration, parameters.angular_limits.deceleration));
+  }
+  command_scheduler.init(parameters.enable_command_scheduling, parameters.command_lead, diff_drive.encoder_resolution());
+  command_scheduler.initChangeDriven(parameters.enable_change_driven_commands, parameters.command_keepalive);
+  safety_reflex.init(parameters.safety_reflex);
+  link_statistics.reset();
+  frame_queue.init(parameters.enable_processing_thread, parameters.frame_queue_size);
+  gyro_bias.init(parameters.gyro_bias_settle_time, parameters.gyro_bias_memory);
+  motion_primitive.init(parameters.motion_limits);
+  firmware_clock.reset();
+  pose.setIdentity();
+  frame_pose_update.setIdentity();
+  frame_pose_update_rates.setZero();
+  pose_history.init(parameters.pose_history_size);
+  odometry_covariance.init(parameters.odometry_distance_noise, parameters.odometry_rotation_noise,
+                           parameters.odometry_drift_noise, parameters.odometry_slip_gain,
+                           parameters.odometry_heading_variance);
+  dock_ir_filter.init(parameters.dock_ir_window);
 
   // in case the user changed these from the defaults
+  battery_capacity_configured = ( parameters.battery_capacity != Battery::capacity );
   Battery::capacity = parameters.battery_capacity;
   Battery::low = parameters.battery_low;
   Battery::dangerous = parameters.battery_dangerous;
 
   /******************************************
-   ** Get Version Info Commands
+   ** Device Cache
    *******************************************/
-  version_info_reminder = 10;
-  sendCommand(Command::GetVersionInfo());
+  device_cache.init(parameters.cache_directory);
+  default_calibration = DeviceCache::Entry();
+  default_calibration.wheel_bias = diff_drive.wheel_bias();
+  default_calibration.tick_to_rad = diff_drive.encoder_resolution();
+  default_calibration.battery_capacity = parameters.battery_capacity;
+  cached_device = DeviceCache::Entry();
+  if ( device_cache.isEnabled() ) {
+    cache_writer.start(device_cache, parameters.device_port);
+  }
 
-  thread.start(&Kobuki::spin, *this);
+  // waiting for and opening the device happens on the worker thread (or the reactor)
+  if ( parameters.reactor ) {
+    parameters.reactor->add(this);
+  } else {
+    thread.start(&Kobuki::spin, *this);
+    if ( frame_queue.isEnabled() ) {
+      processing_thread.start(&Kobuki::process, *this);
+    }
+  }
+}
+
+/**
+ * @brief Wait for the device to appear, then open it.
+ *
+ * Runs on the worker thread so init() never blocks on a missing device.
+ *
+ * @return bool : true if opened, false if shutdown was requested meanwhile.
+ */
+bool Kobuki::connect()
+{
+  ecl::MilliSleep sleep;
+  while (!shutdown_requested)
+  {
+    state_mutex.lock();
+    bool opened = openDevice();
+    state_mutex.unlock();
+    if (opened)
+    {
+      return true;
+    }
+    sleep(100);
+  }
+  return false;
+}
+
+/**
+ * @brief Make one attempt at opening the device.
+ *
+ * Failures are reported at most every five seconds.
+ *
+ * @return bool : true if opened.
+ */
+bool Kobuki::openDevice()
+{
+  ecl::Duration notice_interval(5.0);
+  if (!transport->exists())
+  {
+    if ((ecl::TimeStamp() - last_notice) > notice_interval)
+    {
+      sig_info.emit("Device does not exist. Waiting...");
+      last_notice.stamp();
+    }
+    return false;
+  }
+  connection.opening();
+  if (!transport->open())
+  {
+    if ((ecl::TimeStamp() - last_notice) > notice_interval)
+    {
+      sig_error.emit("Could not open the device: " + transport->errorMessage());
+      last_notice.stamp();
+    }
+    return false;
+  }
+  PtyTransport *pty = dynamic_cast<PtyTransport*>(transport.get());
+  if (pty)
+  {
+    sig_info.emit("pseudo terminal for the emulator is " + pty->slaveName());
+  }
+  sig_info.emit("device is connected (" + transport->uri() + ").");
+  is_connected = true;
+  is_alive = true;
+  event_manager.update(is_connected, is_alive);
+  connection.opened(ecl::TimeStamp(), warmStart()); // version requests go out as the frames come in
+  return true;
+}
+
+/**
+ * @brief The device went away (or was never there); close it and reset the link state.
+ */
+void Kobuki::dropConnection()
+{
+  if( transport->isOpen() )
+  {
+    sig_error.emit("Device does not exist.");
+    sig_info.emit("Device is still open, closing it and will try to open it again.");
+    command_mutex.lock(); // not under a command write from a user thread
+    transport->close();
+    command_mutex.unlock();
+  }
+  is_connected = false;
+  is_alive = false;
+  command_scheduler.forceNext();
+  safety_reflex.reset();
+  trajectory_buffer.cancel();
+  motion_primitive.cancel();
+  int input = __atomic_load_n(&plugin_input, __ATOMIC_ACQUIRE);
+  if ( input >= 0 ) {
+    velocity_mux.release(input);
+  }
+  dock_ir_filter.reset();
+  firmware_clock.reset();
+  connection.disconnected();
+  event_manager.update(is_connected, is_alive);
+  last_notice = ecl::TimeStamp(0.0); // report the first failure to reconnect straight away
 }
 
 /*****************************************************************************
@@ -163,15 +314,14 @@ void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
  * @brief Performs a scan looking for incoming data packets.
  *
  * Sits on the device waiting for incoming and then parses it, and signals
- * that an update has occured.
+ * that an update has occured. Drivers served by a Reactor do not use this,
+ * the reactor calls readable() and service() instead.
  *
  * Or, if in simulation, just loopsback the motor devices.
  */
 
 void Kobuki::spin()
 {
-  ecl::TimeStamp last_signal_time;
-  ecl::Duration timeout(0.1);
   unsigned char buf[256];
 
   /*********************
@@ -183,220 +333,484 @@ void Kobuki::spin()
     /*********************
      ** Checking Connection
      **********************/
-    if( access( parameters.device_port.c_str(), F_OK ) == -1 ) {
-      sig_error.emit("Device does not exist.");
-      is_connected = false;
-      is_alive = false;
-      event_manager.update(is_connected, is_alive);
-
-      if( serial.open() )
-      {
-        sig_info.emit("Device is still open, closing it and will try to open it again.");
-        serial.close();
-      }
-      //try_open();
-      ecl::Sleep waiting(5); //for 5sec.
-      while( access( parameters.device_port.c_str(), F_OK ) == -1 ) {
-        sig_info.emit("Device does not exist. Still waiting...");
-        waiting();
-      }
-      serial.open(parameters.device_port, ecl::BaudRate_115200, ecl::DataBits_8, ecl::StopBits_1, ecl::NoParity);
-      if( serial.open() ) {
-        sig_info.emit("device is connected.");
-        is_connected = true;
-        event_manager.update(is_connected, is_alive);
-        version_info_reminder = 10;
+    if( !transport->isOpen() || !transport->exists() ) {
+      state_mutex.lock();
+      dropConnection();
+      state_mutex.unlock();
+      if( !connect() ) {
+        break; // shutdown requested
       }
     }
 
+    /*********************
+     ** Scheduled Commands
+     **********************/
+    // wake up from the read in time for the scheduled transmission, unless
+    // the processing thread is looking after that
+    long wait = frame_queue.isEnabled() ? 4000 : serviceCommands();
+
     /*********************
      ** Read Incoming
      **********************/
-    int n = serial.read(buf, packet_finder.numberOfDataToRead());
-    if (n == 0)
+    int n = 0;
+    long idle = transport->idleTime();
+    if ( idle > 0 ) {
+      ecl::MilliSleep sleep;
+      sleep(static_cast<unsigned long>(std::min(wait, idle))); // nothing to read yet (e.g. a pty with no emulator)
+    } else {
+      n = transport->read(buf, packet_finder.numberOfDataToRead(), wait);
+    }
+    received(buf, n);
+  }
+  sig_error.emit("Driver worker thread shutdown!");
+}
+
+/**
+ * @brief Transmit base control if its scheduled time has come.
+ *
+ * @return long : milliseconds until the next scheduled transmission.
+ */
+long Kobuki::serviceCommands()
+{
+  long wait = 4000;
+  if ( command_scheduler.isPending() ) {
+    wait = static_cast<long>((command_scheduler.transmitTime() - ecl::TimeStamp()) * 1000.0);
+    if ( wait <= 0 ) {
+      transmitBaseControl();
+      wait = 4000;
+    }
+  }
+  return wait;
+}
+
+/**
+ * @brief Handle the outcome of a read from the device.
+ *
+ * @param buf : bytes read.
+ * @param n : number of bytes read, 0 on timeout, negative if the device is lost.
+ */
+void Kobuki::received(const unsigned char *buf, const int &n)
+{
+  if (n < 0)
+  {
+    sig_error.emit("Lost the device: " + transport->errorMessage());
+    // the processing thread (or a user thread) may be writing a command
+    state_mutex.lock();
+    command_mutex.lock();
+    transport->close(); // reconnects on the next pass
+    command_mutex.unlock();
+    state_mutex.unlock();
+    return;
+  }
+  else if (n == 0)
+  {
+    if (!frame_queue.isEnabled()) // else the processing thread keeps the watchdog
     {
-      if (is_alive && ((ecl::TimeStamp() - last_signal_time) > timeout))
-      {
-        is_alive = false;
-        version_info_reminder = 10;
-        sig_debug.emit("Timed out while waiting for incoming bytes.");
-      }
-      event_manager.update(is_connected, is_alive);
-      continue;
+      watchdog();
+    }
+    return;
+  }
+  else
+  {
+    link_statistics.received(n);
+    std::ostringstream ostream;
+    ostream << "kobuki_node : serial_read(" << n << ")"
+      << ", packet_finder.numberOfDataToRead(" << packet_finder.numberOfDataToRead() << ")";
+    sig_debug.emit(ostream.str());
+    // might be useful to send this to a topic if there is subscribers
+  }
+
+  if (packet_finder.update(buf, n)) // this clears packet finder's buffer and transfers important bytes into it
+  {
+    ecl::TimeStamp arrival_time;
+    if (frame_queue.isEnabled())
+    {
+      queueFrame(arrival_time);
     }
     else
     {
-      std::ostringstream ostream;
-      ostream << "kobuki_node : serial_read(" << n << ")"
-        << ", packet_finder.numberOfDataToRead(" << packet_finder.numberOfDataToRead() << ")";
-      sig_debug.emit(ostream.str());
-      // might be useful to send this to a topic if there is subscribers
+      packet_finder.getBuffer(data_buffer); // get a reference to packet finder's buffer.
+      processFrame(arrival_time);
     }
+  }
+  else if (!frame_queue.isEnabled())
+  {
+    // do not call here the event manager update (watchdog()), as it generates a spurious offline state
+    checkStream();
+  }
+}
 
-    if (packet_finder.update(buf, n)) // this clears packet finder's buffer and transfers important bytes into it
+/**
+ * @brief Nothing arrived in time; drop the alive flag if the stream has stalled.
+ */
+void Kobuki::watchdog()
+{
+  checkStream();
+  event_manager.update(is_connected, is_alive);
+}
+
+/**
+ * @brief Drop the alive flag if the stream has stalled.
+ *
+ * The next command then goes out straight away rather than waiting for a
+ * control tick that is no longer being reported.
+ */
+void Kobuki::checkStream()
+{
+  if (is_alive && ((ecl::TimeStamp() - last_signal_time) > stream_timeout))
+  {
+    is_alive = false;
+    command_scheduler.forceNext();
+    firmware_clock.reset();
+    connection.streamLost();
+    sig_debug.emit("Timed out while waiting for incoming bytes.");
+  }
+}
+
+/**
+ * @brief Decode the packet in the data buffer and act on it.
+ *
+ * @param arrival_time : when the packet was framed.
+ */
+void Kobuki::processFrame(const ecl::TimeStamp &arrival_time)
+{
+  PacketFinder::BufferType local_buffer;
+  local_buffer = data_buffer; //copy it to local_buffer, debugging purpose.
+  sig_raw_data_stream.emit(local_buffer);
+
+  // deserialise; first three bytes are not data.
+  data_buffer.pop_front();
+  data_buffer.pop_front();
+  data_buffer.pop_front();
+
+  bool has_core_sensors = false, has_gp_input = false, has_dock_ir = false;
+  while (data_buffer.size() > 1/*size of etx*/)
+  {
+    //std::cout << "header_id: " << (unsigned int)data_buffer[0] << " | ";
+    //std::cout << "remains: " << data_buffer.size() << " | ";
+    //std::cout << "local_buffer: " << local_buffer.size() << " | ";
+    //std::cout << std::endl;
+    switch (data_buffer[0])
     {
-      packet_finder.getBuffer(data_buffer); // get a reference to packet finder's buffer.
-      PacketFinder::BufferType local_buffer;
-      local_buffer = data_buffer; //copy it to local_buffer, debugging purpose.
-      sig_raw_data_stream.emit(local_buffer);
+      // these come with the streamed feedback
+      case Header::CoreSensors:
+        core_sensors.deserialise(data_buffer);
+        has_core_sensors = true;
+        break;
+      case Header::DockInfraRed:
+        dock_ir.deserialise(data_buffer);
+        has_dock_ir = true;
+        break;
+      case Header::Inertia:
+        inertia.deserialise(data_buffer);
+        break;
+      case Header::Cliff:
+        cliff.deserialise(data_buffer);
+        break;
+      case Header::Current:
+        current.deserialise(data_buffer);
+        break;
+      case Header::GpInput:
+        gp_input.deserialise(data_buffer);
+        has_gp_input = true;
+        break;
+        // the rest are only included on request
+      case Header::Hardware:
+        hardware.deserialise(data_buffer);
+        //sig_version_info.emit(VersionInfo(firmware.data.version, hardware.data.version));
+        break;
+      case Header::Firmware:
+        firmware.deserialise(data_buffer);
+        checkFirmwareVersion();
+        break;
+      case Header::UniqueDeviceID:
+        unique_device_id.deserialise(data_buffer);
+        verifyCachedDevice();
+        sig_version_info.emit( VersionInfo( firmware.data.version, hardware.data.version
+            , unique_device_id.data.udid0, unique_device_id.data.udid1, unique_device_id.data.udid2 ));
+        sig_info.emit("Robot version. Hardware: " + VersionInfo::toString(hardware.data.version)
+                                 + ". Firmware: " + VersionInfo::toString(firmware.data.version));
+        connection.handshakeComplete(arrival_time);
+        saveCachedDevice();
+        break;
+      default:
+        if (data_buffer.size() < 3 ) { /* minimum is 3, header_id, length, etx */
+          sig_error.emit("malformed subpayload detected.");
+          data_buffer.clear();
+        } else {
+          std::stringstream ostream;
+          unsigned int header_id = static_cast<unsigned int>(data_buffer.pop_front());
+          unsigned int length = static_cast<unsigned int>(data_buffer.pop_front());
+          unsigned int remains = data_buffer.size();
+          unsigned int to_pop;
 
-      // deserialise; first three bytes are not data.
-      data_buffer.pop_front();
-      data_buffer.pop_front();
-      data_buffer.pop_front();
+          ostream << "[" << header_id << "]";
+          ostream << "[" << length << "] ";
+
+          ostream << "[";
+          ostream << std::setfill('0') << std::uppercase;
+          ostream << std::hex << std::setw(2) << header_id << " " << std::dec;
+          ostream << std::hex << std::setw(2) << length << " " << std::dec;
+
+          if (remains < length) to_pop = remains;
+          else                  to_pop = length;
+
+          for (unsigned int i = 0; i < to_pop; i++ ) {
+            unsigned int byte = static_cast<unsigned int>(data_buffer.pop_front());
+            ostream << std::hex << std::setw(2) << byte << " " << std::dec;
+          }
+          ostream << "]";
+
+          if (remains < length) sig_error.emit("malformed sub-payload detected. "  + ostream.str());
+          else                  sig_debug.emit("unexpected sub-payload received. " + ostream.str());
 
-      while (data_buffer.size() > 1/*size of etx*/)
-      {
-        //std::cout << "header_id: " << (unsigned int)data_buffer[0] << " | ";
-        //std::cout << "remains: " << data_buffer.size() << " | ";
-        //std::cout << "local_buffer: " << local_buffer.size() << " | ";
-        //std::cout << std::endl;
-        switch (data_buffer[0])
-        {
-          // these come with the streamed feedback
-          case Header::CoreSensors:
-            core_sensors.deserialise(data_buffer);
-            event_manager.update(core_sensors.data, cliff.data.bottom);
-            break;
-          case Header::DockInfraRed:
-            dock_ir.deserialise(data_buffer);
-            break;
-          case Header::Inertia:
-            inertia.deserialise(data_buffer);
-            break;
-          case Header::Cliff:
-            cliff.deserialise(data_buffer);
-            break;
-          case Header::Current:
-            current.deserialise(data_buffer);
-            break;
-          case Header::GpInput:
-            gp_input.deserialise(data_buffer);
-            event_manager.update(gp_input.data.digital_input);
-            break;
-            // the rest are only included on request
-          case Header::Hardware:
-            hardware.deserialise(data_buffer);
-            //sig_version_info.emit(VersionInfo(firmware.data.version, hardware.data.version));
-            break;
-          case Header::Firmware:
-            firmware.deserialise(data_buffer);
-            try
-            {
-              // Check firmware/driver compatibility; mayor version must be the same
-              int version_match = firmware.check_mayor_version();
-              if (version_match < 0) {
-                sig_error.emit("Robot firmware is outdated and needs to be upgraded. Consult how-to on: " \
-                               "http://kobuki.yujinrobot.com/documentation/howtos/upgrading-firmware");
-                sig_warn.emit("Robot version is " + VersionInfo::toString(firmware.data.version)
-                        + "; current version is " + firmware.current_version());
-                shutdown_requested = true;
-              }
-              else if (version_match > 0) {
-                sig_error.emit("Driver version isn't not compatible with robot firmware. Please upgrade driver");
-                shutdown_requested = true;
-              }
-              else
-              {
-                // And minor version don't need to, but just make a suggestion
-                version_match = firmware.check_minor_version();
-                if (version_match < 0) {
-                  sig_warn.emit("Robot firmware is outdated; we suggest you to upgrade it " \
-                                "to benefit from the latest features. Consult how-to on: "  \
-                                "http://kobuki.yujinrobot.com/documentation/howtos/upgrading-firmware");
-                  sig_warn.emit("Robot version is " + VersionInfo::toString(firmware.data.version)
-                          + "; current version is " + firmware.current_version());
-                }
-                else if (version_match > 0) {
-                  // Driver version is outdated; maybe we should also suggest to upgrade it, but this is not a typical case
-                }
-              }
-            }
-            catch (std::out_of_range& e)
-            {
-              // Wrong version hardcoded on firmware; lowest value is 10000
-              sig_error.emit(std::string("Invalid firmware version number: ").append(e.what()));
-              shutdown_requested = true;
-            }
-            break;
-          case Header::UniqueDeviceID:
-            unique_device_id.deserialise(data_buffer);
-            sig_version_info.emit( VersionInfo( firmware.data.version, hardware.data.version
-                , unique_device_id.data.udid0, unique_device_id.data.udid1, unique_device_id.data.udid2 ));
-            sig_info.emit("Robot version. Hardware: " + VersionInfo::toString(hardware.data.version)
-                                     + ". Firmware: " + VersionInfo::toString(firmware.data.version));
-            version_info_reminder = 0;
-            break;
-          default:
-            if (data_buffer.size() < 3 ) { /* minimum is 3, header_id, length, etx */
-              sig_error.emit("malformed subpayload detected.");
-              data_buffer.clear();
-            } else {
-              std::stringstream ostream;
-              unsigned int header_id = static_cast<unsigned int>(data_buffer.pop_front());
-              unsigned int length = static_cast<unsigned int>(data_buffer.pop_front());
-              unsigned int remains = data_buffer.size();
-              unsigned int to_pop;
-
-              ostream << "[" << header_id << "]";
-              ostream << "[" << length << "] ";
-
-              ostream << "[";
-              ostream << std::setfill('0') << std::uppercase;
-              ostream << std::hex << std::setw(2) << header_id << " " << std::dec;
-              ostream << std::hex << std::setw(2) << length << " " << std::dec;
-
-              if (remains < length) to_pop = remains;
-              else                  to_pop = length;
-
-              for (unsigned int i = 0; i < to_pop; i++ ) {
-                unsigned int byte = static_cast<unsigned int>(data_buffer.pop_front());
-                ostream << std::hex << std::setw(2) << byte << " " << std::dec;
-              }
-              ostream << "]";
-
-              if (remains < length) sig_error.emit("malformed sub-payload detected. "  + ostream.str());
-              else                  sig_debug.emit("unexpected sub-payload received. " + ostream.str());
-
-            }
-            break;
         }
-      }
+        break;
+    }
+  }
 
-      is_alive = true;
-      event_manager.update(is_connected, is_alive);
-      last_signal_time.stamp();
-      sig_stream_data.emit();
-      sendBaseControlCommand(); // send the command packet to mainboard;
-      if( version_info_reminder/*--*/ > 0 ) sendCommand(Command::GetVersionInfo());
+  firmware_clock.update(core_sensors.data.time_stamp, arrival_time);
+  // after the whole frame, so cliff events carry this frame's analog readings,
+  // and all are stamped with the frame's firmware time on the host clock
+  if (has_core_sensors)
+  {
+    event_manager.update(core_sensors.data, cliff.data.bottom, firmware_clock.hostTime());
+  }
+  if (has_gp_input)
+  {
+    event_manager.update(gp_input.data.digital_input, firmware_clock.hostTime());
+  }
+  command_scheduler.feedback(firmware_clock.hostTime(), firmware_clock.frameInterval(),
+                             core_sensors.data.left_encoder, core_sensors.data.right_encoder);
+  if ( has_core_sensors ) {
+    // the stationary test needs this frame's encoders, not the previous frame's again
+    gyro_bias.update(core_sensors.data.time_stamp, core_sensors.data.left_encoder, core_sensors.data.right_encoder,
+                     core_sensors.data.bumper, diff_drive.commandSpeed() != 0,
+                     inertia.data.angle, inertia.data.angle_rate);
+    integrateOdometry(); // once per frame, after the gyro bias so the covariance sees the corrected rate
+    motion_primitive.feedback(getHeading(), core_sensors.data.left_encoder, core_sensors.data.right_encoder);
+  }
+  if ( has_dock_ir ) {
+    dock_ir_filter.update(getHeading(), dock_ir.data.docking);
+  }
+  bool bumper_claimed = false;
+  if ( has_core_sensors && !plugin_host.empty() ) {
+    plugin_host.run(PluginHost::Feedback(firmware_clock.hostTime(), getHeading(), diff_drive.travel_resolution(),
+                                         core_sensors.data, cliff.data, dock_ir.data,
+                                         inertia.data, gp_input.data, event_manager.events()));
+    bumper_claimed = plugin_host.bumperClaimed();
+  }
+  // a reflex override goes out on this frame, ahead of the signals and the scheduled tick
+  bool reflex = has_core_sensors &&
+                safety_reflex.update(bumper_claimed ? 0 : core_sensors.data.bumper, core_sensors.data.cliff,
+                                     core_sensors.data.wheel_drop, firmware_clock.hostTime());
+  if ( reflex ) {
+    trajectory_buffer.cancel();
+    motion_primitive.cancel();
+    command_scheduler.forceNext();
+    if ( command_scheduler.isEnabled() ) {
+      // the override goes out now as this frame's command, not as an extra one
+      command_scheduler.frameArrived(firmware_clock.hostTime(), firmware_clock.frameInterval());
     }
-    else
+    transmitBaseControl();
+    sig_warn.emit("Safety reflex: " + safety_reflex.cause() + " triggered, "
+                  + ( safety_reflex.state() == SafetyReflex::Stopped ? "stopping." : "backing off." ));
+  }
+
+  is_alive = true;
+  bool first_frame = !connection.isStreaming();
+  connection.frameReceived(arrival_time);
+  if ( first_frame ) {
+    sig_ready.emit();
+  }
+  event_manager.update(is_connected, is_alive);
+  last_signal_time.stamp();
+  sig_stream_data.emit();
+  if ( !reflex ) { // otherwise this frame was answered above
+    if ( command_scheduler.isEnabled() ) {
+      command_scheduler.frameArrived(firmware_clock.hostTime(), firmware_clock.frameInterval());
+    } else {
+      transmitBaseControl(); // send the command packet to mainboard;
+    }
+  }
+  switch ( connection.update(arrival_time) ) {
+    case ConnectionState::RequestVersionInfo:
+      sendCommand(Command::GetVersionInfo());
+      break;
+    case ConnectionState::HandshakeFailed:
+      sig_error.emit("Robot did not answer the version info requests, running without a version check and retrying later.");
+      break;
+    default:
+      break;
+  }
+  if ( cache_writer.failures() > 0 ) {
+    sig_warn.emit("Could not write the device cache in " + parameters.cache_directory + ".");
+  }
+}
+
+/*****************************************************************************
+ ** Implementation [Pipeline]
+ *****************************************************************************/
+
+/**
+ * @brief Hand a framed packet to the processing thread.
+ *
+ * Never waits; if the processing thread has fallen that far behind, the
+ * packet is dropped (and counted) rather than leaving bytes in the device.
+ *
+ * @param arrival_time : when the packet was framed.
+ */
+void Kobuki::queueFrame(const ecl::TimeStamp &arrival_time)
+{
+  FrameQueue::Frame *frame = frame_queue.claim();
+  if (!frame)
+  {
+    sig_debug.emit("frame queue is full, dropping a frame.");
+    return;
+  }
+  packet_finder.getBuffer(frame_buffer);
+  unsigned int size = frame_buffer.size();
+  frame->size = ( size < FrameQueue::max_frame_size ) ? size : FrameQueue::max_frame_size;
+  for (unsigned int i = 0; i < frame->size; ++i)
+  {
+    frame->bytes[i] = frame_buffer[i];
+  }
+  frame->arrival = arrival_time;
+  frame_queue.publish();
+}
+
+/**
+ * @brief The processing thread: decoding, events, signals and scheduled commands.
+ *
+ * Everything spin() does after framing a packet, so the worker thread is
+ * left with nothing but reading the device.
+ */
+void Kobuki::process()
+{
+  data_buffer = PacketFinder::BufferType(FrameQueue::max_frame_size);
+  while (!shutdown_requested)
+  {
+    state_mutex.lock();
+    long wait = serviceCommands();
+    state_mutex.unlock();
+
+    FrameQueue::Frame *frame = frame_queue.front(std::min(wait, 100L)); // 100ms for the watchdog
+    state_mutex.lock();
+    if (frame)
     {
-      // watchdog
-      if (is_alive && ((ecl::TimeStamp() - last_signal_time) > timeout))
+      data_buffer.clear();
+      for (unsigned int i = 0; i < frame->size; ++i)
       {
-        is_alive = false;
-        // do not call here the event manager update, as it generates a spurious offline state
+        data_buffer.push_back(frame->bytes[i]);
       }
+      processFrame(ecl::TimeStamp(frame->arrival));
+      frame_queue.release();
     }
+    else
+    {
+      watchdog();
+    }
+    state_mutex.unlock();
   }
-  sig_error.emit("Driver worker thread shutdown!");
+}
+
+/*****************************************************************************
+ ** Implementation [Reactor Client]
+ *****************************************************************************/
+
+int Kobuki::descriptor() const
+{
+  return transport->isOpen() ? transport->fd() : -1;
+}
+
+void Kobuki::readable()
+{
+  unsigned char buf[256];
+  received(buf, transport->read(buf, packet_finder.numberOfDataToRead(), 0));
+}
+
+/**
+ * @brief The reactor's equivalent of a pass through spin()'s loop, minus the read.
+ *
+ * @return long : milliseconds until the next command deadline or watchdog
+ *                check, whichever is sooner, or Reactor::reconnect_now if
+ *                the device needs opening.
+ */
+long Kobuki::service()
+{
+  if ( shutdown_requested ) {
+    return 4000;
+  }
+  if( !transport->isOpen() || !transport->exists() ) {
+    if ( is_connected || transport->isOpen() ) {
+      dropConnection();
+    }
+    return Reactor::reconnect_now; // opening may block, not on the pool
+  }
+  long wait = serviceCommands();
+  if ( transport->fd() == -1 ) {
+    // nothing to poll (e.g. a replay), so read when it says the next bytes are due
+    if ( transport->idleTime() == 0 ) {
+      readable();
+    }
+    long idle = transport->idleTime();
+    wait = std::min(wait, ( idle > 0 ) ? idle : 5L);
+  } else {
+    watchdog();
+  }
+  if ( is_alive ) {
+    double elapsed = ecl::TimeStamp() - last_signal_time;
+    long watchdog_wait = static_cast<long>((static_cast<double>(stream_timeout) - elapsed) * 1000.0) + 1;
+    wait = std::min(wait, std::max(watchdog_wait, 1L));
+  }
+  return wait;
+}
+
+/**
+ * @brief One attempt at opening the device, on the reactor's connection thread.
+ *
+ * @return long : milliseconds until service() should run, straight away if opened.
+ */
+long Kobuki::reconnect()
+{
+  if ( shutdown_requested ) {
+    return 4000;
+  }
+  state_mutex.lock();
+  bool opened = openDevice();
+  state_mutex.unlock();
+  return opened ? 0 : 100;
 }
 
 /*****************************************************************************
  ** Implementation [Human Friendly Accessors]
  *****************************************************************************/
 
+/**
+ * @brief Gyro heading, bias corrected if the estimator is enabled.
+ */
 ecl::Angle<double> Kobuki::getHeading() const
 {
   ecl::Angle<double> heading;
+  if (parameters.enable_gyro_bias_estimation)
+  {
+    heading = gyro_bias.heading();
+    return heading;
+  }
   // raw data angles are in hundredths of a degree, convert to radians.
   heading = (static_cast<double>(inertia.data.angle) / 100.0) * ecl::pi / 180.0;
   return heading;
 }
 
+/**
+ * @brief Gyro angular velocity, bias corrected if the estimator is enabled.
+ */
 double Kobuki::getAngularVelocity() const
 {
+  if (parameters.enable_gyro_bias_estimation)
+  {
+    return gyro_bias.angularVelocity();
+  }
   // raw data angles are in hundredths of a degree, convert to radians.
   return (static_cast<double>(inertia.data.angle_rate) / 100.0) * ecl::pi / 180.0;
 }
@@ -408,6 +822,9 @@ double Kobuki::getAngularVelocity() const
 void Kobuki::resetOdometry()
 {
   diff_drive.reset(inertia.data.angle);
+  pose.setIdentity();
+  pose_history.clear();
+  odometry_covariance.reset();
 }
 
 void Kobuki::getWheelJointStates(double &wheel_left_angle, double &wheel_left_angle_rate, double &wheel_right_angle,
@@ -415,10 +832,34 @@ void Kobuki::getWheelJointStates(double &wheel_left_angle, double &wheel_left_an
 {
   diff_drive.getWheelJointStates(wheel_left_angle, wheel_left_angle_rate, wheel_right_angle, wheel_right_angle_rate);
 }
-void Kobuki::updateOdometry(ecl::Pose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates)
+/**
+ * @brief The odometry step of the latest frame.
+ *
+ * Integrated once per frame by the driver (see integrateOdometry()), so any
+ * number of consumers may ask for it.
+ */
+void Kobuki::updateOdometry(ecl::Pose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates) const
+{
+  pose_update = frame_pose_update;
+  pose_update_rates = frame_pose_update_rates;
+}
+
+/**
+ * @brief Step the odometry, its covariance and the pose history with this frame's encoders.
+ */
+void Kobuki::integrateOdometry()
 {
   diff_drive.update(core_sensors.data.time_stamp, core_sensors.data.left_encoder, core_sensors.data.right_encoder,
-                      pose_update, pose_update_rates);
+                      frame_pose_update, frame_pose_update_rates);
+  double wheel_left_angle, wheel_left_rate, wheel_right_angle, wheel_right_rate;
+  diff_drive.getWheelJointStates(wheel_left_angle, wheel_left_rate, wheel_right_angle, wheel_right_rate);
+  odometry_covariance.update(pose.heading(), frame_pose_update, frame_pose_update_rates, getAngularVelocity(),
+                             wheel_left_rate, wheel_right_rate,
+                             static_cast<double>(core_sensors.data.left_pwm), static_cast<double>(core_sensors.data.right_pwm),
+                             static_cast<double>(current.data.current[0]) / 100.0, // 10mA units
+                             static_cast<double>(current.data.current[1]) / 100.0);
+  pose *= frame_pose_update;
+  pose_history.add(firmware_clock.hostTime(), pose, frame_pose_update_rates);
 }
 
 /*****************************************************************************
@@ -448,21 +889,370 @@ void Kobuki::playSoundSequence(const enum SoundSequences &number)
   sendCommand(Command::PlaySoundSequence(number, kobuki_command.data));
 }
 
+/*****************************************************************************
+ ** Plugins
+ *****************************************************************************/
+
+/**
+ * @brief Run a controller on every frame, see PluginHost.
+ *
+ * The first plugin also registers the plugins' velocity with the
+ * multiplexer, as the "plugins" input at Parameters::plugin_priority.
+ *
+ * @param plugin : the controller.
+ * @param name : unique name, used for removal and in the statistics.
+ * @param priority : among the plugins, higher runs first and wins conflicting commands.
+ * @param budget : run time [s] per frame, longer runs count as overruns.
+ * @return bool : false if the name is taken, or a velocity input is already called "plugins".
+ */
+bool Kobuki::addPlugin(const boost::shared_ptr<PluginHost::Plugin> &plugin, const std::string &name,
+                       const int &priority, const double &budget)
+{
+  state_mutex.lock();
+  int input = plugin_input;
+  if ( input < 0 ) {
+    input = velocity_mux.add("plugins", parameters.plugin_priority, 0.0);
+    __atomic_store_n(&plugin_input, input, __ATOMIC_RELEASE); // read unlocked on the driver thread
+  }
+  bool added = ( input >= 0 ) && plugin_host.add(plugin, name, priority, budget);
+  state_mutex.unlock();
+  return added;
+}
+
+/**
+ * @brief Set the target base velocity.
+ *
+ * The velocity smoother ramps the commands sent to the robot towards this
+ * target on each feedback cycle.
+ *
+ * Once multiplexed inputs are registered, this is only in effect until the
+ * multiplexer's selection next changes.
+ *
+ * @param linear_velocity : [m/s]
+ * @param angular_velocity : [rad/s]
+ */
 void Kobuki::setBaseControl(const double &linear_velocity, const double &angular_velocity)
 {
+  velocity_smoother.setTarget(linear_velocity, angular_velocity);
+}
+
+/**
+ * @brief Command the base through one of the multiplexed inputs.
+ *
+ * The multiplexer picks the target from the highest priority active input
+ * on each feedback cycle.
+ *
+ * @param input : index returned by addVelocityInput().
+ * @param linear_velocity : [m/s]
+ * @param angular_velocity : [rad/s]
+ */
+void Kobuki::setBaseControl(const unsigned int &input, const double &linear_velocity, const double &angular_velocity)
+{
+  velocity_mux.set(input, linear_velocity, angular_velocity, ecl::TimeStamp());
+}
+
+/**
+ * @brief Rotate, translate or drive an arc, closed on the gyro and encoders.
+ *
+ * Replaces any running primitive or trajectory. The outcome is signalled on
+ * motion_result once it finishes.
+ *
+ * @param distance : [m] to travel, negative for backwards, zero to rotate on the spot.
+ * @param angle : [rad] to turn, positive anti-clockwise.
+ * @return bool : false if the wheel calibration is unusable.
+ */
+bool Kobuki::startMotion(const double &distance, const double &angle)
+{
+  trajectory_buffer.cancel();
+  return motion_primitive.start(distance, angle, diff_drive.travel_resolution(), firmware_clock.hostTime());
+}
+
+/**
+ * @brief Abandon the running motion primitive and ramp down to a stop.
+ */
+void Kobuki::cancelMotion()
+{
+  if ( motion_primitive.isRunning() ) {
+    motion_primitive.cancel();
+    velocity_smoother.setTarget(0.0, 0.0);
+  }
+}
+
+/**
+ * @brief Stop the base at the emergency deceleration rate.
+ *
+ * Remains in effect until the base has stopped or a new target is set.
+ */
+void Kobuki::emergencyStop()
+{
+  trajectory_buffer.cancel();
+  motion_primitive.cancel();
+  velocity_smoother.emergencyStop();
+}
+
+/**
+ * @brief Adopt the identity and calibration of the robot last seen on this port.
+ *
+ * Lets streaming (and publishing) begin on the first frame; the version
+ * handshake still runs in the background and verifyCachedDevice() catches
+ * a different robot having been plugged in.
+ *
+ * @return bool : true if the cache had an entry for this port.
+ */
+bool Kobuki::warmStart()
+{
+  DeviceCache::Entry entry;
+  if ( !device_cache.lookup(parameters.device_port, entry) ) {
+    return false;
+  }
+  applyCalibration(entry);
+  cached_device = entry;
+  firmware.data.version = entry.firmware;
+  hardware.data.version = entry.hardware;
+  unique_device_id.data.udid0 = entry.udid0;
+  unique_device_id.data.udid1 = entry.udid1;
+  unique_device_id.data.udid2 = entry.udid2;
+  sig_version_info.emit(versionInfo());
+  sig_info.emit("Warm start as robot " + DeviceCache::key(entry.udid0, entry.udid1, entry.udid2)
+                + " from the device cache, verifying in the background.");
+  return true;
+}
+
+/**
+ * @brief Switch calibrations if the handshake reveals a different robot than cached.
+ */
+void Kobuki::verifyCachedDevice()
+{
+  const UniqueDeviceID::Data &id = unique_device_id.data;
+  if ( cached_device.sameDevice(id.udid0, id.udid1, id.udid2) ) {
+    return;
+  }
+  DeviceCache::Entry entry;
+  bool known = device_cache.load(id.udid0, id.udid1, id.udid2, entry);
+  if ( cached_device.isValid() ) {
+    sig_warn.emit("A different robot is on " + parameters.device_port + ", dropping the cached calibration.");
+    applyCalibration(known ? entry : default_calibration);
+  } else if ( known ) {
+    applyCalibration(entry);
+  }
+  cached_device = entry;
+}
+
+void Kobuki::applyCalibration(const DeviceCache::Entry &entry)
+{
+  diff_drive.calibrate(entry.wheel_bias, entry.tick_to_rad, entry.wheel_radius_left, entry.wheel_radius_right);
+  gyro_bias.seed(entry.gyro_bias, entry.gyro_bias_valid ? parameters.gyro_bias_cached_weight : 0.0);
+  gyro_bias.setScale(entry.gyro_scale);
+  if ( !battery_capacity_configured ) {
+    Battery::capacity = entry.battery_capacity; // explicit configuration wins
+  }
+}
+
+/**
+ * @brief Record the current robot's identity and calibration in the device cache.
+ *
+ * Only hands the entry over, the cache writer's thread does the disk I/O.
+ */
+void Kobuki::saveCachedDevice()
+{
+  if ( !device_cache.isEnabled() ) {
+    return;
+  }
+  DeviceCache::Entry entry;
+  entry.firmware = firmware.data.version;
+  entry.hardware = hardware.data.version;
+  entry.udid0 = unique_device_id.data.udid0;
+  entry.udid1 = unique_device_id.data.udid1;
+  entry.udid2 = unique_device_id.data.udid2;
+  entry.wheel_bias = diff_drive.wheel_bias();
+  entry.tick_to_rad = diff_drive.encoder_resolution();
+  entry.gyro_bias = gyro_bias.bias();
+  entry.gyro_bias_valid = gyro_bias.isEstimated();
+  entry.battery_capacity = Battery::capacity;
+  diff_drive.wheel_radii(entry.wheel_radius_left, entry.wheel_radius_right);
+  entry.gyro_scale = gyro_bias.scale();
+  cache_writer.post(entry);
+  cached_device = entry;
+}
+
+/**
+ * @brief Check firmware/driver compatibility.
+ *
+ * Major versions must match or the driver shuts down; an older minor
+ * version of the firmware only earns a suggestion to upgrade.
+ */
+void Kobuki::checkFirmwareVersion()
+{
+  try
+  {
+    // Check firmware/driver compatibility; mayor version must be the same
+    int version_match = firmware.check_mayor_version();
+    if (version_match < 0) {
+      sig_error.emit("Robot firmware is outdated and needs to be upgraded. Consult how-to on: " \
+                     "http://kobuki.yujinrobot.com/documentation/howtos/upgrading-firmware");
+      sig_warn.emit("Robot version is " + VersionInfo::toString(firmware.data.version)
+              + "; current version is " + firmware.current_version());
+      shutdown_requested = true;
+    }
+    else if (version_match > 0) {
+      sig_error.emit("Driver version isn't not compatible with robot firmware. Please upgrade driver");
+      shutdown_requested = true;
+    }
+    else
+    {
+      // And minor version don't need to, but just make a suggestion
+      version_match = firmware.check_minor_version();
+      if (version_match < 0) {
+        sig_warn.emit("Robot firmware is outdated; we suggest you to upgrade it " \
+                      "to benefit from the latest features. Consult how-to on: "  \
+                      "http://kobuki.yujinrobot.com/documentation/howtos/upgrading-firmware");
+        sig_warn.emit("Robot version is " + VersionInfo::toString(firmware.data.version)
+                + "; current version is " + firmware.current_version());
+      }
+      else if (version_match > 0) {
+        // Driver version is outdated; maybe we should also suggest to upgrade it, but this is not a typical case
+      }
+    }
+  }
+  catch (std::out_of_range& e)
+  {
+    // Wrong version hardcoded on firmware; lowest value is 10000
+    sig_error.emit(std::string("Invalid firmware version number: ").append(e.what()));
+    shutdown_requested = true;
+  }
+}
+
+/**
+ * @brief Step the velocity smoother and send this cycle's base control command.
+ *
+ * Called once per feedback cycle, either straight after the frame arrives or
+ * when the command scheduler says the firmware's next control tick is due.
+ */
+void Kobuki::transmitBaseControl()
+{
+  // the plugins' velocity competes in the multiplexer, their leds and sound ride along below
+  PluginHost::Commands plugin_commands;
+  plugin_host.collect(plugin_commands);
+  int input = __atomic_load_n(&plugin_input, __ATOMIC_ACQUIRE);
+  if ( input >= 0 ) {
+    if ( plugin_commands.has_velocity ) {
+      velocity_mux.set(input, plugin_commands.linear_velocity, plugin_commands.angular_velocity, ecl::TimeStamp());
+    } else {
+      velocity_mux.release(input); // ramp down, or back to the next input, once they let go
+    }
+  }
+  // the multiplexer picks this cycle's target, the smoother is only touched on a change
+  if ( !velocity_mux.empty() ) {
+    double linear_target, angular_target;
+    if ( velocity_mux.select(ecl::TimeStamp(), linear_target, angular_target) ) {
+      velocity_smoother.setTarget(linear_target, angular_target);
+    }
+  }
+  // a buffered trajectory is sampled for the tick this command takes effect on
+  double linear_sample, angular_sample;
+  switch ( trajectory_buffer.sample(firmware_clock.hostTime() + command_scheduler.period(),
+                                    linear_sample, angular_sample) ) {
+    case TrajectoryBuffer::Running:
+      velocity_smoother.setTarget(linear_sample, angular_sample); // still acceleration and jerk limited
+      break;
+    case TrajectoryBuffer::Finished:
+      velocity_smoother.setTarget(0.0, 0.0); // ramp down from the trajectory's last velocity
+      break;
+    default:
+      break;
+  }
+  // a motion primitive closes its own loop, overriding the other sources while it runs
+  double linear_motion, angular_motion;
+  MotionPrimitive::Status motion = motion_primitive.command(firmware_clock.hostTime(), command_scheduler.period(),
+                                                            linear_motion, angular_motion);
+  if ( motion == MotionPrimitive::Running ) {
+    velocity_smoother.track(linear_motion, angular_motion);
+  } else if ( ( motion == MotionPrimitive::Succeeded ) || ( motion == MotionPrimitive::TimedOut ) ) {
+    velocity_smoother.setTarget(0.0, 0.0); // ramp down from the last command within the limits
+  }
+  if ( ( motion != MotionPrimitive::Idle ) && ( motion != MotionPrimitive::Running ) ) {
+    sig_motion_result.emit(motion_primitive.result());
+  }
+  // step the smoother once per cycle, on the firmware's clock
+  velocity_smoother.update(firmware_clock.frameInterval());
+  double linear_velocity = velocity_smoother.linearVelocity();
+  double angular_velocity = velocity_smoother.angularVelocity();
+  if ( safety_reflex.override(linear_velocity, angular_velocity) ) {
+    velocity_smoother.reset(); // drop the user's target, resume from standstill once released
+  }
+  if ( !isEnabled() ) {
+    linear_velocity = angular_velocity = 0.0;
+    velocity_smoother.reset(); // nothing carries over to enable()
+  }
   diff_drive.velocityCommands(linear_velocity, angular_velocity);
+  command_scheduler.transmitted();
+
+  ecl::TimeStamp now;
+  // plugin led and sound commands ride along in the same packet
+  Command packet[3];
+  unsigned int count = 0;
+  bool redundant = command_scheduler.isRedundant(diff_drive.commandSpeed(), diff_drive.commandRadius(), now);
+  if ( redundant ) {
+    link_statistics.skipped();
+  } else {
+    double left_rate, right_rate;
+    diff_drive.wheelVelocities(linear_velocity, angular_velocity, left_rate, right_rate);
+    command_scheduler.commandSent(now, left_rate, right_rate);
+    packet[count++] = Command::SetVelocityControl(diff_drive.commandSpeed(), diff_drive.commandRadius());
+  }
+  count += pluginCommands(plugin_commands, &packet[count]);
+  if ( count == 0 ) {
+    return;
+  }
+  sendCommands(packet, count);
+  if ( redundant ) {
+    return;
+  }
+  safety_reflex.commandSent(ecl::TimeStamp());
+  if ( is_alive && is_connected ) {
+    command_scheduler.baseControlSent(diff_drive.commandSpeed(), diff_drive.commandRadius(), now);
+  }
+}
+
+/**
+ * @brief Convert the plugins' led and sound commands.
+ *
+ * The plugin host only passes on the leds the plugins asked to change.
+ *
+ * @param commands : merged plugin commands.
+ * @param packet : filled with up to two commands.
+ * @return unsigned int : number of commands filled in.
+ */
+unsigned int Kobuki::pluginCommands(const PluginHost::Commands &commands, Command *packet)
+{
+  unsigned int count = 0;
+  const LedNumber numbers[2] = { Led1, Led2 };
+  bool has_leds = false;
+  Command leds;
+  for ( unsigned int i = 0; i < 2; ++i ) {
+    if ( commands.has_led[i] ) {
+      leds = Command::SetLedArray(numbers[i], commands.led_colours[i], kobuki_command.data); // carries both leds
+      has_leds = true;
+    }
+  }
+  if ( has_leds ) {
+    packet[count++] = leds;
+  }
+  if ( commands.has_sound ) {
+    packet[count++] = Command::PlaySoundSequence(commands.sound, kobuki_command.data);
+  }
+  return count;
 }
 
 void Kobuki::sendBaseControlCommand()
 {
   std::vector<short> velocity_commands = diff_drive.velocityCommands();
-  gate_keeper.confirm(velocity_commands[0], velocity_commands[1]);
   //std::cout << "speed: " << velocity_commands[0] << ", radius: " << velocity_commands[1] << std::endl;
   sendCommand(Command::SetVelocityControl(velocity_commands[0], velocity_commands[1]));
 }
 
 /**
- * @brief Send the prepared command to the serial port.
+ * @brief Send the prepared command to the device.
  *
  * Need to be a bit careful here, because we have no control over how the user
  * is calling this - they may be calling from different threads (this is so for
@@ -472,6 +1262,17 @@ void Kobuki::sendBaseControlCommand()
  * @param command : prepared command template (see Command's static member functions).
  */
 void Kobuki::sendCommand(Command command)
+{
+  sendCommands(&command, 1);
+}
+
+/**
+ * @brief Send several commands to the device as sub-payloads of a single packet.
+ *
+ * @param commands : prepared command templates.
+ * @param count : number of commands.
+ */
+void Kobuki::sendCommands(Command *commands, const unsigned int &count)
 {
   if( !is_alive || !is_connected ) {
     //need to do something
@@ -484,9 +1285,12 @@ void Kobuki::sendCommand(Command command)
   command_mutex.lock();
   kobuki_command.resetBuffer(command_buffer);
 
-  if (!command.serialise(command_buffer))
+  for (unsigned int i = 0; i < count; ++i)
   {
-    sig_error.emit("command serialise failed.");
+    if (!commands[i].serialise(command_buffer))
+    {
+      sig_error.emit("command serialise failed.");
+    }
   }
   command_buffer[2] = command_buffer.size() - 3;
   unsigned char checksum = 0;
@@ -495,7 +1299,10 @@ void Kobuki::sendCommand(Command command)
 
   command_buffer.push_back(checksum);
   //check_device();
-  serial.write(&command_buffer[0], command_buffer.size());
+  if ( transport->write(&command_buffer[0], command_buffer.size()) < 0 ) {
+    sig_debug.emit("command write failed: " + transport->errorMessage());
+  }
+  link_statistics.sent(command_buffer.size(), commands[0].data.command == Command::BaseControl);
 
   sig_raw_data_command.emit(command_buffer);
   command_mutex.unlock();
@@ -503,15 +1310,28 @@ void Kobuki::sendCommand(Command command)
 
 bool Kobuki::enable()
 {
-  is_enabled = true;
+  __atomic_store_n(&is_enabled, true, __ATOMIC_RELEASE);
   return true;
 }
 
+/**
+ * @brief Stop and drop every velocity source.
+ *
+ * Trajectories, motion primitives and plugins are cancelled and the
+ * multiplexed inputs released, so nothing resumes on enable() until
+ * commanded again. Zero goes out until then.
+ */
 bool Kobuki::disable()
 {
-  setBaseControl(0.0f, 0.0f);
-  sendBaseControlCommand();
-  is_enabled = false;
+  __atomic_store_n(&is_enabled, false, __ATOMIC_RELEASE); // first, so the worker thread sends zero from here on
+  // no ramping here, the motors are about to lose power anyway
+  trajectory_buffer.cancel();
+  motion_primitive.cancel();
+  plugin_host.cancel();
+  velocity_mux.clear();
+  velocity_smoother.reset();
+  // diff_drive belongs to the worker thread, it zeroes it on its next cycle
+  sendCommand(Command::SetVelocityControl(0, 0));
   return true;
 }
 
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/motion_primitive.cpp
+ *
+ * @brief Implementation of the closed loop motion primitives.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_driver/modules/motion_primitive.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+MotionPrimitive::MotionPrimitive() :
+  status(Idle),
+  report(false),
+  rotation(false),
+  target_distance(0.0),
+  target_angle(0.0),
+  tick_to_metre(0.0),
+  start_time(0.0),
+  deadline(0.0),
+  last_time(0.0),
+  linear_command(0.0),
+  angular_command(0.0),
+  has_baseline(false),
+  last_left(0),
+  last_right(0),
+  last_heading(0.0),
+  ticks_left(0),
+  ticks_right(0),
+  turned(0.0)
+{}
+
+void MotionPrimitive::init(const Limits &limits) {
+  mutex.lock();
+  this->limits = limits;
+  mutex.unlock();
+}
+
+/**
+ * @brief Start a primitive, replacing any that is still running.
+ *
+ * @param distance : [m] to travel, negative for backwards, zero to rotate on the spot.
+ * @param angle : [rad] to turn, positive anti-clockwise, may exceed a full turn.
+ * @param resolution : [m/tick] wheel travel per encoder tick.
+ * @param time : host time [s] now.
+ * @return bool : false for a non-positive resolution.
+ */
+bool MotionPrimitive::start(const double &distance, const double &angle, const double &resolution, const double &time) {
+  if ( resolution <= 0.0 ) {
+    return false;
+  }
+  mutex.lock();
+  rotation = ( std::fabs(distance) < limits.distance_tolerance );
+  target_distance = rotation ? 0.0 : distance;
+  target_angle = angle;
+  tick_to_metre = resolution;
+  // planned duration of the trapezoidal (or triangular) profile on the dominant axis
+  double amount = rotation ? std::fabs(angle) : std::fabs(distance);
+  double speed = rotation ? limits.angular_velocity : limits.linear_velocity;
+  double acceleration = rotation ? limits.angular_acceleration : limits.linear_acceleration;
+  double duration = ( amount > speed * speed / acceleration ) ? amount / speed + speed / acceleration
+                                                              : 2.0 * std::sqrt(amount / acceleration);
+  start_time = last_time = time;
+  deadline = time + 2.0 * duration + 1.0;
+  linear_command = angular_command = 0.0;
+  has_baseline = false;
+  ticks_left = ticks_right = 0;
+  turned = 0.0;
+  status = Running;
+  report = false;
+  mutex.unlock();
+  return true;
+}
+
+/**
+ * @brief Accumulate a frame's heading and encoders while running.
+ *
+ * @param heading : [rad] gyro heading, bias corrected if available.
+ * @param left_encoder : raw encoder ticks.
+ * @param right_encoder : raw encoder ticks.
+ */
+void MotionPrimitive::feedback(const double &heading, const uint16_t &left_encoder, const uint16_t &right_encoder) {
+  mutex.lock();
+  if ( status == Running ) {
+    if ( has_baseline ) {
+      // 16 bit counters, the signed difference survives a wrap around
+      ticks_left += static_cast<int16_t>(static_cast<uint16_t>(left_encoder - last_left));
+      ticks_right += static_cast<int16_t>(static_cast<uint16_t>(right_encoder - last_right));
+      turned += ecl::wrap_angle(heading - last_heading);
+    }
+    has_baseline = true;
+    last_left = left_encoder;
+    last_right = right_encoder;
+    last_heading = heading;
+  }
+  mutex.unlock();
+}
+
+/**
+ * @brief Velocities for the coming control tick.
+ *
+ * @param time : host time [s] now.
+ * @param period : [s] between commands.
+ * @param linear_velocity : [m/s] to command, zero unless running.
+ * @param angular_velocity : [rad/s] to command, zero unless running.
+ * @return Status : Running, then the final status exactly once, then Idle.
+ */
+MotionPrimitive::Status MotionPrimitive::command(const double &time, const double &period,
+                                                 double &linear_velocity, double &angular_velocity) {
+  linear_velocity = angular_velocity = 0.0;
+  mutex.lock();
+  if ( status != Running ) {
+    Status reported = report ? status : Idle;
+    report = false;
+    mutex.unlock();
+    return reported;
+  }
+  last_time = time;
+  double distance = travelled();
+  double remaining = rotation ? target_angle - turned : target_distance - distance;
+  double tolerance = rotation ? limits.angle_tolerance : limits.distance_tolerance;
+  // arcs and translations must land on their heading as well as their distance
+  bool arrived = ( std::fabs(remaining) <= tolerance );
+  bool on_heading = ( std::fabs(target_angle - turned) <= limits.angle_tolerance );
+  if ( arrived && ( rotation || on_heading ) ) {
+    finish(Succeeded);
+  } else if ( time > deadline ) {
+    finish(TimedOut);
+  }
+  if ( status != Running ) {
+    report = false;
+    Status reported = status;
+    mutex.unlock();
+    return reported;
+  }
+  if ( rotation ) {
+    linear_command = 0.0;
+    angular_command = profile(remaining, angular_command, period, limits.angular_velocity, limits.angular_acceleration);
+  } else if ( arrived ) {
+    // there but for the heading, stop and turn the rest on the spot
+    linear_command = profile(0.0, linear_command, period, limits.linear_velocity, limits.linear_acceleration);
+    angular_command = profile(target_angle - turned, angular_command, period,
+                              limits.angular_velocity, limits.angular_acceleration);
+  } else {
+    double target = profile(remaining, linear_command, period, limits.linear_velocity, limits.linear_acceleration);
+    // the heading follows the distance travelled, corrected for drift
+    double curvature = target_angle / target_distance;
+    linear_command = target;
+    angular_command = target * curvature + limits.heading_gain * ( curvature * distance - turned );
+    angular_command = std::max(-limits.angular_velocity, std::min(limits.angular_velocity, angular_command));
+  }
+  linear_velocity = linear_command;
+  angular_velocity = angular_command;
+  mutex.unlock();
+  return Running;
+}
+
+/**
+ * @brief Abandon the running primitive, command() reports it as aborted.
+ *
+ * The caller is responsible for bringing the base to a stop.
+ */
+void MotionPrimitive::cancel() {
+  mutex.lock();
+  if ( status == Running ) {
+    finish(Aborted);
+    report = true;
+  }
+  mutex.unlock();
+}
+
+/**
+ * @brief The running or most recently finished primitive.
+ */
+MotionPrimitive::Result MotionPrimitive::result() const {
+  mutex.lock();
+  Result current = last_result;
+  if ( status == Running ) {
+    current.status = Running;
+    current.distance = travelled();
+    current.angle = turned;
+    current.duration = last_time - start_time;
+  }
+  mutex.unlock();
+  return current;
+}
+
+std::string MotionPrimitive::toString(const Status &status) {
+  switch ( status ) {
+    case Running: return "running";
+    case Succeeded: return "succeeded";
+    case Aborted: return "aborted";
+    case TimedOut: return "timed out";
+    default: return "idle";
+  }
+}
+
+/**
+ * @brief Trapezoidal profile on an axis' remaining error, allowing for a cycle of latency.
+ *
+ * @param remaining : error left on the axis [m or rad].
+ * @param last_command : velocity commanded on the previous cycle [m/s or rad/s].
+ * @param period : [s] between commands.
+ * @param speed : cruising velocity [m/s or rad/s].
+ * @param acceleration : used both speeding up and slowing down [m/s^2 or rad/s^2].
+ * @return double : velocity to command this cycle.
+ */
+double MotionPrimitive::profile(const double &remaining, const double &last_command, const double &period,
+                                const double &speed, const double &acceleration) {
+  double predicted = remaining - last_command * period;
+  double target = std::min(speed, std::sqrt(2.0 * acceleration * std::fabs(predicted)));
+  if ( predicted < 0.0 ) {
+    target = -target;
+  }
+  double step = acceleration * period;
+  return std::max(last_command - step, std::min(last_command + step, target));
+}
+
+double MotionPrimitive::travelled() const {
+  return 0.5 * static_cast<double>(ticks_left + ticks_right) * tick_to_metre;
+}
+
+/**
+ * @brief Record the outcome, call with the mutex held.
+ */
+void MotionPrimitive::finish(const Status &final_status) {
+  status = final_status;
+  linear_command = angular_command = 0.0;
+  last_result.status = final_status;
+  last_result.distance = travelled();
+  last_result.angle = turned;
+  last_result.duration = last_time - start_time;
+}
+
+} // namespace kobuki
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/odometry_covariance.cpp
+ *
+ * @brief Implementation of the odometry covariance model.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+#include "../../include/kobuki_driver/modules/odometry_covariance.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+
+const double gyro_tolerance = 0.1;   // [rad/s] wheel vs gyro yaw rate difference considered normal
+const double min_learning_rate = 0.5; // [rad/s] wheel rate above which effort ratios are learnt
+const double learning_gain = 0.01;
+const double max_slip_score = 10.0;
+const double base_speed_variance = 1e-4; // [m^2/s^2] floor on the twist variances
+const double base_rate_variance = 1e-4;  // [rad^2/s^2]
+const double initial_position_variance = 1e-4; // [m^2] at (re)start, a known pose
+const double initial_heading_variance = 1e-4;  // [rad^2]
+const double min_position_variance = 1e-4;     // [m^2] floor on the published x, y variances
+
+}
+
+/*****************************************************************************
+** Implementation [EffortModel]
+*****************************************************************************/
+
+void OdometryCovariance::EffortModel::learn(const double &effort, const double &rate) {
+  if ( std::fabs(rate) < min_learning_rate ) {
+    return;
+  }
+  double observed = std::fabs(effort) / std::fabs(rate);
+  if ( !learned ) {
+    ratio = observed;
+    learned = true;
+  } else {
+    ratio += learning_gain * (observed - ratio);
+  }
+}
+
+/**
+ * @return double : relative disagreement between the effort and the one expected at this rate.
+ */
+double OdometryCovariance::EffortModel::mismatch(const double &effort, const double &rate) const {
+  if ( !learned ) {
+    return 0.0;
+  }
+  double expected = ratio * std::fabs(rate);
+  return std::fabs(std::fabs(effort) - expected) / (expected + tolerance);
+}
+
+/*****************************************************************************
+** Implementation [OdometryCovariance]
+*****************************************************************************/
+
+OdometryCovariance::OdometryCovariance() :
+  distance_noise(0.01),
+  rotation_noise(0.05),
+  drift_noise(0.01),
+  heading_variance(1e6),
+  slip_gain(20.0),
+  slip_score(0.0),
+  pwm_left_model(10.0),    // pwm units
+  pwm_right_model(10.0),
+  current_left_model(0.2), // [A]
+  current_right_model(0.2)
+{
+  reset();
+}
+
+/**
+ * @param distance_noise : translational variance added per metre travelled [m^2/m]
+ * @param rotation_noise : heading variance added per radian turned [rad^2/rad]
+ * @param drift_noise : heading variance added per metre travelled [rad^2/m]
+ * @param slip_gain : multiplier on the added noise per unit of slip score
+ * @param heading_variance : floor on the published heading variance [rad^2]
+ */
+void OdometryCovariance::init(const double &distance_noise, const double &rotation_noise, const double &drift_noise,
+                              const double &slip_gain, const double &heading_variance) {
+  this->distance_noise = distance_noise;
+  this->rotation_noise = rotation_noise;
+  this->drift_noise = drift_noise;
+  this->slip_gain = slip_gain;
+  this->heading_variance = heading_variance;
+  reset();
+}
+
+void OdometryCovariance::reset() {
+  pose_covariance.setZero();
+  pose_covariance(0, 0) = pose_covariance(1, 1) = initial_position_variance;
+  pose_covariance(2, 2) = initial_heading_variance;
+  twist_variance << base_speed_variance, base_speed_variance, base_rate_variance;
+  slip_score = 0.0;
+  publish();
+}
+
+/**
+ * @brief The propagated covariance, with floors on its diagonal.
+ */
+void OdometryCovariance::publish() {
+  published_covariance = pose_covariance;
+  published_covariance(0, 0) = std::max(published_covariance(0, 0), min_position_variance);
+  published_covariance(1, 1) = std::max(published_covariance(1, 1), min_position_variance);
+  published_covariance(2, 2) = std::max(published_covariance(2, 2), heading_variance);
+}
+
+/**
+ * @brief Propagate the covariance across one frame's pose update.
+ *
+ * @param heading : heading of the pose before applying the update [rad]
+ * @param pose_update : relative motion over this frame
+ * @param twist : body twist (vx, vy, wz) measured by the wheels
+ * @param gyro_rate : yaw rate measured by the gyro [rad/s]
+ * @param wheel_rate_left, wheel_rate_right : wheel rates [rad/s]
+ * @param pwm_left, pwm_right : motor pwm as reported by the firmware
+ * @param current_left, current_right : motor currents [A]
+ */
+void OdometryCovariance::update(const double &heading,
+                                const ecl::Pose2D<double> &pose_update,
+                                const ecl::linear_algebra::Vector3d &twist,
+                                const double &gyro_rate,
+                                const double &wheel_rate_left, const double &wheel_rate_right,
+                                const double &pwm_left, const double &pwm_right,
+                                const double &current_left, const double &current_right) {
+  /*********************
+  ** Slip Score
+  **********************/
+  double gyro_mismatch = std::fabs(twist[2] - gyro_rate) / gyro_tolerance;
+  double effort_mismatch = std::max(
+      std::max(pwm_left_model.mismatch(pwm_left, wheel_rate_left), pwm_right_model.mismatch(pwm_right, wheel_rate_right)),
+      std::max(current_left_model.mismatch(current_left, wheel_rate_left),
+               current_right_model.mismatch(current_right, wheel_rate_right)));
+  slip_score = std::min(std::max(gyro_mismatch - 1.0, 0.0) + effort_mismatch, max_slip_score);
+
+  if ( gyro_mismatch < 0.5 ) { // only learn what normal looks like when it is normal
+    pwm_left_model.learn(pwm_left, wheel_rate_left);
+    pwm_right_model.learn(pwm_right, wheel_rate_right);
+    current_left_model.learn(current_left, wheel_rate_left);
+    current_right_model.learn(current_right, wheel_rate_right);
+  }
+  double inflation = 1.0 + slip_gain * slip_score;
+
+  /*********************
+  ** Propagation
+  **********************/
+  double ds = pose_update.x();
+  double dtheta = pose_update.heading();
+  double mid_heading = heading + dtheta / 2.0;
+  double c = std::cos(mid_heading);
+  double s = std::sin(mid_heading);
+
+  ecl::linear_algebra::Matrix3d F; // jacobian w.r.t. the previous pose
+  F << 1.0, 0.0, -ds * s,
+       0.0, 1.0,  ds * c,
+       0.0, 0.0,  1.0;
+  Eigen::Matrix<double, 3, 2> G; // jacobian w.r.t. (ds, dtheta)
+  G << c, -ds * s / 2.0,
+       s,  ds * c / 2.0,
+       0.0, 1.0;
+  Eigen::Matrix2d Q = Eigen::Matrix2d::Zero();
+  Q(0, 0) = inflation * distance_noise * std::fabs(ds);
+  Q(1, 1) = inflation * (rotation_noise * std::fabs(dtheta) + drift_noise * std::fabs(ds));
+
+  pose_covariance = F * pose_covariance * F.transpose() + G * Q * G.transpose();
+  publish();
+
+  /*********************
+  ** Twist
+  **********************/
+  double speed_sigma = 0.05 * std::fabs(twist[0]);
+  double rate_sigma = 0.05 * std::fabs(twist[2]) + 0.02 * std::fabs(twist[0]);
+  twist_variance << base_speed_variance + inflation * speed_sigma * speed_sigma,
+                    base_speed_variance,
+                    base_rate_variance + inflation * rate_sigma * rate_sigma;
+}
+
+} // namespace kobuki
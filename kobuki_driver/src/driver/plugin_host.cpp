@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/plugin_host.cpp
+ *
+ * @brief Implementation of the in-driver controller plugin host.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <ecl/time/timestamp.hpp>
+#include "../../include/kobuki_driver/modules/plugin_host.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation [Commands]
+*****************************************************************************/
+
+/**
+ * @return bool : false if a higher priority plugin already set a velocity this frame.
+ */
+bool PluginHost::Commands::setVelocity(const double &linear, const double &angular) {
+  if ( has_velocity ) {
+    return false;
+  }
+  has_velocity = true;
+  linear_velocity = linear;
+  angular_velocity = angular;
+  return true;
+}
+
+/**
+ * @return bool : false if a higher priority plugin already set this led this frame.
+ */
+bool PluginHost::Commands::setLed(const LedNumber &number, const LedColour &colour) {
+  if ( has_led[number] ) {
+    return false;
+  }
+  has_led[number] = true;
+  led_colours[number] = colour;
+  return true;
+}
+
+/**
+ * @return bool : false if a higher priority plugin already asked for a sound this frame.
+ */
+bool PluginHost::Commands::playSoundSequence(const SoundSequences &sequence) {
+  if ( has_sound ) {
+    return false;
+  }
+  has_sound = true;
+  sound = sequence;
+  return true;
+}
+
+void PluginHost::Commands::clear() {
+  has_velocity = false;
+  linear_velocity = angular_velocity = 0.0;
+  has_led[Led1] = has_led[Led2] = false;
+  led_colours[Led1] = led_colours[Led2] = Black;
+  has_sound = false;
+  sound = On;
+  claims_bumper = false;
+}
+
+/*****************************************************************************
+** Implementation [PluginHost]
+*****************************************************************************/
+
+PluginHost::PluginHost() :
+  bumper_claimed(false)
+{
+  has_led_request[Led1] = has_led_request[Led2] = false;
+  led_requests[Led1] = led_requests[Led2] = Black;
+}
+
+/**
+ * @brief Register a plugin.
+ *
+ * @param plugin : the controller.
+ * @param name : unique name, used for removal and in the statistics.
+ * @param priority : higher runs first and wins conflicting commands.
+ * @param budget : run time [s] per frame, longer runs count as overruns.
+ * @return bool : false if the name is already taken.
+ */
+bool PluginHost::add(const boost::shared_ptr<Plugin> &plugin, const std::string &name,
+                     const int &priority, const double &budget) {
+  mutex.lock();
+  for ( unsigned int i = 0; i < plugins.size(); ++i ) {
+    if ( plugins[i].statistics.name == name ) {
+      mutex.unlock();
+      return false;
+    }
+  }
+  Entry entry;
+  entry.plugin = plugin;
+  entry.statistics.name = name;
+  entry.statistics.priority = priority;
+  entry.statistics.budget = budget;
+  // after those of equal priority, so registration order breaks ties
+  std::vector<Entry>::iterator position = plugins.begin();
+  while ( ( position != plugins.end() ) && ( position->statistics.priority >= priority ) ) {
+    ++position;
+  }
+  plugins.insert(position, entry);
+  mutex.unlock();
+  return true;
+}
+
+/**
+ * @return bool : false if there is no plugin by that name.
+ */
+bool PluginHost::remove(const std::string &name) {
+  mutex.lock();
+  for ( std::vector<Entry>::iterator entry = plugins.begin(); entry != plugins.end(); ++entry ) {
+    if ( entry->statistics.name == name ) {
+      plugins.erase(entry);
+      mutex.unlock();
+      return true;
+    }
+  }
+  mutex.unlock();
+  return false;
+}
+
+bool PluginHost::empty() const {
+  mutex.lock();
+  bool none = plugins.empty();
+  mutex.unlock();
+  return none;
+}
+
+/**
+ * @brief Run every plugin on a frame and merge their commands.
+ *
+ * A sound or led change from an earlier frame that was not yet collected
+ * is kept, unless a plugin asks for another. Leds asked for in the colour
+ * last asked for are not requested again.
+ */
+void PluginHost::run(const Feedback &feedback) {
+  mutex.lock();
+  bool pending_sound = commands.has_sound;
+  SoundSequences sound = commands.sound;
+  bool pending_leds[2] = { commands.has_led[Led1], commands.has_led[Led2] };
+  commands.clear();
+  for ( unsigned int i = 0; i < plugins.size(); ++i ) {
+    double start = static_cast<double>(ecl::TimeStamp());
+    plugins[i].plugin->update(feedback, commands);
+    double elapsed = static_cast<double>(ecl::TimeStamp()) - start;
+    Statistics &stats = plugins[i].statistics;
+    stats.last = elapsed;
+    stats.maximum = ( stats.runs == 0 ) ? elapsed : std::max(stats.maximum, elapsed);
+    ++stats.runs;
+    stats.mean += (elapsed - stats.mean) / stats.runs;
+    if ( elapsed > stats.budget ) {
+      ++stats.overruns;
+    }
+  }
+  if ( pending_sound ) {
+    commands.playSoundSequence(sound);
+  }
+  for ( unsigned int i = 0; i < 2; ++i ) {
+    if ( !commands.has_led[i] ) {
+      if ( pending_leds[i] ) {
+        commands.setLed(static_cast<LedNumber>(i), led_requests[i]);
+      }
+    } else if ( has_led_request[i] && ( commands.led_colours[i] == led_requests[i] ) ) {
+      commands.has_led[i] = pending_leds[i]; // no change, unless the change is still to go out
+    }
+    if ( commands.has_led[i] ) {
+      has_led_request[i] = true;
+      led_requests[i] = commands.led_colours[i];
+    }
+  }
+  bumper_claimed = commands.claims_bumper;
+  mutex.unlock();
+}
+
+/**
+ * @brief Whether a plugin claimed the bumper in the latest run.
+ */
+bool PluginHost::bumperClaimed() const {
+  mutex.lock();
+  bool claimed = bumper_claimed;
+  mutex.unlock();
+  return claimed;
+}
+
+/**
+ * @brief Cancel every plugin and drop the commands not yet collected.
+ */
+void PluginHost::cancel() {
+  mutex.lock();
+  for ( unsigned int i = 0; i < plugins.size(); ++i ) {
+    plugins[i].plugin->cancel();
+  }
+  commands.clear();
+  bumper_claimed = false;
+  mutex.unlock();
+}
+
+/**
+ * @brief Take the commands merged by the latest run.
+ *
+ * @param merged : filled with the commands, cleared if there are none.
+ * @return bool : false if there are no commands.
+ */
+bool PluginHost::collect(Commands &merged) {
+  mutex.lock();
+  merged = commands;
+  commands.clear();
+  mutex.unlock();
+  return !merged.empty();
+}
+
+std::vector<PluginHost::Statistics> PluginHost::statistics() const {
+  std::vector<Statistics> result;
+  mutex.lock();
+  for ( unsigned int i = 0; i < plugins.size(); ++i ) {
+    result.push_back(plugins[i].statistics);
+  }
+  mutex.unlock();
+  return result;
+}
+
+} // namespace kobuki
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/pose_history.cpp
+ *
+ * @brief Implementation of the odometry pose history.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_driver/modules/pose_history.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+PoseHistory::PoseHistory(const unsigned int &capacity) :
+  first(0), count(0)
+{
+  init(capacity);
+}
+
+/**
+ * @param capacity : number of entries kept (at 50Hz, 500 entries are 10 seconds).
+ */
+void PoseHistory::init(const unsigned int &capacity) {
+  mutex.lock();
+  ring.resize(( capacity < 2 ) ? 2 : capacity);
+  first = 0;
+  count = 0;
+  mutex.unlock();
+}
+
+void PoseHistory::clear() {
+  mutex.lock();
+  first = 0;
+  count = 0;
+  mutex.unlock();
+}
+
+/**
+ * @brief Append a new pose, overwriting the oldest when full.
+ *
+ * Entries that do not advance in time are dropped.
+ */
+void PoseHistory::add(const double &time, const ecl::Pose2D<double> &pose, const ecl::linear_algebra::Vector3d &twist) {
+  mutex.lock();
+  if ( ( count > 0 ) && ( time <= at(count - 1).time ) ) {
+    mutex.unlock();
+    return;
+  }
+  Entry entry;
+  entry.time = time;
+  entry.x = pose.x();
+  entry.y = pose.y();
+  entry.heading = pose.heading();
+  entry.vx = twist[0];
+  entry.vy = twist[1];
+  entry.wz = twist[2];
+  if ( count < ring.size() ) {
+    ring[(first + count) % ring.size()] = entry;
+    ++count;
+  } else {
+    ring[first] = entry;
+    first = (first + 1) % ring.size();
+  }
+  mutex.unlock();
+}
+
+/**
+ * @brief Pose and twist at an arbitrary time within the stored range.
+ *
+ * @param time : query time, same clock as the stamps given to add()
+ * @param pose : interpolated pose
+ * @param twist : interpolated body twist (vx, vy, wz)
+ * @return bool : false if the time lies outside the stored range.
+ */
+bool PoseHistory::lookup(const double &time, ecl::Pose2D<double> &pose, ecl::linear_algebra::Vector3d &twist) const {
+  mutex.lock();
+  if ( ( count == 0 ) || ( time < at(0).time ) || ( time > at(count - 1).time ) ) {
+    mutex.unlock();
+    return false;
+  }
+  // first entry not older than the query
+  unsigned int low = 0, high = count - 1;
+  while ( low < high ) {
+    unsigned int middle = (low + high) / 2;
+    if ( at(middle).time < time ) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  Entry result;
+  if ( low == 0 ) {
+    result = at(0);
+  } else {
+    const Entry &before = at(low - 1);
+    const Entry &after = at(low);
+    interpolate(before, after, (time - before.time) / (after.time - before.time), result);
+  }
+  mutex.unlock();
+  pose.x(result.x);
+  pose.y(result.y);
+  pose.heading(result.heading);
+  twist << result.vx, result.vy, result.wz;
+  return true;
+}
+
+/**
+ * @brief Stamps of the oldest and newest entries.
+ * @return bool : false if the history is empty.
+ */
+bool PoseHistory::timeRange(double &oldest, double &newest) const {
+  mutex.lock();
+  bool result = ( count > 0 );
+  if ( result ) {
+    oldest = at(0).time;
+    newest = at(count - 1).time;
+  }
+  mutex.unlock();
+  return result;
+}
+
+/**
+ * @brief Constant twist interpolation between two poses.
+ *
+ * Takes the log of the relative motion a->b, scales it by alpha and
+ * composes its exponential back onto a.
+ */
+void PoseHistory::interpolate(const Entry &a, const Entry &b, const double &alpha, Entry &result) {
+  double c = std::cos(a.heading);
+  double s = std::sin(a.heading);
+  // relative motion in a's frame
+  double dx = c * (b.x - a.x) + s * (b.y - a.y);
+  double dy = -s * (b.x - a.x) + c * (b.y - a.y);
+  double dtheta = ecl::wrap_angle(b.heading - a.heading);
+
+  double px, py; // scaled relative motion
+  if ( std::fabs(dtheta) < 1e-9 ) {
+    px = alpha * dx;
+    py = alpha * dy;
+  } else {
+    // log map: translational velocity rho with [dx dy] = V(dtheta) rho
+    double sin_t = std::sin(dtheta), cos_t = std::cos(dtheta);
+    double k = dtheta / (2.0 * (1.0 - cos_t));
+    double rho_x = k * (sin_t * dx + (1.0 - cos_t) * dy);
+    double rho_y = k * (-(1.0 - cos_t) * dx + sin_t * dy);
+    // exp map of alpha * (rho, dtheta)
+    double t = alpha * dtheta;
+    double sin_a = std::sin(t), cos_a = std::cos(t);
+    px = (sin_a * rho_x - (1.0 - cos_a) * rho_y) / dtheta; // V(t) * alpha * rho, with t = alpha * dtheta
+    py = ((1.0 - cos_a) * rho_x + sin_a * rho_y) / dtheta;
+  }
+  result.time = a.time + alpha * (b.time - a.time);
+  result.x = a.x + c * px - s * py;
+  result.y = a.y + s * px + c * py;
+  result.heading = ecl::wrap_angle(a.heading + alpha * dtheta);
+  result.vx = a.vx + alpha * (b.vx - a.vx);
+  result.vy = a.vy + alpha * (b.vy - a.vy);
+  result.wz = a.wz + alpha * (b.wz - a.wz);
+}
+
+} // namespace kobuki
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/reactor.cpp
+ *
+ * @brief Implementation of the epoll reactor.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <ecl/exceptions/standard_exception.hpp>
+#include "../../include/kobuki_driver/reactor.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation [Reactor]
+*****************************************************************************/
+
+const long Reactor::reconnect_now;
+
+/**
+ * @brief Create the epoll set and start the thread pool.
+ *
+ * @param threads : size of the pool, one is plenty for dozens of robots.
+ * @exception StandardException : if the epoll set cannot be created.
+ */
+Reactor::Reactor(const unsigned int &threads) :
+  epoll(-1),
+  wakeup(-1),
+  shutdown_requested(false),
+  next_id(1) // 0 is the wakeup descriptor
+{
+  epoll = epoll_create1(EPOLL_CLOEXEC);
+  wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ( ( epoll == -1 ) || ( wakeup == -1 ) ) {
+    throw ecl::StandardException(LOC, ecl::OpenError, std::string("Reactor could not create its epoll set: ") + std::strerror(errno));
+  }
+  epoll_event event;
+  event.events = EPOLLIN; // level triggered, so it releases every thread in the pool
+  event.data.u64 = 0;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, wakeup, &event);
+  sem_init(&reconnect_requests, 0, 0);
+  connection_thread.start(&Reactor::connect, *this);
+  for ( unsigned int i = 0; i < ( threads ? threads : 1 ); ++i ) {
+    boost::shared_ptr<ecl::Thread> thread(new ecl::Thread());
+    thread->start(&Reactor::spin, *this);
+    pool.push_back(thread);
+  }
+}
+
+/**
+ * @brief Stop the pool; clients should have been removed already.
+ */
+Reactor::~Reactor() {
+  clients_mutex.lock();
+  shutdown_requested = true;
+  clients_mutex.unlock();
+  uint64_t one = 1;
+  if ( write(wakeup, &one, sizeof(one)) != sizeof(one) ) {}
+  sem_post(&reconnect_requests);
+  for ( unsigned int i = 0; i < pool.size(); ++i ) {
+    pool[i]->join();
+  }
+  connection_thread.join();
+  sem_destroy(&reconnect_requests);
+  for ( std::map<uint64_t, EntryPtr>::iterator iter = clients.begin(); iter != clients.end(); ++iter ) {
+    ::close(iter->second->timer);
+  }
+  ::close(wakeup);
+  ::close(epoll);
+}
+
+/**
+ * @brief Start serving a client; its service() is called straight away.
+ *
+ * @exception StandardException : if a timer cannot be created for it.
+ */
+void Reactor::add(Client *client) {
+  clients_mutex.lock();
+  EntryPtr entry(new Entry(client, next_id++));
+  entry->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if ( entry->timer == -1 ) {
+    clients_mutex.unlock();
+    throw ecl::StandardException(LOC, ecl::OpenError, std::string("Reactor could not create a timer: ") + std::strerror(errno));
+  }
+  clients[entry->id] = entry;
+  clients_mutex.unlock();
+
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.u64 = entry->id * 2 + 1;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, entry->timer, &event);
+  itimerspec spec;
+  std::memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_nsec = 1; // now
+  timerfd_settime(entry->timer, 0, &spec, NULL);
+}
+
+/**
+ * @brief Stop serving a client, waiting for a callback in progress to finish.
+ *
+ * That includes a reconnection attempt. Must not be called from within one
+ * of the client's own callbacks.
+ */
+void Reactor::remove(Client *client) {
+  EntryPtr entry;
+  clients_mutex.lock();
+  for ( std::map<uint64_t, EntryPtr>::iterator iter = clients.begin(); iter != clients.end(); ++iter ) {
+    if ( iter->second->client == client ) {
+      entry = iter->second;
+      clients.erase(iter);
+      break;
+    }
+  }
+  clients_mutex.unlock();
+  if ( !entry ) {
+    return;
+  }
+  entry->mutex.lock();
+  entry->removed = true; // for threads already holding one of its events
+  epoll_ctl(epoll, EPOLL_CTL_DEL, entry->timer, NULL);
+  ::close(entry->timer);
+  if ( entry->watched != -1 ) {
+    epoll_ctl(epoll, EPOLL_CTL_DEL, entry->watched, NULL);
+  }
+  entry->mutex.unlock();
+}
+
+/**
+ * @brief A pool thread's loop.
+ */
+void Reactor::spin() {
+  const int max_events = 8;
+  epoll_event events[max_events];
+  while ( !isShuttingDown() ) {
+    int n = epoll_wait(epoll, events, max_events, -1);
+    for ( int i = 0; i < n; ++i ) {
+      if ( events[i].data.u64 != 0 ) {
+        dispatch(events[i].data.u64);
+      }
+    }
+  }
+}
+
+/**
+ * @brief The connection thread's loop, running reconnect() for clients that asked.
+ */
+void Reactor::connect() {
+  for (;;) {
+    while ( ( sem_wait(&reconnect_requests) != 0 ) && ( errno == EINTR ) ) {}
+    clients_mutex.lock();
+    bool done = shutdown_requested;
+    EntryPtr entry;
+    if ( !done && !reconnecting.empty() ) {
+      entry = reconnecting.front();
+      reconnecting.pop_front();
+    }
+    clients_mutex.unlock();
+    if ( done ) {
+      return;
+    }
+    if ( !entry ) {
+      continue;
+    }
+    entry->mutex.lock();
+    if ( !entry->removed ) {
+      rearm(*entry, entry->client->reconnect());
+    }
+    entry->mutex.unlock();
+  }
+}
+
+bool Reactor::isShuttingDown() {
+  clients_mutex.lock();
+  bool shutting_down = shutdown_requested;
+  clients_mutex.unlock();
+  return shutting_down;
+}
+
+/**
+ * @brief Run the callback an event is for, then re-arm the client.
+ *
+ * @param key : client id x2, plus one for its timer.
+ */
+void Reactor::dispatch(const uint64_t &key) {
+  EntryPtr entry;
+  clients_mutex.lock();
+  std::map<uint64_t, EntryPtr>::iterator iter = clients.find(key / 2);
+  if ( iter != clients.end() ) {
+    entry = iter->second;
+  }
+  clients_mutex.unlock();
+  if ( !entry ) {
+    return;
+  }
+  entry->mutex.lock();
+  if ( !entry->removed ) {
+    if ( key & 1 ) {
+      uint64_t expirations;
+      if ( read(entry->timer, &expirations, sizeof(expirations)) != sizeof(expirations) ) {}
+    } else {
+      entry->client->readable();
+    }
+    long wait = entry->client->service();
+    if ( wait == reconnect_now ) {
+      // left disarmed until the connection thread is done with it
+      if ( entry->watched != -1 ) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, entry->watched, NULL);
+        entry->watched = -1;
+      }
+      clients_mutex.lock();
+      reconnecting.push_back(entry);
+      clients_mutex.unlock();
+      sem_post(&reconnect_requests);
+    } else {
+      rearm(*entry, wait);
+    }
+  }
+  entry->mutex.unlock();
+}
+
+/**
+ * @brief Set the client's timer and (re)register its current descriptor.
+ *
+ * @param entry : the client, its mutex held.
+ * @param wait : milliseconds until service() is next due.
+ */
+void Reactor::rearm(Entry &entry, const long &wait) {
+  itimerspec spec;
+  std::memset(&spec, 0, sizeof(spec));
+  long ms = ( wait > 1 ) ? wait : 1;
+  spec.it_value.tv_sec = ms / 1000;
+  spec.it_value.tv_nsec = ( ms % 1000 ) * 1000000L;
+  timerfd_settime(entry.timer, 0, &spec, NULL);
+
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.u64 = entry.id * 2 + 1;
+  epoll_ctl(epoll, EPOLL_CTL_MOD, entry.timer, &event);
+
+  int fd = entry.client->descriptor();
+  if ( ( entry.watched != -1 ) && ( entry.watched != fd ) ) {
+    epoll_ctl(epoll, EPOLL_CTL_DEL, entry.watched, NULL); // fails harmlessly if already closed
+  }
+  entry.watched = fd;
+  if ( fd != -1 ) {
+    event.data.u64 = entry.id * 2;
+    // a closed and reopened device may well get the same number back, but
+    // closing it dropped the registration, so fall back to adding it again.
+    if ( ( epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event) == -1 ) && ( errno == ENOENT ) ) {
+      epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+  }
+}
+
+} // namespace kobuki
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/replay_transport.cpp
+ *
+ * @brief Implementation of the replay and recording transports.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include "../../include/kobuki_driver/transport.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+namespace {
+
+double now() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+} // anonymous namespace
+
+/*****************************************************************************
+** Implementation [ReplayTransport]
+*****************************************************************************/
+
+bool ReplayTransport::exists() const {
+  return !finished && ( access(path.c_str(), R_OK) == 0 );
+}
+
+bool ReplayTransport::open() {
+  close();
+  file = std::fopen(path.c_str(), "rb");
+  if ( file == NULL ) {
+    error_message = "could not open replay log " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  pending.clear();
+  if ( !nextChunk() ) {
+    error_message = "replay log " + path + " is empty.";
+    close();
+    finished = true;
+    return false;
+  }
+  start_log = chunk_time;
+  start_host = now();
+  return true;
+}
+
+void ReplayTransport::close() {
+  if ( file != NULL ) {
+    std::fclose(file);
+    file = NULL;
+  }
+}
+
+/**
+ * @brief Load the next chunk of the log into pending.
+ *
+ * @return bool : false at the end of the log (or a truncated chunk).
+ */
+bool ReplayTransport::nextChunk() {
+  double time;
+  uint32_t length;
+  if ( ( std::fread(&time, sizeof(time), 1, file) != 1 ) ||
+       ( std::fread(&length, sizeof(length), 1, file) != 1 ) ) {
+    return false;
+  }
+  std::vector<unsigned char> bytes(length);
+  if ( length && ( std::fread(&bytes[0], 1, length, file) != length ) ) {
+    return false;
+  }
+  chunk_time = time;
+  pending.insert(pending.end(), bytes.begin(), bytes.end());
+  return true;
+}
+
+/**
+ * @brief Hand out the pending chunk if its (scaled) time has come.
+ *
+ * Returns straight away either way, the timeout is not waited on.
+ *
+ * @return int : bytes read, 0 if not due yet, -1 at the end of the log.
+ */
+int ReplayTransport::read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms) {
+  if ( file == NULL ) {
+    return -1;
+  }
+  if ( pending.empty() ) {
+    if ( !nextChunk() ) {
+      error_message = "end of replay.";
+      finished = true;
+      close();
+      return -1;
+    }
+  }
+  if ( idleTime() > 0 ) {
+    return 0;
+  }
+  unsigned int n = 0;
+  while ( ( n < size ) && !pending.empty() ) {
+    buffer[n++] = pending.front();
+    pending.pop_front();
+  }
+  return static_cast<int>(n);
+}
+
+/**
+ * @brief Milliseconds until the pending chunk is due, 0 if now (or unknown until the next read).
+ */
+long ReplayTransport::idleTime() const {
+  if ( ( file == NULL ) || pending.empty() || ( rate <= 0.0 ) ) {
+    return 0;
+  }
+  double wait = start_host + ( chunk_time - start_log ) / rate - now();
+  return ( wait > 0.0 ) ? static_cast<long>(wait * 1000.0) + 1 : 0;
+}
+
+/*****************************************************************************
+** Implementation [RecordingTransport]
+*****************************************************************************/
+
+RecordingTransport::RecordingTransport(const boost::shared_ptr<Transport> &transport, const std::string &log) :
+  Transport(transport->uri()),
+  transport(transport),
+  log(log),
+  file(NULL)
+{}
+
+RecordingTransport::~RecordingTransport() {
+  if ( file != NULL ) {
+    std::fclose(file);
+  }
+}
+
+/**
+ * @brief Open the underlying transport, truncating the log on the first call.
+ *
+ * Appending to an older run's log would mix two time bases, which the
+ * replay would then wait out (or jump back across).
+ */
+bool RecordingTransport::open() {
+  if ( file == NULL ) {
+    file = std::fopen(log.c_str(), "wb");
+    if ( file == NULL ) {
+      error_message = "could not open record file " + log + ": " + std::strerror(errno);
+      return false;
+    }
+  }
+  return transport->open();
+}
+
+int RecordingTransport::read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms) {
+  int n = transport->read(buffer, size, timeout_ms);
+  if ( ( n > 0 ) && ( file != NULL ) ) {
+    double time = now();
+    uint32_t length = static_cast<uint32_t>(n);
+    std::fwrite(&time, sizeof(time), 1, file);
+    std::fwrite(&length, sizeof(length), 1, file);
+    std::fwrite(buffer, 1, n, file);
+    std::fflush(file);
+  }
+  return n;
+}
+
+} // namespace kobuki
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/safety_reflex.cpp
+ *
+ * @brief Implementation of the in-driver safety reflex.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include "../../include/kobuki_driver/modules/safety_reflex.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+namespace {
+/**
+ * @brief Keep the strongest action of the sensors that are firing.
+ */
+void strongest(const uint8_t &flags, const SafetyReflex::Action &action, const char *sensor,
+               SafetyReflex::Action &result, std::string &cause)
+{
+  if ( flags && ( action > result ) ) {
+    result = action;
+    cause = sensor;
+  }
+}
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+SafetyReflex::SafetyReflex() :
+  current_state(Idle),
+  backoff_end(0.0),
+  reacting(false),
+  trigger_time(0.0)
+{}
+
+void SafetyReflex::init(const Settings &new_settings) {
+  mutex.lock();
+  settings = new_settings;
+  reaction_statistics = Reaction();
+  mutex.unlock();
+  reset();
+}
+
+/**
+ * @brief Release any override, e.g. when the connection is lost.
+ */
+void SafetyReflex::reset() {
+  mutex.lock();
+  current_state = Idle;
+  reacting = false;
+  mutex.unlock();
+}
+
+/**
+ * @brief Step the reflex with the latest frame's sensor flags.
+ *
+ * @param bumper : core sensor bumper flags
+ * @param cliff : core sensor cliff flags
+ * @param wheel_drop : core sensor wheel drop flags
+ * @param frame_time : host time [s] the frame was stamped at by the firmware
+ * @return bool : true if a new override started, it should be sent straight away.
+ */
+bool SafetyReflex::update(const uint8_t &bumper, const uint8_t &cliff, const uint8_t &wheel_drop,
+                          const double &frame_time) {
+  if ( !settings.enable ) {
+    return false;
+  }
+  Action action = Ignore;
+  std::string sensor;
+  strongest(wheel_drop, settings.wheel_drop, "wheel drop", action, sensor);
+  strongest(cliff, settings.cliff, "cliff", action, sensor);
+  strongest(bumper, settings.bumper, "bumper", action, sensor);
+
+  mutex.lock();
+  bool triggered = false;
+  switch ( current_state ) {
+    case Idle:
+      triggered = ( action != Ignore );
+      break;
+    case BackingOff:
+      if ( action == Stop ) {
+        triggered = true; // escalate, e.g. a wheel dropped while reversing
+      } else if ( frame_time >= backoff_end ) {
+        current_state = ( action == Ignore ) ? Idle : Stopped;
+      }
+      break;
+    case Stopped:
+      if ( action == Ignore ) {
+        current_state = Idle;
+      }
+      break;
+  }
+  if ( triggered ) {
+    current_state = ( action == Stop ) ? Stopped : BackingOff;
+    backoff_end = frame_time + settings.backoff_time;
+    reacting = true;
+    trigger_time = frame_time;
+    trigger = sensor;
+    ++reaction_statistics.triggers;
+  }
+  mutex.unlock();
+  return triggered;
+}
+
+/**
+ * @brief Replace the outgoing velocities while the reflex is active.
+ *
+ * @param linear_velocity : [m/s] replaced if overriding
+ * @param angular_velocity : [rad/s] replaced if overriding
+ * @return bool : true if overriding.
+ */
+bool SafetyReflex::override(double &linear_velocity, double &angular_velocity) {
+  mutex.lock();
+  bool active = ( current_state != Idle );
+  if ( active ) {
+    linear_velocity = ( current_state == BackingOff ) ? -settings.backoff_speed : 0.0;
+    angular_velocity = 0.0;
+  }
+  mutex.unlock();
+  return active;
+}
+
+/**
+ * @brief Register a base control command leaving the host.
+ *
+ * Closes the reaction time measurement of the latest trigger.
+ *
+ * @param time : host time [s] of the transmission
+ */
+void SafetyReflex::commandSent(const double &time) {
+  mutex.lock();
+  if ( reacting ) {
+    reacting = false;
+    double latency = time - trigger_time;
+    Reaction &stats = reaction_statistics;
+    stats.last = latency;
+    stats.maximum = ( stats.count == 0 ) ? latency : std::max(stats.maximum, latency);
+    ++stats.count;
+    stats.mean += (latency - stats.mean) / stats.count;
+  }
+  mutex.unlock();
+}
+
+/**
+ * @brief Parse "ignore", "stop" or "backoff".
+ *
+ * @return bool : false if the name is not recognised, action is untouched.
+ */
+bool SafetyReflex::fromString(const std::string &name, Action &action) {
+  if ( name == "ignore" ) {
+    action = Ignore;
+  } else if ( name == "stop" ) {
+    action = Stop;
+  } else if ( name == "backoff" ) {
+    action = BackOff;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::string SafetyReflex::toString(const Action &action) {
+  switch ( action ) {
+    case Stop:    return "stop";
+    case BackOff: return "backoff";
+    default:      return "ignore";
+  }
+}
+
+} // namespace kobuki
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/trajectory_buffer.cpp
+ *
+ * @brief Implementation of the velocity trajectory buffer.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <limits>
+#include "../../include/kobuki_driver/modules/trajectory_buffer.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+static bool isFinite(const double &value) {
+  return ( value == value ) && ( std::fabs(value) <= std::numeric_limits<double>::max() );
+}
+
+/**
+ * @brief Velocity change over a segment is reachable at the given acceleration (zero for unlimited).
+ */
+static bool withinAcceleration(const double &from, const double &to, const double &dt, const double &acceleration) {
+  return ( acceleration <= 0.0 ) || ( std::fabs(to - from) <= acceleration * dt * ( 1.0 + 1e-6 ) );
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+TrajectoryBuffer::TrajectoryBuffer() :
+  linear_acceleration(0.0),
+  angular_acceleration(0.0),
+  running(false),
+  has_pending(false),
+  cursor(0)
+{}
+
+/**
+ * @brief Limit the accelerations a trajectory may ask for.
+ *
+ * @param linear_acceleration : [m/s^2] largest between consecutive samples, zero for unlimited.
+ * @param angular_acceleration : [rad/s^2] largest between consecutive samples, zero for unlimited.
+ */
+void TrajectoryBuffer::init(const double &linear_acceleration, const double &angular_acceleration) {
+  mutex.lock();
+  this->linear_acceleration = linear_acceleration;
+  this->angular_acceleration = angular_acceleration;
+  mutex.unlock();
+}
+
+/**
+ * @brief Queue a trajectory, replacing any other that has not started yet.
+ *
+ * @param start : host time [s] the sample times count from.
+ * @param samples : at least one finite sample, in strictly increasing time.
+ * @return bool : false if the samples are empty, out of order, not finite or too abrupt.
+ */
+bool TrajectoryBuffer::set(const double &start, const std::vector<Sample> &samples) {
+  mutex.lock();
+  bool valid = !samples.empty() && isFinite(start);
+  for ( unsigned int i = 0; valid && ( i < samples.size() ); ++i ) {
+    valid = isFinite(samples[i].time) && isFinite(samples[i].linear_velocity) &&
+            isFinite(samples[i].angular_velocity);
+    if ( valid && ( i > 0 ) ) {
+      double dt = samples[i].time - samples[i - 1].time;
+      valid = ( dt > 0.0 ) &&
+              withinAcceleration(samples[i - 1].linear_velocity, samples[i].linear_velocity, dt, linear_acceleration) &&
+              withinAcceleration(samples[i - 1].angular_velocity, samples[i].angular_velocity, dt, angular_acceleration);
+    }
+  }
+  if ( !valid ) {
+    ++counts.rejected;
+    mutex.unlock();
+    return false;
+  }
+  ++counts.received;
+  pending = samples;
+  for ( unsigned int i = 0; i < pending.size(); ++i ) {
+    pending[i].time += start;
+  }
+  has_pending = true;
+  mutex.unlock();
+  return true;
+}
+
+/**
+ * @brief Velocities due at a given time.
+ *
+ * @param time : host time [s], normally when the next firmware cycle applies the command.
+ * @param linear_velocity : [m/s] interpolated, only written while running.
+ * @param angular_velocity : [rad/s] interpolated, only written while running.
+ * @return Result : whether a trajectory is running, or just finished.
+ */
+TrajectoryBuffer::Result TrajectoryBuffer::sample(const double &time, double &linear_velocity,
+                                                  double &angular_velocity) {
+  mutex.lock();
+  if ( has_pending && ( time >= pending.front().time ) ) {
+    if ( running ) {
+      ++counts.preempted;
+    }
+    current.swap(pending);
+    has_pending = false;
+    running = true;
+    cursor = 0;
+  }
+  if ( !running ) {
+    mutex.unlock();
+    return Idle;
+  }
+  if ( time > current.back().time ) {
+    running = false;
+    ++counts.completed;
+    mutex.unlock();
+    return Finished;
+  }
+  while ( ( cursor + 1 < current.size() ) && ( current[cursor + 1].time < time ) ) {
+    ++cursor;
+  }
+  const Sample &from = current[cursor];
+  if ( cursor + 1 == current.size() ) {
+    linear_velocity = from.linear_velocity;
+    angular_velocity = from.angular_velocity;
+  } else {
+    const Sample &to = current[cursor + 1];
+    double fraction = ( time - from.time ) / ( to.time - from.time );
+    linear_velocity = from.linear_velocity + fraction * ( to.linear_velocity - from.linear_velocity );
+    angular_velocity = from.angular_velocity + fraction * ( to.angular_velocity - from.angular_velocity );
+  }
+  mutex.unlock();
+  return Running;
+}
+
+/**
+ * @brief Drop the running and any queued trajectory.
+ */
+void TrajectoryBuffer::cancel() {
+  mutex.lock();
+  if ( running || has_pending ) {
+    ++counts.cancelled;
+  }
+  running = false;
+  has_pending = false;
+  mutex.unlock();
+}
+
+TrajectoryBuffer::Statistics TrajectoryBuffer::statistics() const {
+  mutex.lock();
+  Statistics result = counts;
+  mutex.unlock();
+  return result;
+}
+
+} // namespace kobuki
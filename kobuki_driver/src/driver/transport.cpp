@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/transport.cpp
+ *
+ * @brief Implementation of the tty, pty and socket transports.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <time.h>
+#include "../../include/kobuki_driver/transport.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+namespace {
+
+double now() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+const int write_timeout = 100; // [ms] for a full output buffer to drain
+
+} // anonymous namespace
+
+/*****************************************************************************
+** Implementation [Transport]
+*****************************************************************************/
+
+/**
+ * @brief Create a transport from its uri (see Transport).
+ *
+ * @param uri : e.g. /dev/kobuki, tcp://bridge:5000, replay:///tmp/kobuki.log?rate=2
+ * @return shared_ptr<Transport> : null if the uri is not understood.
+ */
+boost::shared_ptr<Transport> Transport::create(const std::string &uri) {
+  boost::shared_ptr<Transport> transport;
+  std::string::size_type separator = uri.find("://");
+  std::string scheme = ( separator == std::string::npos ) ? "tty" : uri.substr(0, separator);
+  std::string location = ( separator == std::string::npos ) ? uri : uri.substr(separator + 3);
+
+  if ( scheme == "tty" ) {
+    if ( !location.empty() ) {
+      transport.reset(new TtyTransport(uri, location));
+    }
+  } else if ( scheme == "pty" ) {
+    transport.reset(new PtyTransport(uri));
+  } else if ( scheme == "tcp" ) {
+    std::string::size_type colon = location.rfind(':');
+    if ( ( colon != std::string::npos ) && ( colon > 0 ) && ( colon + 1 < location.size() ) ) {
+      transport.reset(new SocketTransport(uri, location.substr(0, colon), location.substr(colon + 1)));
+    }
+  } else if ( scheme == "unix" ) {
+    if ( !location.empty() ) {
+      transport.reset(new SocketTransport(uri, location));
+    }
+  } else if ( scheme == "replay" ) {
+    double rate = 1.0;
+    std::string::size_type query = location.find("?rate=");
+    if ( query != std::string::npos ) {
+      rate = std::atof(location.c_str() + query + 6);
+      location.erase(query);
+    }
+    if ( !location.empty() && ( rate >= 0.0 ) ) {
+      transport.reset(new ReplayTransport(uri, location, rate));
+    }
+  }
+  return transport;
+}
+
+/*****************************************************************************
+** Implementation [FdTransport]
+*****************************************************************************/
+
+void FdTransport::close() {
+  if ( descriptor != -1 ) {
+    ::close(descriptor);
+    descriptor = -1;
+  }
+}
+
+/**
+ * @brief Read whatever is available, waiting up to the timeout for something.
+ *
+ * @return int : bytes read, 0 on timeout, -1 if the link is gone (and closed).
+ */
+int FdTransport::read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms) {
+  if ( descriptor == -1 ) {
+    return -1;
+  }
+  pollfd request;
+  request.fd = descriptor;
+  request.events = POLLIN;
+  request.revents = 0;
+  int result = ::poll(&request, 1, static_cast<int>(timeout_ms));
+  if ( result == 0 || ( ( result < 0 ) && ( errno == EINTR ) ) ) {
+    return 0;
+  } else if ( result < 0 ) {
+    fail("poll");
+    return -1;
+  }
+  if ( !( request.revents & POLLIN ) ) {
+    return hangup(timeout_ms);
+  }
+  ssize_t n = ::read(descriptor, buffer, size);
+  if ( n > 0 ) {
+    return static_cast<int>(n);
+  } else if ( ( n < 0 ) && ( ( errno == EAGAIN ) || ( errno == EINTR ) ) ) {
+    return 0;
+  }
+  return hangup(timeout_ms);
+}
+
+/**
+ * @brief Write the whole buffer.
+ *
+ * Descriptors are non-blocking, so a full output buffer is waited on (up to
+ * write_timeout) rather than leaving half a packet on the wire.
+ *
+ * @return int : bytes written, -1 on failure.
+ */
+int FdTransport::write(const unsigned char *buffer, const unsigned int &size) {
+  if ( descriptor == -1 ) {
+    return -1;
+  }
+  unsigned int written = 0;
+  double deadline = now() + write_timeout / 1000.0;
+  while ( written < size ) {
+    ssize_t n = ::write(descriptor, buffer + written, size - written);
+    if ( n < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      if ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) {
+        int remaining = static_cast<int>((deadline - now()) * 1000.0);
+        pollfd request;
+        request.fd = descriptor;
+        request.events = POLLOUT;
+        request.revents = 0;
+        int result = ( remaining > 0 ) ? ::poll(&request, 1, remaining) : 0;
+        if ( ( result > 0 ) || ( ( result < 0 ) && ( errno == EINTR ) ) ) {
+          continue;
+        } else if ( result == 0 ) {
+          error_message = "write timed out, the output buffer is not draining.";
+          return -1;
+        }
+      }
+      error_message = std::string("write failed: ") + std::strerror(errno);
+      return -1;
+    }
+    written += static_cast<unsigned int>(n);
+  }
+  return static_cast<int>(written);
+}
+
+/**
+ * @brief The other end went away; by default that is the end of the link.
+ */
+int FdTransport::hangup(const long &timeout_ms) {
+  error_message = "connection closed by the other end.";
+  close();
+  return -1;
+}
+
+bool FdTransport::fail(const std::string &what) {
+  error_message = what + " failed: " + std::strerror(errno);
+  close();
+  return false;
+}
+
+/*****************************************************************************
+** Implementation [TtyTransport]
+*****************************************************************************/
+
+bool TtyTransport::exists() const {
+  return access(device.c_str(), F_OK) == 0;
+}
+
+bool TtyTransport::open() {
+  close();
+  descriptor = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if ( descriptor == -1 ) {
+    return fail("open " + device);
+  }
+  termios options;
+  if ( tcgetattr(descriptor, &options) != 0 ) {
+    return fail("tcgetattr " + device);
+  }
+  cfmakeraw(&options);
+  cfsetispeed(&options, B115200);
+  cfsetospeed(&options, B115200);
+  options.c_cflag |= ( CLOCAL | CREAD );
+  options.c_cflag &= ~( CSTOPB | PARENB | CRTSCTS );
+  options.c_cc[VMIN] = 0;
+  options.c_cc[VTIME] = 0;
+  if ( tcsetattr(descriptor, TCSANOW, &options) != 0 ) {
+    return fail("tcsetattr " + device);
+  }
+  tcflush(descriptor, TCIOFLUSH); // drop whatever was lying around from before
+  return true;
+}
+
+/*****************************************************************************
+** Implementation [PtyTransport]
+*****************************************************************************/
+
+const double PtyTransport::retry_period = 0.1;
+
+bool PtyTransport::open() {
+  close();
+  hung_up = false;
+  descriptor = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if ( descriptor == -1 ) {
+    return fail("posix_openpt");
+  }
+  if ( ( grantpt(descriptor) != 0 ) || ( unlockpt(descriptor) != 0 ) ) {
+    return fail("unlockpt");
+  }
+  termios options;
+  if ( tcgetattr(descriptor, &options) == 0 ) {
+    cfmakeraw(&options);
+    tcsetattr(descriptor, TCSANOW, &options);
+  }
+  const char *name = ptsname(descriptor);
+  slave_name = name ? name : "";
+  return true;
+}
+
+/**
+ * @brief Read, unless still waiting to check for an emulator again.
+ *
+ * Never sleeps while hung up; callers wait for idleTime() instead.
+ */
+int PtyTransport::read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms) {
+  if ( hung_up ) {
+    if ( now() < retry_time ) {
+      return 0;
+    }
+    hung_up = false;
+    return FdTransport::read(buffer, size, 0);
+  }
+  return FdTransport::read(buffer, size, timeout_ms);
+}
+
+long PtyTransport::idleTime() const {
+  double remaining = retry_time - now();
+  return ( hung_up && ( remaining > 0.0 ) ) ? static_cast<long>(remaining * 1000.0) + 1 : 0;
+}
+
+/**
+ * @brief No emulator on the slave end (yet, or any more); check again later.
+ */
+int PtyTransport::hangup(const long &timeout_ms) {
+  hung_up = true;
+  retry_time = now() + retry_period;
+  return 0;
+}
+
+/*****************************************************************************
+** Implementation [SocketTransport]
+*****************************************************************************/
+
+bool SocketTransport::exists() const {
+  return path.empty() || ( access(path.c_str(), F_OK) == 0 );
+}
+
+bool SocketTransport::open() {
+  close();
+  if ( !path.empty() ) {
+    sockaddr_un address;
+    if ( path.size() >= sizeof(address.sun_path) ) {
+      error_message = "unix socket path is too long: " + path;
+      return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( descriptor == -1 ) {
+      return fail("socket");
+    }
+    if ( connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ) {
+      return fail("connect " + path);
+    }
+    return nonBlocking();
+  }
+
+  addrinfo hints, *addresses = NULL;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int result = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+  if ( result != 0 ) {
+    error_message = "could not resolve " + host + ":" + port + ": " + gai_strerror(result);
+    return false;
+  }
+  for ( addrinfo *address = addresses; address != NULL; address = address->ai_next ) {
+    descriptor = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if ( descriptor == -1 ) {
+      continue;
+    }
+    if ( connect(descriptor, address->ai_addr, address->ai_addrlen) == 0 ) {
+      break;
+    }
+    ::close(descriptor);
+    descriptor = -1;
+  }
+  freeaddrinfo(addresses);
+  if ( descriptor == -1 ) {
+    return fail("connect " + host + ":" + port);
+  }
+  int flag = 1; // commands are tiny and latency matters
+  setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  return nonBlocking();
+}
+
+/**
+ * @brief Like the tty and pty, never block in read or write once connected.
+ */
+bool SocketTransport::nonBlocking() {
+  int flags = fcntl(descriptor, F_GETFL, 0);
+  if ( ( flags == -1 ) || ( fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) == -1 ) ) {
+    return fail("fcntl");
+  }
+  return true;
+}
+
+} // namespace kobuki
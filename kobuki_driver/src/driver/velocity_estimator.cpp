@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/velocity_estimator.cpp
+ *
+ * @brief Implementation of the sliding window velocity estimator.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include "../../include/kobuki_driver/modules/velocity_estimator.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+VelocityEstimator::VelocityEstimator(const unsigned int &window) :
+  capacity(0), newest(0), count(0), rate(0.0)
+{
+  init(window);
+}
+
+/**
+ * @param window : number of samples to fit over, at least two.
+ */
+void VelocityEstimator::init(const unsigned int &window) {
+  capacity = ( window < 2 ) ? 2 : window;
+  times.assign(capacity, 0.0);
+  positions.assign(capacity, 0.0);
+  reset();
+}
+
+void VelocityEstimator::reset() {
+  newest = 0;
+  count = 0;
+  rate = 0.0;
+}
+
+/**
+ * @brief Add a sample and refit.
+ *
+ * @param time : monotonic time [s]
+ * @param position : accumulated position (e.g. wheel angle in radians)
+ */
+void VelocityEstimator::update(const double &time, const double &position) {
+  if ( ( count > 0 ) && ( time <= times[newest] ) ) {
+    positions[newest] = position; // same stamp, keep the freshest reading
+  } else {
+    newest = ( count == 0 ) ? 0 : ( newest + 1 ) % capacity;
+    times[newest] = time;
+    positions[newest] = position;
+    if ( count < capacity ) { ++count; }
+  }
+  if ( count < 2 ) {
+    return;
+  }
+  // fit relative to the newest sample to keep the sums well conditioned
+  double mean_t = 0.0, mean_x = 0.0;
+  for ( unsigned int i = 0; i < count; ++i ) {
+    mean_t += times[i] - times[newest];
+    mean_x += positions[i] - positions[newest];
+  }
+  mean_t /= count;
+  mean_x /= count;
+  double stt = 0.0, stx = 0.0;
+  for ( unsigned int i = 0; i < count; ++i ) {
+    double dt = times[i] - times[newest] - mean_t;
+    double dx = positions[i] - positions[newest] - mean_x;
+    stt += dt * dt;
+    stx += dt * dx;
+  }
+  if ( stt > 0.0 ) {
+    rate = stx / stt;
+  }
+}
+
+} // namespace kobuki
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/velocity_mux.cpp
+ *
+ * @brief Implementation of the velocity command multiplexer.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include "../../include/kobuki_driver/modules/velocity_mux.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+VelocityMux::VelocityMux() :
+  selected_input(-1),
+  selected_commands(0)
+{}
+
+/**
+ * @brief Register an input.
+ *
+ * @param name : unique name of the input.
+ * @param priority : higher wins.
+ * @param timeout : silence [s] before the input is dropped, zero or less to never drop it.
+ * @return int : the input's index, -1 if the name is already taken.
+ */
+int VelocityMux::add(const std::string &name, const int &priority, const double &timeout) {
+  mutex.lock();
+  for ( unsigned int i = 0; i < inputs.size(); ++i ) {
+    if ( inputs[i].name == name ) {
+      mutex.unlock();
+      return -1;
+    }
+  }
+  inputs.push_back(Input(name, priority, timeout));
+  int index = inputs.size() - 1;
+  mutex.unlock();
+  return index;
+}
+
+/**
+ * @brief Latest command from an input.
+ *
+ * @param input : index returned by add().
+ * @param linear_velocity : [m/s]
+ * @param angular_velocity : [rad/s]
+ * @param time : host time [s] of the command.
+ * @return bool : false if there is no such input.
+ */
+bool VelocityMux::set(const unsigned int &input, const double &linear_velocity, const double &angular_velocity,
+                      const double &time) {
+  mutex.lock();
+  if ( input >= inputs.size() ) {
+    mutex.unlock();
+    return false;
+  }
+  Input &entry = inputs[input];
+  entry.linear_velocity = linear_velocity;
+  entry.angular_velocity = angular_velocity;
+  entry.last_active = time;
+  entry.released = false;
+  ++entry.commands;
+  mutex.unlock();
+  return true;
+}
+
+/**
+ * @brief Drop an input straight away rather than waiting for its timeout.
+ *
+ * It becomes active again with its next command.
+ *
+ * @param input : index returned by add().
+ * @return bool : false if there is no such input.
+ */
+bool VelocityMux::release(const unsigned int &input) {
+  mutex.lock();
+  if ( input >= inputs.size() ) {
+    mutex.unlock();
+    return false;
+  }
+  inputs[input].released = true;
+  mutex.unlock();
+  return true;
+}
+
+/**
+ * @brief Release every input, e.g. when the motors are disabled.
+ */
+void VelocityMux::clear() {
+  mutex.lock();
+  for ( unsigned int i = 0; i < inputs.size(); ++i ) {
+    inputs[i].released = true;
+  }
+  mutex.unlock();
+}
+
+/**
+ * @brief Pick the command for this cycle.
+ *
+ * @param now : host time [s].
+ * @param linear_velocity : [m/s] selected command, zero if no input is active.
+ * @param angular_velocity : [rad/s] selected command, zero if no input is active.
+ * @return bool : true if the selection differs from the last cycle's, i.e. another input
+ *                won or the winner sent a new command.
+ */
+bool VelocityMux::select(const double &now, double &linear_velocity, double &angular_velocity) {
+  mutex.lock();
+  int winner = -1;
+  for ( unsigned int i = 0; i < inputs.size(); ++i ) {
+    if ( inputs[i].isActive(now) && ( ( winner < 0 ) || ( inputs[i].priority > inputs[winner].priority ) ) ) {
+      winner = i;
+    }
+  }
+  unsigned long commands = 0;
+  linear_velocity = angular_velocity = 0.0;
+  if ( winner >= 0 ) {
+    linear_velocity = inputs[winner].linear_velocity;
+    angular_velocity = inputs[winner].angular_velocity;
+    commands = inputs[winner].commands;
+  }
+  bool changed = ( winner != selected_input ) || ( commands != selected_commands );
+  selected_input = winner;
+  selected_commands = commands;
+  mutex.unlock();
+  return changed;
+}
+
+/**
+ * @brief True if no inputs have been registered.
+ */
+bool VelocityMux::empty() const {
+  mutex.lock();
+  bool result = inputs.empty();
+  mutex.unlock();
+  return result;
+}
+
+/**
+ * @brief Input chosen by the last selection, -1 if none was active.
+ */
+int VelocityMux::selected() const {
+  mutex.lock();
+  int result = selected_input;
+  mutex.unlock();
+  return result;
+}
+
+/**
+ * @brief Copy of every input's configuration and latest command, for introspection.
+ */
+std::vector<VelocityMux::Input> VelocityMux::status() const {
+  mutex.lock();
+  std::vector<Input> result(inputs);
+  mutex.unlock();
+  return result;
+}
+
+} // namespace kobuki
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/driver/velocity_smoother.cpp
+ *
+ * @brief Implementation of the velocity smoother.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+#include "../../include/kobuki_driver/modules/velocity_smoother.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation [Axis]
+*****************************************************************************/
+
+void VelocitySmoother::Axis::step(const double &dt, const Limits &limits, const bool &emergency) {
+  double error = target - value;
+  if ( error == 0.0 ) {
+    acceleration = 0.0;
+    return;
+  }
+  double direction = ( error > 0.0 ) ? 1.0 : -1.0;
+  bool speeding_up = ( value == 0.0 ) || ( ( value * error > 0.0 ) );
+  double max_acceleration = emergency ? limits.emergency_deceleration :
+                            ( speeding_up ? limits.acceleration : limits.deceleration );
+  if ( max_acceleration <= 0.0 ) {
+    value = target;
+    acceleration = 0.0;
+    return;
+  }
+  double desired = direction * max_acceleration;
+  if ( !emergency && ( limits.jerk > 0.0 ) ) {
+    // the largest acceleration that can still be ramped down to zero, one jerk
+    // limited step per cycle, without overshooting the target
+    double landing = limits.jerk * ( std::sqrt(dt * dt / 4.0 + 2.0 * std::fabs(error) / limits.jerk) - dt / 2.0 );
+    desired = direction * std::min(max_acceleration, landing);
+    double max_change = limits.jerk * dt;
+    acceleration = std::min(std::max(desired, acceleration - max_change), acceleration + max_change);
+  } else {
+    acceleration = desired;
+  }
+  double increment = acceleration * dt;
+  if ( ( increment - error ) * direction >= 0.0 ) {
+    value = target; // arrived (or would overshoot)
+    acceleration = 0.0;
+  } else {
+    value += increment;
+  }
+}
+
+/*****************************************************************************
+** Implementation [VelocitySmoother]
+*****************************************************************************/
+
+VelocitySmoother::VelocitySmoother() :
+  is_enabled(true),
+  emergency(false)
+{}
+
+/**
+ * @param enable : if false, targets pass straight through.
+ * @param linear_limits : limits on the linear velocity [m/s^2, m/s^3]
+ * @param angular_limits : limits on the angular velocity [rad/s^2, rad/s^3]
+ */
+void VelocitySmoother::init(const bool &enable, const Limits &linear_limits, const Limits &angular_limits) {
+  mutex.lock();
+  is_enabled = enable;
+  this->linear_limits = linear_limits;
+  this->angular_limits = angular_limits;
+  mutex.unlock();
+  reset();
+}
+
+void VelocitySmoother::setTarget(const double &linear_velocity, const double &angular_velocity) {
+  mutex.lock();
+  linear.target = linear_velocity;
+  angular.target = angular_velocity;
+  emergency = false;
+  mutex.unlock();
+}
+
+/**
+ * @brief Bring both axes to zero at the emergency deceleration.
+ *
+ * Stays in effect until the robot has stopped or a new target is set.
+ */
+void VelocitySmoother::emergencyStop() {
+  mutex.lock();
+  linear.target = 0.0;
+  angular.target = 0.0;
+  emergency = true;
+  mutex.unlock();
+}
+
+/**
+ * @brief Follow a profile shaped elsewhere, e.g. a buffered trajectory.
+ *
+ * Both the output and the target jump to the given velocities, so a later
+ * setTarget() ramps on from there.
+ */
+void VelocitySmoother::track(const double &linear_velocity, const double &angular_velocity) {
+  mutex.lock();
+  linear.target = linear.value = linear_velocity;
+  angular.target = angular.value = angular_velocity;
+  linear.acceleration = angular.acceleration = 0.0;
+  emergency = false;
+  mutex.unlock();
+}
+
+/**
+ * @brief Drop immediately to zero, e.g. when the motors are disabled.
+ */
+void VelocitySmoother::reset() {
+  mutex.lock();
+  linear = Axis();
+  angular = Axis();
+  emergency = false;
+  mutex.unlock();
+}
+
+/**
+ * @brief Smoothed linear velocity [m/s].
+ */
+double VelocitySmoother::linearVelocity() const {
+  mutex.lock();
+  double value = linear.value;
+  mutex.unlock();
+  return value;
+}
+
+/**
+ * @brief Smoothed angular velocity [rad/s].
+ */
+double VelocitySmoother::angularVelocity() const {
+  mutex.lock();
+  double value = angular.value;
+  mutex.unlock();
+  return value;
+}
+
+/**
+ * @brief Advance one feedback cycle.
+ *
+ * @param dt : time since the previous cycle [s]
+ */
+void VelocitySmoother::update(const double &dt) {
+  mutex.lock();
+  if ( !is_enabled ) {
+    linear.value = linear.target;
+    angular.value = angular.target;
+  } else if ( dt > 0.0 ) {
+    linear.step(dt, linear_limits, emergency);
+    angular.step(dt, angular_limits, emergency);
+    if ( emergency && ( linear.value == 0.0 ) && ( angular.value == 0.0 ) ) {
+      emergency = false;
+    }
+  }
+  mutex.unlock();
+}
+
+} // namespace kobuki
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/connection_state.cpp
+ *
+ * @brief Walks the connection state through handshakes, failures and stalls.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/modules/connection_state.hpp"
+
+using kobuki::ConnectionState;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * Stream frames at 50Hz from the given time, counting the version info
+ * requests, until the given action comes back or the time runs out.
+ */
+double streamUntil(ConnectionState &connection, const double &start, const double &end,
+                   const ConnectionState::Action &action, unsigned int &requests) {
+  for ( double time = start; time < end; time += 0.02 ) {
+    connection.frameReceived(time);
+    ConnectionState::Action result = connection.update(time);
+    if ( result == ConnectionState::RequestVersionInfo ) {
+      ++requests;
+    }
+    if ( result == action ) {
+      return time;
+    }
+  }
+  return end;
+}
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(ConnectionState, coldStart) {
+  ConnectionState connection;
+  connection.init(10, 0.2, 5.0);
+  connection.opening();
+  connection.opened(0.0, false);
+  EXPECT_EQ(ConnectionState::Handshaking, connection.state());
+  unsigned int requests = 0;
+  streamUntil(connection, 0.0, 1.0, ConnectionState::HandshakeFailed, requests);
+  EXPECT_TRUE(connection.isStreaming());
+  EXPECT_FALSE(connection.isReady());
+  EXPECT_EQ(5u, requests); // one every 0.2s
+  connection.handshakeComplete(1.0);
+  EXPECT_TRUE(connection.isReady());
+  EXPECT_TRUE(connection.isVerified());
+  EXPECT_EQ(1u, connection.metrics().handshakes);
+  EXPECT_EQ(ConnectionState::None, connection.update(1.5));
+}
+
+TEST(ConnectionState, warmStartWaitsForVerification) {
+  ConnectionState connection;
+  connection.init(10, 0.2, 5.0);
+  connection.opened(0.0, true);
+  unsigned int requests = 0;
+  streamUntil(connection, 0.0, 0.5, ConnectionState::HandshakeFailed, requests);
+  EXPECT_TRUE(connection.isStreaming());
+  EXPECT_EQ(ConnectionState::Handshaking, connection.state());
+  EXPECT_FALSE(connection.waitUntilReady(0.0));
+  EXPECT_EQ(1u, connection.metrics().warm_starts);
+  connection.handshakeComplete(0.5);
+  EXPECT_EQ(ConnectionState::Streaming, connection.state());
+}
+
+TEST(ConnectionState, failedHandshakeRetriesWithBackoff) {
+  ConnectionState connection;
+  connection.init(3, 0.2, 5.0);
+  connection.opened(0.0, false);
+  unsigned int requests = 0;
+  double failed = streamUntil(connection, 0.0, 10.0, ConnectionState::HandshakeFailed, requests);
+  EXPECT_EQ(3u, requests);
+  EXPECT_EQ(ConnectionState::Degraded, connection.state());
+  EXPECT_EQ(1u, connection.metrics().failures);
+
+  // first retry a second later
+  requests = 0;
+  double retry = streamUntil(connection, failed + 0.02, failed + 10.0, ConnectionState::RequestVersionInfo, requests);
+  EXPECT_NEAR(1.0, retry - failed, 0.03);
+  EXPECT_EQ(ConnectionState::Handshaking, connection.state());
+
+  // fails again, the next retry waits twice as long
+  failed = streamUntil(connection, retry + 0.02, retry + 10.0, ConnectionState::HandshakeFailed, requests);
+  EXPECT_EQ(2u, connection.metrics().failures);
+  requests = 0;
+  retry = streamUntil(connection, failed + 0.02, failed + 10.0, ConnectionState::RequestVersionInfo, requests);
+  EXPECT_NEAR(2.0, retry - failed, 0.03);
+
+  connection.handshakeComplete(retry + 0.1);
+  EXPECT_TRUE(connection.isReady());
+  EXPECT_EQ(7u, connection.metrics().total_attempts); // 3 + 3 for the failures, 1 on the last retry
+}
+
+TEST(ConnectionState, noRetryWithoutStream) {
+  ConnectionState connection;
+  connection.init(3, 0.2, 5.0);
+  connection.opened(0.0, false);
+  unsigned int requests = 0;
+  double failed = streamUntil(connection, 0.0, 10.0, ConnectionState::HandshakeFailed, requests);
+  connection.streamLost();
+  for ( double time = failed; time < failed + 5.0; time += 0.02 ) {
+    EXPECT_EQ(ConnectionState::None, connection.update(time));
+  }
+}
+
+TEST(ConnectionState, stallRestartsHandshake) {
+  ConnectionState connection;
+  connection.init(10, 0.2, 5.0);
+  connection.opened(0.0, false);
+  unsigned int requests = 0;
+  streamUntil(connection, 0.0, 0.1, ConnectionState::RequestVersionInfo, requests);
+  connection.handshakeComplete(0.1);
+  connection.streamLost();
+  EXPECT_EQ(ConnectionState::Degraded, connection.state());
+  EXPECT_EQ(1u, connection.metrics().stalls);
+  EXPECT_FALSE(connection.isStreaming());
+  connection.frameReceived(2.0);
+  EXPECT_EQ(ConnectionState::Handshaking, connection.state());
+  EXPECT_FALSE(connection.isVerified());
+  EXPECT_EQ(ConnectionState::RequestVersionInfo, connection.update(2.0));
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
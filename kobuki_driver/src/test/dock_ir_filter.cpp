@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/dock_ir_filter.cpp
+ *
+ * @brief Checks the dock bearing estimate against a simulated dock.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_driver/modules/dock_ir_filter.hpp"
+#include "../../include/kobuki_driver/packets/dock_ir.hpp"
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * Dock at the origin facing +x, center beam +-8 degrees, near inside 0.8m.
+ * Receivers at -1, 0 and +1 rad see +-0.7, +-0.35 and +-0.7 rad and miss
+ * one reading in ten.
+ */
+void sense(const double &x, const double &y, const double &theta, std::vector<uint8_t> &docking) {
+  const double axis[3] = { -1.0, 0.0, 1.0 };
+  const double field[3] = { 0.7, 0.35, 0.7 };
+  double phi = std::atan2(y, x);
+  bool near = std::sqrt(x * x + y * y) < 0.8;
+  uint8_t beams;
+  if ( std::fabs(phi) < 8.0 * M_PI / 180.0 ) {
+    beams = near ? kobuki::DockIR::Flags::NearCenter : kobuki::DockIR::Flags::FarCenter;
+  } else if ( phi > 0.0 ) {
+    beams = near ? kobuki::DockIR::Flags::NearLeft : kobuki::DockIR::Flags::FarLeft;
+  } else {
+    beams = near ? kobuki::DockIR::Flags::NearRight : kobuki::DockIR::Flags::FarRight;
+  }
+  double alpha = ecl::wrap_angle(std::atan2(-y, -x) - theta);
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    bool visible = ( std::fabs(alpha - axis[i]) < field[i] ) && ( std::rand() % 10 != 0 );
+    docking[i] = visible ? beams : 0;
+  }
+}
+
+/**
+ * Sit (or spin) on the spot for ten seconds, starting just off facing the
+ * dock, and check the confident bearings and the final range and region.
+ * Still, a bearing can only be placed within the receiver's field. Spinning,
+ * neighbouring receivers' readings blend, though the window lags the turn.
+ */
+void simulate(const double &x, const double &y, const double &rate,
+              const double &mean_tolerance, const double &tolerance, const kobuki::DockIRFilter::Range &range,
+              const kobuki::DockIRFilter::Region &region) {
+  std::srand(7);
+  kobuki::DockIRFilter filter(25);
+  std::vector<uint8_t> docking(3, 0);
+  double theta = std::atan2(-y, -x) + 0.2;
+  double worst = 0.0, total = 0.0;
+  unsigned int confident = 0;
+  for ( unsigned int frame = 0; frame < 500; ++frame ) {
+    theta = ecl::wrap_angle(theta + rate * 0.02);
+    sense(x, y, theta, docking);
+    filter.update(theta, docking);
+    kobuki::DockIRFilter::Estimate estimate = filter.estimate();
+    if ( estimate.confidence > 0.5 ) {
+      double truth = ecl::wrap_angle(std::atan2(-y, -x) - theta);
+      double error = std::fabs(ecl::wrap_angle(estimate.bearing - truth));
+      worst = std::max(worst, error);
+      total += error;
+      ++confident;
+    }
+  }
+  kobuki::DockIRFilter::Estimate estimate = filter.estimate();
+  ASSERT_GT(confident, 0u);
+  EXPECT_LT(total / confident, mean_tolerance);
+  EXPECT_LT(worst, tolerance);
+  EXPECT_EQ(kobuki::DockIRFilter::toString(range), kobuki::DockIRFilter::toString(estimate.range));
+  EXPECT_EQ(kobuki::DockIRFilter::toString(region), kobuki::DockIRFilter::toString(estimate.region));
+}
+
+/**
+ * Feed the central receiver the same beams every frame.
+ */
+kobuki::DockIRFilter::Estimate steady(const uint8_t &beams) {
+  kobuki::DockIRFilter filter(5);
+  std::vector<uint8_t> docking(3, 0);
+  docking[1] = beams;
+  for ( unsigned int frame = 0; frame < 5; ++frame ) {
+    filter.update(0.0, docking);
+  }
+  return filter.estimate();
+}
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(DockIRFilterTests, facingFar) {
+  simulate(1.5, 0.0, 0.0, 0.35, 0.35, kobuki::DockIRFilter::Far, kobuki::DockIRFilter::CenterRegion);
+}
+
+TEST(DockIRFilterTests, facingNear) {
+  simulate(0.5, 0.0, 0.0, 0.35, 0.35, kobuki::DockIRFilter::Near, kobuki::DockIRFilter::CenterRegion);
+}
+
+TEST(DockIRFilterTests, facingLeftBeam) {
+  simulate(1.0, 0.5, 0.0, 0.35, 0.35, kobuki::DockIRFilter::Far, kobuki::DockIRFilter::LeftRegion);
+}
+
+TEST(DockIRFilterTests, facingRightBeam) {
+  simulate(0.6, -0.4, 0.0, 0.35, 0.35, kobuki::DockIRFilter::Near, kobuki::DockIRFilter::RightRegion);
+}
+
+TEST(DockIRFilterTests, spinning) {
+  simulate(1.2, -0.3, 0.6, 0.3, 0.7, kobuki::DockIRFilter::Far, kobuki::DockIRFilter::RightRegion);
+}
+
+TEST(DockIRFilterTests, outOfRangeWithoutBeams) {
+  kobuki::DockIRFilter::Estimate estimate = steady(0);
+  EXPECT_EQ(kobuki::DockIRFilter::OutOfRange, estimate.range);
+  EXPECT_EQ(kobuki::DockIRFilter::NoRegion, estimate.region);
+  EXPECT_EQ(0.0, estimate.confidence);
+}
+
+TEST(DockIRFilterTests, rangeTiesGoNear) {
+  using kobuki::DockIR;
+  EXPECT_EQ(kobuki::DockIRFilter::Near, steady(DockIR::Flags::NearCenter | DockIR::Flags::FarCenter).range);
+}
+
+TEST(DockIRFilterTests, regionTiesGoCenterThenRight) {
+  using kobuki::DockIR;
+  EXPECT_EQ(kobuki::DockIRFilter::CenterRegion, steady(DockIR::Flags::FarLeft | DockIR::Flags::FarCenter).region);
+  EXPECT_EQ(kobuki::DockIRFilter::CenterRegion, steady(DockIR::Flags::FarCenter | DockIR::Flags::FarRight).region);
+  EXPECT_EQ(kobuki::DockIRFilter::RightRegion, steady(DockIR::Flags::FarLeft | DockIR::Flags::FarRight).region);
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/event_manager.cpp
+ *
+ * @brief Checks the edges of the event debounce and the cliff hysteresis.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/event_manager.hpp"
+
+using kobuki::BumperEvent;
+using kobuki::CliffEvent;
+using kobuki::CoreSensors;
+using kobuki::EventManager;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * Feeds 50Hz frames of core sensors to an event manager.
+ */
+class Frames {
+public:
+  Frames(const uint16_t &time_stamp = 0) : cliff_data(3, 1000) {
+    data.time_stamp = time_stamp;
+    data.bumper = data.wheel_drop = data.cliff = data.buttons = 0;
+    data.left_encoder = data.right_encoder = 0;
+    data.left_pwm = data.right_pwm = 0;
+    data.charger = 0;
+    data.battery = 160;
+    data.over_current = 0;
+  }
+
+  /**
+   * Step one frame, returning the events it raised.
+   */
+  const kobuki::EventBatch& step(EventManager &events, const uint16_t &interval = 20) {
+    data.time_stamp += interval;
+    events.update(data, cliff_data, data.time_stamp / 1000.0);
+    return events.events();
+  }
+
+  /**
+   * Frames it takes until a bumper event is raised, 0 if none within the limit.
+   */
+  unsigned int framesUntilBumperEvent(EventManager &events, const unsigned int &limit = 100) {
+    for ( unsigned int i = 1; i <= limit; ++i ) {
+      if ( !step(events).bumper_events.empty() ) {
+        return i;
+      }
+    }
+    return 0;
+  }
+
+  CoreSensors::Data data;
+  std::vector<uint16_t> cliff_data;
+};
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(EventDebounce, reportsStraightAwayByDefault) {
+  EventManager events;
+  Frames frames;
+  frames.data.bumper = CoreSensors::Flags::LeftBumper;
+  const kobuki::EventBatch &batch = frames.step(events);
+  ASSERT_EQ(1u, batch.bumper_events.size());
+  EXPECT_EQ(BumperEvent::Left, batch.bumper_events[0].bumper);
+  EXPECT_EQ(BumperEvent::Pressed, batch.bumper_events[0].state);
+  EXPECT_TRUE(frames.step(events).bumper_events.empty()); // only on the change
+  frames.data.bumper = 0;
+  ASSERT_EQ(1u, frames.step(events).bumper_events.size());
+}
+
+TEST(EventDebounce, framesCountTheChangingFrame) {
+  EventManager events;
+  events.setDebounce(EventManager::Bumper, EventManager::Debounce(3));
+  Frames frames;
+  frames.data.bumper = CoreSensors::Flags::CenterBumper;
+  EXPECT_EQ(3u, frames.framesUntilBumperEvent(events));
+  frames.data.bumper = 0;
+  EXPECT_EQ(3u, frames.framesUntilBumperEvent(events)); // releases are debounced too
+}
+
+TEST(EventDebounce, zeroOrOneFrameIsImmediate) {
+  for ( int setting = 0; setting <= 1; ++setting ) {
+    EventManager events;
+    events.setDebounce(EventManager::Bumper, EventManager::Debounce(setting));
+    Frames frames;
+    frames.data.bumper = CoreSensors::Flags::RightBumper;
+    EXPECT_EQ(1u, frames.framesUntilBumperEvent(events));
+  }
+}
+
+TEST(EventDebounce, revertingChangeIsForgotten) {
+  EventManager events;
+  events.setDebounce(EventManager::Bumper, EventManager::Debounce(3));
+  Frames frames;
+  for ( unsigned int i = 0; i < 10; ++i ) { // chatter: two frames on, one off
+    frames.data.bumper = ( i % 3 == 2 ) ? 0 : CoreSensors::Flags::LeftBumper;
+    EXPECT_TRUE(frames.step(events).bumper_events.empty());
+  }
+  // a change holding long enough after a revert starts counting from scratch
+  frames.data.bumper = 0;
+  frames.step(events);
+  frames.data.bumper = CoreSensors::Flags::LeftBumper;
+  EXPECT_EQ(3u, frames.framesUntilBumperEvent(events));
+}
+
+TEST(EventDebounce, timeByTheFirmwareClock) {
+  EventManager events;
+  events.setDebounce(EventManager::Bumper, EventManager::Debounce(0, 0.1));
+  Frames frames;
+  frames.data.bumper = CoreSensors::Flags::LeftBumper;
+  // held for 0, 20... 100ms on the sixth frame, which is when it is reported
+  EXPECT_EQ(6u, frames.framesUntilBumperEvent(events));
+
+  // a late frame covers the time in one go
+  frames.data.bumper = 0;
+  EXPECT_TRUE(frames.step(events).bumper_events.empty());
+  EXPECT_EQ(1u, frames.step(events, 100).bumper_events.size());
+}
+
+TEST(EventDebounce, timeAcrossTheStampWrap) {
+  EventManager events;
+  events.setDebounce(EventManager::Bumper, EventManager::Debounce(0, 0.1));
+  Frames frames(65500); // wraps on the second frame
+  frames.data.bumper = CoreSensors::Flags::LeftBumper;
+  EXPECT_EQ(6u, frames.framesUntilBumperEvent(events));
+}
+
+TEST(EventDebounce, framesAndTimeMustBothHold) {
+  EventManager events;
+  events.setDebounce(EventManager::Bumper, EventManager::Debounce(4, 0.02));
+  Frames frames;
+  frames.data.bumper = CoreSensors::Flags::LeftBumper;
+  EXPECT_EQ(4u, frames.framesUntilBumperEvent(events)); // the frames are the longer
+
+  EventManager slow;
+  slow.setDebounce(EventManager::Bumper, EventManager::Debounce(2, 0.1));
+  Frames slow_frames;
+  slow_frames.data.bumper = CoreSensors::Flags::LeftBumper;
+  EXPECT_EQ(6u, slow_frames.framesUntilBumperEvent(slow)); // the time is the longer
+}
+
+TEST(EventDebounce, onlyTheMaskedFlags) {
+  EventManager events;
+  events.setDebounce(EventManager::Bumper, EventManager::Debounce(3), CoreSensors::Flags::CenterBumper);
+  Frames frames;
+  frames.data.bumper = CoreSensors::Flags::LeftBumper | CoreSensors::Flags::CenterBumper;
+  const kobuki::EventBatch &first = frames.step(events);
+  ASSERT_EQ(1u, first.bumper_events.size());
+  EXPECT_EQ(BumperEvent::Left, first.bumper_events[0].bumper);
+  EXPECT_TRUE(frames.step(events).bumper_events.empty());
+  const kobuki::EventBatch &third = frames.step(events);
+  ASSERT_EQ(1u, third.bumper_events.size());
+  EXPECT_EQ(BumperEvent::Center, third.bumper_events[0].bumper);
+}
+
+TEST(EventDebounce, fieldsAreIndependent) {
+  EventManager events;
+  events.setDebounce(EventManager::Cliff, EventManager::Debounce(5));
+  Frames frames;
+  frames.data.bumper = CoreSensors::Flags::LeftBumper;
+  frames.data.cliff = CoreSensors::Flags::LeftCliff;
+  const kobuki::EventBatch &batch = frames.step(events);
+  EXPECT_EQ(1u, batch.bumper_events.size());
+  EXPECT_TRUE(batch.cliff_events.empty());
+}
+
+TEST(CliffHysteresis, band) {
+  EventManager events;
+  events.setCliffHysteresis(EventManager::Hysteresis(true, 100, 200));
+  Frames frames;
+  frames.data.cliff = CoreSensors::Flags::LeftCliff; // ignored, the readings decide
+  EXPECT_TRUE(frames.step(events).cliff_events.empty());
+
+  frames.cliff_data[0] = 100; // on the threshold is not under it
+  EXPECT_TRUE(frames.step(events).cliff_events.empty());
+  frames.cliff_data[0] = 99;
+  const kobuki::EventBatch &cliff = frames.step(events);
+  ASSERT_EQ(1u, cliff.cliff_events.size());
+  EXPECT_EQ(CliffEvent::Left, cliff.cliff_events[0].sensor);
+  EXPECT_EQ(CliffEvent::Cliff, cliff.cliff_events[0].state);
+  EXPECT_EQ(99, cliff.cliff_events[0].bottom);
+
+  frames.cliff_data[0] = 200; // inside the band, still a cliff
+  EXPECT_TRUE(frames.step(events).cliff_events.empty());
+  frames.cliff_data[0] = 201;
+  const kobuki::EventBatch &floor = frames.step(events);
+  ASSERT_EQ(1u, floor.cliff_events.size());
+  EXPECT_EQ(CliffEvent::Floor, floor.cliff_events[0].state);
+}
+
+TEST(CliffHysteresis, debouncedToo) {
+  EventManager events;
+  events.setCliffHysteresis(EventManager::Hysteresis(true, 100, 200));
+  events.setDebounce(EventManager::Cliff, EventManager::Debounce(2));
+  Frames frames;
+  frames.cliff_data[2] = 50;
+  EXPECT_TRUE(frames.step(events).cliff_events.empty());
+  const kobuki::EventBatch &batch = frames.step(events);
+  ASSERT_EQ(1u, batch.cliff_events.size());
+  EXPECT_EQ(CliffEvent::Right, batch.cliff_events[0].sensor);
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
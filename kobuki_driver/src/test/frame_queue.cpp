@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/frame_queue.cpp
+ *
+ * @brief Checks the frame queue's ordering, overruns, timeouts and statistics.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstring>
+#include <time.h>
+#include <gtest/gtest.h>
+#include <ecl/threads.hpp>
+#include "../../include/kobuki_driver/modules/frame_queue.hpp"
+
+using kobuki::FrameQueue;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+double now() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+bool push(FrameQueue &queue, const unsigned int &number) {
+  FrameQueue::Frame *frame = queue.claim();
+  if ( !frame ) {
+    return false;
+  }
+  frame->size = sizeof(number);
+  std::memcpy(frame->bytes, &number, sizeof(number));
+  queue.publish();
+  return true;
+}
+
+unsigned int number(const FrameQueue::Frame *frame) {
+  unsigned int number;
+  std::memcpy(&number, frame->bytes, sizeof(number));
+  return number;
+}
+
+/**
+ * Publishes numbered frames as fast as it can, counting those that did not fit.
+ */
+class Producer {
+public:
+  Producer(FrameQueue &queue, const unsigned int &count) : queue(queue), count(count), dropped(0), finished(false) {}
+  void run() {
+    for ( unsigned int i = 0; i < count; ++i ) {
+      if ( !push(queue, i) ) {
+        ++dropped;
+      }
+    }
+    __atomic_store_n(&finished, true, __ATOMIC_RELEASE);
+  }
+  bool isFinished() const { return __atomic_load_n(&finished, __ATOMIC_ACQUIRE); }
+  FrameQueue &queue;
+  unsigned int count, dropped;
+
+private:
+  bool finished;
+};
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(FrameQueue, fifo) {
+  FrameQueue queue;
+  queue.init(true, 4);
+  EXPECT_TRUE(push(queue, 1));
+  EXPECT_TRUE(push(queue, 2));
+  FrameQueue::Frame *frame = queue.front(0);
+  ASSERT_TRUE(frame);
+  EXPECT_EQ(1u, number(frame));
+  queue.release();
+  frame = queue.front(0);
+  ASSERT_TRUE(frame);
+  EXPECT_EQ(2u, number(frame));
+  queue.release();
+  EXPECT_FALSE(queue.front(0));
+}
+
+TEST(FrameQueue, overrun) {
+  FrameQueue queue;
+  queue.init(true, 2);
+  EXPECT_TRUE(push(queue, 1));
+  EXPECT_TRUE(push(queue, 2));
+  EXPECT_FALSE(push(queue, 3)); // full, dropped rather than waited on
+  FrameQueue::Statistics statistics = queue.statistics();
+  EXPECT_EQ(2u, statistics.frames);
+  EXPECT_EQ(1u, statistics.overruns);
+  ASSERT_TRUE(queue.front(0));
+  queue.release();
+  EXPECT_TRUE(push(queue, 4)); // a slot is free again
+  EXPECT_EQ(2u, queue.statistics().max_depth);
+}
+
+TEST(FrameQueue, timeout) {
+  FrameQueue queue;
+  queue.init(true, 2);
+  double start = now();
+  EXPECT_FALSE(queue.front(50));
+  double waited = now() - start;
+  EXPECT_GE(waited, 0.049);
+  EXPECT_LT(waited, 0.5);
+}
+
+TEST(FrameQueue, reinitialiseDropsPending) {
+  FrameQueue queue;
+  queue.init(true, 4);
+  push(queue, 1);
+  push(queue, 2);
+  queue.init(true, 4);
+  EXPECT_FALSE(queue.front(0));
+  EXPECT_EQ(0u, queue.statistics().frames);
+}
+
+TEST(FrameQueue, concurrentStatistics) {
+  FrameQueue queue;
+  queue.init(true, 8);
+  Producer producer(queue, 20000);
+  ecl::Thread thread;
+  thread.start(&Producer::run, producer);
+  unsigned int received = 0;
+  unsigned int next = 0;
+  bool ordered = true;
+  for (;;) {
+    bool finished = producer.isFinished(); // before the wait, so a timeout means drained
+    FrameQueue::Frame *frame = queue.front(10);
+    if ( !frame ) {
+      if ( finished ) {
+        break;
+      }
+      continue;
+    }
+    ordered = ordered && ( number(frame) >= next ); // skipping over dropped frames
+    next = number(frame) + 1;
+    ++received;
+    queue.statistics(); // as a diagnostics thread would, while both sides run
+    queue.release();
+  }
+  thread.join();
+  FrameQueue::Statistics statistics = queue.statistics();
+  EXPECT_TRUE(ordered);
+  EXPECT_EQ(20000u, statistics.frames + statistics.overruns);
+  EXPECT_EQ(producer.dropped, statistics.overruns);
+  EXPECT_EQ(received, statistics.frames);
+  EXPECT_EQ(received, statistics.queueing.count);
+  EXPECT_EQ(received, statistics.processing.count);
+  EXPECT_LE(statistics.max_depth, 8u);
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/kobuki.cpp
+ *
+ * @brief Runs the whole driver over a pseudo terminal against the emulator.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <gtest/gtest.h>
+#include <ecl/sigslots.hpp>
+#include <ecl/threads/mutex.hpp>
+#include <ecl/time/sleep.hpp>
+#include <ecl/time/timestamp.hpp>
+#include "../../include/kobuki_driver/kobuki.hpp"
+#include "../../include/kobuki_driver/emulator.hpp"
+
+using kobuki::Emulator;
+using kobuki::Kobuki;
+using kobuki::Parameters;
+using kobuki::PluginHost;
+using kobuki::SafetyReflex;
+using kobuki::TrajectoryBuffer;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * Brings a driver up on a pty:// transport and connects the emulator to it.
+ */
+class Robot {
+public:
+  Robot() : slot_info(&Robot::info, *this) {
+    static unsigned int count = 0;
+    std::ostringstream ns;
+    ns << "/test_kobuki_" << count++;
+    parameters.device_port = "pty://";
+    parameters.sigslots_namespace = ns.str();
+    parameters.enable_gyro_bias_estimation = false;
+    slot_info.connect(ns.str() + "/ros_info");
+  }
+
+  /**
+   * Start the driver, wait for its pseudo terminal and stream until it
+   * has finished the version handshake.
+   */
+  bool start() {
+    kobuki.init(parameters);
+    ecl::MilliSleep sleep;
+    for ( unsigned int i = 0; ( i < 200 ) && slave().empty(); ++i ) {
+      sleep(10);
+    }
+    if ( slave().empty() || !emulator.open(slave()) ) {
+      return false;
+    }
+    for ( unsigned int i = 0; i < 250; ++i ) {
+      emulator.stream(1);
+      if ( kobuki.waitForHandshake(0.0) ) {
+        emulator.stream(25); // let the command scheduler learn the frame period
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Base controls the emulator received in reply to the next frame.
+   */
+  unsigned long step() {
+    unsigned long before = emulator.baseControls();
+    emulator.stream(1);
+    return emulator.baseControls() - before;
+  }
+
+  std::string slave() {
+    mutex.lock();
+    std::string name = slave_name;
+    mutex.unlock();
+    return name;
+  }
+
+  Parameters parameters;
+  Kobuki kobuki;
+  Emulator emulator;
+
+private:
+  void info(const std::string &message) {
+    const std::string prefix("pseudo terminal for the emulator is ");
+    if ( message.compare(0, prefix.size(), prefix) == 0 ) {
+      mutex.lock();
+      slave_name = message.substr(prefix.size());
+      mutex.unlock();
+    }
+  }
+
+  ecl::Slot<const std::string&> slot_info;
+  ecl::Mutex mutex;
+  std::string slave_name;
+};
+
+/**
+ * A plugin that drives forwards until cancelled.
+ */
+class Cruise : public PluginHost::Plugin {
+public:
+  Cruise() : cruising(true) {}
+  void update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands) {
+    if ( cruising ) {
+      commands.setVelocity(0.2, 0.0);
+    }
+  }
+  void cancel() { cruising = false; }
+private:
+  bool cruising;
+};
+
+/**
+ * A plugin that drives into whatever is in front, as docking does.
+ */
+class Ram : public PluginHost::Plugin {
+public:
+  void update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands) {
+    commands.setVelocity(0.1, 0.0);
+    commands.claimBumper();
+  }
+};
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(Kobuki, reflexOverridesTheScheduledCommand) {
+  Robot robot;
+  robot.parameters.enable_command_scheduling = true;
+  robot.parameters.command_lead = 0.012; // well clear of the emulator's next read
+  robot.parameters.safety_reflex.enable = true;
+  robot.parameters.safety_reflex.bumper = SafetyReflex::Stop;
+  ASSERT_TRUE(robot.start());
+  robot.kobuki.enable();
+  robot.kobuki.setBaseControl(0.1, 0.0);
+  robot.emulator.stream(10);
+  EXPECT_EQ(100, robot.emulator.commandSpeed());
+
+  robot.emulator.sensors.bumper = 0x02;
+  EXPECT_EQ(1u, robot.step()); // the frame carrying the bumper
+  EXPECT_EQ(1u, robot.step()); // the reflex' reply to it, in place of the scheduled command
+  EXPECT_EQ(0, robot.emulator.commandSpeed());
+  EXPECT_EQ(SafetyReflex::Stopped, robot.kobuki.getSafetyReflexState());
+  EXPECT_EQ(1u, robot.kobuki.getSafetyReflexReaction().triggers);
+}
+
+TEST(Kobuki, reflexReplacesTheFrameCommand) {
+  Robot robot;
+  robot.parameters.safety_reflex.enable = true;
+  robot.parameters.safety_reflex.bumper = SafetyReflex::Stop;
+  ASSERT_TRUE(robot.start());
+  robot.kobuki.enable();
+  robot.kobuki.setBaseControl(0.1, 0.0);
+  robot.emulator.stream(10);
+  EXPECT_EQ(100, robot.emulator.commandSpeed());
+
+  robot.emulator.sensors.bumper = 0x02;
+  EXPECT_EQ(1u, robot.step());
+  EXPECT_EQ(1u, robot.step());
+  EXPECT_EQ(0, robot.emulator.commandSpeed());
+}
+
+TEST(Kobuki, reflexBacksOffOncePerFrame) {
+  Robot robot;
+  robot.parameters.enable_command_scheduling = true;
+  robot.parameters.command_lead = 0.012;
+  robot.parameters.safety_reflex.enable = true;
+  robot.parameters.safety_reflex.bumper = SafetyReflex::BackOff;
+  robot.parameters.safety_reflex.backoff_speed = 0.1;
+  robot.parameters.safety_reflex.backoff_time = 0.2;
+  ASSERT_TRUE(robot.start());
+  robot.kobuki.enable();
+  robot.kobuki.setBaseControl(0.1, 0.0);
+  robot.emulator.stream(10);
+
+  robot.emulator.sensors.bumper = 0x02;
+  robot.step();
+  robot.emulator.sensors.bumper = 0x00;
+  unsigned long commands = 0;
+  for ( unsigned int i = 0; i < 5; ++i ) {
+    commands += robot.step();
+    EXPECT_EQ(-100, robot.emulator.commandSpeed());
+  }
+  EXPECT_EQ(5u, commands);
+  robot.emulator.stream(15); // past the back off time
+  EXPECT_EQ(0, robot.emulator.commandSpeed());
+}
+
+TEST(Kobuki, pluginRanksAmongTheMuxInputs) {
+  Robot robot;
+  robot.parameters.plugin_priority = 5;
+  ASSERT_TRUE(robot.start());
+  int teleop = robot.kobuki.addVelocityInput("teleop", 1, 0.0);
+  int safety = robot.kobuki.addVelocityInput("safety", 10, 0.1);
+  ASSERT_TRUE(robot.kobuki.addPlugin(boost::shared_ptr<PluginHost::Plugin>(new Cruise()), "cruise"));
+  robot.kobuki.enable();
+  robot.kobuki.setBaseControl(teleop, 0.1, 0.0);
+  robot.emulator.stream(5);
+  EXPECT_EQ(200, robot.emulator.commandSpeed()); // the plugin beats teleop
+
+  robot.kobuki.setBaseControl(safety, 0.0, 0.0);
+  robot.emulator.stream(3);
+  EXPECT_EQ(0, robot.emulator.commandSpeed()); // the safety input beats the plugin
+  EXPECT_EQ("safety", robot.kobuki.getVelocityInputs()[robot.kobuki.getSelectedVelocityInput()].name);
+
+  robot.emulator.stream(10); // the safety input times out
+  EXPECT_EQ(200, robot.emulator.commandSpeed());
+
+  robot.kobuki.removePlugin("cruise");
+  robot.emulator.stream(3);
+  EXPECT_EQ(100, robot.emulator.commandSpeed()); // back to teleop once the plugin lets go
+}
+
+TEST(Kobuki, pluginsClaimTheBumperFromTheReflex) {
+  Robot robot;
+  robot.parameters.safety_reflex.enable = true;
+  robot.parameters.safety_reflex.bumper = SafetyReflex::Stop;
+  robot.parameters.safety_reflex.cliff = SafetyReflex::Stop;
+  ASSERT_TRUE(robot.start());
+  ASSERT_TRUE(robot.kobuki.addPlugin(boost::shared_ptr<PluginHost::Plugin>(new Ram()), "ram"));
+  robot.kobuki.enable();
+  robot.emulator.stream(3);
+  EXPECT_EQ(100, robot.emulator.commandSpeed());
+
+  robot.emulator.sensors.bumper = 0x02;
+  robot.emulator.stream(3);
+  EXPECT_EQ(100, robot.emulator.commandSpeed());
+  EXPECT_EQ(0u, robot.kobuki.getSafetyReflexReaction().triggers);
+
+  robot.emulator.sensors.cliff = 0x02; // only the bumper is claimed
+  robot.emulator.stream(3);
+  EXPECT_EQ(0, robot.emulator.commandSpeed());
+  EXPECT_EQ(1u, robot.kobuki.getSafetyReflexReaction().triggers);
+}
+
+TEST(Kobuki, disableStopsEverySource) {
+  Robot robot;
+  ASSERT_TRUE(robot.start());
+  int teleop = robot.kobuki.addVelocityInput("teleop", -1, 0.0);
+  ASSERT_TRUE(robot.kobuki.addPlugin(boost::shared_ptr<PluginHost::Plugin>(new Cruise()), "cruise"));
+  robot.kobuki.enable();
+  robot.kobuki.setBaseControl(teleop, 0.1, 0.0);
+  robot.emulator.stream(3);
+  EXPECT_EQ(200, robot.emulator.commandSpeed());
+
+  robot.kobuki.disable();
+  robot.emulator.stream(3);
+  EXPECT_EQ(0, robot.emulator.commandSpeed());
+  EXPECT_EQ(-1, robot.kobuki.getSelectedVelocityInput()) << "the plugin is cancelled, teleop released";
+  robot.kobuki.setBaseControl(0.3, 0.0);
+  robot.emulator.stream(3);
+  EXPECT_EQ(0, robot.emulator.commandSpeed()) << "zero goes out while disabled";
+
+  robot.kobuki.enable();
+  robot.emulator.stream(3);
+  EXPECT_EQ(0, robot.emulator.commandSpeed()) << "the released input stays released";
+  robot.kobuki.setBaseControl(teleop, 0.1, 0.0);
+  robot.emulator.stream(3);
+  EXPECT_EQ(100, robot.emulator.commandSpeed());
+}
+
+TEST(Kobuki, trajectoriesAreAccelerationLimited) {
+  Robot robot;
+  robot.parameters.enable_velocity_smoother = true;
+  robot.parameters.linear_limits = kobuki::VelocitySmoother::Limits(0.5, 0.8, 2.0, 0.0);
+  ASSERT_TRUE(robot.start());
+  robot.kobuki.enable();
+
+  std::vector<TrajectoryBuffer::Sample> samples;
+  samples.push_back(TrajectoryBuffer::Sample(0.0, 0.0, 0.0));
+  samples.push_back(TrajectoryBuffer::Sample(0.1, 0.3, 0.0)); // 3m/s^2
+  EXPECT_FALSE(robot.kobuki.setTrajectory(static_cast<double>(ecl::TimeStamp()), samples));
+
+  // a jump from standstill passes validation, the smoother ramps into it
+  samples.clear();
+  samples.push_back(TrajectoryBuffer::Sample(0.0, 0.3, 0.0));
+  samples.push_back(TrajectoryBuffer::Sample(2.0, 0.3, 0.0));
+  ASSERT_TRUE(robot.kobuki.setTrajectory(static_cast<double>(ecl::TimeStamp()), samples));
+  int previous = 0;
+  for ( unsigned int i = 0; i < 50; ++i ) {
+    robot.emulator.stream(1);
+    EXPECT_LE(robot.emulator.commandSpeed() - previous, 12) << "frame " << i; // 10mm/s per 20ms frame
+    previous = robot.emulator.commandSpeed();
+  }
+  EXPECT_EQ(300, robot.emulator.commandSpeed());
+}
+
+TEST(Kobuki, motionsRampDownOnArrival) {
+  Robot robot;
+  robot.parameters.enable_velocity_smoother = true;
+  robot.parameters.linear_limits = kobuki::VelocitySmoother::Limits(0.6, 0.6, 2.0, 0.0);
+  ASSERT_TRUE(robot.start());
+  robot.kobuki.enable();
+  ASSERT_TRUE(robot.kobuki.startMotion(0.3, 0.0));
+  int previous = 0;
+  for ( unsigned int i = 0; ( i < 300 ) && robot.kobuki.isMotionRunning(); ++i ) {
+    robot.emulator.stream(1);
+    EXPECT_LE(std::abs(robot.emulator.commandSpeed() - previous), 13) << "frame " << i; // 12mm/s per 20ms frame
+    previous = robot.emulator.commandSpeed();
+  }
+  EXPECT_EQ(kobuki::MotionPrimitive::Succeeded, robot.kobuki.getMotionResult().status);
+  for ( unsigned int i = 0; i < 10; ++i ) {
+    robot.emulator.stream(1);
+    EXPECT_LE(std::abs(robot.emulator.commandSpeed() - previous), 13) << "after arrival, frame " << i;
+    previous = robot.emulator.commandSpeed();
+  }
+  EXPECT_EQ(0, robot.emulator.commandSpeed());
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/motion_primitive.cpp
+ *
+ * @brief Runs motion primitives against a simulated base and checks where they land.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/modules/motion_primitive.hpp"
+
+using kobuki::MotionPrimitive;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * Drive a differential base at 50Hz, with each command taking effect one
+ * cycle late as on the robot, and verify that the primitive succeeds within
+ * tolerance without exceeding its acceleration limits.
+ *
+ * A turn efficiency below one has the base turn less than its wheels say,
+ * as when they slip; the gyro still measures the true heading.
+ */
+void simulate(const double &distance, const double &angle, const double &turn_efficiency = 1.0) {
+  const double dt = 0.02;
+  const double tolerance = 1e-9;
+  const double wheel_radius = 0.035;
+  const double wheel_bias = 0.23;
+  const double tick_to_metre = 0.002436916871363930187454 * wheel_radius;
+  MotionPrimitive::Limits limits;
+  MotionPrimitive primitive;
+  primitive.init(limits);
+
+  double travelled = 0.0, heading = 0.0, left = 0.0, right = 0.0; // ground truth
+  double v = 0.0, w = 0.0; // in effect this cycle
+  ASSERT_TRUE(primitive.start(distance, angle, tick_to_metre, 0.0));
+  for ( double t = 0.0; t < 30.0; t += dt ) {
+    uint16_t left_encoder = static_cast<uint16_t>(static_cast<long>(std::floor(left / tick_to_metre)));
+    uint16_t right_encoder = static_cast<uint16_t>(static_cast<long>(std::floor(right / tick_to_metre)));
+    primitive.feedback(std::atan2(std::sin(heading), std::cos(heading)), left_encoder, right_encoder);
+    double next_v, next_w;
+    MotionPrimitive::Status status = primitive.command(t, dt, next_v, next_w);
+    left += ( v - w * wheel_bias / 2.0 ) * dt;
+    right += ( v + w * wheel_bias / 2.0 ) * dt;
+    travelled += v * dt;
+    heading += turn_efficiency * w * dt;
+    if ( status == MotionPrimitive::Running ) {
+      bool rotation = ( distance == 0.0 );
+      double acceleration = rotation ? ( next_w - w ) / dt : ( next_v - v ) / dt;
+      double limit = rotation ? limits.angular_acceleration : limits.linear_acceleration;
+      EXPECT_LE(std::fabs(acceleration), limit + tolerance) << "at " << t << "s";
+      v = next_v;
+      w = next_w;
+      continue;
+    }
+    // the base is still crawling when the target is reached, allow it the next cycle
+    EXPECT_EQ(MotionPrimitive::Succeeded, status) << MotionPrimitive::toString(status);
+    EXPECT_NEAR(distance, travelled, 2.0 * limits.distance_tolerance);
+    EXPECT_NEAR(angle, heading, 2.0 * limits.angle_tolerance);
+    MotionPrimitive::Result result = primitive.result();
+    EXPECT_EQ(status, result.status);
+    EXPECT_NEAR(result.angle, heading, 2.0 * limits.angle_tolerance);
+    return;
+  }
+  ADD_FAILURE() << "never finished";
+}
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(MotionPrimitive, quarterTurn) {
+  simulate(0.0, 0.5 * M_PI);
+}
+
+TEST(MotionPrimitive, twoTurnsClockwise) {
+  simulate(0.0, -4.0 * M_PI);
+}
+
+TEST(MotionPrimitive, metreForwards) {
+  simulate(1.0, 0.0);
+}
+
+TEST(MotionPrimitive, shortReverse) {
+  simulate(-0.05, 0.0);
+}
+
+TEST(MotionPrimitive, quarterArc) {
+  simulate(0.5, 0.5 * M_PI);
+}
+
+TEST(MotionPrimitive, slippingArcFinishesOnHeading) {
+  simulate(0.5, 0.5 * M_PI, 0.7);
+}
+
+TEST(MotionPrimitive, reportsCancellationOnce) {
+  MotionPrimitive primitive;
+  ASSERT_TRUE(primitive.start(1.0, 0.0, 1e-4, 0.0));
+  EXPECT_TRUE(primitive.isRunning());
+  primitive.cancel();
+  double linear, angular;
+  EXPECT_EQ(MotionPrimitive::Aborted, primitive.command(0.02, 0.02, linear, angular));
+  EXPECT_EQ(MotionPrimitive::Idle, primitive.command(0.04, 0.02, linear, angular));
+  EXPECT_DOUBLE_EQ(0.0, linear);
+  EXPECT_FALSE(primitive.start(1.0, 0.0, 0.0, 0.0));
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
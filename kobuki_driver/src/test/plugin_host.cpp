@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/plugin_host.cpp
+ *
+ * @brief Runs a few controller plugins on synthetic frames and checks how their commands merge.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/modules/plugin_host.hpp"
+
+using kobuki::PluginHost;
+
+/*****************************************************************************
+** Plugins
+*****************************************************************************/
+
+/**
+ * Blinks the first led red while a bumper is pressed, green otherwise.
+ */
+class BumpBlink : public PluginHost::Plugin {
+public:
+  void update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands) {
+    commands.setLed(kobuki::Led1, feedback.core_sensors.bumper ? kobuki::Red : kobuki::Green);
+    for ( unsigned int i = 0; i < feedback.events.bumper_events.size(); ++i ) {
+      if ( feedback.events.bumper_events[i].state == kobuki::BumperEvent::Pressed ) {
+        commands.playSoundSequence(kobuki::Error);
+      }
+    }
+  }
+};
+
+/**
+ * Drives forwards, orange while driving; ignored whenever a higher priority claims first.
+ */
+class Cruise : public PluginHost::Plugin {
+public:
+  void update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands) {
+    commands.setVelocity(0.2, 0.0);
+    commands.setLed(kobuki::Led1, kobuki::Orange);
+  }
+};
+
+/**
+ * Stops on a bump, taking far too long about it.
+ */
+class SlowStop : public PluginHost::Plugin {
+public:
+  void update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands) {
+    usleep(2000);
+    if ( feedback.core_sensors.bumper ) {
+      commands.setVelocity(0.0, 0.0);
+    }
+  }
+};
+
+/**
+ * Pushes against whatever it bumps into, as a docking controller would.
+ */
+class Push : public PluginHost::Plugin {
+public:
+  Push() : pushing(true) {}
+  void update(const PluginHost::Feedback &feedback, PluginHost::Commands &commands) {
+    if ( pushing ) {
+      commands.claimBumper();
+    }
+  }
+  bool pushing;
+};
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * A host with the three plugins above and the frames to run them on.
+ */
+class Plugins {
+public:
+  Plugins() : time(0.0) {
+    core_sensors.bumper = 0;
+    host.add(boost::shared_ptr<PluginHost::Plugin>(new Cruise()), "cruise", 0);
+    host.add(boost::shared_ptr<PluginHost::Plugin>(new BumpBlink()), "bump_blink", 10);
+    host.add(boost::shared_ptr<PluginHost::Plugin>(new SlowStop()), "slow_stop", 20);
+  }
+
+  void run() {
+    host.run(PluginHost::Feedback(time, 0.0, 0.000085, core_sensors, cliff, dock_ir, inertia, gp_input, events));
+    time += 0.02;
+  }
+
+  void press() {
+    core_sensors.bumper = kobuki::CoreSensors::Flags::LeftBumper;
+    kobuki::BumperEvent pressed = { kobuki::BumperEvent::Pressed, kobuki::BumperEvent::Left, time };
+    events.bumper_events.push_back(pressed);
+    run();
+    events.clear();
+  }
+
+  PluginHost host;
+  PluginHost::Commands commands;
+  double time;
+  kobuki::CoreSensors::Data core_sensors;
+  kobuki::Cliff::Data cliff;
+  kobuki::DockIR::Data dock_ir;
+  kobuki::Inertia::Data inertia;
+  kobuki::GpInput::Data gp_input;
+  kobuki::EventBatch events;
+};
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(PluginHost, refusesDuplicateNames) {
+  Plugins plugins;
+  EXPECT_FALSE(plugins.host.add(boost::shared_ptr<PluginHost::Plugin>(new Cruise()), "cruise"));
+  EXPECT_FALSE(plugins.host.empty());
+}
+
+TEST(PluginHost, firstClaimWins) {
+  Plugins plugins;
+  plugins.run();
+  ASSERT_TRUE(plugins.host.collect(plugins.commands));
+  EXPECT_TRUE(plugins.commands.has_velocity);
+  EXPECT_DOUBLE_EQ(0.2, plugins.commands.linear_velocity); // nothing above cruise claims it
+  EXPECT_TRUE(plugins.commands.has_led[kobuki::Led1]);
+  EXPECT_EQ(kobuki::Green, plugins.commands.led_colours[kobuki::Led1]); // bump blink is above cruise
+  EXPECT_FALSE(plugins.host.collect(plugins.commands)) << "collecting clears";
+
+  plugins.press();
+  plugins.host.collect(plugins.commands);
+  EXPECT_TRUE(plugins.commands.has_velocity);
+  EXPECT_DOUBLE_EQ(0.0, plugins.commands.linear_velocity); // slow stop is above them all
+}
+
+TEST(PluginHost, ledsOnlyOnChange) {
+  Plugins plugins;
+  plugins.run();
+  plugins.host.collect(plugins.commands);
+  EXPECT_TRUE(plugins.commands.has_led[kobuki::Led1]);
+  EXPECT_FALSE(plugins.commands.has_led[kobuki::Led2]);
+
+  plugins.run(); // green again
+  plugins.host.collect(plugins.commands);
+  EXPECT_FALSE(plugins.commands.has_led[kobuki::Led1]);
+
+  plugins.press();
+  plugins.host.collect(plugins.commands);
+  EXPECT_TRUE(plugins.commands.has_led[kobuki::Led1]);
+  EXPECT_EQ(kobuki::Red, plugins.commands.led_colours[kobuki::Led1]);
+}
+
+TEST(PluginHost, keepsUncollectedRequests) {
+  Plugins plugins;
+  plugins.run();
+  plugins.host.collect(plugins.commands);
+
+  plugins.press();
+  plugins.run(); // not collected in between, the sound and the led change must survive
+  plugins.host.collect(plugins.commands);
+  EXPECT_TRUE(plugins.commands.has_sound);
+  EXPECT_EQ(kobuki::Error, plugins.commands.sound);
+  EXPECT_TRUE(plugins.commands.has_led[kobuki::Led1]);
+  EXPECT_EQ(kobuki::Red, plugins.commands.led_colours[kobuki::Led1]);
+
+  plugins.run();
+  plugins.host.collect(plugins.commands);
+  EXPECT_FALSE(plugins.commands.has_sound);
+  EXPECT_FALSE(plugins.commands.has_led[kobuki::Led1]);
+}
+
+TEST(PluginHost, statistics) {
+  Plugins plugins;
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    plugins.run();
+  }
+  std::vector<PluginHost::Statistics> statistics = plugins.host.statistics();
+  ASSERT_EQ(3u, statistics.size());
+  EXPECT_EQ("slow_stop", statistics[0].name); // in priority order
+  EXPECT_EQ("bump_blink", statistics[1].name);
+  EXPECT_EQ("cruise", statistics[2].name);
+  EXPECT_EQ(3u, statistics[0].runs);
+  EXPECT_EQ(3u, statistics[0].overruns);
+  EXPECT_EQ(0u, statistics[1].overruns);
+  EXPECT_EQ(0u, statistics[2].overruns);
+
+  EXPECT_TRUE(plugins.host.remove("slow_stop"));
+  EXPECT_FALSE(plugins.host.remove("slow_stop"));
+  EXPECT_EQ(2u, plugins.host.statistics().size());
+}
+
+TEST(PluginHost, bumperClaimsLastOneRun) {
+  Plugins plugins;
+  plugins.run();
+  EXPECT_FALSE(plugins.host.bumperClaimed());
+
+  boost::shared_ptr<Push> push(new Push());
+  plugins.host.add(push, "push", -10);
+  plugins.press();
+  EXPECT_TRUE(plugins.host.bumperClaimed()) << "whatever the priority";
+  plugins.host.collect(plugins.commands);
+  EXPECT_TRUE(plugins.host.bumperClaimed()) << "until the next run, not the next collection";
+
+  push->pushing = false;
+  plugins.run();
+  EXPECT_FALSE(plugins.host.bumperClaimed());
+  push->pushing = true;
+  plugins.run();
+  plugins.host.cancel();
+  EXPECT_FALSE(plugins.host.bumperClaimed());
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
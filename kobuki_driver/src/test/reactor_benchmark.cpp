@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/reactor_benchmark.cpp
+ *
+ * @brief Compares threads and cpu per robot, worker threads versus a reactor.
+ *
+ * Usage: reactor_benchmark [robots=20] [seconds=10] [thread|reactor] [pool=1]
+ *
+ * Each robot is emulated on a pseudo terminal streaming 50Hz core sensor
+ * frames from this process' main thread; the drivers open the slave ends.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <boost/shared_ptr.hpp>
+#include "../../include/kobuki_driver/kobuki.hpp"
+
+/*****************************************************************************
+** Emulator
+*****************************************************************************/
+
+/**
+ * The robot end of a pseudo terminal, streaming core sensor frames.
+ */
+class Emulator {
+public:
+  Emulator() : master(-1), time_stamp(0) {}
+  ~Emulator() { if ( master != -1 ) { close(master); } }
+
+  bool open() {
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if ( ( master == -1 ) || grantpt(master) || unlockpt(master) ) {
+      return false;
+    }
+    termios options;
+    tcgetattr(master, &options);
+    cfmakeraw(&options);
+    tcsetattr(master, TCSANOW, &options);
+    slave = ptsname(master);
+    return true;
+  }
+
+  void frame() {
+    unsigned char packet[] = { 0xaa, 0x55, 17, 0x01, 15,
+                               0, 0,       // time stamp [ms]
+                               0, 0, 0,    // bumper, wheel drop, cliff
+                               0, 0, 0, 0, // encoders
+                               0, 0, 0, 0, // pwm, buttons, charger
+                               160, 0,     // battery [0.1V], over current
+                               0 };        // checksum
+    time_stamp += 20;
+    packet[5] = time_stamp & 0xff;
+    packet[6] = time_stamp >> 8;
+    unsigned char checksum = 0;
+    for ( unsigned int i = 2; i < sizeof(packet) - 1; ++i ) {
+      checksum ^= packet[i];
+    }
+    packet[sizeof(packet) - 1] = checksum;
+    if ( write(master, packet, sizeof(packet)) < 0 ) {} // nobody listening yet
+    unsigned char commands[256];
+    while ( read(master, commands, sizeof(commands)) > 0 ) {} // drop them
+  }
+
+  int master;
+  std::string slave;
+  uint16_t time_stamp;
+};
+
+/*****************************************************************************
+** Measurements
+*****************************************************************************/
+
+int threadCount() {
+  int threads = -1;
+  std::FILE *status = std::fopen("/proc/self/status", "r");
+  char line[256];
+  while ( status && std::fgets(line, sizeof(line), status) ) {
+    if ( std::sscanf(line, "Threads: %d", &threads) == 1 ) {
+      break;
+    }
+  }
+  if ( status ) {
+    std::fclose(status);
+  }
+  return threads;
+}
+
+double cpuTime(const int &who) {
+  rusage usage;
+  getrusage(who, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1e-6;
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  unsigned int robots = ( argc > 1 ) ? std::atoi(argv[1]) : 20;
+  double duration = ( argc > 2 ) ? std::atof(argv[2]) : 10.0;
+  bool use_reactor = ( argc > 3 ) && ( std::string(argv[3]) == "reactor" );
+  unsigned int pool = ( argc > 4 ) ? std::atoi(argv[4]) : 1;
+
+  boost::shared_ptr<kobuki::Reactor> reactor;
+  if ( use_reactor ) {
+    reactor.reset(new kobuki::Reactor(pool));
+  }
+  std::vector<boost::shared_ptr<Emulator> > emulators;
+  std::vector<boost::shared_ptr<kobuki::Kobuki> > drivers;
+  for ( unsigned int i = 0; i < robots; ++i ) {
+    boost::shared_ptr<Emulator> emulator(new Emulator());
+    if ( !emulator->open() ) {
+      std::printf("could not open a pseudo terminal for robot %u\n", i);
+      return 1;
+    }
+    kobuki::Parameters parameters;
+    parameters.device_port = "tty://" + emulator->slave;
+    char name[32];
+    std::snprintf(name, sizeof(name), "/kobuki_%u", i);
+    parameters.sigslots_namespace = name;
+    parameters.handshake_attempts = 1;
+    parameters.reactor = reactor;
+    boost::shared_ptr<kobuki::Kobuki> driver(new kobuki::Kobuki());
+    driver->init(parameters);
+    emulators.push_back(emulator);
+    drivers.push_back(driver);
+  }
+
+  // stream at 50Hz for a second to settle, then measure
+  timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  unsigned int settle = 50, frames = static_cast<unsigned int>(duration * 50.0);
+  double cpu_start = 0.0, emulator_start = 0.0;
+  for ( unsigned int n = 0; n < settle + frames; ++n ) {
+    if ( n == settle ) {
+      cpu_start = cpuTime(RUSAGE_SELF);
+      emulator_start = cpuTime(RUSAGE_THREAD);
+    }
+    for ( unsigned int i = 0; i < emulators.size(); ++i ) {
+      emulators[i]->frame();
+    }
+    next.tv_nsec += 20000000L;
+    if ( next.tv_nsec >= 1000000000L ) {
+      next.tv_nsec -= 1000000000L;
+      ++next.tv_sec;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+  double driver_cpu = ( cpuTime(RUSAGE_SELF) - cpu_start ) - ( cpuTime(RUSAGE_THREAD) - emulator_start );
+
+  unsigned int alive = 0;
+  for ( unsigned int i = 0; i < drivers.size(); ++i ) {
+    if ( drivers[i]->isAlive() ) {
+      ++alive;
+    }
+  }
+  std::printf("mode     : %s\n", use_reactor ? "reactor" : "thread per robot");
+  std::printf("robots   : %u (%u streaming)\n", robots, alive);
+  std::printf("threads  : %d\n", threadCount());
+  std::printf("cpu      : %.2f%% total, %.3f%% per robot\n",
+              100.0 * driver_cpu / duration, 100.0 * driver_cpu / duration / ( robots ? robots : 1 ));
+  drivers.clear(); // before the reactor serving them
+  return 0;
+}
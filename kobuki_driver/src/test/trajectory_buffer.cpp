@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/trajectory_buffer.cpp
+ *
+ * @brief Checks the trajectory buffer's validation, interpolation and preemption.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <limits>
+#include <vector>
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/modules/trajectory_buffer.hpp"
+
+using kobuki::TrajectoryBuffer;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * Accelerate to 0.5m/s over a second, cruise for a second.
+ */
+std::vector<TrajectoryBuffer::Sample> ramp() {
+  std::vector<TrajectoryBuffer::Sample> samples;
+  samples.push_back(TrajectoryBuffer::Sample(0.0, 0.0, 0.0));
+  samples.push_back(TrajectoryBuffer::Sample(1.0, 0.5, 1.0));
+  samples.push_back(TrajectoryBuffer::Sample(2.0, 0.5, 1.0));
+  return samples;
+}
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(TrajectoryBuffer, rejectsMalformedSamples) {
+  TrajectoryBuffer buffer;
+  EXPECT_FALSE(buffer.set(0.0, std::vector<TrajectoryBuffer::Sample>()));
+
+  std::vector<TrajectoryBuffer::Sample> samples = ramp();
+  samples[2].time = 1.0;
+  EXPECT_FALSE(buffer.set(0.0, samples)); // times must strictly increase
+
+  samples = ramp();
+  samples[1].linear_velocity = std::numeric_limits<double>::quiet_NaN();
+  EXPECT_FALSE(buffer.set(0.0, samples));
+
+  samples = ramp();
+  samples[2].angular_velocity = std::numeric_limits<double>::infinity();
+  EXPECT_FALSE(buffer.set(0.0, samples));
+
+  EXPECT_FALSE(buffer.set(std::numeric_limits<double>::quiet_NaN(), ramp()));
+  EXPECT_EQ(5u, buffer.statistics().rejected);
+  EXPECT_EQ(0u, buffer.statistics().received);
+}
+
+TEST(TrajectoryBuffer, rejectsAbruptSegments) {
+  TrajectoryBuffer buffer;
+  std::vector<TrajectoryBuffer::Sample> samples = ramp();
+  samples[1].time = 0.5; // 1m/s^2, 2rad/s^2
+  EXPECT_TRUE(buffer.set(0.0, samples)); // unlimited until initialised
+
+  buffer.init(0.8, 4.0);
+  EXPECT_FALSE(buffer.set(0.0, samples));
+  EXPECT_TRUE(buffer.set(0.0, ramp())); // 0.5m/s^2, 1rad/s^2
+
+  buffer.init(0.8, 1.5);
+  samples[1].time = 0.7; // 0.71m/s^2 but 1.43rad/s^2, just within both
+  EXPECT_TRUE(buffer.set(0.0, samples));
+  samples[1].time = 0.6; // 1.67rad/s^2
+  EXPECT_FALSE(buffer.set(0.0, samples));
+}
+
+TEST(TrajectoryBuffer, interpolatesUntilFinished) {
+  TrajectoryBuffer buffer;
+  buffer.init(0.8, 4.0);
+  ASSERT_TRUE(buffer.set(10.0, ramp()));
+  double linear = -1.0, angular = -1.0;
+  EXPECT_EQ(TrajectoryBuffer::Idle, buffer.sample(9.9, linear, angular));
+  EXPECT_DOUBLE_EQ(-1.0, linear);
+
+  EXPECT_EQ(TrajectoryBuffer::Running, buffer.sample(10.5, linear, angular));
+  EXPECT_DOUBLE_EQ(0.25, linear);
+  EXPECT_DOUBLE_EQ(0.5, angular);
+  EXPECT_TRUE(buffer.isRunning());
+
+  EXPECT_EQ(TrajectoryBuffer::Running, buffer.sample(11.5, linear, angular));
+  EXPECT_DOUBLE_EQ(0.5, linear);
+  EXPECT_EQ(TrajectoryBuffer::Finished, buffer.sample(12.1, linear, angular));
+  EXPECT_EQ(TrajectoryBuffer::Idle, buffer.sample(12.2, linear, angular));
+  EXPECT_EQ(1u, buffer.statistics().completed);
+}
+
+TEST(TrajectoryBuffer, preemptsWhenDue) {
+  TrajectoryBuffer buffer;
+  ASSERT_TRUE(buffer.set(0.0, ramp()));
+  double linear, angular;
+  EXPECT_EQ(TrajectoryBuffer::Running, buffer.sample(0.5, linear, angular));
+
+  std::vector<TrajectoryBuffer::Sample> slower;
+  slower.push_back(TrajectoryBuffer::Sample(0.0, 0.1, 0.0));
+  slower.push_back(TrajectoryBuffer::Sample(1.0, 0.1, 0.0));
+  ASSERT_TRUE(buffer.set(1.0, slower));
+  EXPECT_EQ(TrajectoryBuffer::Running, buffer.sample(0.9, linear, angular));
+  EXPECT_DOUBLE_EQ(0.45, linear); // still the first
+  EXPECT_EQ(TrajectoryBuffer::Running, buffer.sample(1.0, linear, angular));
+  EXPECT_DOUBLE_EQ(0.1, linear);
+  EXPECT_EQ(1u, buffer.statistics().preempted);
+
+  buffer.cancel();
+  EXPECT_EQ(TrajectoryBuffer::Idle, buffer.sample(1.5, linear, angular));
+  EXPECT_EQ(1u, buffer.statistics().cancelled);
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/transport.cpp
+ *
+ * @brief Checks the transports' open, read and write failure paths.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/transport.hpp"
+
+using kobuki::Transport;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * A unix socket for a SocketTransport to connect to, standing in for an emulator.
+ */
+class Listener {
+public:
+  Listener(const std::string &path) : path(path), peer(-1) {
+    unlink(path.c_str());
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    listen(server, 1);
+  }
+  ~Listener() {
+    hangup();
+    ::close(server);
+    unlink(path.c_str());
+  }
+  void accept() { peer = ::accept(server, NULL, NULL); }
+  void hangup() {
+    if ( peer != -1 ) {
+      ::close(peer);
+      peer = -1;
+    }
+  }
+  int peer;
+
+private:
+  std::string path;
+  int server;
+};
+
+/**
+ * Hands out a fixed sequence of reads, for the recorder to log.
+ */
+class Script : public Transport {
+public:
+  Script(const bool &openable) : Transport("script://"), openable(openable), is_open(false) {}
+  bool open() {
+    is_open = openable;
+    error_message = openable ? "" : "script refuses to open.";
+    return is_open;
+  }
+  void close() { is_open = false; }
+  bool isOpen() const { return is_open; }
+  int read(unsigned char *buffer, const unsigned int &size, const long &timeout_ms) {
+    if ( reads.empty() ) {
+      return -1;
+    }
+    std::string next = reads.front();
+    reads.erase(reads.begin());
+    std::memcpy(buffer, next.data(), next.size());
+    return static_cast<int>(next.size());
+  }
+  int write(const unsigned char *buffer, const unsigned int &size) { return size; }
+
+  std::vector<std::string> reads;
+
+private:
+  bool openable, is_open;
+};
+
+std::string readAll(Transport &transport) {
+  std::string bytes;
+  unsigned char buffer[64];
+  int n;
+  while ( ( n = transport.read(buffer, sizeof(buffer), 100) ) >= 0 ) {
+    bytes.append(reinterpret_cast<char*>(buffer), n);
+  }
+  return bytes;
+}
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(Transport, create) {
+  EXPECT_TRUE(Transport::create("/dev/ttyUSB0"));
+  EXPECT_TRUE(Transport::create("tcp://localhost:5000"));
+  EXPECT_TRUE(Transport::create("replay:///tmp/kobuki.log?rate=0"));
+  EXPECT_FALSE(Transport::create("tcp://localhost"));
+  EXPECT_FALSE(Transport::create("tcp://:5000"));
+  EXPECT_FALSE(Transport::create("unix://"));
+  EXPECT_FALSE(Transport::create("replay:///tmp/kobuki.log?rate=-1"));
+  EXPECT_FALSE(Transport::create("carrier://pigeon"));
+}
+
+TEST(Transport, openFailures) {
+  boost::shared_ptr<Transport> tty = Transport::create("/tmp/kobuki_test_no_such_device");
+  EXPECT_FALSE(tty->exists());
+  EXPECT_FALSE(tty->open());
+  EXPECT_FALSE(tty->isOpen());
+  EXPECT_FALSE(tty->errorMessage().empty());
+
+  boost::shared_ptr<Transport> socket = Transport::create("unix:///tmp/kobuki_test_no_such_socket");
+  EXPECT_FALSE(socket->exists());
+  EXPECT_FALSE(socket->open());
+  EXPECT_EQ(-1, socket->fd());
+
+  boost::shared_ptr<Transport> tcp = Transport::create("tcp://no.such.host.invalid:5000");
+  EXPECT_FALSE(tcp->open());
+  EXPECT_FALSE(tcp->errorMessage().empty());
+
+  boost::shared_ptr<Transport> replay = Transport::create("replay:///tmp/kobuki_test_no_such_log");
+  EXPECT_FALSE(replay->open());
+  EXPECT_FALSE(replay->errorMessage().empty());
+}
+
+TEST(Transport, closedReadAndWrite) {
+  boost::shared_ptr<Transport> socket = Transport::create("unix:///tmp/kobuki_test_no_such_socket");
+  unsigned char buffer[8] = { 0 };
+  EXPECT_EQ(-1, socket->read(buffer, sizeof(buffer), 0));
+  EXPECT_EQ(-1, socket->write(buffer, sizeof(buffer)));
+}
+
+TEST(Transport, socketHangup) {
+  Listener listener("/tmp/kobuki_test_hangup");
+  boost::shared_ptr<Transport> socket = Transport::create("unix:///tmp/kobuki_test_hangup");
+  ASSERT_TRUE(socket->open());
+  listener.accept();
+  EXPECT_TRUE(fcntl(socket->fd(), F_GETFL, 0) & O_NONBLOCK);
+
+  unsigned char buffer[8] = { 0xaa, 0x55 };
+  EXPECT_EQ(0, socket->read(buffer, sizeof(buffer), 10)); // nothing yet
+  EXPECT_EQ(2, ::write(listener.peer, buffer, 2));
+  EXPECT_EQ(2, socket->read(buffer, sizeof(buffer), 100));
+
+  listener.hangup();
+  EXPECT_EQ(-1, socket->read(buffer, sizeof(buffer), 100));
+  EXPECT_FALSE(socket->isOpen());
+  EXPECT_FALSE(socket->errorMessage().empty());
+}
+
+TEST(Transport, socketWriteTimesOut) {
+  Listener listener("/tmp/kobuki_test_stuck");
+  boost::shared_ptr<Transport> socket = Transport::create("unix:///tmp/kobuki_test_stuck");
+  ASSERT_TRUE(socket->open());
+  listener.accept(); // but never reads
+  std::vector<unsigned char> bytes(1 << 16, 0xaa);
+  int result = 0;
+  for ( unsigned int i = 0; ( i < 1000 ) && ( result >= 0 ); ++i ) {
+    result = socket->write(&bytes[0], bytes.size());
+  }
+  EXPECT_EQ(-1, result); // rather than blocking for good
+  EXPECT_NE(std::string::npos, socket->errorMessage().find("timed out"));
+}
+
+TEST(Transport, recordingFailsToOpen) {
+  boost::shared_ptr<Transport> script(new Script(true));
+  kobuki::RecordingTransport unwritable(script, "/tmp/kobuki_test_no_such_directory/log");
+  EXPECT_FALSE(unwritable.open());
+  EXPECT_FALSE(unwritable.errorMessage().empty());
+
+  boost::shared_ptr<Transport> refusing(new Script(false));
+  kobuki::RecordingTransport recording(refusing, "/tmp/kobuki_test_refused.log");
+  EXPECT_FALSE(recording.open());
+  EXPECT_EQ("script refuses to open.", recording.errorMessage());
+  std::remove("/tmp/kobuki_test_refused.log");
+}
+
+TEST(Transport, recordAndReplay) {
+  const char *log = "/tmp/kobuki_test_replay.log";
+  for ( unsigned int run = 0; run < 2; ++run ) {
+    Script *script = new Script(true);
+    script->reads.push_back(run ? "second" : "first");
+    script->reads.push_back(" run");
+    kobuki::RecordingTransport recording(boost::shared_ptr<Transport>(script), log);
+    ASSERT_TRUE(recording.open());
+    readAll(recording);
+  }
+  boost::shared_ptr<Transport> replay = Transport::create(std::string("replay://") + log + "?rate=0");
+  ASSERT_TRUE(replay->open());
+  EXPECT_EQ("second run", readAll(*replay)); // the first run was truncated, not appended to
+  EXPECT_FALSE(replay->isOpen());
+  EXPECT_FALSE(replay->exists()); // finished
+  unsigned char buffer[8];
+  EXPECT_EQ(-1, replay->read(buffer, sizeof(buffer), 0));
+  std::remove(log);
+}
+
+TEST(Transport, replayWaitsWithoutSleeping) {
+  const char *log = "/tmp/kobuki_test_paced.log";
+  std::FILE *file = std::fopen(log, "wb");
+  const double times[2] = { 10.0, 10.5 };
+  for ( unsigned int i = 0; i < 2; ++i ) {
+    uint32_t length = 1;
+    unsigned char byte = 0xaa;
+    std::fwrite(&times[i], sizeof(times[i]), 1, file);
+    std::fwrite(&length, sizeof(length), 1, file);
+    std::fwrite(&byte, 1, 1, file);
+  }
+  std::fclose(file);
+  boost::shared_ptr<Transport> replay = Transport::create(std::string("replay://") + log);
+  ASSERT_TRUE(replay->open());
+  unsigned char buffer[8];
+  EXPECT_EQ(1, replay->read(buffer, sizeof(buffer), 1000)); // the first chunk is due straight away
+  EXPECT_EQ(0, replay->read(buffer, sizeof(buffer), 1000)); // loads the second, not due for 0.5s
+  long idle = replay->idleTime();
+  EXPECT_GT(idle, 400);
+  EXPECT_LE(idle, 501);
+  usleep(idle * 1000);
+  EXPECT_EQ(0, replay->idleTime());
+  EXPECT_EQ(1, replay->read(buffer, sizeof(buffer), 0));
+  std::remove(log);
+}
+
+TEST(Transport, emptyReplay) {
+  const char *log = "/tmp/kobuki_test_empty.log";
+  std::fclose(std::fopen(log, "wb"));
+  boost::shared_ptr<Transport> replay = Transport::create(std::string("replay://") + log);
+  EXPECT_FALSE(replay->open());
+  EXPECT_FALSE(replay->exists());
+  std::remove(log);
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/velocity_mux.cpp
+ *
+ * @brief Checks the velocity multiplexer's priorities, timeouts and releases.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/modules/velocity_mux.hpp"
+
+using kobuki::VelocityMux;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * A safety input above a teleop input above a navigation input that never times out.
+ */
+class Mux {
+public:
+  Mux() : linear(0.0), angular(0.0) {
+    navigation = mux.add("navigation", 1, 0.0);
+    teleop = mux.add("teleop", 5, 0.5);
+    safety = mux.add("safety", 10, 0.2);
+  }
+
+  /**
+   * Select at the given time, returning the winning input's name, "idle" if none.
+   */
+  std::string select(const double &now) {
+    changed = mux.select(now, linear, angular);
+    return ( mux.selected() < 0 ) ? "idle" : mux.status()[mux.selected()].name;
+  }
+
+  VelocityMux mux;
+  int navigation, teleop, safety;
+  double linear, angular;
+  bool changed;
+};
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(VelocityMux, refusesDuplicateNames) {
+  Mux mux;
+  EXPECT_EQ(0, mux.navigation);
+  EXPECT_EQ(1, mux.teleop);
+  EXPECT_EQ(2, mux.safety);
+  EXPECT_EQ(-1, mux.mux.add("teleop", 3, 0.1));
+  EXPECT_FALSE(mux.mux.set(3, 0.1, 0.0, 0.0));
+}
+
+TEST(VelocityMux, idleUntilCommanded) {
+  Mux mux;
+  EXPECT_EQ("idle", mux.select(0.0));
+  EXPECT_DOUBLE_EQ(0.0, mux.linear);
+  EXPECT_DOUBLE_EQ(0.0, mux.angular);
+}
+
+TEST(VelocityMux, highestPriorityWins) {
+  Mux mux;
+  mux.mux.set(mux.navigation, 0.3, 0.1, 0.0);
+  EXPECT_EQ("navigation", mux.select(0.0));
+  EXPECT_DOUBLE_EQ(0.3, mux.linear);
+  EXPECT_DOUBLE_EQ(0.1, mux.angular);
+
+  mux.mux.set(mux.teleop, 0.2, 0.0, 0.0);
+  EXPECT_EQ("teleop", mux.select(0.0));
+  EXPECT_DOUBLE_EQ(0.2, mux.linear);
+
+  mux.mux.set(mux.safety, -0.1, 0.0, 0.0);
+  mux.mux.set(mux.navigation, 0.4, 0.0, 0.0); // a lower input's new command changes nothing
+  EXPECT_EQ("safety", mux.select(0.0));
+  EXPECT_DOUBLE_EQ(-0.1, mux.linear);
+}
+
+TEST(VelocityMux, inputsTimeOut) {
+  Mux mux;
+  mux.mux.set(mux.navigation, 0.3, 0.0, 0.0);
+  mux.mux.set(mux.teleop, 0.2, 0.0, 0.0);
+  mux.mux.set(mux.safety, 0.0, 0.0, 0.0);
+  EXPECT_EQ("safety", mux.select(0.2));   // silent for exactly its timeout
+  EXPECT_EQ("teleop", mux.select(0.25));  // safety timed out
+  EXPECT_DOUBLE_EQ(0.2, mux.linear);
+  EXPECT_EQ("teleop", mux.select(0.5));
+  EXPECT_EQ("navigation", mux.select(0.55)); // teleop timed out, navigation never does
+  EXPECT_DOUBLE_EQ(0.3, mux.linear);
+  EXPECT_EQ("navigation", mux.select(100.0));
+
+  mux.mux.set(mux.teleop, 0.1, 0.0, 100.0); // back with its next command
+  EXPECT_EQ("teleop", mux.select(100.0));
+}
+
+TEST(VelocityMux, reportsChanges) {
+  Mux mux;
+  mux.mux.set(mux.teleop, 0.2, 0.0, 0.0);
+  mux.select(0.0);
+  EXPECT_TRUE(mux.changed);
+  mux.select(0.1);
+  EXPECT_FALSE(mux.changed) << "same input, no new command";
+  mux.mux.set(mux.teleop, 0.2, 0.0, 0.1);
+  mux.select(0.1);
+  EXPECT_TRUE(mux.changed) << "a new command, even if it repeats the last";
+  mux.select(1.0);
+  EXPECT_TRUE(mux.changed) << "timed out";
+  EXPECT_EQ(-1, mux.mux.selected());
+}
+
+TEST(VelocityMux, releases) {
+  Mux mux;
+  mux.mux.set(mux.navigation, 0.3, 0.0, 0.0);
+  mux.mux.set(mux.teleop, 0.2, 0.0, 0.0);
+  EXPECT_TRUE(mux.mux.release(mux.teleop));
+  EXPECT_FALSE(mux.mux.release(3));
+  EXPECT_EQ("navigation", mux.select(0.0));
+
+  mux.mux.set(mux.teleop, 0.2, 0.0, 0.1);
+  EXPECT_EQ("teleop", mux.select(0.1));
+
+  mux.mux.clear();
+  EXPECT_EQ("idle", mux.select(0.1));
+  EXPECT_TRUE(mux.changed);
+  EXPECT_DOUBLE_EQ(0.0, mux.linear);
+  EXPECT_EQ(2u, mux.mux.status()[mux.teleop].commands); // counts survive a release
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
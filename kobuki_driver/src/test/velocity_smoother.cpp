@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/test/velocity_smoother.cpp
+ *
+ * @brief Replays step inputs through the velocity smoother and checks its limits.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include "../../include/kobuki_driver/modules/velocity_smoother.hpp"
+
+/*****************************************************************************
+** Replay
+*****************************************************************************/
+
+struct Step {
+  double time;    // [s] when the target is applied
+  double linear;  // [m/s]
+  double angular; // [rad/s]
+  bool emergency;
+};
+
+/**
+ * Replay a sequence of targets at the 50Hz feedback rate and verify that
+ * neither axis ever exceeds its acceleration, deceleration or jerk limits,
+ * and that every target is eventually reached.
+ */
+void replay(const std::vector<Step> &steps, const double &duration,
+            const kobuki::VelocitySmoother::Limits &linear_limits,
+            const kobuki::VelocitySmoother::Limits &angular_limits) {
+  const double dt = 0.02;
+  const double tolerance = 1e-9;
+  kobuki::VelocitySmoother smoother;
+  smoother.init(true, linear_limits, angular_limits);
+
+  unsigned int next = 0;
+  double v = 0.0, w = 0.0, last_a_v = 0.0, last_a_w = 0.0;
+  bool emergency = false;
+  for ( double t = 0.0; t < duration; t += dt ) {
+    if ( ( next < steps.size() ) && ( t >= steps[next].time - tolerance ) ) {
+      if ( steps[next].emergency ) {
+        smoother.emergencyStop();
+        emergency = true;
+      } else {
+        smoother.setTarget(steps[next].linear, steps[next].angular);
+        emergency = false;
+      }
+      ++next;
+    }
+    smoother.update(dt);
+    double a_v = (smoother.linearVelocity() - v) / dt;
+    double a_w = (smoother.angularVelocity() - w) / dt;
+    double max_a_v = emergency ? linear_limits.emergency_deceleration :
+                     std::max(linear_limits.acceleration, linear_limits.deceleration);
+    double max_a_w = emergency ? angular_limits.emergency_deceleration :
+                     std::max(angular_limits.acceleration, angular_limits.deceleration);
+    EXPECT_LE(std::fabs(a_v), max_a_v + tolerance) << "linear acceleration at " << t << "s";
+    EXPECT_LE(std::fabs(a_w), max_a_w + tolerance) << "angular acceleration at " << t << "s";
+    // arrival snaps onto the target, dropping a small residual acceleration in one cycle
+    bool arrived_v = ( next > 0 ) && ( smoother.linearVelocity() == ( emergency ? 0.0 : steps[next - 1].linear ) );
+    bool arrived_w = ( next > 0 ) && ( smoother.angularVelocity() == ( emergency ? 0.0 : steps[next - 1].angular ) );
+    if ( !emergency && !arrived_v ) {
+      EXPECT_LE(std::fabs(a_v - last_a_v), linear_limits.jerk * dt + tolerance) << "linear jerk at " << t << "s";
+    }
+    if ( !emergency && !arrived_w ) {
+      EXPECT_LE(std::fabs(a_w - last_a_w), angular_limits.jerk * dt + tolerance) << "angular jerk at " << t << "s";
+    }
+    v = smoother.linearVelocity();
+    w = smoother.angularVelocity();
+    last_a_v = a_v;
+    last_a_w = a_w;
+  }
+  const Step &last = steps.back();
+  EXPECT_NEAR(last.emergency ? 0.0 : last.linear, v, tolerance) << "final linear target";
+  EXPECT_NEAR(last.emergency ? 0.0 : last.angular, w, tolerance) << "final angular target";
+}
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+const kobuki::VelocitySmoother::Limits linear_limits(0.5, 0.8, 2.0, 5.0);
+const kobuki::VelocitySmoother::Limits angular_limits(3.0, 4.0, 10.0, 30.0);
+
+TEST(VelocitySmoother, stepUpAndDown) {
+  std::vector<Step> steps;
+  Step start = { 0.0, 0.3, 0.0, false };
+  Step stop = { 1.5, 0.0, 0.0, false };
+  steps.push_back(start);
+  steps.push_back(stop);
+  replay(steps, 3.0, linear_limits, angular_limits);
+}
+
+TEST(VelocitySmoother, rotateAndStop) {
+  std::vector<Step> steps;
+  Step start = { 0.0, 0.0, 1.5, false };
+  Step stop = { 1.5, 0.0, 0.0, false };
+  steps.push_back(start);
+  steps.push_back(stop);
+  replay(steps, 3.0, linear_limits, angular_limits);
+}
+
+TEST(VelocitySmoother, reversal) {
+  std::vector<Step> steps;
+  Step forwards = { 0.0, 0.3, 1.0, false };
+  Step backwards = { 1.0, -0.3, -1.0, false };
+  steps.push_back(forwards);
+  steps.push_back(backwards);
+  replay(steps, 3.0, linear_limits, angular_limits);
+}
+
+TEST(VelocitySmoother, emergencyStop) {
+  std::vector<Step> steps;
+  Step cruise = { 0.0, 0.5, 0.5, false };
+  Step emergency = { 1.5, 0.0, 0.0, true };
+  steps.push_back(cruise);
+  steps.push_back(emergency);
+  replay(steps, 2.5, linear_limits, angular_limits);
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
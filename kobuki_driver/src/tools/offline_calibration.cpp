@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_driver/src/tools/offline_calibration.cpp
+ *
+ * @brief Fits wheel base, wheel radii and gyro scale to recorded streams.
+ *
+ * Usage: offline_calibration [--jobs n] [--cache dir] [--radius m] log [log...]
+ *
+ * Each log is a replay log written by the driver's record_file option. Logs
+ * are decoded in parallel and grouped by the robot's unique device id (the
+ * handshake's answer is part of every recording). Per robot, the gyro's
+ * rotation over short windows is fitted by least squares to the rotation
+ * the two wheels imply, along with the gyro's rate bias.
+ *
+ * The gyro only fixes the wheel radii relative to the wheel base. Absolute
+ * scale comes from optional ground truth: a "<log>.truth" file next to a
+ * log may give the true net "distance" [m] and/or net "angle" [rad] of that
+ * run (e.g. a taped straight run, or a known number of turns). Distance
+ * truth fixes the wheel base, angle truth the gyro scale; without them the
+ * mean wheel radius is taken as --radius (nominal 0.035m) and the gyro as
+ * exact.
+ *
+ * With --cache, each robot's fit is merged into its device cache entry,
+ * which the driver applies the next time it meets the robot.
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <ecl/math.hpp>
+#include <ecl/geometry/angle.hpp>
+#include <ecl/threads/mutex.hpp>
+#include <ecl/threads/thread.hpp>
+#include "../../include/kobuki_driver/kobuki.hpp"
+#include "../../include/kobuki_driver/packets.hpp"
+#include "../../include/kobuki_driver/packet_handler/payload_headers.hpp"
+#include "../../include/kobuki_driver/modules/battery.hpp"
+#include "../../include/kobuki_driver/modules/device_cache.hpp"
+#include "../../include/kobuki_driver/modules/diff_drive.hpp"
+
+/*****************************************************************************
+** Log Summaries
+*****************************************************************************/
+
+/**
+ * Least squares normal equations for dpsi = p * dR - q * dL + bias * dt,
+ * where dpsi is the gyro's rotation over a window and dL, dR the wheels'
+ * rotations [rad]; p and q are the wheel radii over the wheel base.
+ */
+struct NormalEquations {
+  NormalEquations() : yty(0.0), rows(0) {
+    std::memset(ata, 0, sizeof(ata));
+    std::memset(aty, 0, sizeof(aty));
+  }
+  void add(const double &left, const double &right, const double &dt, const double &gyro) {
+    double a[3] = { right, -left, dt };
+    for ( unsigned int i = 0; i < 3; ++i ) {
+      for ( unsigned int j = 0; j < 3; ++j ) {
+        ata[i][j] += a[i] * a[j];
+      }
+      aty[i] += a[i] * gyro;
+    }
+    yty += gyro * gyro;
+    ++rows;
+  }
+  void add(const NormalEquations &other) {
+    for ( unsigned int i = 0; i < 3; ++i ) {
+      for ( unsigned int j = 0; j < 3; ++j ) {
+        ata[i][j] += other.ata[i][j];
+      }
+      aty[i] += other.aty[i];
+    }
+    yty += other.yty;
+    rows += other.rows;
+  }
+  bool solve(double x[3]) const;
+  double residual(const double x[3]) const;
+
+  double ata[3][3], aty[3], yty;
+  unsigned long rows;
+};
+
+/**
+ * Gaussian elimination with partial pivoting, false if (nearly) singular,
+ * i.e. the logs lack rotations on the spot or in both directions.
+ */
+bool NormalEquations::solve(double x[3]) const {
+  double m[3][4];
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    for ( unsigned int j = 0; j < 3; ++j ) {
+      m[i][j] = ata[i][j];
+    }
+    m[i][3] = aty[i];
+  }
+  double scale = std::max(m[0][0], m[1][1]);
+  for ( unsigned int c = 0; c < 3; ++c ) {
+    unsigned int pivot = c;
+    for ( unsigned int r = c + 1; r < 3; ++r ) {
+      if ( std::fabs(m[r][c]) > std::fabs(m[pivot][c]) ) {
+        pivot = r;
+      }
+    }
+    if ( std::fabs(m[pivot][c]) <= 1e-9 * ( scale > 0.0 ? scale : 1.0 ) ) {
+      return false;
+    }
+    for ( unsigned int j = 0; j < 4; ++j ) {
+      std::swap(m[c][j], m[pivot][j]);
+    }
+    for ( unsigned int r = 0; r < 3; ++r ) {
+      if ( r != c ) {
+        double factor = m[r][c] / m[c][c];
+        for ( unsigned int j = c; j < 4; ++j ) {
+          m[r][j] -= factor * m[c][j];
+        }
+      }
+    }
+  }
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    x[i] = m[i][3] / m[i][i];
+  }
+  return true;
+}
+
+/**
+ * Root mean square residual [rad] per window of a solution.
+ */
+double NormalEquations::residual(const double x[3]) const {
+  if ( rows == 0 ) {
+    return 0.0;
+  }
+  double squares = yty;
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    squares -= 2.0 * x[i] * aty[i];
+    for ( unsigned int j = 0; j < 3; ++j ) {
+      squares += x[i] * ata[i][j] * x[j];
+    }
+  }
+  return std::sqrt(std::max(squares, 0.0) / static_cast<double>(rows));
+}
+
+/**
+ * What a single log contributes.
+ */
+struct LogSummary {
+  LogSummary() :
+    decoded(false), identified(false), firmware(0), hardware(0), udid0(0), udid1(0), udid2(0),
+    frames(0), duration(0.0), left(0.0), right(0.0), gyro(0.0),
+    has_distance(false), has_angle(false), distance(0.0), angle(0.0) {}
+
+  std::string path;
+  bool decoded;
+  std::string error;
+  bool identified;
+  uint32_t firmware, hardware, udid0, udid1, udid2;
+  unsigned long frames;
+  double duration;        // [s] of firmware time
+  NormalEquations equations;
+  double left, right;     // [rad] net wheel rotations
+  double gyro;            // [rad] net raw gyro rotation, unwrapped
+  bool has_distance, has_angle;
+  double distance, angle; // ground truth [m], [rad]
+};
+
+/*****************************************************************************
+** Decoding
+*****************************************************************************/
+
+namespace {
+
+const unsigned int window_frames = 10;    // frames (0.2s) per observation, smoothing encoder quantisation
+const double maximum_frame_gap = 0.1;     // [s], a longer silence restarts the window (e.g. a reconnection)
+
+/**
+ * Read the ground truth, if any, from "<log>.truth".
+ */
+void readTruth(LogSummary &summary) {
+  std::ifstream file((summary.path + ".truth").c_str());
+  std::string field;
+  while ( file >> field ) {
+    if ( field == "distance" ) {
+      summary.has_distance = static_cast<bool>(file >> summary.distance);
+    } else if ( field == "angle" ) {
+      summary.has_angle = static_cast<bool>(file >> summary.angle);
+    } else {
+      std::getline(file, field);
+    }
+  }
+}
+
+/**
+ * Concatenate the bytes of every chunk in a replay log.
+ */
+bool readLog(const std::string &path, std::vector<unsigned char> &bytes, std::string &error) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if ( file == NULL ) {
+    error = std::string("could not open: ") + std::strerror(errno);
+    return false;
+  }
+  double time;
+  uint32_t length;
+  while ( ( std::fread(&time, sizeof(time), 1, file) == 1 ) &&
+          ( std::fread(&length, sizeof(length), 1, file) == 1 ) ) {
+    std::size_t offset = bytes.size();
+    bytes.resize(offset + length);
+    if ( length && ( std::fread(&bytes[offset], 1, length, file) != length ) ) {
+      bytes.resize(offset); // truncated by a crash, keep what came before
+      break;
+    }
+  }
+  std::fclose(file);
+  if ( bytes.empty() ) {
+    error = "no data.";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Frame and decode a log with the driver's own packet finder and packets.
+ */
+void decode(LogSummary &summary, const double &tick_to_rad) {
+  readTruth(summary);
+  std::vector<unsigned char> bytes;
+  if ( !readLog(summary.path, bytes, summary.error) ) {
+    return;
+  }
+  kobuki::PacketFinder packet_finder;
+  ecl::PushAndPop<unsigned char> stx(2, 0);
+  ecl::PushAndPop<unsigned char> etx(1);
+  stx.push_back(0xaa);
+  stx.push_back(0x55);
+  packet_finder.configure("/offline_calibration", stx, etx, 1, 256, 1, true);
+  kobuki::PacketFinder::BufferType buffer;
+  kobuki::CoreSensors core_sensors;
+  kobuki::Inertia inertia;
+  kobuki::Hardware hardware;
+  kobuki::Firmware firmware;
+  kobuki::UniqueDeviceID unique_device_id;
+
+  bool started = false;
+  uint16_t last_time_stamp = 0, last_left = 0, last_right = 0;
+  double last_angle = 0.0;
+  double window_left = 0.0, window_right = 0.0, window_gyro = 0.0, window_time = 0.0;
+  unsigned int window_count = 0;
+
+  std::size_t offset = 0;
+  while ( true ) {
+    unsigned int n = packet_finder.numberOfDataToRead();
+    if ( offset + n > bytes.size() ) {
+      break;
+    }
+    bool found = packet_finder.update(&bytes[offset], n);
+    offset += n;
+    if ( !found ) {
+      continue;
+    }
+    packet_finder.getBuffer(buffer);
+    buffer.pop_front(); // stx
+    buffer.pop_front();
+    buffer.pop_front(); // length
+    bool has_core_sensors = false, has_inertia = false;
+    while ( buffer.size() > 1 /* etx */ ) {
+      switch ( buffer[0] ) {
+        case kobuki::Header::CoreSensors: has_core_sensors = core_sensors.deserialise(buffer); break;
+        case kobuki::Header::Inertia: has_inertia = inertia.deserialise(buffer); break;
+        case kobuki::Header::Hardware: hardware.deserialise(buffer); summary.hardware = hardware.data.version; break;
+        case kobuki::Header::Firmware: firmware.deserialise(buffer); summary.firmware = firmware.data.version; break;
+        case kobuki::Header::UniqueDeviceID:
+          unique_device_id.deserialise(buffer);
+          summary.identified = true;
+          summary.udid0 = unique_device_id.data.udid0;
+          summary.udid1 = unique_device_id.data.udid1;
+          summary.udid2 = unique_device_id.data.udid2;
+          break;
+        default: {
+          if ( buffer.size() < 3 ) {
+            buffer.clear();
+            break;
+          }
+          buffer.pop_front(); // header id
+          unsigned int length = buffer.pop_front();
+          for ( unsigned int i = 0; ( i < length ) && ( buffer.size() > 1 ); ++i ) {
+            buffer.pop_front();
+          }
+          break;
+        }
+      }
+    }
+    if ( !has_core_sensors || !has_inertia ) {
+      continue;
+    }
+    ++summary.frames;
+    // raw data angles are in hundredths of a degree, convert to radians.
+    double angle = ( static_cast<double>(inertia.data.angle) / 100.0 ) * ecl::pi / 180.0;
+    const kobuki::CoreSensors::Data &data = core_sensors.data;
+    if ( started ) {
+      double dt = static_cast<double>(static_cast<uint16_t>(data.time_stamp - last_time_stamp)) / 1000.0;
+      if ( dt > maximum_frame_gap ) {
+        window_left = window_right = window_gyro = window_time = 0.0;
+        window_count = 0;
+      } else {
+        double left = tick_to_rad * static_cast<int16_t>(static_cast<uint16_t>(data.left_encoder - last_left));
+        double right = tick_to_rad * static_cast<int16_t>(static_cast<uint16_t>(data.right_encoder - last_right));
+        double gyro = ecl::wrap_angle(angle - last_angle);
+        summary.duration += dt;
+        summary.left += left;
+        summary.right += right;
+        summary.gyro += gyro;
+        window_left += left;
+        window_right += right;
+        window_gyro += gyro;
+        window_time += dt;
+        if ( ++window_count == window_frames ) {
+          // standing still says nothing about the wheels, and the gyro bias is better left to the driver then
+          if ( ( window_left != 0.0 ) || ( window_right != 0.0 ) ) {
+            summary.equations.add(window_left, window_right, window_time, window_gyro);
+          }
+          window_left = window_right = window_gyro = window_time = 0.0;
+          window_count = 0;
+        }
+      }
+    }
+    started = true;
+    last_time_stamp = data.time_stamp;
+    last_left = data.left_encoder;
+    last_right = data.right_encoder;
+    last_angle = angle;
+  }
+  summary.decoded = true;
+}
+
+} // anonymous namespace
+
+/*****************************************************************************
+** Workers
+*****************************************************************************/
+
+/**
+ * Decodes logs off a shared list until none are left.
+ */
+class Worker {
+public:
+  Worker(std::vector<LogSummary> &summaries, unsigned int &next, ecl::Mutex &mutex, const double &tick_to_rad) :
+    summaries(summaries), next(next), mutex(mutex), tick_to_rad(tick_to_rad) {}
+
+  void run() {
+    while ( true ) {
+      mutex.lock();
+      unsigned int index = next++;
+      mutex.unlock();
+      if ( index >= summaries.size() ) {
+        return;
+      }
+      decode(summaries[index], tick_to_rad);
+    }
+  }
+
+private:
+  std::vector<LogSummary> &summaries;
+  unsigned int &next;
+  ecl::Mutex &mutex;
+  double tick_to_rad;
+};
+
+/*****************************************************************************
+** Fit
+*****************************************************************************/
+
+/**
+ * Fit a robot's calibration from all its logs and print it.
+ *
+ * @return bool : false if the logs do not constrain the fit.
+ */
+bool fit(const std::vector<const LogSummary*> &logs, const double &nominal_radius, kobuki::DeviceCache::Entry &entry) {
+  NormalEquations equations;
+  double frames = 0.0, duration = 0.0;
+  for ( unsigned int i = 0; i < logs.size(); ++i ) {
+    equations.add(logs[i]->equations);
+    frames += logs[i]->frames;
+    duration += logs[i]->duration;
+  }
+  std::printf("  %u logs, %.0f frames, %.1f minutes, %lu moving windows\n",
+              static_cast<unsigned int>(logs.size()), frames, duration / 60.0, equations.rows);
+  double x[3];
+  if ( ( equations.rows < 3 ) || !equations.solve(x) || ( x[0] <= 0.0 ) || ( x[1] <= 0.0 ) ) {
+    std::printf("  cannot fit, the logs need turns in both directions.\n");
+    return false;
+  }
+  double p = x[0], q = x[1], bias = x[2];
+
+  // gyro scale from the runs with a known net rotation
+  double gyro_scale = 1.0;
+  double angle_products = 0.0, angle_squares = 0.0;
+  for ( unsigned int i = 0; i < logs.size(); ++i ) {
+    if ( logs[i]->has_angle ) {
+      double measured = logs[i]->gyro - bias * logs[i]->duration;
+      angle_products += logs[i]->angle * measured;
+      angle_squares += measured * measured;
+    }
+  }
+  if ( angle_squares > 0.0 ) {
+    gyro_scale = angle_products / angle_squares;
+  }
+  p *= gyro_scale;
+  q *= gyro_scale;
+
+  // wheel base from the runs with a known net distance, else from the nominal mean radius
+  double wheel_bias = 2.0 * nominal_radius / ( p + q );
+  double distance_products = 0.0, distance_squares = 0.0;
+  for ( unsigned int i = 0; i < logs.size(); ++i ) {
+    if ( logs[i]->has_distance ) {
+      double k = ( q * logs[i]->left + p * logs[i]->right ) / 2.0; // distance per metre of wheel base
+      distance_products += logs[i]->distance * k;
+      distance_squares += k * k;
+    }
+  }
+  if ( distance_squares > 0.0 ) {
+    wheel_bias = distance_products / distance_squares;
+  }
+  entry.wheel_bias = wheel_bias;
+  entry.wheel_radius_left = q * wheel_bias;
+  entry.wheel_radius_right = p * wheel_bias;
+  entry.gyro_scale = gyro_scale;
+
+  std::printf("  wheel base   %.5f m%s\n", entry.wheel_bias, distance_squares > 0.0 ? "" : " (from the nominal radius)");
+  std::printf("  wheel radii  %.5f m left, %.5f m right\n", entry.wheel_radius_left, entry.wheel_radius_right);
+  std::printf("  gyro scale   %.5f%s\n", entry.gyro_scale, angle_squares > 0.0 ? "" : " (assumed)");
+  std::printf("  gyro bias    %.6f rad/s\n", bias);
+  std::printf("  residual     %.5f rad per window\n", equations.residual(x));
+  return true;
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+void usage() {
+  std::printf("Usage: offline_calibration [--jobs n] [--cache dir] [--radius m] log [log...]\n");
+  std::printf("  --jobs n    : logs decoded in parallel (default: 4)\n");
+  std::printf("  --cache dir : merge each robot's fit into its device cache entry here\n");
+  std::printf("  --radius m  : mean wheel radius when no log has distance truth (default: 0.035)\n");
+}
+
+int main(int argc, char **argv) {
+  unsigned int jobs = 4;
+  double nominal_radius = 0.035;
+  std::string cache_directory;
+  std::vector<LogSummary> summaries;
+  for ( int i = 1; i < argc; ++i ) {
+    std::string argument(argv[i]);
+    if ( ( argument == "--jobs" ) && ( i + 1 < argc ) ) {
+      jobs = std::max(1, std::atoi(argv[++i]));
+    } else if ( ( argument == "--cache" ) && ( i + 1 < argc ) ) {
+      cache_directory = argv[++i];
+    } else if ( ( argument == "--radius" ) && ( i + 1 < argc ) ) {
+      nominal_radius = std::atof(argv[++i]);
+    } else if ( argument.compare(0, 2, "--") == 0 ) {
+      usage();
+      return 1;
+    } else {
+      summaries.push_back(LogSummary());
+      summaries.back().path = argument;
+    }
+  }
+  if ( summaries.empty() || ( nominal_radius <= 0.0 ) ) {
+    usage();
+    return 1;
+  }
+  kobuki::DeviceCache cache;
+  cache.init(cache_directory);
+  double default_tick_to_rad = kobuki::DiffDrive().encoder_resolution();
+
+  /*********************
+  ** Decode
+  **********************/
+  unsigned int next = 0;
+  ecl::Mutex mutex;
+  std::vector<boost::shared_ptr<Worker> > workers;
+  std::vector<boost::shared_ptr<ecl::Thread> > threads;
+  for ( unsigned int i = 0; i < std::min(jobs, static_cast<unsigned int>(summaries.size())); ++i ) {
+    workers.push_back(boost::shared_ptr<Worker>(new Worker(summaries, next, mutex, default_tick_to_rad)));
+    threads.push_back(boost::shared_ptr<ecl::Thread>(new ecl::Thread()));
+    threads.back()->start(&Worker::run, *workers.back());
+  }
+  for ( unsigned int i = 0; i < threads.size(); ++i ) {
+    threads[i]->join();
+  }
+
+  /*********************
+  ** Group by Robot
+  **********************/
+  std::map<std::string, std::vector<const LogSummary*> > robots;
+  for ( unsigned int i = 0; i < summaries.size(); ++i ) {
+    const LogSummary &summary = summaries[i];
+    if ( !summary.decoded ) {
+      std::printf("%s : skipped, %s\n", summary.path.c_str(), summary.error.c_str());
+    } else if ( !summary.identified ) {
+      std::printf("%s : skipped, no unique device id (record from before the handshake).\n", summary.path.c_str());
+    } else {
+      robots[kobuki::DeviceCache::key(summary.udid0, summary.udid1, summary.udid2)].push_back(&summary);
+    }
+  }
+
+  /*********************
+  ** Fit
+  **********************/
+  bool ok = !robots.empty();
+  for ( std::map<std::string, std::vector<const LogSummary*> >::const_iterator robot = robots.begin();
+        robot != robots.end(); ++robot ) {
+    const LogSummary &first = *robot->second.front();
+    std::printf("[%s]\n", robot->first.c_str());
+    // start from what the driver already knows, so the cache keeps its gyro bias, battery...
+    kobuki::DeviceCache::Entry entry;
+    if ( !cache.load(first.udid0, first.udid1, first.udid2, entry) ) {
+      entry.tick_to_rad = default_tick_to_rad;
+      entry.battery_capacity = kobuki::Battery::capacity;
+    }
+    entry.udid0 = first.udid0;
+    entry.udid1 = first.udid1;
+    entry.udid2 = first.udid2;
+    for ( unsigned int i = 0; i < robot->second.size(); ++i ) {
+      if ( robot->second[i]->firmware ) { entry.firmware = robot->second[i]->firmware; }
+      if ( robot->second[i]->hardware ) { entry.hardware = robot->second[i]->hardware; }
+    }
+    if ( !fit(robot->second, nominal_radius, entry) ) {
+      ok = false;
+      continue;
+    }
+    if ( cache.isEnabled() ) {
+      if ( cache.store(entry) ) {
+        std::printf("  written to %s/%s\n", cache_directory.c_str(), robot->first.c_str());
+      } else {
+        std::printf("  could not write the device cache in %s\n", cache_directory.c_str());
+        ok = false;
+      }
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -43,9 +43,17 @@
 ** Includes
 *****************************************************************************/
 
+#include <algorithm>
+#include <vector>
 #include <kobuki_driver/packets/cliff.hpp>
 #include <kobuki_driver/modules/battery.hpp>
 #include <kobuki_driver/packets/core_sensors.hpp>
+#include <kobuki_driver/modules/command_scheduler.hpp>
+#include <kobuki_driver/modules/link_statistics.hpp>
+#include <kobuki_driver/modules/connection_state.hpp>
+#include <kobuki_driver/modules/frame_queue.hpp>
+#include <kobuki_driver/modules/safety_reflex.hpp>
+#include <kobuki_driver/modules/velocity_mux.hpp>
 #include <diagnostic_updater/diagnostic_updater.h>
 
 /*****************************************************************************
@@ -181,6 +189,121 @@ private:
   std::vector<uint16_t> values;
 };
 
+/**
+ * Diagnostic reporting the delay from the firmware stamping a frame to its
+ * sensor events being published.
+ */
+class EventLatencyTask : public diagnostic_updater::DiagnosticTask {
+public:
+  EventLatencyTask() : DiagnosticTask("Event Latency"), count(0), last(0.0), total(0.0), maximum(0.0) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const double &latency) {
+    last = latency; total += latency; maximum = std::max(maximum, latency); ++count;
+  }
+
+private:
+  unsigned int count; // since the last run
+  double last, total, maximum;
+};
+
+/**
+ * Diagnostic reporting the delay between sending a velocity command and the
+ * wheel encoders first responding to it.
+ */
+class CommandLatencyTask : public diagnostic_updater::DiagnosticTask {
+public:
+  CommandLatencyTask() : DiagnosticTask("Command Latency") {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const CommandScheduler::Latency &new_values) { values = new_values; }
+
+private:
+  CommandScheduler::Latency values;
+};
+
+/**
+ * Diagnostic reporting the serial link bandwidth, and how much of it
+ * change driven base control transmission saves.
+ */
+class SerialLinkTask : public diagnostic_updater::DiagnosticTask {
+public:
+  SerialLinkTask() : DiagnosticTask("Serial Link") {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const LinkStatistics &new_values) { values = new_values; }
+
+private:
+  LinkStatistics values, last_values;
+  ros::Time last_time;
+};
+
+/**
+ * Diagnostic reporting the connection life cycle and version handshake.
+ */
+class ConnectionTask : public diagnostic_updater::DiagnosticTask {
+public:
+  ConnectionTask() : DiagnosticTask("Connection"), state(ConnectionState::Disconnected) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const ConnectionState::State &new_state, const ConnectionState::Metrics &new_metrics) {
+    state = new_state; metrics = new_metrics;
+  }
+
+private:
+  ConnectionState::State state;
+  ConnectionState::Metrics metrics;
+};
+
+/**
+ * Diagnostic reporting the I/O to processing thread frame queue.
+ */
+class PipelineTask : public diagnostic_updater::DiagnosticTask {
+public:
+  PipelineTask() : DiagnosticTask("Pipeline"), enabled(false), last_overruns(0) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const bool &is_enabled, const FrameQueue::Statistics &new_values) {
+    enabled = is_enabled; values = new_values;
+  }
+
+private:
+  bool enabled;
+  FrameQueue::Statistics values;
+  unsigned long last_overruns;
+};
+
+/**
+ * Diagnostic reporting the in-driver safety reflex and the delay from a
+ * hazard's frame to the overriding command leaving the host.
+ */
+class SafetyReflexTask : public diagnostic_updater::DiagnosticTask {
+public:
+  SafetyReflexTask() : DiagnosticTask("Safety Reflex"), enabled(false), state(SafetyReflex::Idle) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const bool &is_enabled, const SafetyReflex::State &new_state, const SafetyReflex::Reaction &new_values) {
+    enabled = is_enabled; state = new_state; values = new_values;
+  }
+
+private:
+  bool enabled;
+  SafetyReflex::State state;
+  SafetyReflex::Reaction values;
+};
+
+/**
+ * Diagnostic reporting the built-in velocity multiplexer's inputs and
+ * which of them is in control.
+ */
+class VelocityMuxTask : public diagnostic_updater::DiagnosticTask {
+public:
+  VelocityMuxTask() : DiagnosticTask("Velocity Mux"), selected(-1), now(0.0) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const std::vector<VelocityMux::Input> &new_inputs, const int &new_selected, const double &time) {
+    inputs = new_inputs; selected = new_selected; now = time;
+  }
+
+private:
+  std::vector<VelocityMux::Input> inputs;
+  int selected;
+  double now; // host [s]
+};
+
 } // namespace kobuki
 
 #endif /* KOBUKI_NODE_DIAGNOSTICS_HPP_ */
@@ -46,11 +46,13 @@
  *****************************************************************************/
 
 #include <string>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 
 #include <ros/ros.h>
 #include <pcl/point_types.h>
 #include <pcl_ros/point_cloud.h>
+#include <std_msgs/Bool.h>
 #include <std_msgs/Empty.h>
 #include <std_msgs/String.h>
 #include <sensor_msgs/JointState.h>
@@ -72,6 +74,13 @@
 #include <kobuki_msgs/VersionInfo.h>
 #include <kobuki_msgs/WheelDropEvent.h>
 #include <kobuki_driver/kobuki.hpp>
+#ifdef KOBUKI_AUTO_DOCKING
+#include <auto_docking/auto_docking_plugin.hpp>
+#endif
+#include <kobuki_node/DockBearing.h>
+#include <kobuki_node/MotionPrimitive.h>
+#include <kobuki_node/MotionPrimitiveResult.h>
+#include <kobuki_node/VelocityTrajectory.h>
 #include "diagnostics.hpp"
 #include "odometry.hpp"
 
@@ -108,22 +117,46 @@ private:
    **********************/
   ros::Publisher version_info_publisher;
   ros::Publisher imu_data_publisher, sensor_state_publisher, joint_state_publisher, dock_ir_publisher;
+  ros::Publisher dock_bearing_publisher;
   ros::Publisher button_event_publisher, input_event_publisher, robot_event_publisher;
   ros::Publisher bumper_event_publisher, cliff_event_publisher, wheel_event_publisher, power_event_publisher;
   ros::Publisher raw_data_command_publisher, raw_data_stream_publisher;
   ros::Publisher bumper_as_pc_publisher;
+  ros::Publisher velocity_mux_publisher;
+  ros::Publisher motion_result_publisher;
+  ros::Publisher auto_docking_publisher;
 
   ros::Subscriber velocity_command_subscriber, digital_output_command_subscriber, external_power_command_subscriber;
   ros::Subscriber led1_command_subscriber, led2_command_subscriber, sound_command_subscriber;
   ros::Subscriber motor_power_subscriber, reset_odometry_subscriber;
+  ros::Subscriber velocity_trajectory_subscriber, motion_subscriber, auto_docking_subscriber;
+  std::vector<ros::Subscriber> velocity_input_subscribers;
+  int velocity_command_input; // commands/velocity as a multiplexed input, -1 if not multiplexing
+  int active_velocity_input;  // as last published on velocity_mux/active, -2 before the first
+#ifdef KOBUKI_AUTO_DOCKING
+  boost::shared_ptr<AutoDockingPlugin> auto_docking; // null unless hosted
+#endif
+  int auto_docking_state;     // as last published on events/auto_docking, -1 before the first
 
   void advertiseTopics(ros::NodeHandle& nh);
   void subscribeTopics(ros::NodeHandle& nh);
+  bool configureVelocityMux(ros::NodeHandle& nh);
+  void publishActiveVelocityInput();
+  bool configureAutoDocking(ros::NodeHandle& nh);
+#ifdef KOBUKI_AUTO_DOCKING
+  void publishAutoDockingState();
+#endif
 
   /*********************
   ** Ros Callbacks
   **********************/
   void subscribeVelocityCommand(const geometry_msgs::TwistConstPtr);
+  void subscribeVelocityInput(const geometry_msgs::TwistConstPtr, const int input);
+  void subscribeVelocityTrajectory(const kobuki_node::VelocityTrajectoryConstPtr);
+  void subscribeMotion(const kobuki_node::MotionPrimitiveConstPtr);
+#ifdef KOBUKI_AUTO_DOCKING
+  void subscribeAutoDocking(const std_msgs::BoolConstPtr);
+#endif
   void subscribeLed1Command(const kobuki_msgs::LedConstPtr);
   void subscribeLed2Command(const kobuki_msgs::LedConstPtr);
   void subscribeDigitalOutputCommand(const kobuki_msgs::DigitalOutputConstPtr);
@@ -137,13 +170,11 @@ private:
    **********************/
   ecl::Slot<const VersionInfo&> slot_version_info;
   ecl::Slot<> slot_stream_data;
-  ecl::Slot<const ButtonEvent&> slot_button_event;
-  ecl::Slot<const BumperEvent&> slot_bumper_event;
-  ecl::Slot<const CliffEvent&>  slot_cliff_event;
-  ecl::Slot<const WheelEvent&>  slot_wheel_event;
-  ecl::Slot<const PowerEvent&>  slot_power_event;
+  ecl::Slot<> slot_ready;
+  ecl::Slot<const EventBatch&> slot_event_batch;
   ecl::Slot<const InputEvent&>  slot_input_event;
   ecl::Slot<const RobotEvent&>  slot_robot_event;
+  ecl::Slot<const MotionPrimitive::Result&> slot_motion_result;
   ecl::Slot<const std::string&> slot_debug, slot_info, slot_warn, slot_error;
   ecl::Slot<Command::Buffer&> slot_raw_data_command;
   ecl::Slot<PacketFinder::BufferType&> slot_raw_data_stream;
@@ -156,7 +187,9 @@ private:
   void publishInertia();
   void publishSensorState();
   void publishDockIRData();
+  void publishDockBearing();
   void publishVersionInfo(const VersionInfo &version_info);
+  void publishEventBatch(const EventBatch &batch);
   void publishButtonEvent(const ButtonEvent &event);
   void publishBumperEvent(const BumperEvent &event);
   void publishCliffEvent(const CliffEvent &event);
@@ -164,6 +197,7 @@ private:
   void publishPowerEvent(const PowerEvent &event);
   void publishInputEvent(const InputEvent &event);
   void publishRobotEvent(const RobotEvent &event);
+  void publishMotionResult(const MotionPrimitive::Result &result);
 
 
   // debugging
@@ -171,6 +205,7 @@ private:
   void rosInfo(const std::string &msg) { ROS_INFO_STREAM("Kobuki : " << msg); }
   void rosWarn(const std::string &msg) { ROS_WARN_STREAM("Kobuki : " << msg); }
   void rosError(const std::string &msg) { ROS_ERROR_STREAM("Kobuki : " << msg); }
+  void streamReady() { ROS_INFO_STREAM("Kobuki : data stream is up [" << name << "]."); }
 
   std::vector<PacketFinder::BufferType> command_buffer_stack, stream_buffer_stack;
   void publishRawDataCommand(Command::Buffer &buffer);
@@ -189,6 +224,13 @@ private:
   GyroSensorTask     gyro_diagnostics;
   DigitalInputTask dinput_diagnostics;
   AnalogInputTask  ainput_diagnostics;
+  CommandLatencyTask latency_diagnostics;
+  EventLatencyTask   event_latency_diagnostics;
+  SerialLinkTask     link_diagnostics;
+  ConnectionTask     connection_diagnostics;
+  PipelineTask       pipeline_diagnostics;
+  SafetyReflexTask   reflex_diagnostics;
+  VelocityMuxTask    mux_diagnostics;
 };
 
 } // namespace kobuki
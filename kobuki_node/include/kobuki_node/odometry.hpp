@@ -42,7 +42,9 @@ public:
   Odometry();
   void init(ros::NodeHandle& nh, const std::string& name);
   bool commandTimeout() const;
-  void update(const ecl::Pose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates);
+  void update(const ecl::Pose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates,
+              const ecl::linear_algebra::Matrix3d &pose_covariance,
+              const ecl::linear_algebra::Vector3d &twist_variance, const ros::Time &stamp);
   void resetOdometry() { pose.setIdentity(); }
   const ros::Duration& timeout() const { return cmd_vel_timeout; }
   void resetTimeout() { last_cmd_time = ros::Time::now(); }
@@ -58,8 +60,10 @@ private:
   tf::TransformBroadcaster odom_broadcaster;
   ros::Publisher odom_publisher;
 
-  void publishTransform(const geometry_msgs::Quaternion &odom_quat);
-  void publishOdometry(const geometry_msgs::Quaternion &odom_quat, const ecl::linear_algebra::Vector3d &pose_update_rates);
+  void publishTransform(const geometry_msgs::Quaternion &odom_quat, const ros::Time &stamp);
+  void publishOdometry(const geometry_msgs::Quaternion &odom_quat, const ecl::linear_algebra::Vector3d &pose_update_rates,
+                       const ecl::linear_algebra::Matrix3d &pose_covariance,
+                       const ecl::linear_algebra::Vector3d &twist_variance, const ros::Time &stamp);
 };
 
 } // namespace kobuki
@@ -178,4 +178,147 @@ void AnalogInputTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
                 values[0], values[1], values[2], values[3]);
 }
 
+void EventLatencyTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( count == 0 ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "No events since the last update");
+    return;
+  }
+  stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Latency: %.1f ms", 1000.0*last);
+  stat.add("Events", count);
+  stat.addf("Mean (ms)",    "%.1f", 1000.0*total/count);
+  stat.addf("Maximum (ms)", "%.1f", 1000.0*maximum);
+  count = 0;
+  total = maximum = 0.0;
+}
+
+void CommandLatencyTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( values.count == 0 ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "No measurements yet");
+    return;
+  }
+  stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Latency: %.1f ms", 1000.0*values.last);
+  stat.add("Measurements", values.count);
+  stat.addf("Mean (ms)",    "%.1f", 1000.0*values.mean);
+  stat.addf("Minimum (ms)", "%.1f", 1000.0*values.minimum);
+  stat.addf("Maximum (ms)", "%.1f", 1000.0*values.maximum);
+}
+
+void SerialLinkTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  ros::Time now = ros::Time::now();
+  double elapsed = last_time.isZero() ? 0.0 : (now - last_time).toSec();
+  if ( elapsed > 0.0 ) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Tx: %.0f B/s  Rx: %.0f B/s",
+                  (values.bytes_sent - last_values.bytes_sent) / elapsed,
+                  (values.bytes_received - last_values.bytes_received) / elapsed);
+  } else {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Measuring");
+  }
+  unsigned long base_control_total = values.base_control_sent + values.base_control_skipped;
+  stat.add("Bytes Sent", values.bytes_sent);
+  stat.add("Bytes Received", values.bytes_received);
+  stat.add("Packets Sent", values.packets_sent);
+  stat.add("Base Control Sent", values.base_control_sent);
+  stat.add("Base Control Skipped", values.base_control_skipped);
+  stat.add("Bytes Saved", values.base_control_bytes_saved);
+  stat.addf("Base Control Saving (%)", "%.1f",
+            base_control_total ? (100.0*values.base_control_skipped)/base_control_total : 0.0);
+  last_values = values;
+  last_time = now;
+}
+
+void ConnectionTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  switch ( state ) {
+    case ( ConnectionState::Streaming ) : {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, ConnectionState::toString(state));
+      break;
+    }
+    case ( ConnectionState::Degraded ) : {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, ConnectionState::toString(state));
+      break;
+    }
+    case ( ConnectionState::Disconnected ) : {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, ConnectionState::toString(state));
+      break;
+    }
+    default : {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, ConnectionState::toString(state));
+      break;
+    }
+  }
+  stat.add("Handshakes", metrics.handshakes);
+  stat.add("Handshake Failures", metrics.failures);
+  stat.add("Attempts (last)", metrics.attempts);
+  stat.add("Attempts (total)", metrics.total_attempts);
+  stat.add("Stream Stalls", metrics.stalls);
+  stat.addf("Handshake Duration (ms)", "%.1f", 1000.0*metrics.last_duration);
+}
+
+void PipelineTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( !enabled ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Disabled, frames are processed on the worker thread");
+    return;
+  }
+  if ( values.overruns > last_overruns ) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Processing fell behind, %lu frames dropped",
+                  values.overruns - last_overruns);
+  } else {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Queueing: %.2f ms  Processing: %.2f ms",
+                  1000.0*values.queueing.mean, 1000.0*values.processing.mean);
+  }
+  stat.add("Frames", values.frames);
+  stat.add("Overruns", values.overruns);
+  stat.add("Queue Depth", values.depth);
+  stat.add("Queue Depth (max)", values.max_depth);
+  stat.addf("Queueing Latency (mean ms)", "%.3f", 1000.0*values.queueing.mean);
+  stat.addf("Queueing Latency (max ms)", "%.3f", 1000.0*values.queueing.maximum);
+  stat.addf("Processing Time (mean ms)", "%.3f", 1000.0*values.processing.mean);
+  stat.addf("Processing Time (max ms)", "%.3f", 1000.0*values.processing.maximum);
+  last_overruns = values.overruns;
+}
+
+void SafetyReflexTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( !enabled ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Disabled");
+    return;
+  }
+  switch ( state ) {
+    case SafetyReflex::Stopped:
+      stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Holding the base still");
+      break;
+    case SafetyReflex::BackingOff:
+      stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Backing off");
+      break;
+    default:
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Standing by");
+      break;
+  }
+  stat.add("Triggers", values.triggers);
+  if ( values.count > 0 ) {
+    stat.addf("Reaction (ms)",      "%.1f", 1000.0*values.last);
+    stat.addf("Reaction (mean ms)", "%.1f", 1000.0*values.mean);
+    stat.addf("Reaction (max ms)",  "%.1f", 1000.0*values.maximum);
+  }
+}
+
+void VelocityMuxTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( inputs.empty() ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Disabled, velocity commands go straight to the driver");
+    return;
+  }
+  if ( ( selected >= 0 ) && ( selected < static_cast<int>(inputs.size()) ) ) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Active: %s", inputs[selected].name.c_str());
+  } else {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Idle, no input is active");
+  }
+  for ( unsigned int i = 0; i < inputs.size(); ++i ) {
+    const VelocityMux::Input &input = inputs[i];
+    if ( input.commands == 0 ) {
+      stat.addf(input.name, "priority %d, never active", input.priority);
+    } else {
+      stat.addf(input.name, "priority %d, %lu commands, last %.2fs ago", input.priority, input.commands,
+                now - input.last_active);
+    }
+  }
+}
+
 } // namespace kobuki
@@ -37,7 +37,11 @@
  *****************************************************************************/
 
 #include <float.h>
+#include <cstdlib>
+#include <limits>
+#include <boost/bind.hpp>
 #include <tf/tf.h>
+#include <ecl/time/timestamp.hpp>
 #include <ecl/streams/string_stream.hpp>
 #include <kobuki_msgs/VersionInfo.h>
 #include "kobuki_node/kobuki_ros.hpp"
@@ -60,15 +64,14 @@ namespace kobuki
  */
 KobukiRos::KobukiRos(std::string& node_name) :
     name(node_name), cmd_vel_timed_out_(false), serial_timed_out_(false),
+    velocity_command_input(-1), active_velocity_input(-2), auto_docking_state(-1),
     slot_version_info(&KobukiRos::publishVersionInfo, *this),
     slot_stream_data(&KobukiRos::processStreamData, *this),
-    slot_button_event(&KobukiRos::publishButtonEvent, *this),
-    slot_bumper_event(&KobukiRos::publishBumperEvent, *this),
-    slot_cliff_event(&KobukiRos::publishCliffEvent, *this),
-    slot_wheel_event(&KobukiRos::publishWheelEvent, *this),
-    slot_power_event(&KobukiRos::publishPowerEvent, *this),
+    slot_ready(&KobukiRos::streamReady, *this),
+    slot_event_batch(&KobukiRos::publishEventBatch, *this),
     slot_input_event(&KobukiRos::publishInputEvent, *this),
     slot_robot_event(&KobukiRos::publishRobotEvent, *this),
+    slot_motion_result(&KobukiRos::publishMotionResult, *this),
     slot_debug(&KobukiRos::rosDebug, *this),
     slot_info(&KobukiRos::rosInfo, *this),
     slot_warn(&KobukiRos::rosWarn, *this),
@@ -86,6 +89,13 @@ KobukiRos::KobukiRos(std::string& node_name) :
   updater.add(gyro_diagnostics);
   updater.add(dinput_diagnostics);
   updater.add(ainput_diagnostics);
+  updater.add(latency_diagnostics);
+  updater.add(event_latency_diagnostics);
+  updater.add(link_diagnostics);
+  updater.add(connection_diagnostics);
+  updater.add(pipeline_diagnostics);
+  updater.add(reflex_diagnostics);
+  updater.add(mux_diagnostics);
 }
 
 /**
@@ -110,13 +120,11 @@ bool KobukiRos::init(ros::NodeHandle& nh)
    **********************/
   slot_stream_data.connect(name + std::string("/stream_data"));
   slot_version_info.connect(name + std::string("/version_info"));
-  slot_button_event.connect(name + std::string("/button_event"));
-  slot_bumper_event.connect(name + std::string("/bumper_event"));
-  slot_cliff_event.connect(name + std::string("/cliff_event"));
-  slot_wheel_event.connect(name + std::string("/wheel_event"));
-  slot_power_event.connect(name + std::string("/power_event"));
+  slot_ready.connect(name + std::string("/ready"));
+  slot_event_batch.connect(name + std::string("/event_batch"));
   slot_input_event.connect(name + std::string("/input_event"));
   slot_robot_event.connect(name + std::string("/robot_event"));
+  slot_motion_result.connect(name + std::string("/motion_result"));
   slot_debug.connect(name + std::string("/ros_debug"));
   slot_info.connect(name + std::string("/ros_info"));
   slot_warn.connect(name + std::string("/ros_warn"));
@@ -129,10 +137,85 @@ bool KobukiRos::init(ros::NodeHandle& nh)
    **********************/
   Parameters parameters;
 
-  nh.param("gate_keeper", parameters.enable_gate_keeper, false);
+  nh.param("velocity_smoother", parameters.enable_velocity_smoother, false);
+  nh.param("linear_acceleration", parameters.linear_limits.acceleration, parameters.linear_limits.acceleration);
+  nh.param("linear_deceleration", parameters.linear_limits.deceleration, parameters.linear_limits.deceleration);
+  nh.param("linear_emergency_deceleration", parameters.linear_limits.emergency_deceleration,
+           parameters.linear_limits.emergency_deceleration);
+  nh.param("linear_jerk", parameters.linear_limits.jerk, parameters.linear_limits.jerk);
+  nh.param("angular_acceleration", parameters.angular_limits.acceleration, parameters.angular_limits.acceleration);
+  nh.param("angular_deceleration", parameters.angular_limits.deceleration, parameters.angular_limits.deceleration);
+  nh.param("angular_emergency_deceleration", parameters.angular_limits.emergency_deceleration,
+           parameters.angular_limits.emergency_deceleration);
+  nh.param("angular_jerk", parameters.angular_limits.jerk, parameters.angular_limits.jerk);
+  nh.param("command_scheduling", parameters.enable_command_scheduling, false);
+  nh.param("command_lead", parameters.command_lead, 0.005);
+  nh.param("change_driven_commands", parameters.enable_change_driven_commands, false);
+  nh.param("command_keepalive", parameters.command_keepalive, 0.1);
+  nh.param("plugin_priority", parameters.plugin_priority, 0);
+  nh.param("processing_thread", parameters.enable_processing_thread, false);
+  nh.param("frame_queue_size", parameters.frame_queue_size, 16);
+  nh.param("bumper_debounce_frames", parameters.bumper_debounce.frames, 0);
+  nh.param("bumper_debounce_time", parameters.bumper_debounce.time, 0.0);
+  nh.param("cliff_debounce_frames", parameters.cliff_debounce.frames, 0);
+  nh.param("cliff_debounce_time", parameters.cliff_debounce.time, 0.0);
+  nh.param("wheel_drop_debounce_frames", parameters.wheel_drop_debounce.frames, 0);
+  nh.param("wheel_drop_debounce_time", parameters.wheel_drop_debounce.time, 0.0);
+  nh.param("cliff_hysteresis", parameters.cliff_hysteresis.enable, false);
+  nh.param("cliff_threshold", parameters.cliff_hysteresis.cliff_below, 0);
+  nh.param("floor_threshold", parameters.cliff_hysteresis.floor_above, 0);
+  nh.param("safety_reflex", parameters.safety_reflex.enable, false);
+  nh.param("reflex_backoff_speed", parameters.safety_reflex.backoff_speed, parameters.safety_reflex.backoff_speed);
+  nh.param("reflex_backoff_time", parameters.safety_reflex.backoff_time, parameters.safety_reflex.backoff_time);
+  const char *reflex_sensors[] = { "bumper_reflex", "cliff_reflex", "wheel_drop_reflex" };
+  SafetyReflex::Action *reflex_actions[] = { &parameters.safety_reflex.bumper, &parameters.safety_reflex.cliff,
+                                             &parameters.safety_reflex.wheel_drop };
+  for ( unsigned int i = 0; i < 3; ++i ) {
+    std::string action;
+    nh.param(reflex_sensors[i], action, SafetyReflex::toString(*reflex_actions[i]));
+    if ( !SafetyReflex::fromString(action, *reflex_actions[i]) ) {
+      ROS_ERROR_STREAM("Kobuki : " << reflex_sensors[i] << " must be one of ignore, stop or backoff, not '"
+                       << action << "' [" << name << "].");
+      return false;
+    }
+  }
+  nh.param("motion_linear_velocity", parameters.motion_limits.linear_velocity, parameters.motion_limits.linear_velocity);
+  nh.param("motion_angular_velocity", parameters.motion_limits.angular_velocity, parameters.motion_limits.angular_velocity);
+  nh.param("motion_linear_acceleration", parameters.motion_limits.linear_acceleration,
+           parameters.motion_limits.linear_acceleration);
+  nh.param("motion_angular_acceleration", parameters.motion_limits.angular_acceleration,
+           parameters.motion_limits.angular_acceleration);
+  nh.param("motion_distance_tolerance", parameters.motion_limits.distance_tolerance,
+           parameters.motion_limits.distance_tolerance);
+  nh.param("motion_angle_tolerance", parameters.motion_limits.angle_tolerance, parameters.motion_limits.angle_tolerance);
+  nh.param("handshake_attempts", parameters.handshake_attempts, 10);
+  nh.param("handshake_retry_interval", parameters.handshake_retry_interval, 0.2);
+  nh.param("handshake_timeout", parameters.handshake_timeout, 5.0);
+
+  // robots' identity and calibration are remembered under ROS_HOME by default
+  std::string ros_home;
+  if ( std::getenv("ROS_HOME") ) {
+    ros_home = std::getenv("ROS_HOME");
+  } else if ( std::getenv("HOME") ) {
+    ros_home = std::string(std::getenv("HOME")) + "/.ros";
+  }
+  nh.param("device_cache", parameters.cache_directory, ros_home.empty() ? ros_home : ros_home + "/kobuki");
+  nh.param("record_file", parameters.record_file, std::string(""));
   nh.param("battery_capacity", parameters.battery_capacity, Battery::capacity);
   nh.param("battery_low", parameters.battery_low, Battery::low);
   nh.param("battery_dangerous", parameters.battery_dangerous, Battery::dangerous);
+  nh.param("gyro_bias_estimation", parameters.enable_gyro_bias_estimation, true);
+  nh.param("gyro_bias_settle_time", parameters.gyro_bias_settle_time, 0.5);
+  nh.param("gyro_bias_memory", parameters.gyro_bias_memory, 60.0);
+  nh.param("gyro_bias_cached_weight", parameters.gyro_bias_cached_weight, 5.0);
+  nh.param("velocity_window", parameters.velocity_window, 5);
+  nh.param("dock_ir_window", parameters.dock_ir_window, 25);
+  nh.param("pose_history_size", parameters.pose_history_size, 500);
+  nh.param("odometry_distance_noise", parameters.odometry_distance_noise, 0.01);
+  nh.param("odometry_rotation_noise", parameters.odometry_rotation_noise, 0.05);
+  nh.param("odometry_drift_noise", parameters.odometry_drift_noise, 0.01);
+  nh.param("odometry_slip_gain", parameters.odometry_slip_gain, 20.0);
+  nh.param("odometry_heading_variance", parameters.odometry_heading_variance, 1e6);
 
   parameters.sigslots_namespace = name; // name is automatically picked up by device_nodelet parent.
   if (!nh.getParam("device_port", parameters.device_port))
@@ -195,17 +278,22 @@ bool KobukiRos::init(ros::NodeHandle& nh)
 
   odometry.init(nh, name);
 
+  if (!configureVelocityMux(nh))
+  {
+    return false;
+  }
+  if (!configureAutoDocking(nh))
+  {
+    return false;
+  }
+
   /*********************
    ** Driver Init
    **********************/
   try
   {
+    // returns immediately, the device is opened in the background and "/ready" signals the first frame
     kobuki.init(parameters);
-    ros::Duration(0.25).sleep(); // wait for some data to come in.
-    if ( !kobuki.isAlive() ) {
-      ROS_ERROR_STREAM("Kobuki : no data stream, is Kobuki turned on?");
-      // don't need to return false here - simply turning kobuki on while spin()'ing should resurrect the situation.
-    }
     kobuki.enable();
   }
   catch (const ecl::StandardException &e)
@@ -269,7 +357,10 @@ bool KobukiRos::update()
     return false;
   }
 
-  if ( (kobuki.isEnabled() == true) && odometry.commandTimeout())
+  // trajectories and motion primitives are self contained, they need no stream of commands;
+  // when multiplexing, the multiplexer drops commands/velocity after the same timeout by itself
+  if ( (velocity_command_input < 0) && (kobuki.isEnabled() == true) && odometry.commandTimeout() &&
+       !kobuki.isTrajectoryRunning() && !kobuki.isMotionRunning() )
   {
     if ( !cmd_vel_timed_out_ )
     {
@@ -306,6 +397,23 @@ bool KobukiRos::update()
   gyro_diagnostics.update(kobuki.getInertiaData().angle);
   dinput_diagnostics.update(kobuki.getGpInputData().digital_input);
   ainput_diagnostics.update(kobuki.getGpInputData().analog_input);
+  latency_diagnostics.update(kobuki.getCommandLatency());
+  link_diagnostics.update(kobuki.getLinkStatistics());
+  connection_diagnostics.update(kobuki.connectionState(), kobuki.handshakeMetrics());
+  pipeline_diagnostics.update(kobuki.isPipelined(), kobuki.getPipelineStatistics());
+  reflex_diagnostics.update(kobuki.isSafetyReflexEnabled(), kobuki.getSafetyReflexState(),
+                            kobuki.getSafetyReflexReaction());
+  if ( velocity_command_input >= 0 )
+  {
+    publishActiveVelocityInput();
+    mux_diagnostics.update(kobuki.getVelocityInputs(), kobuki.getSelectedVelocityInput(), ecl::TimeStamp());
+  }
+#ifdef KOBUKI_AUTO_DOCKING
+  if ( auto_docking )
+  {
+    publishAutoDockingState();
+  }
+#endif
   updater.update();
 
   return true;
@@ -333,8 +441,10 @@ void KobukiRos::advertiseTopics(ros::NodeHandle& nh)
   power_event_publisher  = nh.advertise < kobuki_msgs::PowerSystemEvent > ("events/power_system", 100);
   input_event_publisher  = nh.advertise < kobuki_msgs::DigitalInputEvent > ("events/digital_input", 100);
   robot_event_publisher  = nh.advertise < kobuki_msgs::RobotStateEvent > ("events/robot_state", 100, true); // also latched
+  motion_result_publisher = nh.advertise < kobuki_node::MotionPrimitiveResult > ("events/motion", 100);
   sensor_state_publisher = nh.advertise < kobuki_msgs::SensorState > ("sensors/core", 100);
   dock_ir_publisher = nh.advertise < kobuki_msgs::DockInfraRed > ("sensors/dock_ir", 100);
+  dock_bearing_publisher = nh.advertise < kobuki_node::DockBearing > ("sensors/dock_bearing", 100);
   imu_data_publisher = nh.advertise < sensor_msgs::Imu > ("sensors/imu_data", 100);
   raw_data_command_publisher = nh.advertise< std_msgs::String > ("debug/raw_data_command", 100);
   raw_data_stream_publisher = nh.advertise< std_msgs::String > ("debug/raw_data_stream", 100);
@@ -355,8 +465,146 @@ void KobukiRos::subscribeTopics(ros::NodeHandle& nh)
   sound_command_subscriber =  nh.subscribe(std::string("commands/sound"), 10, &KobukiRos::subscribeSoundCommand, this);
   reset_odometry_subscriber = nh.subscribe("commands/reset_odometry", 10, &KobukiRos::subscribeResetOdometry, this);
   motor_power_subscriber = nh.subscribe("commands/motor_power", 10, &KobukiRos::subscribeMotorPower, this);
+  velocity_trajectory_subscriber = nh.subscribe("commands/velocity_trajectory", 10, &KobukiRos::subscribeVelocityTrajectory, this);
+  motion_subscriber = nh.subscribe("commands/motion", 10, &KobukiRos::subscribeMotion, this);
 }
 
+/**
+ * Optional built-in velocity multiplexer, replacing an external cmd_vel mux.
+ *
+ * Each entry of the velocity_inputs list (name, topic, priority, timeout)
+ * becomes an input of the driver's VelocityMux. commands/velocity stays
+ * available as the lowest priority input, dropped after cmd_vel_timeout.
+ *
+ * @return bool : false if the list is malformed.
+ */
+bool KobukiRos::configureVelocityMux(ros::NodeHandle& nh)
+{
+  XmlRpc::XmlRpcValue inputs;
+  if (!nh.getParam("velocity_inputs", inputs))
+  {
+    return true; // velocity commands go straight to the driver
+  }
+  if (inputs.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR_STREAM("Kobuki : velocity_inputs must be a list [" << name << "].");
+    return false;
+  }
+  velocity_command_input = kobuki.addVelocityInput("commands/velocity", std::numeric_limits<int>::min(),
+                                                  odometry.timeout().toSec());
+  for (int i = 0; i < inputs.size(); ++i)
+  {
+    XmlRpc::XmlRpcValue& input = inputs[i];
+    if ((input.getType() != XmlRpc::XmlRpcValue::TypeStruct) ||
+        !input.hasMember("name") || !input.hasMember("topic") ||
+        !input.hasMember("priority") || !input.hasMember("timeout") ||
+        (input["name"].getType() != XmlRpc::XmlRpcValue::TypeString) ||
+        (input["topic"].getType() != XmlRpc::XmlRpcValue::TypeString) ||
+        (input["priority"].getType() != XmlRpc::XmlRpcValue::TypeInt))
+    {
+      ROS_ERROR_STREAM("Kobuki : velocity input " << i << " needs a name, topic, integer priority and timeout ["
+                       << name << "].");
+      return false;
+    }
+    std::string input_name = static_cast<std::string>(input["name"]);
+    std::string topic = static_cast<std::string>(input["topic"]);
+    int priority = static_cast<int>(input["priority"]);
+    double timeout = (input["timeout"].getType() == XmlRpc::XmlRpcValue::TypeInt) ?
+                     static_cast<int>(input["timeout"]) : static_cast<double>(input["timeout"]);
+    int index = kobuki.addVelocityInput(input_name, priority, timeout);
+    if (index < 0)
+    {
+      ROS_ERROR_STREAM("Kobuki : velocity input '" << input_name << "' is listed twice [" << name << "].");
+      return false;
+    }
+    velocity_input_subscribers.push_back(
+        nh.subscribe<geometry_msgs::Twist>(topic, 10, boost::bind(&KobukiRos::subscribeVelocityInput, this, _1, index)));
+    ROS_INFO_STREAM("Kobuki : velocity input '" << input_name << "' on " << topic << ", priority " << priority
+                    << ", timeout " << timeout << "s [" << name << "].");
+  }
+  velocity_mux_publisher = nh.advertise<std_msgs::String>("velocity_mux/active", 1, true); // latched
+  publishActiveVelocityInput();
+  return true;
+}
 
-} // namespace kobuki
+/**
+ * Publish the name of the multiplexer's selected input when it changes,
+ * "idle" when no input is active.
+ */
+void KobukiRos::publishActiveVelocityInput()
+{
+  int selected = kobuki.getSelectedVelocityInput();
+  if (selected == active_velocity_input)
+  {
+    return;
+  }
+  active_velocity_input = selected;
+  std::vector<VelocityMux::Input> inputs = kobuki.getVelocityInputs();
+  std_msgs::StringPtr msg(new std_msgs::String);
+  msg->data = ((selected >= 0) && (selected < static_cast<int>(inputs.size()))) ? inputs[selected].name : "idle";
+  velocity_mux_publisher.publish(msg);
+}
 
+
+/**
+ * Optional docking controller, hosted in the driver as a plugin so that it
+ * runs on every frame (see kobuki_auto_docking).
+ *
+ * commands/auto_dock starts (true) or cancels (false) an attempt and the
+ * state machine's progress is latched on events/auto_docking.
+ *
+ * @return bool : false if the driver refused the plugin.
+ */
+bool KobukiRos::configureAutoDocking(ros::NodeHandle& nh)
+{
+  bool enable;
+  nh.param("auto_docking", enable, false);
+  if (!enable)
+  {
+    return true;
+  }
+#ifndef KOBUKI_AUTO_DOCKING
+  ROS_WARN_STREAM("Kobuki : auto docking requested, but built without kobuki_auto_docking [" << name << "].");
+  return true;
+#else
+  AutoDocking::Settings settings;
+  nh.param("docking_approach_speed", settings.approach_speed, settings.approach_speed);
+  nh.param("docking_near_speed", settings.near_speed, settings.near_speed);
+  nh.param("docking_search_speed", settings.search_speed, settings.search_speed);
+  nh.param("docking_turn_speed", settings.turn_speed, settings.turn_speed);
+  nh.param("docking_retries", settings.retries, settings.retries);
+  nh.param("docking_timeout", settings.timeout, settings.timeout);
+  auto_docking.reset(new AutoDockingPlugin(settings));
+  // above the defaults, so that docking claims the base from other plugins
+  if (!kobuki.addPlugin(auto_docking, "auto_docking", 100))
+  {
+    ROS_ERROR_STREAM("Kobuki : could not host the auto docking plugin [" << name << "].");
+    auto_docking.reset();
+    return false;
+  }
+  auto_docking_subscriber = nh.subscribe("commands/auto_dock", 10, &KobukiRos::subscribeAutoDocking, this);
+  auto_docking_publisher = nh.advertise<std_msgs::String>("events/auto_docking", 1, true); // latched
+  publishAutoDockingState();
+  return true;
+#endif
+}
+
+#ifdef KOBUKI_AUTO_DOCKING
+/**
+ * Publish the docking state when it changes.
+ */
+void KobukiRos::publishAutoDockingState()
+{
+  int state = auto_docking->state();
+  if (state == auto_docking_state)
+  {
+    return;
+  }
+  auto_docking_state = state;
+  std_msgs::StringPtr msg(new std_msgs::String);
+  msg->data = AutoDocking::toString(static_cast<AutoDocking::State>(state));
+  auto_docking_publisher.publish(msg);
+}
+#endif
+
+} // namespace kobuki
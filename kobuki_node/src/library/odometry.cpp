@@ -74,15 +74,22 @@ bool Odometry::commandTimeout() const {
   }
 }
 
-void Odometry::update(const ecl::Pose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates) {
+/**
+ * @param pose_covariance : x, y, heading covariance of the accumulated pose.
+ * @param twist_variance : vx, vy, wz variances of the twist.
+ * @param stamp : firmware time of the frame, synchronised to the host clock.
+ */
+void Odometry::update(const ecl::Pose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates,
+                      const ecl::linear_algebra::Matrix3d &pose_covariance,
+                      const ecl::linear_algebra::Vector3d &twist_variance, const ros::Time &stamp) {
   pose *= pose_update;
 
   //since all ros tf odometry is 6DOF we'll need a quaternion created from yaw
   geometry_msgs::Quaternion odom_quat = tf::createQuaternionMsgFromYaw(pose.heading());
 
   if ( ros::ok() ) {
-    publishTransform(odom_quat);
-    publishOdometry(odom_quat, pose_update_rates);
+    publishTransform(odom_quat, stamp);
+    publishOdometry(odom_quat, pose_update_rates, pose_covariance, twist_variance, stamp);
   }
 }
 
@@ -90,12 +97,12 @@ void Odometry::update(const ecl::Pose2D<double> &pose_update, ecl::linear_algebr
 ** Private Implementation
 *****************************************************************************/
 
-void Odometry::publishTransform(const geometry_msgs::Quaternion &odom_quat)
+void Odometry::publishTransform(const geometry_msgs::Quaternion &odom_quat, const ros::Time &stamp)
 {
   if (publish_tf == false)
     return;
 
-  odom_trans.header.stamp = ros::Time::now();
+  odom_trans.header.stamp = stamp;
   odom_trans.transform.translation.x = pose.x();
   odom_trans.transform.translation.y = pose.y();
   odom_trans.transform.translation.z = 0.0;
@@ -104,13 +111,16 @@ void Odometry::publishTransform(const geometry_msgs::Quaternion &odom_quat)
 }
 
 void Odometry::publishOdometry(const geometry_msgs::Quaternion &odom_quat,
-                               const ecl::linear_algebra::Vector3d &pose_update_rates)
+                               const ecl::linear_algebra::Vector3d &pose_update_rates,
+                               const ecl::linear_algebra::Matrix3d &pose_covariance,
+                               const ecl::linear_algebra::Vector3d &twist_variance,
+                               const ros::Time &stamp)
 {
   // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
   nav_msgs::OdometryPtr odom(new nav_msgs::Odometry);
 
   // Header
-  odom->header.stamp = ros::Time::now();
+  odom->header.stamp = stamp;
   odom->header.frame_id = odom_frame;
   odom->child_frame_id = base_frame;
 
@@ -125,16 +135,24 @@ void Odometry::publishOdometry(const geometry_msgs::Quaternion &odom_quat,
   odom->twist.twist.linear.y = pose_update_rates[1];
   odom->twist.twist.angular.z = pose_update_rates[2];
 
-  // Pose covariance (required by robot_pose_ekf) TODO: publish realistic values
-  // Odometry yaw covariance must be much bigger than the covariance provided
-  // by the imu, as the later takes much better measures
-  odom->pose.covariance[0]  = 0.1;
-  odom->pose.covariance[7]  = 0.1;
-  odom->pose.covariance[35] = 1000000.0;  // the wheels slip like crazy (on concrete), set covariance accordingly
+  // Pose covariance (required by robot_pose_ekf), propagated by the driver's
+  // covariance model: grows with distance/rotation travelled and with slip
+  const int pose_index[3] = {0, 1, 5}; // x, y, yaw rows/cols of the 6x6 matrix
+  for (unsigned int i = 0; i < 3; ++i) {
+    for (unsigned int j = 0; j < 3; ++j) {
+      odom->pose.covariance[6*pose_index[i] + pose_index[j]] = pose_covariance(i, j);
+    }
+  }
+  odom->twist.covariance[0]  = twist_variance[0];
+  odom->twist.covariance[7]  = twist_variance[1];
+  odom->twist.covariance[35] = twist_variance[2];
 
   odom->pose.covariance[14] = DBL_MAX; // set a very large covariance on unused
   odom->pose.covariance[21] = DBL_MAX; // dimensions (z, pitch and roll); this
   odom->pose.covariance[28] = DBL_MAX; // is a requirement of robot_pose_ekf
+  odom->twist.covariance[14] = DBL_MAX;
+  odom->twist.covariance[21] = DBL_MAX;
+  odom->twist.covariance[28] = DBL_MAX;
 
   odom_publisher.publish(odom);
 }
@@ -38,6 +38,7 @@
 ** Includes
 *****************************************************************************/
 
+#include <ecl/time/timestamp.hpp>
 #include "kobuki_node/kobuki_ros.hpp"
 
 /*****************************************************************************
@@ -51,6 +52,7 @@ void KobukiRos::processStreamData() {
   publishWheelState();
   publishSensorState();
   publishDockIRData();
+  publishDockBearing();
   publishInertia();
 }
 
@@ -119,11 +121,13 @@ void KobukiRos::publishWheelState()
   kobuki.getWheelJointStates(joint_states.position[0], joint_states.velocity[0],   // left wheel
                              joint_states.position[1], joint_states.velocity[1]);  // right wheel
 
-  odometry.update(pose_update, pose_update_rates);
+  // firmware time of this frame is on the driver's (ecl) clock, carry its age over to ros time
+  ros::Time stamp = ros::Time::now() - ros::Duration(static_cast<double>(ecl::TimeStamp()) - kobuki.getStreamTime());
+  odometry.update(pose_update, pose_update_rates, kobuki.getPoseCovariance(), kobuki.getTwistVariance(), stamp);
 
   if (ros::ok())
   {
-    joint_states.header.stamp = ros::Time::now();
+    joint_states.header.stamp = stamp;
     joint_state_publisher.publish(joint_states);
   }
 }
@@ -186,6 +190,28 @@ void KobukiRos::publishDockIRData()
   }
 }
 
+void KobukiRos::publishDockBearing()
+{
+  if (ros::ok())
+  {
+    if (dock_bearing_publisher.getNumSubscribers() > 0)
+    {
+      DockIRFilter::Estimate estimate = kobuki.getDockEstimate();
+
+      kobuki_node::DockBearingPtr msg(new kobuki_node::DockBearing);
+
+      msg->header.frame_id = "base_link";
+      msg->header.stamp = ros::Time::now();
+      msg->bearing = estimate.bearing;
+      msg->range = static_cast<uint8_t>(estimate.range);   // same ordering as the message constants
+      msg->region = static_cast<uint8_t>(estimate.region);
+      msg->confidence = estimate.confidence;
+
+      dock_bearing_publisher.publish(msg);
+    }
+  }
+}
+
 /*****************************************************************************
 ** Non Default Stream Packets
 *****************************************************************************/
@@ -230,6 +256,38 @@ void KobukiRos::publishVersionInfo(const VersionInfo &version_info)
 ** Events
 *****************************************************************************/
 
+/**
+ * @brief All of a frame's sensor events, published in the order they were raised.
+ *
+ * The events carry the host time the firmware stamped their frame; the
+ * delay until they are published goes to the event latency diagnostics.
+ * (The kobuki_msgs event messages have no header to carry it further.)
+ */
+void KobukiRos::publishEventBatch(const EventBatch &batch)
+{
+  double time = 0.0;
+  if      (!batch.button_events.empty()) time = batch.button_events[0].time;
+  else if (!batch.bumper_events.empty()) time = batch.bumper_events[0].time;
+  else if (!batch.cliff_events.empty())  time = batch.cliff_events[0].time;
+  else if (!batch.wheel_events.empty())  time = batch.wheel_events[0].time;
+  else if (!batch.power_events.empty())  time = batch.power_events[0].time;
+
+  for (unsigned int i = 0; i < batch.button_events.size(); ++i)
+    publishButtonEvent(batch.button_events[i]);
+  for (unsigned int i = 0; i < batch.bumper_events.size(); ++i)
+    publishBumperEvent(batch.bumper_events[i]);
+  for (unsigned int i = 0; i < batch.cliff_events.size(); ++i)
+    publishCliffEvent(batch.cliff_events[i]);
+  for (unsigned int i = 0; i < batch.wheel_events.size(); ++i)
+    publishWheelEvent(batch.wheel_events[i]);
+  for (unsigned int i = 0; i < batch.power_events.size(); ++i)
+    publishPowerEvent(batch.power_events[i]);
+  if (time > 0.0)
+  {
+    event_latency_diagnostics.update(static_cast<double>(ecl::TimeStamp()) - time);
+  }
+}
+
 void KobukiRos::publishButtonEvent(const ButtonEvent &event)
 {
   if (ros::ok())
@@ -360,6 +418,25 @@ void KobukiRos::publishRobotEvent(const RobotEvent &event)
   }
 }
 
+void KobukiRos::publishMotionResult(const MotionPrimitive::Result &result)
+{
+  if (ros::ok())
+  {
+    kobuki_node::MotionPrimitiveResultPtr msg(new kobuki_node::MotionPrimitiveResult);
+    switch(result.status) {
+      case(MotionPrimitive::Succeeded) : { msg->status = kobuki_node::MotionPrimitiveResult::SUCCEEDED; break; }
+      case(MotionPrimitive::Aborted)   : { msg->status = kobuki_node::MotionPrimitiveResult::ABORTED;   break; }
+      case(MotionPrimitive::TimedOut)  : { msg->status = kobuki_node::MotionPrimitiveResult::TIMED_OUT; break; }
+      default: break;
+    }
+    msg->distance = result.distance;
+    msg->angle = result.angle;
+    msg->duration = result.duration;
+
+    motion_result_publisher.publish(msg);
+  }
+}
+
 void KobukiRos::publishRawDataCommand(Command::Buffer &buffer)
 {
   if ( raw_data_command_publisher.getNumSubscribers() > 0 ) { // do not do string processing if there is no-one listening.
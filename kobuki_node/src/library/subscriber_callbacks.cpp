@@ -38,6 +38,7 @@
  ** Includes
  *****************************************************************************/
 
+#include <ecl/time/timestamp.hpp>
 #include "../../include/kobuki_node/kobuki_ros.hpp"
 
 /*****************************************************************************
@@ -60,12 +61,119 @@ void KobukiRos::subscribeVelocityCommand(const geometry_msgs::TwistConstPtr msg)
     //double vx = msg->linear.x;        // in (m/s)
     //double wz = msg->angular.z;       // in (rad/s)
     ROS_DEBUG_STREAM("Kobuki : velocity command received [" << msg->linear.x << "],[" << msg->angular.z << "]");
-    kobuki.setBaseControl(msg->linear.x, msg->angular.z);
+    if (velocity_command_input >= 0)
+    {
+      kobuki.setBaseControl(velocity_command_input, msg->linear.x, msg->angular.z);
+    }
+    else
+    {
+      kobuki.setBaseControl(msg->linear.x, msg->angular.z);
+    }
     odometry.resetTimeout();
   }
   return;
 }
 
+/**
+ * @brief A command on one of the multiplexed velocity inputs (see velocity_inputs).
+ */
+void KobukiRos::subscribeVelocityInput(const geometry_msgs::TwistConstPtr msg, const int input)
+{
+  if (kobuki.isEnabled())
+  {
+    kobuki.setBaseControl(input, msg->linear.x, msg->angular.z);
+    odometry.resetTimeout();
+  }
+}
+
+/**
+ * @brief Hand a timestamped velocity profile to the driver for execution.
+ *
+ * The driver works on the host's wall clock, so the stamp is converted via
+ * its offset from now. An empty trajectory cancels the running one.
+ */
+void KobukiRos::subscribeVelocityTrajectory(const kobuki_node::VelocityTrajectoryConstPtr msg)
+{
+  if (!kobuki.isEnabled())
+  {
+    return;
+  }
+  if (msg->points.empty())
+  {
+    kobuki.cancelTrajectory();
+    return;
+  }
+  double start = static_cast<double>(ecl::TimeStamp());
+  if (!msg->header.stamp.isZero())
+  {
+    start += (msg->header.stamp - ros::Time::now()).toSec();
+  }
+  std::vector<TrajectoryBuffer::Sample> samples;
+  samples.reserve(msg->points.size());
+  for (unsigned int i = 0; i < msg->points.size(); ++i)
+  {
+    if ((msg->points[i].linear != msg->points[i].linear) || (msg->points[i].angular != msg->points[i].angular))
+    {
+      ROS_WARN_STREAM("Kobuki : velocity trajectory rejected, NaN velocity at point " << i << " [" << name << "].");
+      return;
+    }
+    samples.push_back(TrajectoryBuffer::Sample(msg->points[i].time_from_start.toSec(),
+                                               msg->points[i].linear, msg->points[i].angular));
+  }
+  if (!kobuki.setTrajectory(start, samples))
+  {
+    ROS_WARN_STREAM("Kobuki : velocity trajectory rejected, point times must strictly increase and velocities stay "
+                    "finite and within the smoother's accelerations [" << name << "].");
+    return;
+  }
+  odometry.resetTimeout();
+}
+
+/**
+ * @brief Rotate, translate or drive an arc, closed loop in the driver.
+ */
+void KobukiRos::subscribeMotion(const kobuki_node::MotionPrimitiveConstPtr msg)
+{
+  if (!kobuki.isEnabled())
+  {
+    ROS_WARN_STREAM("Kobuki : motion primitive ignored, the motors are disabled [" << name << "].");
+    return;
+  }
+  if ((msg->distance != msg->distance) && (msg->angle != msg->angle)) // both NaN
+  {
+    kobuki.cancelMotion();
+    return;
+  }
+  if ((msg->distance != msg->distance) || (msg->angle != msg->angle))
+  {
+    ROS_WARN_STREAM("Kobuki : motion primitive rejected, NaN distance or angle [" << name << "].");
+    return;
+  }
+  if (!kobuki.startMotion(msg->distance, msg->angle))
+  {
+    ROS_WARN_STREAM("Kobuki : motion primitive rejected, invalid wheel calibration [" << name << "].");
+    return;
+  }
+  odometry.resetTimeout();
+}
+
+#ifdef KOBUKI_AUTO_DOCKING
+void KobukiRos::subscribeAutoDocking(const std_msgs::BoolConstPtr msg)
+{
+  if (!msg->data)
+  {
+    auto_docking->cancel();
+    return;
+  }
+  if (!kobuki.isEnabled())
+  {
+    ROS_WARN_STREAM("Kobuki : auto docking ignored, the motors are disabled [" << name << "].");
+    return;
+  }
+  auto_docking->start();
+}
+#endif
+
   
 void KobukiRos::subscribeLed1Command(const kobuki_msgs::LedConstPtr msg)
 {
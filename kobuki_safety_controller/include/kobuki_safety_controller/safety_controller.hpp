@@ -58,6 +58,8 @@
 #include <kobuki_msgs/BumperEvent.h>
 #include <kobuki_msgs/CliffEvent.h>
 #include <kobuki_msgs/WheelDropEvent.h>
+#include <ecl/threads/mutex.hpp>
+#include "safety_state_machine.hpp"
 
 namespace kobuki
 {
@@ -68,6 +70,9 @@ namespace kobuki
  * The SafetyController keeps track of bumper, cliff and wheel drop events. In case of the first two,
  * Kobuki is commanded to move back. In the latter case, Kobuki is stopped.
  *
+ * Reactions are published from within the event callbacks (see SafetyStateMachine). A timer only
+ * runs while a reaction is in progress, repeating the command and ending the back off.
+ *
  * This controller can be enabled/disabled.
  * The safety states (bumper pressed etc.) can be reset. WARNING: Dangerous!
  */
@@ -78,11 +83,16 @@ public:
     Controller(),
     nh_(nh),
     name_(name),
-    bumper_pressed_(false),
-    cliff_detected_(false),
-    wheel_left_dropped_(false),
-    wheel_right_dropped_(false){};
-  ~SafetyController(){};
+    backoff_speed_(0.1),
+    timer_running_(false){};
+  ~SafetyController()
+  {
+    if (reaction_.count > 0)
+    {
+      ROS_INFO_STREAM("Reaction times: mean " << 1000.0 * reaction_.mean << "ms, max "
+                      << 1000.0 * reaction_.maximum << "ms over " << reaction_.count << " reactions. [" << name_ << "]");
+    }
+  };
 
   /**
    * Set-up necessary publishers/subscribers and variables
@@ -90,6 +100,22 @@ public:
    */
   bool init()
   {
+    double backoff_time, command_period;
+    nh_.param("backoff_speed", backoff_speed_, 0.1);
+    nh_.param("backoff_time", backoff_time, 0.5);
+    nh_.param("command_period", command_period, 0.1);
+    if ((backoff_speed_ <= 0.0) || (backoff_time < 0.0) || (command_period <= 0.0))
+    {
+      ROS_ERROR_STREAM("Back off speed and command period must be positive, back off time non-negative. ["
+                       << name_ << "]");
+      return false;
+    }
+    state_machine_ = SafetyStateMachine(backoff_time);
+    // built once, so a reaction never waits on the allocator
+    stop_msg_.reset(new geometry_msgs::Twist());
+    backoff_msg_.reset(new geometry_msgs::Twist());
+    backoff_msg_->linear.x = -backoff_speed_;
+    command_timer_ = nh_.createTimer(ros::Duration(command_period), &SafetyController::timerCB, this, false, false);
     enable_controller_subscriber_ = nh_.subscribe("enable", 10, &SafetyController::enableCB, this);
     disable_controller_subscriber_ = nh_.subscribe("disable", 10, &SafetyController::disableCB, this);
     bumper_event_subscriber_ = nh_.subscribe("events/bumper", 10, &SafetyController::bumperEventCB, this);
@@ -101,9 +127,26 @@ public:
   };
 
   /**
-   * @ brief Checks safety states and publishes velocity commands when necessary
+   * @brief Time taken from receiving an event to publishing the reaction
    */
-  void spin();
+  SafetyStateMachine::Reaction reactionTime() const
+  {
+    mutex_.lock();
+    SafetyStateMachine::Reaction reaction = reaction_;
+    mutex_.unlock();
+    return reaction;
+  }
+
+  /**
+   * @brief Where the state machine is, e.g. to check a replay against
+   */
+  SafetyStateMachine::State state() const
+  {
+    mutex_.lock();
+    SafetyStateMachine::State state = state_machine_.state();
+    mutex_.unlock();
+    return state;
+  }
 
 private:
   ros::NodeHandle nh_;
@@ -112,8 +155,26 @@ private:
   ros::Subscriber bumper_event_subscriber_, cliff_event_subscriber_, wheel_event_subscriber_;
   ros::Subscriber reset_safety_states_subscriber_;
   ros::Publisher controller_state_publisher_, velocity_command_publisher_;
-  bool bumper_pressed_, cliff_detected_, wheel_left_dropped_, wheel_right_dropped_;
-  geometry_msgs::TwistPtr msg_; // velocity command
+  ros::Timer command_timer_;
+  SafetyStateMachine state_machine_;
+  SafetyStateMachine::Reaction reaction_;
+  double backoff_speed_;
+  geometry_msgs::TwistPtr stop_msg_, backoff_msg_; // never modified once published
+  bool timer_running_;
+  mutable ecl::Mutex mutex_; // nodelet callbacks may run concurrently
+
+  /**
+   * @brief Publishes a reaction and runs the timer only while one is in progress
+   * @param command reaction decided by the state machine
+   * @param received when the triggering callback started, for the reaction time
+   */
+  void react(const SafetyStateMachine::Command& command, const ros::WallTime& received);
+
+  /**
+   * @brief Repeats the current command and ends the back off once it has run its course
+   * @param event timer event
+   */
+  void timerCB(const ros::TimerEvent& event);
 
   /**
    * @brief ROS logging output for enabling the controller
@@ -128,19 +189,19 @@ private:
   void disableCB(const std_msgs::EmptyConstPtr msg);
 
   /**
-   * @brief Keeps track of bumps
+   * @brief Backs off when a bumper is pressed
    * @param msg incoming topic message
    */
   void bumperEventCB(const kobuki_msgs::BumperEventConstPtr msg);
 
   /**
-   * @brief Keeps track of cliff detection
+   * @brief Backs off when a cliff is detected
    * @param msg incoming topic message
    */
   void cliffEventCB(const kobuki_msgs::CliffEventConstPtr msg);
 
   /**
-   * @brief Keeps track of the wheel states
+   * @brief Stops while a wheel is dropped
    * @param msg incoming topic message
    */
   void wheelEventCB(const kobuki_msgs::WheelDropEventConstPtr msg);
@@ -183,104 +244,99 @@ void SafetyController::disableCB(const std_msgs::EmptyConstPtr msg)
 
 void SafetyController::cliffEventCB(const kobuki_msgs::CliffEventConstPtr msg)
 {
-  if (msg->state == kobuki_msgs::CliffEvent::CLIFF)
+  ros::WallTime received = ros::WallTime::now();
+  bool detected = (msg->state == kobuki_msgs::CliffEvent::CLIFF);
+  if (detected)
   {
     ROS_DEBUG_STREAM("Cliff detected. Moving backwards. [" << name_ << "]");
-    cliff_detected_ = true;
   }
   else // kobuki_msgs::CliffEvent::FLOOR
   {
     ROS_DEBUG_STREAM("Not detecting any cliffs. Resuming normal operation. [" << name_ << "]");
-    cliff_detected_ = false;
   }
+  mutex_.lock();
+  react(state_machine_.cliff(msg->sensor, detected, ros::Time::now().toSec()), received);
+  mutex_.unlock();
 };
 
 void SafetyController::bumperEventCB(const kobuki_msgs::BumperEventConstPtr msg)
 {
-  if (msg->state == kobuki_msgs::BumperEvent::PRESSED)
+  ros::WallTime received = ros::WallTime::now();
+  bool pressed = (msg->state == kobuki_msgs::BumperEvent::PRESSED);
+  if (pressed)
   {
     ROS_DEBUG_STREAM("Bumper pressed. Moving backwards. [" << name_ << "]");
-    bumper_pressed_ = true;
   }
   else // kobuki_msgs::BumperEvent::RELEASED
   {
-    ROS_DEBUG_STREAM("No bumper pressed. Resuming normal operation. [" << name_ << "]");
-    bumper_pressed_ = false;
+    ROS_DEBUG_STREAM("Bumper released. [" << name_ << "]");
   }
+  mutex_.lock();
+  react(state_machine_.bumper(msg->bumper, pressed, ros::Time::now().toSec()), received);
+  mutex_.unlock();
 };
 
 void SafetyController::wheelEventCB(const kobuki_msgs::WheelDropEventConstPtr msg)
 {
-  if (msg->state == kobuki_msgs::WheelDropEvent::DROPPED)
+  ros::WallTime received = ros::WallTime::now();
+  bool dropped = (msg->state == kobuki_msgs::WheelDropEvent::DROPPED);
+  // need to keep track of both wheels separately
+  if (msg->wheel == kobuki_msgs::WheelDropEvent::LEFT)
   {
-    // need to keep track of both wheels separately
-    if (msg->wheel == kobuki_msgs::WheelDropEvent::LEFT)
-    {
-      ROS_DEBUG_STREAM("Left wheel dropped. [" << name_ << "]");
-      wheel_left_dropped_ = true;
-    }
-    else // kobuki_msgs::WheelDropEvent::RIGHT
-    {
-      ROS_DEBUG_STREAM("Right wheel dropped. [" << name_ << "]");
-      wheel_right_dropped_ = true;
-    }
+    ROS_DEBUG_STREAM("Left wheel " << (dropped ? "dropped" : "raised") << ". [" << name_ << "]");
   }
-  else // kobuki_msgs::WheelDropEvent::RAISED
+  else // kobuki_msgs::WheelDropEvent::RIGHT
   {
-    // need to keep track of both wheels separately
-    if (msg->wheel == kobuki_msgs::WheelDropEvent::LEFT)
-    {
-      ROS_DEBUG_STREAM("Left wheel raised. [" << name_ << "]");
-      wheel_left_dropped_ = false;
-    }
-    else // kobuki_msgs::WheelDropEvent::RIGHT
-    {
-      ROS_DEBUG_STREAM("Right wheel raised. [" << name_ << "]");
-      wheel_right_dropped_ = false;
-    }
-    if (!wheel_left_dropped_ && !wheel_right_dropped_)
-    {
-      ROS_DEBUG_STREAM("Both wheels raised. Resuming normal operation. [" << name_ << "]");
-    }
+    ROS_DEBUG_STREAM("Right wheel " << (dropped ? "dropped" : "raised") << ". [" << name_ << "]");
+  }
+  mutex_.lock();
+  react(state_machine_.wheelDrop(msg->wheel, dropped, ros::Time::now().toSec()), received);
+  if (!dropped && (state_machine_.state() != SafetyStateMachine::Stopped))
+  {
+    ROS_DEBUG_STREAM("Both wheels raised. Resuming normal operation. [" << name_ << "]");
   }
+  mutex_.unlock();
 };
 
 void SafetyController::resetSafetyStatesCB(const std_msgs::EmptyConstPtr msg)
 {
-  wheel_left_dropped_ = false;
-  wheel_right_dropped_ = false;
-  bumper_pressed_ = false;
-  cliff_detected_ = false;
+  mutex_.lock();
+  state_machine_.reset();
+  command_timer_.stop();
+  timer_running_ = false;
+  mutex_.unlock();
   ROS_WARN_STREAM("All safety states have been reset to false. [" << name_ << "]");
 }
 
-void SafetyController::spin()
+void SafetyController::timerCB(const ros::TimerEvent& event)
 {
-  if (this->getState())
+  mutex_.lock();
+  react(state_machine_.tick(ros::Time::now().toSec()), ros::WallTime());
+  mutex_.unlock();
+}
+
+void SafetyController::react(const SafetyStateMachine::Command& command, const ros::WallTime& received)
+{
+  if ((command != SafetyStateMachine::None) && this->getState())
   {
-    if (wheel_left_dropped_ || wheel_right_dropped_)
-    {
-      msg_.reset(new geometry_msgs::Twist());
-      msg_->linear.x = 0.0;
-      msg_->linear.y = 0.0;
-      msg_->linear.z = 0.0;
-      msg_->angular.x = 0.0;
-      msg_->angular.y = 0.0;
-      msg_->angular.z = 0.0;
-      velocity_command_publisher_.publish(msg_);
-    }
-    else if (bumper_pressed_ || cliff_detected_)
+    velocity_command_publisher_.publish((command == SafetyStateMachine::BackOff) ? backoff_msg_ : stop_msg_);
+    if (!received.isZero())
     {
-      msg_.reset(new geometry_msgs::Twist());
-      msg_->linear.x = -0.1;
-      msg_->linear.y = 0.0;
-      msg_->linear.z = 0.0;
-      msg_->angular.x = 0.0;
-      msg_->angular.y = 0.0;
-      msg_->angular.z = 0.0;
-      velocity_command_publisher_.publish(msg_);
+      reaction_.record((ros::WallTime::now() - received).toSec());
     }
   }
+  // only touch the timer on a transition, (re)arming it takes the timer manager's locks
+  bool idle = (state_machine_.state() == SafetyStateMachine::Idle);
+  if (idle && timer_running_)
+  {
+    command_timer_.stop();
+    timer_running_ = false;
+  }
+  else if (!idle && !timer_running_)
+  {
+    command_timer_.start();
+    timer_running_ = true;
+  }
 };
 
 } // namespace kobuki
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_safety_controller/include/kobuki_safety_controller/safety_state_machine.hpp
+ *
+ * @brief Hazard tracking and reactions of Kobuki's safety controller
+ *
+ * Free of ros, so the controller's decisions can be replayed and timed offline.
+ *
+ * @date Nov 30, 2012
+ **/
+
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef SAFETY_STATE_MACHINE_HPP_
+#define SAFETY_STATE_MACHINE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <stdint.h>
+
+namespace kobuki
+{
+
+/**
+ * @brief Decides when the safety controller backs off or stops Kobuki
+ *
+ * Driven directly by the bumper, cliff and wheel drop events, so a reaction
+ * is decided the moment its event arrives:
+ *
+ * - Idle : no hazard, nothing is commanded.
+ * - BackingOff : a bumper was pressed or a cliff detected. Kobuki reverses
+ *   while the hazard lasts and at least for the back off time since the
+ *   latest trigger, then is stopped once.
+ * - Stopped : a wheel dropped. Kobuki is held still until both wheels are
+ *   raised again.
+ *
+ * While not idle, the owner calls tick() periodically to repeat the command,
+ * which keeps it on top of a velocity multiplexer.
+ */
+class SafetyStateMachine
+{
+public:
+  enum State
+  {
+    Idle,
+    BackingOff,
+    Stopped
+  };
+
+  enum Command
+  {
+    None,    /**< nothing to publish **/
+    Stop,    /**< publish zero velocity **/
+    BackOff  /**< publish the back off velocity **/
+  };
+
+  /**
+   * @brief Time [s] taken to react to an event.
+   */
+  struct Reaction
+  {
+    Reaction() : count(0), last(0.0), mean(0.0), maximum(0.0) {}
+    void record(const double &latency)
+    {
+      last = latency;
+      maximum = ( count == 0 ) ? latency : std::max(maximum, latency);
+      ++count;
+      mean += (latency - mean) / count;
+    }
+    unsigned int count;
+    double last, mean, maximum;
+  };
+
+  SafetyStateMachine(const double &backoff_time = 0.5) :
+    backoff_time_(backoff_time),
+    state_(Idle),
+    bumpers_(0),
+    cliffs_(0),
+    wheels_(0),
+    backoff_end_(0.0) {};
+
+  /**
+   * @param bumper : bumper index (left, centre, right)
+   * @param pressed : new state of that bumper
+   * @param now : time [s]
+   * @return Command : what to publish straight away.
+   */
+  Command bumper(const unsigned int &bumper, const bool &pressed, const double &now)
+  {
+    return evaluate(flag(bumpers_, bumper, pressed), now);
+  }
+
+  /**
+   * @param sensor : cliff sensor index (left, centre, right)
+   * @param detected : whether that sensor sees a cliff
+   * @param now : time [s]
+   * @return Command : what to publish straight away.
+   */
+  Command cliff(const unsigned int &sensor, const bool &detected, const double &now)
+  {
+    return evaluate(flag(cliffs_, sensor, detected), now);
+  }
+
+  /**
+   * @param wheel : wheel index (left, right)
+   * @param dropped : new state of that wheel
+   * @param now : time [s]
+   * @return Command : what to publish straight away.
+   */
+  Command wheelDrop(const unsigned int &wheel, const bool &dropped, const double &now)
+  {
+    return evaluate(flag(wheels_, wheel, dropped), now);
+  }
+
+  /**
+   * @brief Periodic update while not idle.
+   *
+   * Ends an expired back off and otherwise repeats the current command.
+   *
+   * @param now : time [s]
+   * @return Command : what to publish.
+   */
+  Command tick(const double &now)
+  {
+    switch (state_)
+    {
+      case BackingOff:
+        if (!bumpers_ && !cliffs_ && (now >= backoff_end_))
+        {
+          state_ = Idle;
+          return Stop;
+        }
+        return BackOff;
+      case Stopped:
+        return Stop;
+      default:
+        return None;
+    }
+  }
+
+  /**
+   * @brief Forget all hazards. DANGEROUS!
+   */
+  void reset()
+  {
+    bumpers_ = cliffs_ = wheels_ = 0;
+    state_ = Idle;
+  }
+
+  State state() const { return state_; }
+  double backoffTime() const { return backoff_time_; }
+
+private:
+  double backoff_time_;
+  State state_;
+  uint8_t bumpers_, cliffs_, wheels_; // one bit per sensor that is currently firing
+  double backoff_end_;
+
+  /**
+   * @return bool : true if the sensor just started firing.
+   */
+  static bool flag(uint8_t &flags, const unsigned int &index, const bool &firing)
+  {
+    uint8_t bit = static_cast<uint8_t>(1 << index);
+    bool triggered = firing && !(flags & bit);
+    flags = firing ? (flags | bit) : (flags & ~bit);
+    return triggered;
+  }
+
+  Command evaluate(const bool &triggered, const double &now)
+  {
+    if (wheels_)
+    {
+      if (state_ == Stopped)
+      {
+        return None;
+      }
+      state_ = Stopped;
+      return Stop;
+    }
+    if (bumpers_ || cliffs_)
+    {
+      if (triggered || (state_ != BackingOff))
+      {
+        backoff_end_ = now + backoff_time_;
+      }
+      if (state_ == BackingOff)
+      {
+        return None;
+      }
+      state_ = BackingOff;
+      return BackOff;
+    }
+    if (state_ == Stopped)
+    {
+      state_ = Idle; // wheels raised, leave the robot standing
+    }
+    return None; // an ongoing back off is ended by tick()
+  }
+};
+
+} // namespace kobuki
+
+#endif /* SAFETY_STATE_MACHINE_HPP_ */
@@ -43,7 +43,6 @@
 
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
-#include <ecl/threads/thread.hpp>
 #include "kobuki_safety_controller/safety_controller.hpp"
 
 
@@ -53,13 +52,7 @@ namespace kobuki
 class SafetyControllerNodelet : public nodelet::Nodelet
 {
 public:
-  SafetyControllerNodelet() : shutdown_requested_(false) { };
-  ~SafetyControllerNodelet()
-  {
-    NODELET_DEBUG_STREAM("Waiting for update thread to finish.");
-    shutdown_requested_ = true;
-    update_thread_.join();
-  }
+  SafetyControllerNodelet() {};
   virtual void onInit()
   {
     ros::NodeHandle nh = this->getPrivateNodeHandle();
@@ -71,8 +64,7 @@ public:
     controller_.reset(new SafetyController(nh, name));
     if (controller_->init())
     {
-      NODELET_INFO_STREAM("Kobuki initialised. Spinning up update thread ... [" << name << "]");
-      update_thread_.start(&SafetyControllerNodelet::update, *this);
+      controller_->enable(); // enable the controller when loading the nodelet
       NODELET_INFO_STREAM("Nodelet initialised. [" << name << "]");
     }
     else
@@ -81,20 +73,7 @@ public:
     }
   }
 private:
-  void update()
-  {
-    ros::Rate spin_rate(10);
-    controller_->enable(); // enable the controller when loading the nodelet
-    while (! shutdown_requested_ && ros::ok())
-    {
-      controller_->spin();
-      spin_rate.sleep();
-    }
-  }
-
-  boost::shared_ptr<SafetyController> controller_;
-  ecl::Thread update_thread_;
-  bool shutdown_requested_;
+  boost::shared_ptr<SafetyController> controller_; // reacts from its callbacks, no update thread needed
 };
 
 } // namespace kobuki
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2012, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file /kobuki_safety_controller/src/test/replay.cpp
+ *
+ * @brief Plays a scripted hazard sequence through a running safety controller.
+ *
+ * The events go out on the controller's topics in real time, so each one
+ * takes the whole callback path: the subscription, the state machine, the
+ * publisher and the timer. Every reaction is checked on cmd_vel, and the
+ * slowest event to publish time, as the controller measures it, must stay
+ * under a millisecond. Run with rostest (safety_replay.test).
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <geometry_msgs/Twist.h>
+#include <kobuki_msgs/BumperEvent.h>
+#include <kobuki_msgs/CliffEvent.h>
+#include <kobuki_msgs/WheelDropEvent.h>
+#include "../../include/kobuki_safety_controller/safety_controller.hpp"
+
+/*****************************************************************************
+** Script
+*****************************************************************************/
+
+using kobuki::SafetyController;
+using kobuki::SafetyStateMachine;
+
+enum Source { Bumper, Cliff, Wheel, Wait };
+
+struct Event {
+  double time;    // [s] since the start of the replay
+  Source source;
+  unsigned int index;
+  bool firing;
+  SafetyStateMachine::Command command; // expected reaction, None for no immediate command
+  SafetyStateMachine::State state;     // expected state afterwards
+};
+
+/*
+ * Back off time 0.5s, command period 0.1s. The timer starts with each
+ * reaction from idle, so events fall half a period off its ticks; waits
+ * check the timer's repeats and the stop ending each back off.
+ */
+const Event script[] = {
+  // a bump, released before the back off has run its course
+  { 0.00, Bumper, 1, true,  SafetyStateMachine::BackOff, SafetyStateMachine::BackingOff },
+  { 0.15, Bumper, 1, false, SafetyStateMachine::None,    SafetyStateMachine::BackingOff },
+  { 0.35, Wait,   0, false, SafetyStateMachine::BackOff, SafetyStateMachine::BackingOff },
+  { 0.65, Wait,   0, false, SafetyStateMachine::Stop,    SafetyStateMachine::Idle },
+  // a cliff, then lifted off the ground mid back off
+  { 1.00, Cliff,  0, true,  SafetyStateMachine::BackOff, SafetyStateMachine::BackingOff },
+  { 1.05, Wheel,  0, true,  SafetyStateMachine::Stop,    SafetyStateMachine::Stopped },
+  { 1.25, Wheel,  1, true,  SafetyStateMachine::None,    SafetyStateMachine::Stopped },
+  { 1.35, Wheel,  0, false, SafetyStateMachine::None,    SafetyStateMachine::Stopped },
+  { 1.45, Wheel,  1, false, SafetyStateMachine::BackOff, SafetyStateMachine::BackingOff },
+  { 1.55, Cliff,  0, false, SafetyStateMachine::None,    SafetyStateMachine::BackingOff },
+  { 2.15, Wait,   0, false, SafetyStateMachine::Stop,    SafetyStateMachine::Idle },
+  // a second bumper extends the back off
+  { 2.50, Bumper, 0, true,  SafetyStateMachine::BackOff, SafetyStateMachine::BackingOff },
+  { 2.75, Bumper, 2, true,  SafetyStateMachine::None,    SafetyStateMachine::BackingOff },
+  { 2.85, Bumper, 0, false, SafetyStateMachine::None,    SafetyStateMachine::BackingOff },
+  { 2.95, Bumper, 2, false, SafetyStateMachine::None,    SafetyStateMachine::BackingOff },
+  { 3.15, Wait,   0, false, SafetyStateMachine::BackOff, SafetyStateMachine::BackingOff },
+  { 3.45, Wait,   0, false, SafetyStateMachine::Stop,    SafetyStateMachine::Idle },
+  // lifted while idle
+  { 4.00, Wheel,  1, true,  SafetyStateMachine::Stop,    SafetyStateMachine::Stopped },
+  { 4.55, Wheel,  1, false, SafetyStateMachine::None,    SafetyStateMachine::Idle },
+};
+const unsigned int script_length = sizeof(script) / sizeof(Event);
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+/**
+ * Publishes the events on the controller's topics and watches its cmd_vel.
+ */
+class Replay {
+public:
+  Replay(ros::NodeHandle &nh) : commands(0) {
+    bumper = nh.advertise<kobuki_msgs::BumperEvent>("events/bumper", 10);
+    cliff = nh.advertise<kobuki_msgs::CliffEvent>("events/cliff", 10);
+    wheel_drop = nh.advertise<kobuki_msgs::WheelDropEvent>("events/wheel_drop", 10);
+    cmd_vel = nh.subscribe("cmd_vel", 100, &Replay::command, this);
+  }
+
+  void publish(const Event &event) {
+    switch ( event.source ) {
+      case Bumper: {
+        kobuki_msgs::BumperEventPtr msg(new kobuki_msgs::BumperEvent());
+        msg->bumper = event.index;
+        msg->state = event.firing ? kobuki_msgs::BumperEvent::PRESSED : kobuki_msgs::BumperEvent::RELEASED;
+        bumper.publish(msg);
+        break;
+      }
+      case Cliff: {
+        kobuki_msgs::CliffEventPtr msg(new kobuki_msgs::CliffEvent());
+        msg->sensor = event.index;
+        msg->state = event.firing ? kobuki_msgs::CliffEvent::CLIFF : kobuki_msgs::CliffEvent::FLOOR;
+        cliff.publish(msg);
+        break;
+      }
+      case Wheel: {
+        kobuki_msgs::WheelDropEventPtr msg(new kobuki_msgs::WheelDropEvent());
+        msg->wheel = event.index;
+        msg->state = event.firing ? kobuki_msgs::WheelDropEvent::DROPPED : kobuki_msgs::WheelDropEvent::RAISED;
+        wheel_drop.publish(msg);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  /**
+   * Spin the callbacks until the given time [s] since the start.
+   */
+  void spinUntil(const ros::WallTime &start, const double &time) {
+    while ( ros::ok() && ( (ros::WallTime::now() - start).toSec() < time ) ) {
+      ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration(0.001));
+    }
+  }
+
+  /**
+   * The most recent command since the last call, None if there was none.
+   */
+  SafetyStateMachine::Command latest() {
+    SafetyStateMachine::Command command = SafetyStateMachine::None;
+    if ( commands > 0 ) {
+      command = ( last_linear < 0.0 ) ? SafetyStateMachine::BackOff : SafetyStateMachine::Stop;
+    }
+    commands = 0;
+    return command;
+  }
+
+private:
+  void command(const geometry_msgs::TwistConstPtr &msg) {
+    last_linear = msg->linear.x;
+    ++commands;
+  }
+
+  ros::Publisher bumper, cliff, wheel_drop;
+  ros::Subscriber cmd_vel;
+  unsigned int commands;
+  double last_linear;
+};
+
+/*****************************************************************************
+** Tests
+*****************************************************************************/
+
+TEST(SafetyController, replay) {
+  ros::NodeHandle nh("safety_controller");
+  nh.setParam("backoff_speed", 0.1);
+  nh.setParam("backoff_time", 0.5);
+  nh.setParam("command_period", 0.1);
+  std::string name("safety_controller");
+  SafetyController controller(nh, name);
+  ASSERT_TRUE(controller.init());
+  controller.enable();
+  Replay replay(nh);
+  ros::WallTime start = ros::WallTime::now();
+  replay.spinUntil(start, 0.5); // let the publishers and subscribers connect
+  replay.latest();
+
+  const char *commands[] = { "none", "stop", "back off" };
+  for ( unsigned int i = 0; i < script_length; ++i ) {
+    const Event &event = script[i];
+    replay.spinUntil(start, 1.0 + event.time);
+    if ( event.source != Wait ) {
+      replay.latest(); // drop the timer's repeats, only this event's reaction counts
+      replay.publish(event);
+      replay.spinUntil(start, 1.0 + event.time + 0.02);
+    }
+    EXPECT_STREQ(commands[event.command], commands[replay.latest()]) << "at " << event.time << "s";
+    EXPECT_EQ(event.state, controller.state()) << "at " << event.time << "s";
+  }
+
+  SafetyStateMachine::Reaction reaction = controller.reactionTime();
+  ROS_INFO_STREAM("Reaction times: mean " << 1e6 * reaction.mean << "us, max " << 1e6 * reaction.maximum
+                  << "us over " << reaction.count << " reactions.");
+  EXPECT_EQ(6u, reaction.count); // events that published a command
+  EXPECT_LT(reaction.maximum, 0.001);
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "safety_replay");
+  ros::NodeHandle nh; // keeps the node up for the whole test
+  return RUN_ALL_TESTS();
+}